@@ -0,0 +1,506 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include "libcute/defines.h"
+#include "libcute/collections/dircollection.h"
+#include "libcute/collections/track.h"
+#include "libcute/tags/filetyperesolver.h"
+#include "libcute/tags/taggedfile.h"
+#include "libcute/util/trace.h"
+
+/*
+ * Our exit codes: 0 means every benchmark ran, and 1 means we couldn't run
+ * them (bad arguments, or a media directory which couldn't be loaded).
+ */
+#define BENCH_OK 0
+#define BENCH_ERROR 1
+
+/*
+ * The fraction of tracks (in tenths) which two synthetic collections of the
+ * same size have in common, for our diff benchmark.
+ */
+#define BENCH_DIFF_OVERLAP 9
+
+/*!
+ * This structure stores the samples taken by a single benchmark.
+ */
+typedef struct BenchResult
+{
+	QString name;
+	int items;
+	uint64_t bytes;
+	QList<qint64> samples;
+} BenchResult;
+
+/*!
+ * This function prints our usage information.
+ */
+void printUsage()
+{
+	std::cerr << "Usage: cutesync-bench [options]\n\n";
+	std::cerr << "Options:\n";
+	std::cerr << "\t--sizes <n,...>  The synthetic collection sizes to " <<
+		"test (default:\n\t                 " <<
+		"1000,10000,100000,1000000).\n";
+	std::cerr << "\t--repeat <n>     The number of times to run each " <<
+		"benchmark (default: 3).\n";
+	std::cerr << "\t--media <dir>    Also benchmark scanning, tagging " <<
+		"and copying the audio\n\t                 files in this " <<
+		"directory.\n";
+	std::cerr << "\t--seed <n>       The seed for our synthetic " <<
+		"collections (default: 1).\n";
+	std::cerr << "\t--pretty         Indent our JSON output.\n";
+}
+
+/*!
+ * This function serializes a single synthetic track, in the same format as
+ * CSDirTrack::serialize(). The track's tags are derived only from its number,
+ * so the same number always produces the same track (and the same key).
+ *
+ * \param i The track's number.
+ * \return The serialized track.
+ */
+QByteArray createTrack(int i)
+{
+	QByteArray obuf;
+	QDataStream out(&obuf, QIODevice::ReadWrite);
+
+	out.setVersion(SERIALIZATION_VERSION);
+	out << static_cast<qint32>(SERIALIZATION_VERSION);
+
+	out << QString("/bench/Artist %1/Album %2/%3 - Title %4.mp3")
+		.arg(i / 120).arg(i / 12).arg((i % 12) + 1).arg(i);
+	out << QString("Title %1").arg(i);
+	out << QString("Artist %1").arg(i / 120);
+	out << QString("Album %1").arg(i / 12);
+	out << QString();
+	out << QString("Genre %1").arg(i % 16);
+	out << static_cast<qint32>(1970 + (i / 12) % 50);
+	out << static_cast<qint32>((i % 12) + 1);
+	out << static_cast<qint32>(12);
+	out << static_cast<qint32>(1);
+	out << static_cast<qint32>(180 + (i % 120));
+	out << static_cast<qint32>(320);
+	out << static_cast<qint32>(44100);
+	out << static_cast<qint64>(4000000 + (i % 1000) * 1000);
+	out << QDateTime::fromTime_t(1300000000 + i);
+
+	return obuf;
+}
+
+/*!
+ * This function serializes a synthetic directory collection, in the same
+ * format as CSDirCollection::serialize(). It contains the tracks numbered
+ * [f, f + n), in a shuffled order.
+ *
+ * \param f The number of the first track.
+ * \param n The number of tracks.
+ * \param s The seed used to shuffle the tracks.
+ * \return The serialized collection.
+ */
+QByteArray createCollection(int f, int n, unsigned int s)
+{
+	std::vector<int> order;
+	for(int i = 0; i < n; ++i)
+		order.push_back(f + i);
+
+	std::mt19937 generator(s);
+	std::shuffle(order.begin(), order.end(), generator);
+
+	QByteArray obuf;
+	QDataStream out(&obuf, QIODevice::ReadWrite);
+
+	out.setVersion(SERIALIZATION_VERSION);
+	out << static_cast<qint32>(SERIALIZATION_VERSION);
+	out << QString("bench");
+	out << QString("/bench");
+	out << true;
+	out << false;
+	out << static_cast<qint32>(n);
+
+	for(int i = 0; i < n; ++i)
+		out << createTrack(order[i]);
+
+	return obuf;
+}
+
+/*!
+ * This function converts the given benchmark result to a JSON object. All
+ * times are reported in nanoseconds, and throughput is computed from the
+ * median sample.
+ *
+ * \param r The result to convert.
+ * \return The result, as a JSON object.
+ */
+QJsonObject toJson(const BenchResult &r)
+{
+	QJsonObject o;
+
+	QList<qint64> s = r.samples;
+	std::sort(s.begin(), s.end());
+
+	qint64 total = 0;
+	for(int i = 0; i < s.count(); ++i)
+		total += s.at(i);
+
+	qint64 median = s.isEmpty() ? 0 : s.at(s.count() / 2);
+	double seconds = static_cast<double>(median) / 1000000000.0;
+
+	o.insert("name", r.name);
+	o.insert("items", r.items);
+	o.insert("bytes", static_cast<double>(r.bytes));
+	o.insert("iterations", s.count());
+	o.insert("min", s.isEmpty() ? 0.0 : static_cast<double>(s.first()));
+	o.insert("median", static_cast<double>(median));
+	o.insert("max", s.isEmpty() ? 0.0 : static_cast<double>(s.last()));
+	o.insert("mean", s.isEmpty() ? 0.0 :
+		static_cast<double>(total) / s.count());
+	o.insert("itemsPerSecond", (seconds > 0.0) ?
+		(r.items / seconds) : 0.0);
+	o.insert("bytesPerSecond", (seconds > 0.0) ?
+		(static_cast<double>(r.bytes) / seconds) : 0.0);
+
+	return o;
+}
+
+/*!
+ * This function creates an empty benchmark result.
+ *
+ * \param n The benchmark's name.
+ * \param i The number of items each sample processes.
+ * \param b The number of bytes each sample processes.
+ * \return The new result.
+ */
+BenchResult createResult(const QString &n, int i, uint64_t b = 0)
+{
+	BenchResult r;
+
+	r.name = n;
+	r.items = i;
+	r.bytes = b;
+
+	return r;
+}
+
+/*!
+ * This function runs our micro-benchmarks against synthetic collections of
+ * the given size: unserializing, sorting, hashing, diffing and serializing.
+ * Each iteration starts from a freshly unserialized (and so unsorted)
+ * collection.
+ *
+ * \param n The number of tracks.
+ * \param r The number of iterations.
+ * \param s The seed for our synthetic collections.
+ * \param l The list to append our results to.
+ */
+void runSynthetic(int n, int r, unsigned int s, QList<BenchResult> *l)
+{
+	CSAbstractCollection::DisplayDescriptor descriptor =
+		CSAbstractCollection::getDefaultDisplayDescriptor();
+
+	QByteArray source = createCollection(0, n, s);
+	QByteArray other = createCollection(
+		n - (n * BENCH_DIFF_OVERLAP / 10), n, s + 1);
+
+	CSDirCollection dest("other", &descriptor);
+	dest.unserialize(other);
+	dest.publishSnapshot();
+
+	BenchResult unserialize = createResult("unserialize", n,
+		static_cast<uint64_t>(source.size()));
+	BenchResult sort = createResult("sort", n);
+	BenchResult hash = createResult("getHash", n);
+	BenchResult diff = createResult("keysDifference", n);
+	BenchResult serialize = createResult("serialize", n,
+		static_cast<uint64_t>(source.size()));
+
+	QElapsedTimer timer;
+
+	for(int i = 0; i < r; ++i)
+	{
+		CSDirCollection c("bench", &descriptor);
+
+		timer.start();
+		c.unserialize(source);
+		c.publishSnapshot();
+		unserialize.samples.append(timer.nsecsElapsed());
+
+		timer.start();
+		c.sort();
+		sort.samples.append(timer.nsecsElapsed());
+
+		c.publishSnapshot();
+
+		timer.start();
+		int length = 0;
+		for(int j = 0; j < c.count(); ++j)
+			length += c.getDisplayedTrack(j)->getHash().length();
+		hash.samples.append(timer.nsecsElapsed());
+		hash.bytes = static_cast<uint64_t>(length);
+
+		timer.start();
+		c.keysDifference(&dest);
+		diff.samples.append(timer.nsecsElapsed());
+
+		timer.start();
+		c.serialize();
+		serialize.samples.append(timer.nsecsElapsed());
+	}
+
+	l->append(unserialize);
+	l->append(sort);
+	l->append(hash);
+	l->append(diff);
+	l->append(serialize);
+}
+
+/*!
+ * This function runs our macro-benchmarks against the audio files in the
+ * given directory: enumerating them, extracting their tags, loading them as a
+ * collection, refreshing that collection, and copying it to a temporary
+ * directory collection.
+ *
+ * \param p The path to the directory.
+ * \param r The number of iterations.
+ * \param l The list to append our results to.
+ * \return True on success, or false on failure.
+ */
+bool runMedia(const QString &p, int r, QList<BenchResult> *l)
+{
+	CSDirCollection source("media");
+	if(!source.loadCollectionFromPath(p))
+		return false;
+
+	int files = 0;
+	QDirIterator counter(p, QDir::Files | QDir::NoSymLinks,
+		QDirIterator::Subdirectories);
+	while(counter.hasNext())
+	{
+		counter.next();
+		++files;
+	}
+
+	uint64_t size = static_cast<uint64_t>(source.getTotalSize());
+
+	BenchResult enumerate = createResult("enumerate", files);
+	BenchResult tags = createResult("tags", files);
+	BenchResult scan = createResult("scan", source.count(), size);
+	BenchResult refresh = createResult("refresh", source.count(), size);
+	BenchResult copy = createResult("copy", source.count(), size);
+
+	QElapsedTimer timer;
+	CSFileTypeResolver resolver;
+
+	for(int i = 0; i < r; ++i)
+	{
+		timer.start();
+		QDirIterator walker(p, QDir::Files | QDir::NoSymLinks,
+			QDirIterator::Subdirectories);
+		while(walker.hasNext())
+			walker.next();
+		enumerate.samples.append(timer.nsecsElapsed());
+
+		timer.start();
+		QDirIterator tagger(p, QDir::Files | QDir::NoSymLinks,
+			QDirIterator::Subdirectories);
+		while(tagger.hasNext())
+		{
+			CSTaggedFile f(tagger.next(), resolver);
+			if(!f.isNull())
+				f.getTitle();
+		}
+		tags.samples.append(timer.nsecsElapsed());
+
+		CSDirCollection c("scan");
+		timer.start();
+		if(!c.loadCollectionFromPath(p))
+			return false;
+		scan.samples.append(timer.nsecsElapsed());
+
+		timer.start();
+		if(!c.refresh())
+			return false;
+		refresh.samples.append(timer.nsecsElapsed());
+
+		QTemporaryDir target;
+		if(!target.isValid())
+			return false;
+
+		CSDirCollection dest("copy");
+		if(!dest.loadCollectionFromPath(target.path()))
+			return false;
+
+		timer.start();
+		if(!dest.copyTracks(&source, source.getKeysList()))
+			return false;
+		if(!dest.flush())
+			return false;
+		copy.samples.append(timer.nsecsElapsed());
+	}
+
+	l->append(enumerate);
+	l->append(tags);
+	l->append(scan);
+	l->append(refresh);
+	l->append(copy);
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	CSTrace::initialize();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Parse our command-line arguments.
+
+	QList<int> sizes;
+	sizes << 1000 << 10000 << 100000 << 1000000;
+	int repeat = 3;
+	unsigned int seed = 1;
+	QString media;
+	bool pretty = false;
+
+	QStringList args = app.arguments();
+	for(int i = 1; i < args.count(); ++i)
+	{
+		const QString &a = args.at(i);
+		bool ok = true;
+
+		if( (a == "--sizes") && (i + 1 < args.count()) )
+		{
+			sizes.clear();
+
+			QStringList l = args.at(++i).split(',',
+				QString::SkipEmptyParts);
+			for(int j = 0; ok && (j < l.count()); ++j)
+			{
+				sizes.append(l.at(j).toInt(&ok));
+				ok = ok && (sizes.last() > 0);
+			}
+		}
+		else if( (a == "--repeat") && (i + 1 < args.count()) )
+		{
+			repeat = args.at(++i).toInt(&ok);
+			ok = ok && (repeat > 0);
+		}
+		else if( (a == "--seed") && (i + 1 < args.count()) )
+			seed = args.at(++i).toUInt(&ok);
+		else if( (a == "--media") && (i + 1 < args.count()) )
+			media = QDir(args.at(++i)).absolutePath();
+		else if(a == "--pretty")
+			pretty = true;
+		else if( (a == "--help") || (a == "-h") )
+		{
+			printUsage();
+			return BENCH_OK;
+		}
+		else
+			ok = false;
+
+		if(!ok)
+		{
+			printUsage();
+			return BENCH_ERROR;
+		}
+	}
+
+	// Run our benchmarks.
+
+	QJsonArray runs;
+
+	for(int i = 0; i < sizes.count(); ++i)
+	{
+		QList<BenchResult> results;
+		runSynthetic(sizes.at(i), repeat, seed, &results);
+
+		QJsonArray benchmarks;
+		for(int j = 0; j < results.count(); ++j)
+			benchmarks.append(toJson(results.at(j)));
+
+		QJsonObject run;
+		run.insert("corpus", QString("synthetic"));
+		run.insert("tracks", sizes.at(i));
+		run.insert("benchmarks", benchmarks);
+		runs.append(run);
+	}
+
+	if(!media.isEmpty())
+	{
+		QList<BenchResult> results;
+		if(!runMedia(media, repeat, &results))
+		{
+			std::cerr << "Unable to benchmark media directory: " <<
+				media.toUtf8().data() << "\n";
+			return BENCH_ERROR;
+		}
+
+		QJsonArray benchmarks;
+		for(int j = 0; j < results.count(); ++j)
+			benchmarks.append(toJson(results.at(j)));
+
+		QJsonObject run;
+		run.insert("corpus", media);
+		run.insert("benchmarks", benchmarks);
+		runs.append(run);
+	}
+
+	// Report our results.
+
+	QJsonObject result;
+	result.insert("version", QString("%1.%2.%3")
+		.arg(CUTE_SYNC_VERSION_MAJ).arg(CUTE_SYNC_VERSION_MIN)
+		.arg(CUTE_SYNC_VERSION_BUG));
+	result.insert("repeat", repeat);
+	result.insert("seed", static_cast<double>(seed));
+	result.insert("runs", runs);
+	result.insert("wallTime", static_cast<double>(timer.nsecsElapsed()));
+
+	QJsonDocument doc(result);
+	std::cout << doc.toJson(pretty ? QJsonDocument::Indented :
+		QJsonDocument::Compact).data();
+
+	if(!pretty)
+		std::cout << "\n";
+
+	return BENCH_OK;
+}
@@ -0,0 +1,659 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "libcute/collections/abstractcollection.h"
+#include "libcute/collections/catalogdiff.h"
+#include "libcute/collections/collectioncatalog.h"
+#include "libcute/collections/collectiontyperesolver.h"
+#include "libcute/util/trace.h"
+
+#include "jobrecorder.h"
+
+/*
+ * Our exit codes: 0 means the command succeeded, 1 means we couldn't run it at
+ * all (bad arguments, or a collection which couldn't be loaded), and 2 means
+ * it ran but one or more of its jobs reported errors.
+ */
+#define CLI_OK 0
+#define CLI_ERROR 1
+#define CLI_JOB_ERRORS 2
+
+/*!
+ * This structure stores a single collection we have loaded, along with the
+ * catalog entry it was loaded from (if any), so it can be saved back there.
+ */
+typedef struct CLICollection
+{
+	CSAbstractCollection *collection;
+	QString catalog;
+} CLICollection;
+
+/*!
+ * This function prints our usage information.
+ */
+void printUsage()
+{
+	std::cerr << "Usage: cutesync-cli [options] <command> [arguments]\n\n";
+	std::cerr << "Commands:\n";
+	std::cerr << "\tinfo <collection>               Load a collection " <<
+		"and report its size.\n";
+	std::cerr << "\tdiff <source> <destination>     Report the tracks " <<
+		"which differ.\n";
+	std::cerr << "\tsync <source> <destination>     Make the " <<
+		"destination match the source.\n";
+	std::cerr << "\tcopy <source> <destination> [query]\n";
+	std::cerr << "\t                                Copy (matching) " <<
+		"tracks missing from the destination.\n";
+	std::cerr << "\tdelete <collection> <query>     Delete the " <<
+		"matching tracks.\n";
+	std::cerr << "\tplan <source> <destination>     Compare two saved " <<
+		"catalogs, without loading\n";
+	std::cerr << "\t                                either collection.\n\n";
+	std::cerr << "Collections can be given as a directory or iPod path, " <<
+		"a saved catalog file, or\nthe name of a saved collection " <<
+		"(with --catalog).\nThe plan command only accepts saved " <<
+		"collections.\n\n";
+	std::cerr << "Options:\n";
+	std::cerr << "\t--catalog <dir>  Resolve collection names using " <<
+		"this catalog directory.\n";
+	std::cerr << "\t--dry-run        Report what would be changed, " <<
+		"without changing anything.\n";
+	std::cerr << "\t--external-threshold <n>\n";
+	std::cerr << "\t                 Plan using external sorting if " <<
+		"both catalogs have more\n\t                 than n tracks " <<
+		"(default " << CSCatalogDiff::DefaultExternalThreshold <<
+		").\n";
+	std::cerr << "\t--pretty         Indent our JSON output.\n";
+}
+
+/*!
+ * This function finds the catalog file for the given collection specifier, if
+ * it refers to one: either it is the path to a catalog file itself, or it is
+ * the name of a collection saved in the given catalog directory.
+ *
+ * \param s The collection specifier.
+ * \param d The catalog directory to search, if any.
+ * \param h The header of the catalog file we found.
+ * \return The path to the catalog file, or an empty string.
+ */
+QString findCatalogEntry(const QString &s, const QString &d,
+	CSCollectionCatalog::Header *h)
+{
+	QFileInfo info(s);
+
+	if(info.isFile() && CSCollectionCatalog::readHeader(s, h))
+		return info.absoluteFilePath();
+
+	if(d.isEmpty())
+		return QString();
+
+	QStringList entries = CSCollectionCatalog(d).getEntries();
+	for(int i = 0; i < entries.count(); ++i)
+	{
+		if(!CSCollectionCatalog::readHeader(entries.at(i), h))
+			continue;
+
+		if(h->name == s)
+			return entries.at(i);
+	}
+
+	return QString();
+}
+
+/*!
+ * This function loads the collection identified by the given specifier. Saved
+ * collections are attached to their catalog data (and validated, if needed);
+ * anything else is treated as a path, and loaded from disk.
+ *
+ * \param s The collection specifier.
+ * \param d The catalog directory to search, if any.
+ * \param r The recorder which should watch the collection's jobs.
+ * \param c The collection we loaded.
+ * \return True on success, or false on failure.
+ */
+bool loadCollection(const QString &s, const QString &d, CSJobRecorder *r,
+	CLICollection *c)
+{
+	CSCollectionCatalog::Header h;
+	QString entry = findCatalogEntry(s, d, &h);
+
+	if(!entry.isEmpty())
+	{
+		c->collection = CSCollectionTypeResolver::createCollection(h);
+		c->catalog = QFileInfo(entry).absolutePath();
+
+		if(c->collection == NULL)
+			return false;
+
+		r->watch(c->collection);
+		c->collection->detach(entry, h);
+
+		if(!c->collection->attach())
+			return false;
+
+		if(c->collection->isValidationPending())
+		{
+			if(!c->collection->validate())
+				return false;
+		}
+	}
+	else
+	{
+		QString path = QDir(s).absolutePath();
+
+		c->collection = CSCollectionTypeResolver::createCollection(
+			QDir(path).dirName(), path);
+		c->catalog = QString();
+
+		if(c->collection == NULL)
+			return false;
+
+		r->watch(c->collection);
+
+		if(!c->collection->loadCollectionFromPath(path))
+			return false;
+	}
+
+	c->collection->publishSnapshot();
+
+	return true;
+}
+
+/*!
+ * This function flushes any changes made to the given collection, and writes
+ * it back to the catalog it was loaded from, if any.
+ *
+ * \param c The collection to save.
+ * \return True on success, or false on failure.
+ */
+bool saveCollection(const CLICollection &c)
+{
+	if(!c.collection->flush())
+		return false;
+
+	if(c.catalog.isEmpty())
+		return true;
+
+	return CSCollectionCatalog(c.catalog).write(
+		CSCollectionCatalog::createHeader(c.collection),
+		c.collection->serialize());
+}
+
+/*!
+ * This function describes the given collection as a JSON object.
+ *
+ * \param c The collection to describe.
+ * \return The collection's description.
+ */
+QJsonObject describeCollection(const CLICollection &c)
+{
+	QJsonObject o;
+
+	o.insert("name", c.collection->getName());
+	o.insert("path", c.collection->getMountPoint());
+	o.insert("type", QString(c.collection->metaObject()->className()));
+	o.insert("tracks", c.collection->count());
+	o.insert("totalSize",
+		static_cast<double>(c.collection->getTotalSize()));
+	o.insert("totalLength",
+		static_cast<double>(c.collection->getTotalLength()));
+
+	return o;
+}
+
+/*!
+ * This function describes the given catalog header as a JSON object.
+ *
+ * \param h The header to describe.
+ * \return The header's description.
+ */
+QJsonObject describeHeader(const CSCollectionCatalog::Header &h)
+{
+	QJsonObject o;
+
+	o.insert("name", h.name);
+	o.insert("path", h.path);
+	o.insert("type", h.type);
+	o.insert("tracks", h.trackCount);
+	o.insert("totalSize", static_cast<double>(h.totalSize));
+	o.insert("totalLength", static_cast<double>(h.totalLength));
+
+	return o;
+}
+
+/*!
+ * This function describes the given track from a catalog comparison as a JSON
+ * object.
+ *
+ * \param e The track to describe.
+ * \return The track's description.
+ */
+QJsonObject describeEntry(const CSCatalogDiff::Entry &e)
+{
+	QJsonObject o;
+
+	o.insert("key", e.key);
+	o.insert("path", e.path);
+	o.insert("size", static_cast<double>(e.size));
+
+	return o;
+}
+
+/*!
+ * This function converts the given list of tracks from a catalog comparison to
+ * a JSON array, sorted by path so our output is stable between runs.
+ *
+ * \param l The tracks to convert.
+ * \return The tracks, as a JSON array.
+ */
+QJsonArray toJsonArray(QList<CSCatalogDiff::Entry> l)
+{
+	QJsonArray a;
+
+	std::sort(l.begin(), l.end(), [](const CSCatalogDiff::Entry &x,
+		const CSCatalogDiff::Entry &y) -> bool
+	{
+		return x.path < y.path;
+	});
+
+	for(int i = 0; i < l.count(); ++i)
+		a.append(describeEntry(l.at(i)));
+
+	return a;
+}
+
+/*!
+ * This function converts the given list of track keys to a JSON array, sorted
+ * so our output is stable between runs.
+ *
+ * \param k The keys to convert.
+ * \return The keys, as a JSON array.
+ */
+QJsonArray toJsonArray(QStringList k)
+{
+	QJsonArray a;
+
+	k.sort();
+	for(int i = 0; i < k.count(); ++i)
+		a.append(k.at(i));
+
+	return a;
+}
+
+/*!
+ * This function prints our results, and returns the given exit code.
+ *
+ * \param o Our results.
+ * \param p True if our output should be indented.
+ * \param e Our exit code.
+ * \return The given exit code.
+ */
+int finish(const QJsonObject &o, bool p, int e)
+{
+	QJsonDocument doc(o);
+
+	std::cout << doc.toJson(p ? QJsonDocument::Indented :
+		QJsonDocument::Compact).data();
+
+	if(!p)
+		std::cout << "\n";
+
+	return e;
+}
+
+/*!
+ * This function runs our plan command: it compares the two given saved
+ * collections using only their catalog files, and reports the changes which
+ * would make the destination match the source. Neither collection is loaded,
+ * so this works even if the collections themselves aren't available.
+ *
+ * \param s The source collection specifier.
+ * \param d The destination collection specifier.
+ * \param c The catalog directory to search, if any.
+ * \param x The track count above which we should use external sorting.
+ * \param p True if our output should be indented.
+ * \param t A timer started when we were.
+ * \return Our exit code.
+ */
+int runPlan(const QString &s, const QString &d, const QString &c, qint32 x,
+	bool p, const QElapsedTimer &t)
+{
+	QJsonObject result;
+	QJsonArray errors;
+	result.insert("command", QString("plan"));
+	result.insert("dryRun", true);
+
+	CSCollectionCatalog::Header sh, dh;
+	QString src = findCatalogEntry(s, c, &sh);
+	QString dest = findCatalogEntry(d, c, &dh);
+
+	if(src.isEmpty())
+		errors.append(QString("Unable to find catalog: %1").arg(s));
+	if(dest.isEmpty())
+		errors.append(QString("Unable to find catalog: %1").arg(d));
+
+	CSCatalogDiff diff(src, dest);
+	diff.setExternalThreshold(x);
+
+	if(errors.isEmpty() && !diff.run())
+		errors.append(diff.getError());
+
+	if(!errors.isEmpty())
+	{
+		result.insert("success", false);
+		result.insert("errors", errors);
+		result.insert("wallTime", static_cast<double>(
+			t.nsecsElapsed()));
+		return finish(result, p, CLI_ERROR);
+	}
+
+	QJsonArray described;
+	described.append(describeHeader(diff.getSourceHeader()));
+	described.append(describeHeader(diff.getDestinationHeader()));
+	result.insert("collections", described);
+	result.insert("mode", QString(diff.isExternal() ? "external" :
+		"indexed"));
+
+	const CSCatalogDiff::Plan &plan = diff.getPlan();
+
+	QList<CSCatalogDiff::Update> updates = plan.updates;
+	std::sort(updates.begin(), updates.end(), [](
+		const CSCatalogDiff::Update &x,
+		const CSCatalogDiff::Update &y) -> bool
+	{
+		return x.source.path < y.source.path;
+	});
+
+	QJsonArray update;
+	for(int i = 0; i < updates.count(); ++i)
+	{
+		QJsonObject o;
+		o.insert("source", describeEntry(updates.at(i).source));
+		o.insert("destination", describeEntry(
+			updates.at(i).destination));
+		update.append(o);
+	}
+
+	QJsonObject changes;
+	changes.insert("copy", toJsonArray(plan.copies));
+	changes.insert("delete", toJsonArray(plan.deletions));
+	changes.insert("update", update);
+	changes.insert("copyCount", plan.copies.count());
+	changes.insert("deleteCount", plan.deletions.count());
+	changes.insert("updateCount", plan.updates.count());
+	changes.insert("unchangedCount", plan.unchanged);
+	changes.insert("copyBytes", static_cast<double>(plan.copyBytes));
+	changes.insert("deleteBytes", static_cast<double>(plan.deleteBytes));
+	changes.insert("updateBytes", static_cast<double>(plan.updateBytes));
+	changes.insert("unchangedBytes",
+		static_cast<double>(plan.unchangedBytes));
+	result.insert("changes", changes);
+
+	result.insert("success", true);
+	result.insert("errors", errors);
+	result.insert("wallTime", static_cast<double>(t.nsecsElapsed()));
+
+	return finish(result, p, CLI_OK);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	CSTrace::initialize();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Parse our command-line arguments.
+
+	QString catalogDir;
+	bool dryRun = false;
+	qint32 externalThreshold = CSCatalogDiff::DefaultExternalThreshold;
+	bool pretty = false;
+	QStringList positional;
+
+	QStringList args = app.arguments();
+	for(int i = 1; i < args.count(); ++i)
+	{
+		const QString &a = args.at(i);
+
+		if(a == "--catalog")
+		{
+			if(++i >= args.count())
+			{
+				printUsage();
+				return CLI_ERROR;
+			}
+
+			catalogDir = args.at(i);
+		}
+		else if(a == "--external-threshold")
+		{
+			bool ok = false;
+
+			if(++i < args.count())
+				externalThreshold = args.at(i).toInt(&ok);
+
+			if(!ok || (externalThreshold < 0))
+			{
+				printUsage();
+				return CLI_ERROR;
+			}
+		}
+		else if(a == "--dry-run")
+			dryRun = true;
+		else if(a == "--pretty")
+			pretty = true;
+		else if( (a == "--help") || (a == "-h") )
+		{
+			printUsage();
+			return CLI_OK;
+		}
+		else if(a.startsWith("--"))
+		{
+			printUsage();
+			return CLI_ERROR;
+		}
+		else
+			positional.append(a);
+	}
+
+	if(positional.isEmpty())
+	{
+		printUsage();
+		return CLI_ERROR;
+	}
+
+	QString command = positional.takeFirst();
+
+	if(command == "plan")
+	{
+		if(positional.count() != 2)
+		{
+			printUsage();
+			return CLI_ERROR;
+		}
+
+		return runPlan(positional.at(0), positional.at(1), catalogDir,
+			externalThreshold, pretty, timer);
+	}
+
+	int collectionCount = ( (command == "info") ||
+		(command == "delete") ) ? 1 : 2;
+
+	bool known = (command == "info") || (command == "diff") ||
+		(command == "sync") || (command == "copy") ||
+		(command == "delete");
+
+	if(!known || (positional.count() < collectionCount) ||
+		(positional.count() > collectionCount + 1) ||
+		( (positional.count() > collectionCount) &&
+			(command != "copy") && (command != "delete") ) ||
+		( (command == "delete") && (positional.count() < 2) ))
+	{
+		printUsage();
+		return CLI_ERROR;
+	}
+
+	QJsonObject result;
+	QJsonArray errors;
+	result.insert("command", command);
+	result.insert("dryRun", dryRun);
+
+	// Load the collections we were given.
+
+	CSJobRecorder recorder;
+	QList<CLICollection> collections;
+
+	for(int i = 0; i < collectionCount; ++i)
+	{
+		CLICollection c;
+
+		if(!loadCollection(positional.at(i), catalogDir, &recorder, &c))
+		{
+			errors.append(QString("Unable to load collection: %1")
+				.arg(positional.at(i)));
+
+			if(!recorder.getLastResult().isEmpty())
+				errors.append(recorder.getLastResult());
+
+			delete c.collection;
+			for(int j = 0; j < collections.count(); ++j)
+				delete collections.at(j).collection;
+
+			result.insert("success", false);
+			result.insert("errors", errors);
+			result.insert("jobs", recorder.getJobs());
+			result.insert("wallTime", static_cast<double>(
+				timer.nsecsElapsed()));
+			return finish(result, pretty, CLI_ERROR);
+		}
+
+		collections.append(c);
+	}
+
+	QJsonArray described;
+	for(int i = 0; i < collections.count(); ++i)
+		described.append(describeCollection(collections.at(i)));
+	result.insert("collections", described);
+
+	// Run the command.
+
+	int exitCode = CLI_OK;
+	CLICollection src = collections.first();
+	CLICollection dest = collections.last();
+	QString query = (positional.count() > collectionCount) ?
+		positional.last() : QString();
+
+	if(command != "info")
+	{
+		QStringList toCopy;
+		QStringList toDelete;
+
+		if(command == "delete")
+		{
+			toDelete = src.collection->search(query).toList();
+		}
+		else
+		{
+			toCopy = src.collection->keysDifference(
+				dest.collection);
+
+			if( (command == "copy") && !query.isEmpty() )
+			{
+				QSet<QString> matches =
+					src.collection->search(query);
+
+				QStringList filtered;
+				for(int i = 0; i < toCopy.count(); ++i)
+				{
+					if(matches.contains(toCopy.at(i)))
+						filtered.append(toCopy.at(i));
+				}
+
+				toCopy = filtered;
+			}
+			else if(command != "copy")
+			{
+				toDelete = dest.collection->keysDifference(
+					src.collection);
+			}
+		}
+
+		QJsonObject changes;
+		changes.insert("copy", toJsonArray(toCopy));
+		changes.insert("delete", toJsonArray(toDelete));
+		changes.insert("copyCount", toCopy.count());
+		changes.insert("deleteCount", toDelete.count());
+		result.insert("changes", changes);
+
+		if( (command != "diff") && !dryRun )
+		{
+			bool ok = true;
+
+			if(command == "sync")
+				ok = dest.collection->syncFrom(src.collection);
+			else if(command == "copy")
+				ok = dest.collection->copyTracks(src.collection,
+					toCopy);
+			else
+				ok = dest.collection->deleteTracks(toDelete);
+
+			if(!ok)
+			{
+				errors.append(recorder.getLastResult());
+				exitCode = CLI_JOB_ERRORS;
+			}
+
+			if(!saveCollection(dest))
+			{
+				errors.append(QString("Unable to save " \
+					"collection: %1").arg(
+					dest.collection->getName()));
+				exitCode = CLI_JOB_ERRORS;
+			}
+		}
+	}
+
+	// Report our results.
+
+	result.insert("success", (exitCode == CLI_OK));
+	result.insert("errors", errors);
+	result.insert("jobs", recorder.getJobs());
+	result.insert("wallTime", static_cast<double>(timer.nsecsElapsed()));
+
+	for(int i = 0; i < collections.count(); ++i)
+		delete collections.at(i).collection;
+
+	return finish(result, pretty, exitCode);
+}
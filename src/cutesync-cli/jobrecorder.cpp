@@ -0,0 +1,155 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobrecorder.h"
+
+#include "libcute/collections/abstractcollection.h"
+
+/*!
+ * This is our default constructor, which creates a new, empty recorder.
+ *
+ * \param p Our parent object.
+ */
+CSJobRecorder::CSJobRecorder(QObject *p)
+	: QObject(p)
+{
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSJobRecorder::~CSJobRecorder()
+{
+}
+
+/*!
+ * This function starts recording the jobs run by the given collection.
+ *
+ * \param c The collection to watch.
+ */
+void CSJobRecorder::watch(CSAbstractCollection *c)
+{
+	QObject::connect(c, SIGNAL(jobFinished(const QString &)),
+		this, SLOT(doJobFinished(const QString &)));
+	QObject::connect(c, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)), this, SLOT(doStatisticsUpdated(
+		const CSJobStatistics &)));
+}
+
+/*!
+ * This function returns the result string of the most recently finished job.
+ * This is empty if that job didn't report any errors.
+ *
+ * \return The last job's result.
+ */
+QString CSJobRecorder::getLastResult() const
+{
+	return lastResult;
+}
+
+/*!
+ * This function returns the statistics of every job which has finished since
+ * we were created, in the order they finished.
+ *
+ * \return Our recorded jobs, as JSON objects.
+ */
+QJsonArray CSJobRecorder::getJobs() const
+{
+	return jobs;
+}
+
+/*!
+ * This function converts the given job statistics to a JSON object. All times
+ * are reported in nanoseconds, and the throughput figures are averaged over
+ * the whole job.
+ *
+ * \param s The statistics to convert.
+ * \return The statistics, as a JSON object.
+ */
+QJsonObject CSJobRecorder::toJson(const CSJobStatistics &s)
+{
+	QJsonObject o;
+
+	double seconds = static_cast<double>(s.wallTime) / 1000000000.0;
+	double bytes = static_cast<double>(s.bytesRead + s.bytesWritten);
+
+	o.insert("job", s.job);
+	o.insert("finished", s.finished);
+	o.insert("wallTime", static_cast<double>(s.wallTime));
+	o.insert("cpuTime", static_cast<double>(s.cpuTime));
+	o.insert("itemsDone", s.itemsDone);
+	o.insert("itemsTotal", s.itemsTotal);
+	o.insert("bytesRead", static_cast<double>(s.bytesRead));
+	o.insert("bytesWritten", static_cast<double>(s.bytesWritten));
+	o.insert("itemsPerSecond", s.itemsPerSecond);
+	o.insert("bytesPerSecond", (seconds > 0.0) ? (bytes / seconds) : 0.0);
+
+	QJsonObject phases;
+	for(QHash<QString, CSJobStatistics::Phase>::const_iterator it =
+		s.phases.begin(); it != s.phases.end(); ++it)
+	{
+		QJsonObject phase;
+		phase.insert("wallTime",
+			static_cast<double>(it.value().wallTime));
+		phase.insert("cpuTime",
+			static_cast<double>(it.value().cpuTime));
+		phase.insert("count", static_cast<double>(it.value().count));
+
+		phases.insert(it.key(), phase);
+	}
+
+	o.insert("phases", phases);
+
+	return o;
+}
+
+/*!
+ * This slot handles one of our collections' jobs finishing by recording its
+ * result string.
+ *
+ * \param r The job's result.
+ */
+void CSJobRecorder::doJobFinished(const QString &r)
+{ /* SLOT */
+
+	lastResult = r;
+
+}
+
+/*!
+ * This slot handles one of our collections publishing job statistics. We only
+ * keep the final statistics of each job.
+ *
+ * \param s The statistics which were published.
+ */
+void CSJobRecorder::doStatisticsUpdated(const CSJobStatistics &s)
+{ /* SLOT */
+
+	if(!s.finished)
+		return;
+
+	QJsonObject job = toJson(s);
+
+	CSAbstractCollection *c = qobject_cast<CSAbstractCollection *>(
+		sender());
+	if(c != NULL)
+		job.insert("collection", c->getName());
+
+	jobs.append(job);
+
+}
@@ -0,0 +1,62 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_CUTE_SYNC_CLI_JOB_RECORDER_H
+#define INCLUDE_CUTE_SYNC_CLI_JOB_RECORDER_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+
+#include "libcute/util/jobinstrumentation.h"
+
+class CSAbstractCollection;
+
+/*!
+ * \brief This class records the results of the jobs our collections run.
+ *
+ * Since cutesync-cli runs every job directly on its main thread, each
+ * collection's signals are delivered to us as soon as they are emitted; we
+ * keep the final statistics of every job, so they can be reported as JSON.
+ */
+class CSJobRecorder : public QObject
+{
+	Q_OBJECT
+
+	public:
+		CSJobRecorder(QObject *p = 0);
+		virtual ~CSJobRecorder();
+
+		void watch(CSAbstractCollection *c);
+
+		QString getLastResult() const;
+		QJsonArray getJobs() const;
+
+		static QJsonObject toJson(const CSJobStatistics &s);
+
+	private:
+		QString lastResult;
+		QJsonArray jobs;
+
+	private Q_SLOTS:
+		void doJobFinished(const QString &r);
+		void doStatisticsUpdated(const CSJobStatistics &s);
+};
+
+#endif
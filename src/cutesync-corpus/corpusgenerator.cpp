@@ -0,0 +1,1220 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "corpusgenerator.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPair>
+#include <QSet>
+
+#include <taglib/attachedpictureframe.h>
+#include <taglib/flacfile.h>
+#include <taglib/flacpicture.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4coverart.h>
+#include <taglib/mp4file.h>
+#include <taglib/mp4item.h>
+#include <taglib/mp4tag.h>
+#include <taglib/mpegfile.h>
+#include <taglib/tag.h>
+#include <taglib/textidentificationframe.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/xiphcomment.h>
+
+/*
+ * The format of the (silent) audio we write. Every format uses the same sample
+ * rate and channel count, so tracks of the same length report the same
+ * audio properties regardless of their format.
+ */
+#define CORPUS_SAMPLE_RATE 44100
+#define CORPUS_CHANNELS 2
+#define CORPUS_BITS_PER_SAMPLE 16
+
+/*
+ * MP3 files consist of 128 kbps, 44.1 kHz MPEG-1 Layer III frames, each of
+ * which holds 1152 samples.
+ */
+#define CORPUS_MP3_FRAME_SIZE 417
+#define CORPUS_MP3_FRAME_SAMPLES 1152
+
+/*
+ * FLAC files consist of fixed-size frames of 4096 samples, and MP4 files
+ * contain a 128 kbps worth of (empty) media data.
+ */
+#define CORPUS_FLAC_BLOCK_SIZE 4096
+#define CORPUS_MP4_BYTES_PER_SECOND 16000
+
+/*
+ * The size of the (square) cover art we embed, in pixels.
+ */
+#define CORPUS_COVER_SIZE 64
+
+/*
+ * The serial number of the logical bitstream in each Ogg file we write.
+ */
+#define CORPUS_OGG_SERIAL 0x43534331
+
+namespace
+{
+	/*
+	 * The words we build our artist, album and track names from. A few of
+	 * them aren't plain ASCII, so our tags exercise UTF-8 handling too.
+	 */
+	const char *corpusWords[] = {
+		"Amber", "Bright", "Cascade", "Distant", "Echo", "Falling",
+		"Golden", "Harbor", "Iron", "Jade", "Kingdom", "Lantern",
+		"Midnight", "Neon", "Ocean", "Paper", "Quiet", "River",
+		"Silver", "Thunder", "Under", "Velvet", "Winter", "Yellow",
+		"Zephyr", "Glass", "Mirror", "Static", "Signal", "Hollow",
+		"Café", "Über", "Ñandú", "Señor", "Fjörd", "Noël",
+		"東京", "Мир"
+	};
+
+	const char *corpusGenres[] = {
+		"Rock", "Pop", "Jazz", "Classical", "Electronic", "Hip-Hop",
+		"Folk", "Blues", "Metal", "Soundtrack", "Ambient", "Country"
+	};
+
+	const int corpusWordCount = sizeof(corpusWords) / sizeof(char *);
+	const int corpusGenreCount = sizeof(corpusGenres) / sizeof(char *);
+
+	/*
+	 * The identity transformation matrix used in MP4 "mvhd" and "tkhd"
+	 * atoms.
+	 */
+	const quint32 corpusMP4Matrix[9] = {
+		0x00010000, 0, 0,
+		0, 0x00010000, 0,
+		0, 0, 0x40000000
+	};
+
+	/*!
+	 * This function converts the given string to a TagLib string.
+	 *
+	 * \param s The string to convert.
+	 * \return The string, as a TagLib string.
+	 */
+	TagLib::String toTagLibString(const QString &s)
+	{
+		return TagLib::String(s.toUtf8().data(), TagLib::String::UTF8);
+	}
+
+	/*!
+	 * This function converts the given byte array to a TagLib byte
+	 * vector.
+	 *
+	 * \param d The byte array to convert.
+	 * \return The byte array, as a TagLib byte vector.
+	 */
+	TagLib::ByteVector toByteVector(const QByteArray &d)
+	{
+		return TagLib::ByteVector(d.constData(),
+			static_cast<unsigned int>(d.size()));
+	}
+
+	/*!
+	 * This function writes the given data to a new file, replacing any
+	 * existing file at the given path.
+	 *
+	 * \param p The path to write to.
+	 * \param d The data to write.
+	 * \return True on success, or false on failure.
+	 */
+	bool writeFile(const QString &p, const QByteArray &d)
+	{
+		QFile f(p);
+
+		if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			return false;
+
+		return (f.write(d) == d.size());
+	}
+}
+
+/*!
+ * This is our default constructor, which creates a new generator which will
+ * write its library into the given directory.
+ *
+ * \param r The root directory of the library.
+ * \param s The seed everything we generate is derived from.
+ */
+CSCorpusGenerator::CSCorpusGenerator(const QString &r, unsigned int s)
+	: generator(s), root(r), artistCount(10), albumCount(3),
+		trackCount(12), trackLength(5), covers(true), filesWritten(0),
+		bytesWritten(0)
+{
+	formats << MP3 << MP4 << FLAC << Ogg;
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCorpusGenerator::~CSCorpusGenerator()
+{
+}
+
+/*!
+ * This function sets the number of artists in the library we generate.
+ *
+ * \param c The number of artists.
+ */
+void CSCorpusGenerator::setArtistCount(int c)
+{
+	artistCount = c;
+}
+
+/*!
+ * This function sets the number of albums each artist has.
+ *
+ * \param c The number of albums per artist.
+ */
+void CSCorpusGenerator::setAlbumCount(int c)
+{
+	albumCount = c;
+}
+
+/*!
+ * This function sets the number of tracks each album has.
+ *
+ * \param c The number of tracks per album.
+ */
+void CSCorpusGenerator::setTrackCount(int c)
+{
+	trackCount = c;
+}
+
+/*!
+ * This function sets the length of each track we write. Note that the size of
+ * our files grows with their length.
+ *
+ * \param l The length of each track, in seconds.
+ */
+void CSCorpusGenerator::setTrackLength(int l)
+{
+	trackLength = l;
+}
+
+/*!
+ * This function sets the audio formats we will write. Each album is written
+ * in a single format, chosen at random from this list.
+ *
+ * \param f The list of formats to use.
+ */
+void CSCorpusGenerator::setFormats(const QList<Format> &f)
+{
+	formats = f;
+}
+
+/*!
+ * This function sets whether or not we embed cover art in the tracks we
+ * write. If enabled, every album gets its own (small) cover.
+ *
+ * \param c True if covers should be embedded, or false otherwise.
+ */
+void CSCorpusGenerator::setCoversEnabled(bool c)
+{
+	covers = c;
+}
+
+/*!
+ * This function generates our library. Tracks which can't be written are
+ * skipped, and the reason is recorded (see getErrors()).
+ *
+ * \return True if every track was written, or false otherwise.
+ */
+bool CSCorpusGenerator::generate()
+{
+	if(formats.isEmpty())
+	{
+		errors.append("No audio formats were selected.");
+		return false;
+	}
+
+	if(!QDir().mkpath(root))
+	{
+		errors.append(QString("Unable to create directory: %1")
+			.arg(root));
+		return false;
+	}
+
+	QSet<QString> albums;
+
+	for(int a = 0; a < artistCount; ++a)
+	{
+		bool various = (random(10) == 0);
+		QString artist = various ? QString("Various Artists") :
+			createName(2);
+
+		for(int b = 0; b < albumCount; ++b)
+		{
+			// Decide what this album looks like.
+
+			QString album = createName(1 + random(3));
+			Format format = formats.at(random(formats.count()));
+			QString genre = QString(corpusGenres[
+				random(corpusGenreCount)]);
+			int year = 1960 + random(60);
+			int discs = (random(8) == 0) ? 2 : 1;
+			bool albumArtist = various || (random(2) == 0);
+			QByteArray cover = covers ? createCover() :
+				QByteArray();
+
+			// Make sure each album gets its own directory.
+
+			QString dir = QDir(root).filePath(
+				QString("%1/%2").arg(artist).arg(album));
+
+			for(int i = 2; albums.contains(dir); ++i)
+			{
+				dir = QDir(root).filePath(QString("%1/%2 %3")
+					.arg(artist).arg(album).arg(i));
+			}
+
+			albums.insert(dir);
+
+			if(!QDir().mkpath(dir))
+			{
+				errors.append(QString("Unable to create " \
+					"directory: %1").arg(dir));
+				continue;
+			}
+
+			// Write each of its tracks.
+
+			int perDisc = (trackCount + discs - 1) / discs;
+			discs = (trackCount + perDisc - 1) / perDisc;
+
+			for(int i = 0; i < trackCount; ++i)
+			{
+				Track t;
+
+				t.format = format;
+				t.title = createName(1 + random(4));
+				t.artist = various ? createName(2) : artist;
+				t.album = album;
+				t.albumArtist = albumArtist ? artist :
+					QString();
+				t.composer = (random(3) == 0) ?
+					createName(2) : QString();
+				t.genre = genre;
+				t.comment = (random(4) == 0) ? QString(
+					"Generated by cutesync-corpus") :
+					QString();
+				t.year = year;
+				t.discNumber = (i / perDisc) + 1;
+				t.discCount = discs;
+				t.trackNumber = (i % perDisc) + 1;
+				t.trackCount = qMin(perDisc,
+					trackCount - (i / perDisc) * perDisc);
+
+				QString name = QString("%1 - %2.%3")
+					.arg(t.trackNumber, 2, 10, QChar('0'))
+					.arg(t.title)
+					.arg(getFormatName(format).toLower());
+
+				if(discs > 1)
+				{
+					name = QString("%1-%2").arg(
+						t.discNumber).arg(name);
+				}
+
+				t.path = QDir(dir).filePath(name);
+
+				if(!writeTrack(t, cover))
+				{
+					errors.append(QString("Unable to " \
+						"write track: %1").arg(t.path));
+				}
+			}
+		}
+	}
+
+	return errors.isEmpty();
+}
+
+/*!
+ * This function returns the number of files we have written.
+ *
+ * \return The number of files written.
+ */
+int CSCorpusGenerator::getFilesWritten() const
+{
+	return filesWritten;
+}
+
+/*!
+ * This function returns the total size of the files we have written.
+ *
+ * \return The number of bytes written.
+ */
+uint64_t CSCorpusGenerator::getBytesWritten() const
+{
+	return bytesWritten;
+}
+
+/*!
+ * This function returns the number of files we have written in each format,
+ * keyed by format name (see getFormatName()).
+ *
+ * \return Our per-format file counts.
+ */
+QHash<QString, int> CSCorpusGenerator::getFormatCounts() const
+{
+	return formatCounts;
+}
+
+/*!
+ * This function returns a description of every error we have encountered.
+ *
+ * \return Our errors.
+ */
+QStringList CSCorpusGenerator::getErrors() const
+{
+	return errors;
+}
+
+/*!
+ * This function returns the name of the given format, which is also the
+ * (upper-case) file extension we use for it.
+ *
+ * \param f The format.
+ * \return The format's name.
+ */
+QString CSCorpusGenerator::getFormatName(Format f)
+{
+	switch(f)
+	{
+		case MP3:
+			return QString("MP3");
+
+		case MP4:
+			return QString("M4A");
+
+		case FLAC:
+			return QString("FLAC");
+
+		case Ogg:
+			return QString("OGG");
+	}
+
+	return QString();
+}
+
+/*!
+ * This function finds the format with the given name (see getFormatName()).
+ * Names are not case-sensitive, and "mp4" is accepted as well as "m4a".
+ *
+ * \param n The name of the format.
+ * \param f The format with that name.
+ * \return True if a format was found, or false otherwise.
+ */
+bool CSCorpusGenerator::getFormatByName(const QString &n, Format *f)
+{
+	QString name = n.toUpper();
+
+	if(name == "MP4")
+		name = "M4A";
+
+	for(int i = MP3; i <= Ogg; ++i)
+	{
+		if(getFormatName(static_cast<Format>(i)) == name)
+		{
+			(*f) = static_cast<Format>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * This function returns a random integer in the range [0, n). We don't use
+ * the standard distributions, since their output isn't the same across
+ * standard libraries; this way, a seed always produces the same library.
+ *
+ * \param n The upper bound of the range.
+ * \return A random integer.
+ */
+int CSCorpusGenerator::random(int n)
+{
+	return static_cast<int>(generator() % static_cast<unsigned int>(n));
+}
+
+/*!
+ * This function creates a random name, made up of the given number of words.
+ *
+ * \param w The number of words.
+ * \return The new name.
+ */
+QString CSCorpusGenerator::createName(int w)
+{
+	QStringList words;
+
+	for(int i = 0; i < w; ++i)
+	{
+		words.append(QString::fromUtf8(
+			corpusWords[random(corpusWordCount)]));
+	}
+
+	return words.join(" ");
+}
+
+/*!
+ * This function creates a small, random piece of cover art: a two-color
+ * pattern, encoded as a PNG image.
+ *
+ * \return The PNG data.
+ */
+QByteArray CSCorpusGenerator::createCover()
+{
+	QRgb a = qRgb(random(256), random(256), random(256));
+	QRgb b = qRgb(random(256), random(256), random(256));
+	int stripe = 4 + random(12);
+
+	QImage image(CORPUS_COVER_SIZE, CORPUS_COVER_SIZE,
+		QImage::Format_RGB32);
+
+	for(int y = 0; y < image.height(); ++y)
+	{
+		for(int x = 0; x < image.width(); ++x)
+			image.setPixel(x, y, (((x + y) / stripe) % 2) ? a : b);
+	}
+
+	QByteArray d;
+	QBuffer buffer(&d);
+	buffer.open(QIODevice::WriteOnly);
+	image.save(&buffer, "PNG");
+
+	return d;
+}
+
+/*!
+ * This function writes a single track: its audio data, followed by its tags.
+ *
+ * \param t The track to write.
+ * \param c The track's cover art, or an empty byte array for none.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::writeTrack(const Track &t, const QByteArray &c)
+{
+	bool r = false;
+
+	switch(t.format)
+	{
+		case MP3:
+			r = writeMP3(t.path) && tagMP3(t, c);
+			break;
+
+		case MP4:
+			r = writeMP4(t.path) && tagMP4(t, c);
+			break;
+
+		case FLAC:
+			r = writeFLAC(t.path) && tagFLAC(t, c);
+			break;
+
+		case Ogg:
+			r = writeOgg(t.path) && tagOgg(t, c);
+			break;
+	}
+
+	if(!r)
+		return false;
+
+	++filesWritten;
+	bytesWritten += static_cast<uint64_t>(QFileInfo(t.path).size());
+	++formatCounts[getFormatName(t.format)];
+
+	return true;
+}
+
+/*!
+ * This function writes a silent MP3 file, made up of MPEG-1 Layer III frames
+ * whose side information and main data are all zeros.
+ *
+ * \param p The path to write to.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::writeMP3(const QString &p) const
+{
+	QByteArray frame(CORPUS_MP3_FRAME_SIZE, '\0');
+
+	// MPEG-1 Layer III, no CRC, 128 kbps, 44.1 kHz, joint stereo.
+
+	frame[0] = static_cast<char>(0xFF);
+	frame[1] = static_cast<char>(0xFB);
+	frame[2] = static_cast<char>(0x90);
+	frame[3] = static_cast<char>(0x64);
+
+	int frames = (trackLength * CORPUS_SAMPLE_RATE +
+		CORPUS_MP3_FRAME_SAMPLES - 1) / CORPUS_MP3_FRAME_SAMPLES;
+
+	QByteArray d;
+	d.reserve(frames * CORPUS_MP3_FRAME_SIZE);
+
+	for(int i = 0; i < frames; ++i)
+		d.append(frame);
+
+	return writeFile(p, d);
+}
+
+/*!
+ * This function writes a silent MP4 file: an "M4A " file type, a movie
+ * describing a single AAC audio track of the right length, and empty media
+ * data. The track has no samples, so it decodes to silence.
+ *
+ * \param p The path to write to.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::writeMP4(const QString &p) const
+{
+	quint32 duration = static_cast<quint32>(trackLength) * 1000;
+	quint32 samples = static_cast<quint32>(trackLength) *
+		CORPUS_SAMPLE_RATE;
+
+	QByteArray ftyp;
+	ftyp.append("M4A ");
+	ftyp.append(QByteArray(4, '\0'));
+	ftyp.append("M4A mp42");
+
+	// Build our movie header.
+
+	QByteArray mvhd;
+	{
+		QDataStream out(&mvhd, QIODevice::WriteOnly);
+
+		out << quint32(0) << quint32(0) << quint32(0);
+		out << quint32(1000) << duration;
+		out << quint32(0x00010000) << quint16(0x0100);
+		out << quint16(0) << quint32(0) << quint32(0);
+
+		for(int i = 0; i < 9; ++i)
+			out << corpusMP4Matrix[i];
+
+		for(int i = 0; i < 6; ++i)
+			out << quint32(0);
+
+		out << quint32(2);
+	}
+
+	// Build our track header, and our media header and handler.
+
+	QByteArray tkhd;
+	{
+		QDataStream out(&tkhd, QIODevice::WriteOnly);
+
+		out << quint32(0x00000007) << quint32(0) << quint32(0);
+		out << quint32(1) << quint32(0) << duration;
+		out << quint32(0) << quint32(0);
+		out << quint16(0) << quint16(0) << quint16(0x0100);
+		out << quint16(0);
+
+		for(int i = 0; i < 9; ++i)
+			out << corpusMP4Matrix[i];
+
+		out << quint32(0) << quint32(0);
+	}
+
+	QByteArray mdhd;
+	{
+		QDataStream out(&mdhd, QIODevice::WriteOnly);
+
+		out << quint32(0) << quint32(0) << quint32(0);
+		out << quint32(CORPUS_SAMPLE_RATE) << samples;
+		out << quint16(0x55C4) << quint16(0);
+	}
+
+	QByteArray hdlr;
+	{
+		QDataStream out(&hdlr, QIODevice::WriteOnly);
+
+		out << quint32(0) << quint32(0);
+		out.writeRawData("soun", 4);
+		out << quint32(0) << quint32(0) << quint32(0);
+		out.writeRawData("SoundHandler", 13);
+	}
+
+	// Build our sample table, which describes a single AAC stream.
+
+	QByteArray mp4a;
+	{
+		QDataStream out(&mp4a, QIODevice::WriteOnly);
+
+		out << quint16(0) << quint16(0) << quint16(0);
+		out << quint16(1) << quint32(0) << quint32(0);
+		out << quint16(CORPUS_CHANNELS);
+		out << quint16(CORPUS_BITS_PER_SAMPLE);
+		out << quint16(0) << quint16(0);
+		out << (quint32(CORPUS_SAMPLE_RATE) << 16);
+	}
+
+	QByteArray stsd;
+	{
+		QDataStream out(&stsd, QIODevice::WriteOnly);
+		out << quint32(0) << quint32(1);
+	}
+	stsd.append(createAtom("mp4a", mp4a));
+
+	QByteArray emptyTable;
+	{
+		QDataStream out(&emptyTable, QIODevice::WriteOnly);
+		out << quint32(0) << quint32(0);
+	}
+
+	QByteArray stsz;
+	{
+		QDataStream out(&stsz, QIODevice::WriteOnly);
+		out << quint32(0) << quint32(0) << quint32(0);
+	}
+
+	QByteArray stbl = createAtom("stsd", stsd) +
+		createAtom("stts", emptyTable) +
+		createAtom("stsc", emptyTable) +
+		createAtom("stsz", stsz) +
+		createAtom("stco", emptyTable);
+
+	QByteArray dref;
+	{
+		QDataStream out(&dref, QIODevice::WriteOnly);
+		out << quint32(0) << quint32(1);
+	}
+	dref.append(createAtom("url ", QByteArray("\0\0\0\1", 4)));
+
+	QByteArray minf = createAtom("smhd", QByteArray(8, '\0')) +
+		createAtom("dinf", createAtom("dref", dref)) +
+		createAtom("stbl", stbl);
+
+	QByteArray mdia = createAtom("mdhd", mdhd) +
+		createAtom("hdlr", hdlr) + createAtom("minf", minf);
+
+	QByteArray trak = createAtom("tkhd", tkhd) +
+		createAtom("mdia", mdia);
+
+	QByteArray moov = createAtom("mvhd", mvhd) +
+		createAtom("trak", trak);
+
+	return writeFile(p, createAtom("ftyp", ftyp) +
+		createAtom("moov", moov) + createAtom("mdat", QByteArray(
+		trackLength * CORPUS_MP4_BYTES_PER_SECOND, '\0')));
+}
+
+/*!
+ * This function writes a silent FLAC file: a stream info block, followed by
+ * fixed-size frames whose subframes are all constant zeros.
+ *
+ * \param p The path to write to.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::writeFLAC(const QString &p) const
+{
+	quint32 frames = (static_cast<quint32>(trackLength) *
+		CORPUS_SAMPLE_RATE + CORPUS_FLAC_BLOCK_SIZE - 1) /
+		CORPUS_FLAC_BLOCK_SIZE;
+	quint64 samples = static_cast<quint64>(frames) *
+		CORPUS_FLAC_BLOCK_SIZE;
+
+	// Write our stream info block, which is our last metadata block.
+
+	QByteArray d;
+	{
+		QDataStream out(&d, QIODevice::WriteOnly);
+
+		out.writeRawData("fLaC", 4);
+
+		out << quint8(0x80) << quint8(0) << quint16(34);
+		out << quint16(CORPUS_FLAC_BLOCK_SIZE);
+		out << quint16(CORPUS_FLAC_BLOCK_SIZE);
+		out << quint8(0) << quint16(0) << quint8(0) << quint16(0);
+
+		out << ( (quint64(CORPUS_SAMPLE_RATE) << 44) |
+			(quint64(CORPUS_CHANNELS - 1) << 41) |
+			(quint64(CORPUS_BITS_PER_SAMPLE - 1) << 36) |
+			samples );
+
+		for(int i = 0; i < 4; ++i)
+			out << quint32(0);
+	}
+
+	// Write our frames.
+
+	for(quint32 i = 0; i < frames; ++i)
+	{
+		/*
+		 * Fixed block size, 4096 samples, 44.1 kHz, two independent
+		 * channels, 16 bits per sample; the frame number is encoded
+		 * like a UTF-8 character.
+		 */
+
+		QByteArray frame("\xFF\xF8\xC9\x18", 4);
+
+		if(i < 0x80)
+			frame.append(static_cast<char>(i));
+		else if(i < 0x800)
+		{
+			frame.append(static_cast<char>(0xC0 | (i >> 6)));
+			frame.append(static_cast<char>(0x80 | (i & 0x3F)));
+		}
+		else
+		{
+			frame.append(static_cast<char>(0xE0 | (i >> 12)));
+			frame.append(static_cast<char>(
+				0x80 | ((i >> 6) & 0x3F)));
+			frame.append(static_cast<char>(0x80 | (i & 0x3F)));
+		}
+
+		frame.append(static_cast<char>(crc8(frame)));
+
+		// Each channel is a CONSTANT subframe with the value 0.
+
+		frame.append(QByteArray(3 * CORPUS_CHANNELS, '\0'));
+
+		quint16 crc = crc16(frame);
+		frame.append(static_cast<char>(crc >> 8));
+		frame.append(static_cast<char>(crc & 0xFF));
+
+		d.append(frame);
+	}
+
+	return writeFile(p, d);
+}
+
+/*!
+ * This function writes a silent Ogg Vorbis file. It contains the three Vorbis
+ * header packets, followed by a final (empty) audio page whose granule
+ * position gives the stream its length.
+ *
+ * \param p The path to write to.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::writeOgg(const QString &p) const
+{
+	quint64 samples = static_cast<quint64>(trackLength) *
+		CORPUS_SAMPLE_RATE;
+
+	QByteArray identification;
+	{
+		QDataStream out(&identification, QIODevice::WriteOnly);
+		out.setByteOrder(QDataStream::LittleEndian);
+
+		out << quint8(0x01);
+		out.writeRawData("vorbis", 6);
+		out << quint32(0) << quint8(CORPUS_CHANNELS);
+		out << quint32(CORPUS_SAMPLE_RATE);
+		out << qint32(0) << qint32(128000) << qint32(0);
+
+		// Block sizes 256 and 2048, and the framing bit.
+
+		out << quint8(0xB8) << quint8(0x01);
+	}
+
+	QByteArray comment;
+	{
+		QDataStream out(&comment, QIODevice::WriteOnly);
+		out.setByteOrder(QDataStream::LittleEndian);
+
+		out << quint8(0x03);
+		out.writeRawData("vorbis", 6);
+		out << quint32(8);
+		out.writeRawData("CuteSync", 8);
+		out << quint32(0) << quint8(0x01);
+	}
+
+	QByteArray setup;
+	{
+		QDataStream out(&setup, QIODevice::WriteOnly);
+		out.setByteOrder(QDataStream::LittleEndian);
+
+		out << quint8(0x05);
+		out.writeRawData("vorbis", 6);
+		out << quint32(0) << quint8(0x01);
+	}
+
+	QList<int> lengths;
+
+	lengths << identification.size();
+	QByteArray d = createOggPage(identification, lengths, 0x02, 0, 0);
+
+	lengths.clear();
+	lengths << comment.size() << setup.size();
+	d.append(createOggPage(comment + setup, lengths, 0x00, 0, 1));
+
+	lengths.clear();
+	lengths << 0;
+	d.append(createOggPage(QByteArray(), lengths, 0x04, samples, 2));
+
+	return writeFile(p, d);
+}
+
+/*!
+ * This function writes the given track's tags to an MP3 file, as an ID3v2
+ * tag. Half of our files get ID3v2.3 tags, and the other half ID3v2.4.
+ *
+ * \param t The track whose tags should be written.
+ * \param c The track's cover art, or an empty byte array for none.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::tagMP3(const Track &t, const QByteArray &c)
+{
+	int version = (random(2) == 0) ? 3 : 4;
+
+	TagLib::MPEG::File f(QFile::encodeName(t.path).constData(), false);
+	if(!f.isValid())
+		return false;
+
+	TagLib::ID3v2::Tag *tag = f.ID3v2Tag(true);
+	tagCommon(tag, t);
+
+	QList<QPair<QByteArray, QString> > frames;
+	frames.append(qMakePair(QByteArray("TRCK"), QString("%1/%2")
+		.arg(t.trackNumber).arg(t.trackCount)));
+	frames.append(qMakePair(QByteArray("TPOS"), QString("%1/%2")
+		.arg(t.discNumber).arg(t.discCount)));
+	frames.append(qMakePair(QByteArray("TPE2"), t.albumArtist));
+	frames.append(qMakePair(QByteArray("TCOM"), t.composer));
+
+	for(int i = 0; i < frames.count(); ++i)
+	{
+		TagLib::ByteVector id = toByteVector(frames.at(i).first);
+		tag->removeFrames(id);
+
+		if(frames.at(i).second.isEmpty())
+			continue;
+
+		TagLib::ID3v2::TextIdentificationFrame *frame =
+			new TagLib::ID3v2::TextIdentificationFrame(id,
+			TagLib::String::UTF8);
+		frame->setText(toTagLibString(frames.at(i).second));
+		tag->addFrame(frame);
+	}
+
+	if(!c.isEmpty())
+	{
+		TagLib::ID3v2::AttachedPictureFrame *frame =
+			new TagLib::ID3v2::AttachedPictureFrame();
+		frame->setMimeType("image/png");
+		frame->setType(
+			TagLib::ID3v2::AttachedPictureFrame::FrontCover);
+		frame->setPicture(toByteVector(c));
+		tag->addFrame(frame);
+	}
+
+	return f.save(TagLib::MPEG::File::ID3v2, true, version);
+}
+
+/*!
+ * This function writes the given track's tags to an MP4 file, as iTunes-style
+ * metadata items.
+ *
+ * \param t The track whose tags should be written.
+ * \param c The track's cover art, or an empty byte array for none.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::tagMP4(const Track &t, const QByteArray &c) const
+{
+	TagLib::MP4::File f(QFile::encodeName(t.path).constData(), false);
+	if(!f.isValid())
+		return false;
+
+	TagLib::MP4::Tag *tag = f.tag();
+	tagCommon(tag, t);
+
+	TagLib::MP4::ItemListMap &items = tag->itemListMap();
+	items["trkn"] = TagLib::MP4::Item(t.trackNumber, t.trackCount);
+	items["disk"] = TagLib::MP4::Item(t.discNumber, t.discCount);
+
+	if(!t.albumArtist.isEmpty())
+	{
+		items["aART"] = TagLib::MP4::Item(TagLib::StringList(
+			toTagLibString(t.albumArtist)));
+	}
+
+	if(!t.composer.isEmpty())
+	{
+		items["\251wrt"] = TagLib::MP4::Item(TagLib::StringList(
+			toTagLibString(t.composer)));
+	}
+
+	if(!c.isEmpty())
+	{
+		TagLib::MP4::CoverArtList art;
+		art.append(TagLib::MP4::CoverArt(TagLib::MP4::CoverArt::PNG,
+			toByteVector(c)));
+		items["covr"] = TagLib::MP4::Item(art);
+	}
+
+	return f.save();
+}
+
+/*!
+ * This function writes the given track's tags to a FLAC file, as a Vorbis
+ * comment block plus a picture block for its cover art.
+ *
+ * \param t The track whose tags should be written.
+ * \param c The track's cover art, or an empty byte array for none.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::tagFLAC(const Track &t, const QByteArray &c) const
+{
+	TagLib::FLAC::File f(QFile::encodeName(t.path).constData(), false);
+	if(!f.isValid())
+		return false;
+
+	tagXiph(f.xiphComment(true), t);
+
+	if(!c.isEmpty())
+	{
+		TagLib::FLAC::Picture *picture = new TagLib::FLAC::Picture();
+		picture->setType(TagLib::FLAC::Picture::FrontCover);
+		picture->setMimeType("image/png");
+		picture->setWidth(CORPUS_COVER_SIZE);
+		picture->setHeight(CORPUS_COVER_SIZE);
+		picture->setColorDepth(24);
+		picture->setData(toByteVector(c));
+		f.addPicture(picture);
+	}
+
+	return f.save();
+}
+
+/*!
+ * This function writes the given track's tags to an Ogg Vorbis file, as a
+ * Vorbis comment. Cover art is stored as a base64-encoded FLAC picture block,
+ * the same way other taggers do.
+ *
+ * \param t The track whose tags should be written.
+ * \param c The track's cover art, or an empty byte array for none.
+ * \return True on success, or false on failure.
+ */
+bool CSCorpusGenerator::tagOgg(const Track &t, const QByteArray &c) const
+{
+	TagLib::Ogg::Vorbis::File f(QFile::encodeName(t.path).constData(),
+		false);
+	if(!f.isValid())
+		return false;
+
+	tagXiph(f.tag(), t);
+
+	if(!c.isEmpty())
+	{
+		TagLib::FLAC::Picture picture;
+		picture.setType(TagLib::FLAC::Picture::FrontCover);
+		picture.setMimeType("image/png");
+		picture.setWidth(CORPUS_COVER_SIZE);
+		picture.setHeight(CORPUS_COVER_SIZE);
+		picture.setColorDepth(24);
+		picture.setData(toByteVector(c));
+
+		TagLib::ByteVector block = picture.render();
+		f.tag()->addField("METADATA_BLOCK_PICTURE", TagLib::String(
+			QByteArray(block.data(), block.size()).toBase64()
+			.constData()));
+	}
+
+	return f.save();
+}
+
+/*!
+ * This function writes the tags every format supports through TagLib's
+ * common API.
+ *
+ * \param g The tag to write to.
+ * \param t The track whose tags should be written.
+ */
+void CSCorpusGenerator::tagCommon(TagLib::Tag *g, const Track &t)
+{
+	g->setTitle(toTagLibString(t.title));
+	g->setArtist(toTagLibString(t.artist));
+	g->setAlbum(toTagLibString(t.album));
+	g->setComment(toTagLibString(t.comment));
+	g->setGenre(toTagLibString(t.genre));
+	g->setYear(static_cast<unsigned int>(t.year));
+	g->setTrack(static_cast<unsigned int>(t.trackNumber));
+}
+
+/*!
+ * This function writes the given track's tags to a Vorbis comment, which is
+ * shared by our FLAC and Ogg Vorbis files.
+ *
+ * \param x The Vorbis comment to write to.
+ * \param t The track whose tags should be written.
+ */
+void CSCorpusGenerator::tagXiph(TagLib::Ogg::XiphComment *x, const Track &t)
+{
+	tagCommon(x, t);
+
+	x->addField("TRACKTOTAL", TagLib::String::number(t.trackCount));
+	x->addField("DISCNUMBER", TagLib::String::number(t.discNumber));
+	x->addField("DISCTOTAL", TagLib::String::number(t.discCount));
+
+	if(!t.albumArtist.isEmpty())
+		x->addField("ALBUMARTIST", toTagLibString(t.albumArtist));
+
+	if(!t.composer.isEmpty())
+		x->addField("COMPOSER", toTagLibString(t.composer));
+}
+
+/*!
+ * This function creates an MP4 atom of the given type, containing the given
+ * data.
+ *
+ * \param t The atom's four-character type.
+ * \param d The atom's contents.
+ * \return The complete atom.
+ */
+QByteArray CSCorpusGenerator::createAtom(const char *t, const QByteArray &d)
+{
+	QByteArray atom;
+	QDataStream out(&atom, QIODevice::WriteOnly);
+
+	out << static_cast<quint32>(d.size() + 8);
+	out.writeRawData(t, 4);
+	out.writeRawData(d.constData(), d.size());
+
+	return atom;
+}
+
+/*!
+ * This function creates a single Ogg page, containing the given packets.
+ * Every packet must be complete, and the page must fit in 255 segments.
+ *
+ * \param d The packets' data, concatenated.
+ * \param l The length of each packet.
+ * \param f The page's header type flags.
+ * \param g The page's granule position.
+ * \param s The page's sequence number.
+ * \return The complete page.
+ */
+QByteArray CSCorpusGenerator::createOggPage(const QByteArray &d,
+	const QList<int> &l, uint8_t f, uint64_t g, uint32_t s)
+{
+	QByteArray lacing;
+
+	for(int i = 0; i < l.count(); ++i)
+	{
+		int length = l.at(i);
+
+		for(; length >= 255; length -= 255)
+			lacing.append(static_cast<char>(0xFF));
+
+		lacing.append(static_cast<char>(length));
+	}
+
+	QByteArray page;
+	{
+		QDataStream out(&page, QIODevice::WriteOnly);
+		out.setByteOrder(QDataStream::LittleEndian);
+
+		out.writeRawData("OggS", 4);
+		out << quint8(0) << quint8(f) << quint64(g);
+		out << quint32(CORPUS_OGG_SERIAL) << quint32(s) << quint32(0);
+		out << quint8(lacing.size());
+	}
+
+	page.append(lacing);
+	page.append(d);
+
+	quint32 crc = oggCRC(page);
+	for(int i = 0; i < 4; ++i)
+		page[22 + i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+
+	return page;
+}
+
+/*!
+ * This function computes the CRC-8 of the given data, as used in FLAC frame
+ * headers (polynomial 0x07, initial value 0).
+ *
+ * \param d The data to checksum.
+ * \return The data's CRC.
+ */
+uint8_t CSCorpusGenerator::crc8(const QByteArray &d)
+{
+	uint8_t crc = 0;
+
+	for(int i = 0; i < d.size(); ++i)
+	{
+		crc ^= static_cast<uint8_t>(d.at(i));
+
+		for(int j = 0; j < 8; ++j)
+		{
+			crc = (crc & 0x80) ? static_cast<uint8_t>(
+				(crc << 1) ^ 0x07) : static_cast<uint8_t>(
+				crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+/*!
+ * This function computes the CRC-16 of the given data, as used at the end of
+ * FLAC frames (polynomial 0x8005, initial value 0).
+ *
+ * \param d The data to checksum.
+ * \return The data's CRC.
+ */
+uint16_t CSCorpusGenerator::crc16(const QByteArray &d)
+{
+	uint16_t crc = 0;
+
+	for(int i = 0; i < d.size(); ++i)
+	{
+		crc ^= static_cast<uint16_t>(
+			static_cast<uint8_t>(d.at(i)) << 8);
+
+		for(int j = 0; j < 8; ++j)
+		{
+			crc = (crc & 0x8000) ? static_cast<uint16_t>(
+				(crc << 1) ^ 0x8005) : static_cast<uint16_t>(
+				crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+/*!
+ * This function computes the CRC-32 of the given data, as used in Ogg page
+ * headers (polynomial 0x04C11DB7, initial value 0, not reflected).
+ *
+ * \param d The data to checksum.
+ * \return The data's CRC.
+ */
+uint32_t CSCorpusGenerator::oggCRC(const QByteArray &d)
+{
+	uint32_t crc = 0;
+
+	for(int i = 0; i < d.size(); ++i)
+	{
+		crc ^= static_cast<uint32_t>(
+			static_cast<uint8_t>(d.at(i))) << 24;
+
+		for(int j = 0; j < 8; ++j)
+		{
+			crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04C11DB7) :
+				(crc << 1);
+		}
+	}
+
+	return crc;
+}
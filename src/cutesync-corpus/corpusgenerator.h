@@ -0,0 +1,152 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_CUTE_SYNC_CORPUS_CORPUS_GENERATOR_H
+#define INCLUDE_CUTE_SYNC_CORPUS_CORPUS_GENERATOR_H
+
+#include <cstdint>
+#include <random>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace TagLib
+{
+	class Tag;
+
+	namespace Ogg
+	{
+		class XiphComment;
+	}
+}
+
+/*!
+ * \brief This class writes a synthetic library of small, valid audio files.
+ *
+ * The library is laid out in nested artist/album directories, and contains
+ * MP3, MP4, FLAC and Ogg Vorbis files with varied tags and (optionally)
+ * embedded cover art. The audio data is silent, and built from the smallest
+ * valid frames of each format; tags are written with TagLib.
+ *
+ * Everything we generate is derived from our seed, so the same seed and size
+ * parameters always produce the same library.
+ */
+class CSCorpusGenerator
+{
+	public:
+		/*!
+		 * This enumeration identifies the audio formats we can write.
+		 */
+		enum Format
+		{
+			MP3,
+			MP4,
+			FLAC,
+			Ogg
+		};
+
+		CSCorpusGenerator(const QString &r, unsigned int s);
+		virtual ~CSCorpusGenerator();
+
+		void setArtistCount(int c);
+		void setAlbumCount(int c);
+		void setTrackCount(int c);
+		void setTrackLength(int l);
+		void setFormats(const QList<Format> &f);
+		void setCoversEnabled(bool c);
+
+		bool generate();
+
+		int getFilesWritten() const;
+		uint64_t getBytesWritten() const;
+		QHash<QString, int> getFormatCounts() const;
+		QStringList getErrors() const;
+
+		static QString getFormatName(Format f);
+		static bool getFormatByName(const QString &n, Format *f);
+
+	private:
+		/*!
+		 * This structure stores the tags of a single track we are
+		 * going to write.
+		 */
+		typedef struct Track
+		{
+			Format format;
+			QString path;
+			QString title;
+			QString artist;
+			QString album;
+			QString albumArtist;
+			QString composer;
+			QString genre;
+			QString comment;
+			int year;
+			int trackNumber;
+			int trackCount;
+			int discNumber;
+			int discCount;
+		} Track;
+
+		std::mt19937 generator;
+		QString root;
+		int artistCount;
+		int albumCount;
+		int trackCount;
+		int trackLength;
+		QList<Format> formats;
+		bool covers;
+		int filesWritten;
+		uint64_t bytesWritten;
+		QHash<QString, int> formatCounts;
+		QStringList errors;
+
+		int random(int n);
+		QString createName(int w);
+		QByteArray createCover();
+
+		bool writeTrack(const Track &t, const QByteArray &c);
+
+		bool writeMP3(const QString &p) const;
+		bool writeMP4(const QString &p) const;
+		bool writeFLAC(const QString &p) const;
+		bool writeOgg(const QString &p) const;
+
+		bool tagMP3(const Track &t, const QByteArray &c);
+		bool tagMP4(const Track &t, const QByteArray &c) const;
+		bool tagFLAC(const Track &t, const QByteArray &c) const;
+		bool tagOgg(const Track &t, const QByteArray &c) const;
+
+		static void tagCommon(TagLib::Tag *g, const Track &t);
+		static void tagXiph(TagLib::Ogg::XiphComment *x,
+			const Track &t);
+
+		static QByteArray createAtom(const char *t,
+			const QByteArray &d);
+		static QByteArray createOggPage(const QByteArray &d,
+			const QList<int> &l, uint8_t f, uint64_t g,
+			uint32_t s);
+		static uint8_t crc8(const QByteArray &d);
+		static uint16_t crc16(const QByteArray &d);
+		static uint32_t oggCRC(const QByteArray &d);
+};
+
+#endif
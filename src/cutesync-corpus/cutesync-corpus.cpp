@@ -0,0 +1,269 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "libcute/collections/ipodcollection.h"
+
+#include "corpusgenerator.h"
+
+/*
+ * Our exit codes: 0 means the whole corpus was written, 1 means we couldn't
+ * write it at all (bad arguments, or an unusable output directory), and 2
+ * means some of its files couldn't be written.
+ */
+#define CORPUS_OK 0
+#define CORPUS_ERROR 1
+#define CORPUS_INCOMPLETE 2
+
+/*
+ * The longest track we will write, in seconds.
+ */
+#define CORPUS_MAX_LENGTH 3600
+
+/*!
+ * This function prints our usage information.
+ */
+void printUsage()
+{
+	std::cerr << "Usage: cutesync-corpus [options] <output directory>\n\n";
+	std::cerr << "Options:\n";
+	std::cerr << "\t--seed <n>         The seed the corpus is derived " <<
+		"from (default: 1).\n";
+	std::cerr << "\t--artists <n>      The number of artists " <<
+		"(default: 10).\n";
+	std::cerr << "\t--albums <n>       The number of albums per " <<
+		"artist (default: 3).\n";
+	std::cerr << "\t--tracks <n>       The number of tracks per " <<
+		"album (default: 12).\n";
+	std::cerr << "\t--length <s>       The length of each track, in " <<
+		"seconds (default: 5).\n";
+	std::cerr << "\t--formats <f,...>  The formats to write, from " <<
+		"mp3, mp4, flac and ogg\n\t                   " <<
+		"(default: all).\n";
+	std::cerr << "\t--no-covers        Don't embed cover art.\n";
+	std::cerr << "\t--ipod <dir>       Also create an empty iPod in " <<
+		"this directory.\n";
+	std::cerr << "\t--ipod-name <n>    The name of the iPod " <<
+		"(default: CuteSync).\n";
+	std::cerr << "\t--pretty           Indent our JSON output.\n";
+}
+
+/*!
+ * This function parses a positive integer option value.
+ *
+ * \param v The option value.
+ * \param m The largest value allowed.
+ * \param r The parsed value.
+ * \return True on success, or false on failure.
+ */
+bool parseCount(const QString &v, int m, int *r)
+{
+	bool ok;
+	(*r) = v.toInt(&ok);
+
+	return ok && ((*r) > 0) && ((*r) <= m);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Parse our command-line arguments.
+
+	unsigned int seed = 1;
+	int artists = 10;
+	int albums = 3;
+	int tracks = 12;
+	int length = 5;
+	QList<CSCorpusGenerator::Format> formats;
+	bool covers = true;
+	QString ipod;
+	QString ipodName("CuteSync");
+	bool pretty = false;
+	QString path;
+
+	QStringList args = app.arguments();
+	for(int i = 1; i < args.count(); ++i)
+	{
+		const QString &a = args.at(i);
+		bool hasValue = (i + 1 < args.count());
+		bool ok = true;
+
+		if( (a == "--seed") && hasValue )
+			seed = args.at(++i).toUInt(&ok);
+		else if( (a == "--artists") && hasValue )
+			ok = parseCount(args.at(++i), 100000, &artists);
+		else if( (a == "--albums") && hasValue )
+			ok = parseCount(args.at(++i), 1000, &albums);
+		else if( (a == "--tracks") && hasValue )
+			ok = parseCount(args.at(++i), 1000, &tracks);
+		else if( (a == "--length") && hasValue )
+		{
+			ok = parseCount(args.at(++i), CORPUS_MAX_LENGTH,
+				&length);
+		}
+		else if( (a == "--formats") && hasValue )
+		{
+			QStringList l = args.at(++i).split(',',
+				QString::SkipEmptyParts);
+
+			for(int j = 0; ok && (j < l.count()); ++j)
+			{
+				CSCorpusGenerator::Format f;
+				ok = CSCorpusGenerator::getFormatByName(
+					l.at(j), &f);
+
+				if(ok && !formats.contains(f))
+					formats.append(f);
+			}
+		}
+		else if(a == "--no-covers")
+			covers = false;
+		else if( (a == "--ipod") && hasValue )
+			ipod = QDir(args.at(++i)).absolutePath();
+		else if( (a == "--ipod-name") && hasValue )
+			ipodName = args.at(++i);
+		else if(a == "--pretty")
+			pretty = true;
+		else if( (a == "--help") || (a == "-h") )
+		{
+			printUsage();
+			return CORPUS_OK;
+		}
+		else if(!a.startsWith("--") && path.isEmpty())
+			path = QDir(a).absolutePath();
+		else
+			ok = false;
+
+		if(!ok)
+		{
+			printUsage();
+			return CORPUS_ERROR;
+		}
+	}
+
+	if(path.isEmpty() && ipod.isEmpty())
+	{
+		printUsage();
+		return CORPUS_ERROR;
+	}
+
+	/*
+	 * Refuse to write into a directory which already has something in it,
+	 * since the result wouldn't be reproducible.
+	 */
+
+	if(!path.isEmpty() && QDir(path).exists() && (QDir(path).entryList(
+		QDir::AllEntries | QDir::NoDotAndDotDot).count() > 0))
+	{
+		std::cerr << "The output directory must be empty: " <<
+			path.toUtf8().data() << "\n";
+		return CORPUS_ERROR;
+	}
+
+	QJsonObject result;
+	QJsonArray errors;
+	int exitCode = CORPUS_OK;
+
+	result.insert("seed", static_cast<double>(seed));
+
+	// Generate our library.
+
+	if(!path.isEmpty())
+	{
+		CSCorpusGenerator generator(path, seed);
+
+		generator.setArtistCount(artists);
+		generator.setAlbumCount(albums);
+		generator.setTrackCount(tracks);
+		generator.setTrackLength(length);
+		generator.setCoversEnabled(covers);
+
+		if(!formats.isEmpty())
+			generator.setFormats(formats);
+
+		if(!generator.generate())
+		{
+			exitCode = (generator.getFilesWritten() > 0) ?
+				CORPUS_INCOMPLETE : CORPUS_ERROR;
+		}
+
+		QStringList l = generator.getErrors();
+		for(int i = 0; i < l.count(); ++i)
+			errors.append(l.at(i));
+
+		QJsonObject counts;
+		QHash<QString, int> c = generator.getFormatCounts();
+		for(QHash<QString, int>::const_iterator it = c.begin();
+			it != c.end(); ++it)
+		{
+			counts.insert(it.key(), it.value());
+		}
+
+		result.insert("path", path);
+		result.insert("files", generator.getFilesWritten());
+		result.insert("bytes", static_cast<double>(
+			generator.getBytesWritten()));
+		result.insert("formats", counts);
+	}
+
+	// Create our iPod.
+
+	if(!ipod.isEmpty())
+	{
+		if(!QDir().mkpath(ipod) ||
+			!CSIPodCollection::createFalseIPod(ipodName, ipod))
+		{
+			errors.append(QString("Unable to create iPod: %1")
+				.arg(ipod));
+			exitCode = CORPUS_ERROR;
+		}
+
+		result.insert("ipod", ipod);
+	}
+
+	// Report our results.
+
+	result.insert("success", (exitCode == CORPUS_OK));
+	result.insert("errors", errors);
+	result.insert("wallTime", static_cast<double>(timer.nsecsElapsed()));
+
+	QJsonDocument doc(result);
+	std::cout << doc.toJson(pretty ? QJsonDocument::Indented :
+		QJsonDocument::Compact).data();
+
+	if(!pretty)
+		std::cout << "\n";
+
+	return exitCode;
+}
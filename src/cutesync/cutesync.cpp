@@ -19,11 +19,13 @@
 #include <QLocalSocket>
 
 #include "libcute/defines.h"
+#include "libcute/util/trace.h"
 #include "cutesync/application.h"
 
 int main(int argc, char *argv[])
 {
 	CSApplication app(argc, argv);
+	CSTrace::initialize();
 
 	QLocalSocket s;
 	s.connectToServer(CUTE_SYNC_GUID);
@@ -31,6 +31,8 @@
 #include <QMessageBox>
 
 #include "libcute/defines.h"
+#include "libcute/collections/collectioncatalog.h"
+#include "libcute/util/jobinstrumentation.h"
 #include "libcute/widgets/collectionmodel.h"
 #include "cutesync/mainmenubar.h"
 #include "cutesync/dialogs/newcollectiondialog.h"
@@ -54,6 +56,8 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 	: QMainWindow(p, f)
 {
 	settingsManager = new CSSettingsManager(this);
+	catalog = new CSCollectionCatalog(
+		settingsManager->getDataDirectory() + "/catalog");
 
 	// Set some window properties.
 
@@ -75,7 +79,12 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 	collectionsListWidget = new CSCollectionListWidget(
 		centralWidget);
 
-	collectionsListModel = new CSCollectionModel();
+	collectionsListModel = new CSCollectionModel(NULL, settingsManager->
+		getSetting("worker-threads").value<int>());
+	collectionsListModel->setDeviceQueueDepth(settingsManager->getSetting(
+		"device-queue-depth").value<int>());
+	CSJobInstrumentation::setLogPath(settingsManager->getSetting(
+		"statistics-log").value<QString>());
 
 	collectionsListWidget->setCollectionModel(collectionsListModel);
 
@@ -112,6 +121,10 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 		SIGNAL(selectionChanged(CSAbstractCollection *)),
 		collectionInspector,
 		SLOT(setCollection(CSAbstractCollection *)));
+	QObject::connect(collectionsListWidget,
+		SIGNAL(selectionChanged(CSAbstractCollection *)),
+		collectionsListModel,
+		SLOT(attachCollection(CSAbstractCollection *)));
 
 	QObject::connect(collectionsListModel,
 		SIGNAL(jobStarted(const QString &, bool)), this,
@@ -126,10 +139,6 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 		SIGNAL(jobFinished(const QString &)), this,
 		SLOT(doWorkerJobFinished(const QString &)));
 
-	QObject::connect(this,
-		SIGNAL(startUnserialize(const QList<QVariant> &)),
-		collectionsListModel,
-		SLOT(loadSerializedList(const QList<QVariant> &)));
 	QObject::connect(this,
 		SIGNAL(startNew(const QString &, const QString &, bool)),
 		collectionsListModel,
@@ -154,16 +163,34 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 	QObject::connect(collectionInspector,
 		SIGNAL(refreshRequested(CSAbstractCollection *)),
 		this, SIGNAL(startRefresh(CSAbstractCollection *)));
+	QObject::connect(collectionInspector,
+		SIGNAL(deleteRequested(CSAbstractCollection *,
+		const QStringList &)), collectionsListModel,
+		SLOT(deleteTracks(CSAbstractCollection *,
+		const QStringList &)));
 
 	// Finally, restore our window state.
 
 	restoreState(settingsManager->getSetting("window-state")
 		.value<QByteArray>());
 
-	// Restore other stuff from settings.
+	/*
+	 * Older versions stored our saved collections in our settings; move
+	 * any such collections into our catalog before loading it.
+	 */
+
+	QList<QVariant> legacy = settingsManager->getSetting(
+		"saved-collections").value< QList<QVariant> >();
 
-	Q_EMIT startUnserialize(settingsManager->getSetting(
-		"saved-collections").value< QList<QVariant> >());
+	if( (!legacy.isEmpty()) && catalog->migrate(legacy) )
+	{
+		settingsManager->setSetting("saved-collections",
+			QVariant(QList<QVariant>()));
+	}
+
+	// Restore our saved collections.
+
+	collectionsListModel->loadCatalog(catalog);
 }
 
 /*!
@@ -172,6 +199,7 @@ CSMainWindow::CSMainWindow(QWidget *p, Qt::WindowFlags f)
 CSMainWindow::~CSMainWindow()
 {
 	delete collectionsListModel;
+	delete catalog;
 }
 
 /*!
@@ -197,8 +225,7 @@ void CSMainWindow::closeEvent(QCloseEvent *e)
 	settingsManager->setSetting("window-geometry",
 		QVariant(saveGeometry()));
 	settingsManager->setSetting("window-state", QVariant(saveState()));
-	settingsManager->setSetting("saved-collections",
-		QVariant(collectionsListModel->getSerializedList()));
+	collectionsListModel->saveCatalog(catalog);
 
 	// Exit!
 
@@ -470,8 +497,12 @@ void CSMainWindow::doWorkerJobFinished(const QString &r)
  * \param k The key of the setting that was changed.
  * \param v The new value for this setting.
  */
-void CSMainWindow::doSettingChanged(
-	const QString &UNUSED(k), const QVariant &UNUSED(v))
-{
+void CSMainWindow::doSettingChanged(const QString &k, const QVariant &v)
+{ /* SLOT */
+
+	if(k == "device-queue-depth")
+		collectionsListModel->setDeviceQueueDepth(v.value<int>());
+	else if(k == "statistics-log")
+		CSJobInstrumentation::setLogPath(v.value<QString>());
 
 }
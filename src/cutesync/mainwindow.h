@@ -38,6 +38,7 @@ class CSNewCollectionDialog;
 class CSSyncDialog;
 class CSAbstractCollection;
 class CSSettingsManager;
+class CSCollectionCatalog;
 
 #ifdef CUTESYNC_DEBUG
 	class CSCreateIPodDialog;
@@ -59,6 +60,7 @@ class CSMainWindow : public QMainWindow
 
 	private:
 		CSSettingsManager *settingsManager;
+		CSCollectionCatalog *catalog;
 
 		CSNewCollectionDialog *newCollectionDialog;
 		CSSyncDialog *syncDialog;
@@ -107,7 +109,6 @@ class CSMainWindow : public QMainWindow
 		void doSettingChanged(const QString &k, const QVariant &v);
 
 	Q_SIGNALS:
-		void startUnserialize(const QList<QVariant> &);
 		void startNew(const QString &, const QString &, bool);
 		void startReload(CSAbstractCollection *);
 		void startRefresh(CSAbstractCollection *);
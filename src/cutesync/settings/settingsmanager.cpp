@@ -21,6 +21,7 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QString>
+#include <QFileInfo>
 #include <QSettings>
 
 #include "libcute/collections/abstractcollection.h"
@@ -35,7 +36,10 @@ const QList< QPair<QString, QVariant> > CSSettingsManager::defaults
 		<< QPair<QString, QVariant>("saved-collections",
 			QVariant(QList<QVariant>()))
 		<< QPair<QString, QVariant>("window-geometry", QVariant(QByteArray()))
-		<< QPair<QString, QVariant>("window-stat", QVariant(QByteArray()));
+		<< QPair<QString, QVariant>("window-stat", QVariant(QByteArray()))
+		<< QPair<QString, QVariant>("worker-threads", QVariant(0))
+		<< QPair<QString, QVariant>("device-queue-depth", QVariant(1))
+		<< QPair<QString, QVariant>("statistics-log", QVariant(QString()));
 
 /*!
  * This is our default constructor, which creates a new settings manager
@@ -149,6 +153,18 @@ QVariant CSSettingsManager::getSetting(const QString &k) const
 	return settings->value(k, QVariant());
 }
 
+/*!
+ * This function returns the directory our application should store its data
+ * files in (i.e., anything too large to belong in our settings). This is the
+ * same directory our settings file is stored in.
+ *
+ * \return The path to our data directory.
+ */
+QString CSSettingsManager::getDataDirectory() const
+{
+	return QFileInfo(settings->fileName()).absolutePath();
+}
+
 /*!
  * This function initializes our settings, ensuring that they are valid. Any
  * settings that are not set are given default values, and any settings that
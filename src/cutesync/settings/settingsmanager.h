@@ -50,6 +50,8 @@ class CSSettingsManager : public QObject
 		bool containsSetting(const QString &k) const;
 		QVariant getSetting(const QString &k) const;
 
+		QString getDataDirectory() const;
+
 	private:
 		static const QList< QPair<QString, QVariant> > defaults;
 		QSettings *settings;
@@ -21,15 +21,28 @@
 #include <cmath>
 
 #include <QGridLayout>
+#include <QHeaderView>
+#include <QHideEvent>
+#include <QFontMetrics>
+#include <QItemSelectionModel>
+#include <QShowEvent>
+#include <QStyle>
+#include <QLineEdit>
+#include <QMessageBox>
 #include <QPushButton>
 #include <QTableView>
+#include <QTabWidget>
+#include <QTreeView>
 #include <QLabel>
 #include <QProgressBar>
 #include <QTimerEvent>
 
+#include "libcute/defines.h"
 #include "libcute/collections/abstractcollection.h"
 #include "libcute/util/guiutils.h"
 #include "libcute/util/systemutils.h"
+#include "libcute/widgets/collectionfiltermodel.h"
+#include "libcute/widgets/collectiontreemodel.h"
 #include "cutesync/dialogs/inspector/inspectoraboutdialog.h"
 #include "cutesync/dialogs/inspector/inspectorcollectionconfigdialog.h"
 #include "cutesync/dialogs/inspector/inspectorconfigdialog.h"
@@ -125,6 +138,49 @@ CSAbstractCollection *CSCollectionInspector::getCollection() const
 	return collection;
 }
 
+/*!
+ * This function returns the keys of the tracks the user has selected. If no
+ * tracks are selected but a filter is being applied, then every track matching
+ * the filter is considered selected instead; this makes it easy to act on,
+ * e.g., an entire artist at once. When the tree view is being shown, selecting
+ * an artist or album selects all of its tracks.
+ *
+ * \return The keys of the selected tracks.
+ */
+QStringList CSCollectionInspector::getSelectedKeys() const
+{
+	QStringList keys;
+
+	if(collection == NULL)
+		return keys;
+
+	if(viewTabs->currentWidget() == collectionBrowser)
+	{
+		QModelIndexList nodes =
+			collectionBrowser->selectionModel()->selectedRows();
+
+		for(int i = 0; i < nodes.count(); ++i)
+			keys.append(treeModel->getKeys(nodes.at(i)));
+
+		keys.removeDuplicates();
+		return keys;
+	}
+
+	QModelIndexList rows =
+		collectionViewer->selectionModel()->selectedRows();
+
+	for(int i = 0; i < rows.count(); ++i)
+	{
+		keys.append(collection->getKeyAt(
+			filterModel->mapToSource(rows.at(i)).row()));
+	}
+
+	if(keys.isEmpty() && filterModel->isFiltering())
+		keys = filterModel->getMatchingKeys();
+
+	return keys;
+}
+
 /*!
  * This slot sets the collection we should be displaying.
  *
@@ -145,10 +201,14 @@ void CSCollectionInspector::setCollection(CSAbstractCollection *c)
 	if(collection != NULL)
 	{
 		collection->setDisplayDescriptor(&displayDescriptor);
-		collection->sort();
 
-		collectionViewer->setModel(collection);
-		collectionViewer->resizeColumnsToContents();
+		// Don't carry our browser's state over to the new collection.
+		collectionBrowser->collapseAll();
+		collectionBrowser->clearSelection();
+
+		filterModel->setCollection(collection);
+		treeModel->setCollection(collection);
+		resizeColumns();
 
 		spaceUsedProgressBar->setRange(0, 100);
 		spaceUsedProgressBar->setValue(static_cast<int>(
@@ -160,13 +220,16 @@ void CSCollectionInspector::setCollection(CSAbstractCollection *c)
 			this, SLOT(doCollectionEnabledChanged()));
 		QObject::connect(collection, SIGNAL(contentsChanged()),
 			this, SLOT(doCollectionContentsChanged()));
+		QObject::connect(collection, SIGNAL(snapshotPublished()),
+			this, SLOT(doCollectionSnapshotPublished()));
 	}
 	else
 	{
 		spaceUsedProgressBar->setRange(0, 0);
 		spaceUsedProgressBar->setValue(0);
 
-		collectionViewer->setModel(NULL);
+		filterModel->setCollection(NULL);
+		treeModel->setCollection(NULL);
 	}
 }
 
@@ -190,6 +253,30 @@ void CSCollectionInspector::timerEvent(QTimerEvent *e)
 	e->accept();
 }
 
+/*!
+ * This function handles our widget being shown, by activating our tree model
+ * if it is being displayed (see updateBrowserActive()).
+ *
+ * \param e The event we are handling.
+ */
+void CSCollectionInspector::showEvent(QShowEvent *e)
+{
+	QWidget::showEvent(e);
+	updateBrowserActive();
+}
+
+/*!
+ * This function handles our widget being hidden, by deactivating our tree
+ * model, so it doesn't rebuild its tree while nobody can see it.
+ *
+ * \param e The event we are handling.
+ */
+void CSCollectionInspector::hideEvent(QHideEvent *e)
+{
+	QWidget::hideEvent(e);
+	treeModel->setActive(false);
+}
+
 /*!
  * This is a helper function that creates our GUI for us; this is so we don't
  * have to copypasta the code to do so between our multiple constructors.
@@ -207,6 +294,13 @@ void CSCollectionInspector::createGUI()
 
 	configButton = new QPushButton(tr("Options..."), actionsList);
 
+	deleteButton = new QPushButton(tr("Delete..."), actionsList);
+	deleteButton->setToolTip(
+		tr("Delete the selected (or matching) tracks"));
+
+	filterEdit = new QLineEdit(actionsList);
+	filterEdit->setPlaceholderText(tr("Filter"));
+
 	sortButton = new QPushButton(
 		CSGUIUtils::getIconFromTheme("preferences-other"),
 		QString(), actionsList);
@@ -215,21 +309,54 @@ void CSCollectionInspector::createGUI()
 	actionsLayout->addWidget( aboutButton,   0, 0 );
 	actionsLayout->addWidget( refreshButton, 0, 1 );
 	actionsLayout->addWidget( configButton,  0, 2 );
-	actionsLayout->addWidget( sortButton,    0, 4 );
-	actionsLayout->setColumnStretch(3, 1);
+	actionsLayout->addWidget( deleteButton,  0, 3 );
+	actionsLayout->addWidget( filterEdit,    0, 4 );
+	actionsLayout->addWidget( sortButton,    0, 5 );
+	actionsLayout->setColumnStretch(4, 1);
 	actionsList->setLayout(actionsLayout);
 
-	collectionViewer = new QTableView(this);
+	viewTabs = new QTabWidget(this);
+
+	filterModel = new CSCollectionFilterModel(this);
+
+	collectionViewer = new QTableView(viewTabs);
+	collectionViewer->setModel(filterModel);
 	collectionViewer->setSelectionBehavior(QAbstractItemView::SelectRows);
 	collectionViewer->setSelectionMode(
 		QAbstractItemView::ExtendedSelection);
 	collectionViewer->setSortingEnabled(false);
+	collectionViewer->setWordWrap(false);
+
+	/*
+	 * Every row in our view is a single line of text, so we give them all
+	 * the same fixed height. This lets the view compute row positions
+	 * without asking the model for each row's size hint.
+	 */
+
+	collectionViewer->verticalHeader()->setSectionResizeMode(
+		QHeaderView::Fixed);
+	collectionViewer->verticalHeader()->setDefaultSectionSize(
+		collectionViewer->fontMetrics().lineSpacing() + 6);
+
+	treeModel = new CSCollectionTreeModel(this);
+
+	collectionBrowser = new QTreeView(viewTabs);
+	collectionBrowser->setModel(treeModel);
+	collectionBrowser->setSelectionMode(
+		QAbstractItemView::ExtendedSelection);
+	collectionBrowser->setUniformRowHeights(true);
+
+	viewTabs->addTab(collectionViewer, tr("Tracks"));
+	viewTabs->addTab(collectionBrowser, tr("Browse"));
+
+	// Our tree model is only activated while it is being displayed.
+	treeModel->setActive(false);
 
 	spaceUsedLabel = new QLabel(tr("Disk Space Used:"), this);
 	spaceUsedProgressBar = new QProgressBar(this);
 
 	layout->addWidget(actionsList, 0, 0, 1, 2);
-	layout->addWidget(collectionViewer, 1, 0, 1, 2);
+	layout->addWidget(viewTabs, 1, 0, 1, 2);
 	layout->addWidget(spaceUsedLabel, 2, 0, 1, 1);
 	layout->addWidget(spaceUsedProgressBar, 2, 1, 1, 1);
 	layout->setColumnStretch(1, 1);
@@ -242,8 +369,18 @@ void CSCollectionInspector::createGUI()
 		this, SLOT(doRefresh()));
 	QObject::connect(configButton, SIGNAL(clicked()),
 		this, SLOT(doConfig()));
+	QObject::connect(deleteButton, SIGNAL(clicked()),
+		this, SLOT(doDelete()));
+	QObject::connect(filterEdit, SIGNAL(textChanged(const QString &)),
+		filterModel, SLOT(setQuery(const QString &)));
 	QObject::connect(sortButton, SIGNAL(clicked()),
 		this, SLOT(doSort()));
+	QObject::connect(viewTabs, SIGNAL(currentChanged(int)),
+		this, SLOT(doViewTabChanged(int)));
+	QObject::connect(treeModel, SIGNAL(modelAboutToBeReset()),
+		this, SLOT(doBrowserAboutToBeReset()));
+	QObject::connect(treeModel, SIGNAL(modelReset()),
+		this, SLOT(doBrowserReset()));
 }
 
 /*!
@@ -272,6 +409,98 @@ void CSCollectionInspector::loadDisplayDescriptor()
 		.value<QByteArray>());
 }
 
+/*!
+ * This function activates our tree model if our tree view is currently being
+ * displayed, and deactivates it otherwise, so the model only rebuilds its tree
+ * when somebody can actually see it.
+ */
+void CSCollectionInspector::updateBrowserActive()
+{
+	treeModel->setActive(isVisible() &&
+		(viewTabs->currentWidget() == collectionBrowser));
+}
+
+/*!
+ * This function sizes our view's columns to fit their contents. Unlike
+ * QTableView::resizeColumnsToContents(), which asks the model for every single
+ * cell, we only measure a bounded sample of rows: some from the start, some
+ * from the end, and some spread evenly across the middle of the collection.
+ *
+ * The widths we compute are cached per column. By default the cache is reset
+ * first, so the columns fit the current sample exactly; when r is false (e.g.,
+ * after the collection's contents are modified), the cache only grows, which
+ * keeps columns from jumping around when the sample changes.
+ *
+ * \param r Whether or not our cached column widths should be reset first.
+ */
+void CSCollectionInspector::resizeColumns(bool r)
+{
+	if(collection == NULL)
+		return;
+
+	int rows = collection->rowCount();
+	int columns = collection->columnCount();
+
+	if(r || (columnWidths.size() != columns))
+		columnWidths.fill(0, columns);
+
+	QFontMetrics metrics = collectionViewer->horizontalHeader()
+		->fontMetrics();
+
+	for(int c = 0; c < columns; ++c)
+	{
+		// Leave room for our header, including its sort arrow.
+		int w = metrics.width(collection->headerData(c, Qt::Horizontal)
+			.toString()) + (metrics.height() * 2);
+
+		if(rows <= (ColumnSampleSize * 3))
+		{
+			sampleRows(0, rows, c, &w);
+		}
+		else
+		{
+			sampleRows(0, ColumnSampleSize, c, &w);
+			sampleRows(rows - ColumnSampleSize, rows, c, &w);
+
+			int step = rows / ColumnSampleSize;
+			for(int i = 0; i < ColumnSampleSize; ++i)
+				sampleRows(i * step, (i * step) + 1, c, &w);
+		}
+
+		columnWidths[c] = qMax(columnWidths.at(c), w);
+		collectionViewer->setColumnWidth(c, columnWidths.at(c));
+	}
+}
+
+/*!
+ * This is a helper function for resizeColumns(), which measures the display
+ * text of a contiguous range of rows in a single column.
+ *
+ * \param b The first row to measure.
+ * \param e One past the last row to measure.
+ * \param c The column to measure.
+ * \param w The widest width found so far, which we will update.
+ */
+void CSCollectionInspector::sampleRows(int b, int e, int c, int *w) const
+{
+	QFontMetrics metrics = collectionViewer->fontMetrics();
+
+	/*
+	 * Leave some room for the item's margins and the grid line, as the
+	 * default delegate does.
+	 */
+
+	int margin = collectionViewer->style()->pixelMetric(
+		QStyle::PM_FocusFrameHMargin, NULL, collectionViewer);
+	int padding = ((margin + 1) * 2) + 1;
+
+	for(int r = b; r < e; ++r)
+	{
+		QString text = collection->getDisplayData(r, c).toString();
+		(*w) = qMax((*w), metrics.width(text) + padding);
+	}
+}
+
 /*!
  * This function handles our configuration dialog being accepted by updating
  * our display descriptor with the new data, and then applying those changes to
@@ -284,7 +513,7 @@ void CSCollectionInspector::doSortAccepted()
 	if(collection != NULL)
 	{
 		collection->setDisplayDescriptor(&displayDescriptor);
-		collectionViewer->resizeColumnsToContents();
+		resizeColumns();
 	}
 }
 
@@ -334,6 +563,29 @@ void CSCollectionInspector::doConfig()
 
 }
 
+/*!
+ * This function handles our delete button being clicked by asking the user to
+ * confirm, and then requesting that the selected tracks (see
+ * getSelectedKeys()) be deleted from our collection.
+ */
+void CSCollectionInspector::doDelete()
+{ /* SLOT */
+
+	QStringList keys = getSelectedKeys();
+
+	if(keys.isEmpty())
+		return;
+
+	QMessageBox::StandardButton result = QMessageBox::question(this,
+		tr("Delete Tracks"), tr("Are you sure you want to delete %n "
+		"track(s) from this collection?", "", keys.count()),
+		QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+
+	if(result == QMessageBox::Yes)
+		Q_EMIT deleteRequested(collection, keys);
+
+}
+
 /*!
  * This function handles our sort configuration button being clicked by
  * displaying our configuration dialog.
@@ -369,10 +621,114 @@ void CSCollectionInspector::doCollectionContentsChanged()
 
 	/*
 	 * Because tracks have been added/removed/modified, we need to re-sort
-	 * the collection.
+	 * the collection. This is done on a worker thread, so large
+	 * collections don't block our GUI while they are sorted.
 	 */
 
-	collection->sort();
+	collection->sortInBackground();
+
+	// Widen any columns that need it, without dropping our cached widths.
+	resizeColumns(false);
+
+}
+
+/*!
+ * This function handles our collection publishing a new snapshot of its tracks
+ * by having our view adopt it. This is done here, rather than by the
+ * collection itself, because it has to happen on the GUI thread.
+ */
+void CSCollectionInspector::doCollectionSnapshotPublished()
+{ /* SLOT */
+
+	if(collection != NULL)
+	{
+		collection->adoptSnapshot();
+
+		if(filterModel->isFiltering())
+			filterModel->refreshQuery();
+	}
+
+}
+
+/*!
+ * This function handles the user switching between our views, by activating
+ * our tree model only while the tree view is being displayed.
+ *
+ * \param i The index of the newly displayed view (UNUSED).
+ */
+void CSCollectionInspector::doViewTabChanged(int UNUSED(i))
+{ /* SLOT */
+
+	updateBrowserActive();
+
+}
+
+/*!
+ * This function handles our tree model being about to rebuild its tree, by
+ * recording which of its nodes are expanded and selected in our tree view, so
+ * we can restore them afterwards (see doBrowserReset()).
+ */
+void CSCollectionInspector::doBrowserAboutToBeReset()
+{ /* SLOT */
+
+	expandedPaths.clear();
+	selectedPaths.clear();
+
+	for(int a = 0; a < treeModel->rowCount(); ++a)
+	{
+		QModelIndex artist = treeModel->index(a, 0);
+		if(!collectionBrowser->isExpanded(artist))
+			continue;
+
+		expandedPaths.append(treeModel->getPath(artist));
+
+		for(int b = 0; b < treeModel->rowCount(artist); ++b)
+		{
+			QModelIndex album = treeModel->index(b, 0, artist);
+
+			if(collectionBrowser->isExpanded(album))
+				expandedPaths.append(treeModel->getPath(album));
+		}
+	}
+
+	QModelIndexList nodes =
+		collectionBrowser->selectionModel()->selectedRows();
+
+	for(int i = 0; i < nodes.count(); ++i)
+		selectedPaths.append(treeModel->getPath(nodes.at(i)));
+
+}
+
+/*!
+ * This function handles our tree model having rebuilt its tree, by expanding
+ * and selecting the nodes which were expanded and selected before (see
+ * doBrowserAboutToBeReset()), as long as they still exist.
+ */
+void CSCollectionInspector::doBrowserReset()
+{ /* SLOT */
+
+	for(int i = 0; i < expandedPaths.count(); ++i)
+	{
+		QModelIndex node = treeModel->findIndex(expandedPaths.at(i));
+
+		if(node.isValid())
+			collectionBrowser->expand(node);
+	}
+
+	for(int i = 0; i < selectedPaths.count(); ++i)
+	{
+		QModelIndex node = treeModel->findIndex(selectedPaths.at(i));
+
+		if(node.isValid())
+		{
+			collectionBrowser->selectionModel()->select(node,
+				QItemSelectionModel::Select |
+				QItemSelectionModel::Rows);
+		}
+	}
+
+	expandedPaths.clear();
+	selectedPaths.clear();
 
 }
 
@@ -396,7 +752,7 @@ void CSCollectionInspector::doSettingChanged(
 		if(collection != NULL)
 		{
 			collection->setDisplayDescriptor(&displayDescriptor);
-			collectionViewer->resizeColumnsToContents();
+			resizeColumns();
 		}
 	}
 }
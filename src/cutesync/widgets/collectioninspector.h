@@ -20,12 +20,18 @@
 #define INCLUDE_CUTE_SYNC_WIDGETS_COLLECTION_INSPECTOR_H
 
 #include <QWidget>
+#include <QList>
+#include <QStringList>
+#include <QVector>
 
 #include "libcute/collections/abstractcollection.h"
 
 class QGridLayout;
+class QLineEdit;
 class QPushButton;
 class QTableView;
+class QTabWidget;
+class QTreeView;
 class QLabel;
 class QProgressBar;
 class QDialog;
@@ -33,6 +39,8 @@ class QDialog;
 class CSInspectorAboutDialog;
 class CSInspectorCollectionConfigDialog;
 class CSInspectorConfigDialog;
+class CSCollectionFilterModel;
+class CSCollectionTreeModel;
 class CSSettingsManager;
 
 /*!
@@ -47,6 +55,8 @@ class CSCollectionInspector : public QWidget
 	Q_OBJECT
 
 	public:
+		static const int ColumnSampleSize = 32;
+
 		CSCollectionInspector(CSSettingsManager *s,
 			QWidget *p = 0);
 		CSCollectionInspector(CSSettingsManager *s,
@@ -59,11 +69,15 @@ class CSCollectionInspector : public QWidget
 			getDisplayDescriptor() const;
 		CSAbstractCollection *getCollection() const;
 
+		QStringList getSelectedKeys() const;
+
 	public Q_SLOTS:
 		void setCollection(CSAbstractCollection *c);
 
 	protected:
 		virtual void timerEvent(QTimerEvent *e);
+		virtual void showEvent(QShowEvent *e);
+		virtual void hideEvent(QHideEvent *e);
 
 	private:
 		CSSettingsManager *settingsManager;
@@ -82,33 +96,56 @@ class CSCollectionInspector : public QWidget
 		QPushButton *aboutButton;
 		QPushButton *refreshButton;
 		QPushButton *configButton;
+		QPushButton *deleteButton;
+		QLineEdit *filterEdit;
 		QPushButton *sortButton;
 
+		QTabWidget *viewTabs;
+		CSCollectionFilterModel *filterModel;
 		QTableView *collectionViewer;
+		CSCollectionTreeModel *treeModel;
+		QTreeView *collectionBrowser;
+		QList<QStringList> expandedPaths;
+		QList<QStringList> selectedPaths;
 
 		QLabel *spaceUsedLabel;
 		QProgressBar *spaceUsedProgressBar;
 
+		QVector<int> columnWidths;
+
 		void createGUI();
 		void createDialogs();
 		void loadDisplayDescriptor();
 
+		void resizeColumns(bool r = true);
+		void sampleRows(int b, int e, int c, int *w) const;
+
+		void updateBrowserActive();
+
 	private Q_SLOTS:
 		void doSortAccepted();
 
 		void doAboutDevice();
 		void doRefresh();
 		void doConfig();
+		void doDelete();
 		void doSort();
 
 		void doCollectionEnabledChanged();
 		void doCollectionContentsChanged();
+		void doCollectionSnapshotPublished();
+
+		void doViewTabChanged(int i);
+		void doBrowserAboutToBeReset();
+		void doBrowserReset();
 
 		void doSettingChanged(const QString &k, const QVariant &v);
 
 	Q_SIGNALS:
 		void reloadRequested(CSAbstractCollection *);
 		void refreshRequested(CSAbstractCollection *);
+		void deleteRequested(CSAbstractCollection *,
+			const QStringList &);
 };
 
 #endif
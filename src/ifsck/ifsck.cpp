@@ -17,263 +17,223 @@
  */
 
 #include <iostream>
-#include <iomanip>
-#include <cstdlib>
-#include <cstdint>
+#include <string>
 
-#include <QDirIterator>
+#include <QCoreApplication>
+#include <QList>
 #include <QString>
-#include <QSet>
-#include <QDir>
+#include <QStringList>
 
-#include <taglib/fileref.h>
-#include <taglib/tag.h>
-#include <taglib/audioproperties.h>
+#include "libcute/ipod/ipodchecker.h"
+#include "libcute/ipod/itunesdbscanner.h"
 
-extern "C"
+/*
+ * Our exit codes: 0 means no problems were left, 1 means something failed, and
+ * 2 means problems were found but not (all) repaired.
+ */
+#define IFSCK_OK 0
+#define IFSCK_ERROR 1
+#define IFSCK_UNREPAIRED 2
+
+/*!
+ * This function prints our usage information.
+ */
+void printUsage()
 {
-	#include <glib.h>
-	#include <gpod-1.0/gpod/itdb.h>
+	std::cout << "Usage: ifsck [options] <iPod path>\n\n";
+	std::cout << "Options:\n";
+	std::cout << "\t--report            Only report problems (default).\n";
+	std::cout << "\t--delete-orphans    Repair the database, and delete " <<
+		"files which aren't in it.\n";
+	std::cout << "\t--reimport-orphans  Repair the database, and " <<
+		"re-import files which aren't in it.\n";
+	std::cout << "\t--delete-mismatched Repair the database, and " <<
+		"delete tracks whose files are\n\t                    the " <<
+		"wrong size (so they are copied again).\n";
+	std::cout << "\t--yes               Don't ask before repairing.\n";
 }
 
-int main(int argc, char *argv[])
+/*!
+ * This function prints a single section of our report.
+ *
+ * \param t The title of the section.
+ * \param l The lines of the section.
+ */
+void printSection(const char *t, const QStringList &l)
 {
-	// Check that we were given some command-line arguments.
+	std::cout << "\n\n" << t << "\n";
 
-	if(argc != 2)
+	if(l.isEmpty())
 	{
-		std::cout << "You must provide the path of an " <<
-			"existing iPod to check.\n";
-		return 1;
+		std::cout << "\tNONE! :-)\n";
+		return;
 	}
 
-	/*
-	 * Get an absolute mount point, because libgpod's get_mountpoint
-	 * function is made of failure.
-	 */
+	for(int i = 0; i < l.count(); ++i)
+		std::cout << "\t" << l.at(i).toUtf8().data() << "\n";
+}
 
-	QDir mp(QString::fromUtf8(argv[1]));
-	QString mountPoint = mp.absolutePath();
+/*!
+ * This function asks the user to confirm that repairs should be made.
+ *
+ * \return True if the user said yes, or false otherwise.
+ */
+bool confirm()
+{
+	std::string answer;
 
-	// Try loading the iTunes DB from the path given.
+	std::cout << "\nRepair these problems? [y/N] ";
+	std::getline(std::cin, answer);
 
-	GError *error = NULL;
-	Itdb_iTunesDB *itdb = NULL;
+	return ( (answer == "y") || (answer == "Y") ||
+		(answer == "yes") || (answer == "YES") );
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
 
-	itdb = itdb_parse(argv[1], &error);
+	// Parse our command-line arguments.
 
-	if( (error != NULL) || (itdb == NULL) )
+	bool deleteOrphans = false;
+	bool reimportOrphans = false;
+	bool deleteMismatched = false;
+	bool yes = false;
+	QString path;
+
+	QStringList args = app.arguments();
+	for(int i = 1; i < args.count(); ++i)
 	{
-		if(error != NULL)
+		const QString &a = args.at(i);
+
+		if(a == "--report")
 		{
-			std::cout << "Error while loading iPod from path: " <<
-				error->message << "\n";
-			g_error_free(error);
+			deleteOrphans = false;
+			reimportOrphans = false;
+			deleteMismatched = false;
 		}
-		else
+		else if(a == "--delete-orphans")
+			deleteOrphans = true;
+		else if(a == "--reimport-orphans")
+			reimportOrphans = true;
+		else if(a == "--delete-mismatched")
+			deleteMismatched = true;
+		else if(a == "--yes")
+			yes = true;
+		else if( (a == "--help") || (a == "-h") )
 		{
-			std::cout <<
-				"Unknown error while loading iPod from path.\n";
+			printUsage();
+			return IFSCK_OK;
 		}
-
-		if(itdb != NULL) itdb_free(itdb);
-		return 1;
+		else if(a.startsWith("--") || !path.isEmpty())
+		{
+			printUsage();
+			return IFSCK_ERROR;
+		}
+		else
+			path = a;
 	}
 
-	// Print out some device information.
-
-	const Itdb_IpodInfo *itdbInfo = itdb_device_get_ipod_info(itdb->device);
-
-	std::cout << "Successfully loaded iPod at " <<
-		mountPoint.toLatin1().data() << "\n";
-	std::cout << "\tModel Number:  " << itdbInfo->model_number << "\n";
-	std::cout << "\tGeneration:    " <<
-		itdb_info_get_ipod_generation_string(
-		itdbInfo->ipod_generation) << "\n";
-	std::cout << "\tCapacity:      " << itdbInfo->capacity <<
-		" GiB" << "\n";
-	std::cout << "\tArtwork?       " << std::boolalpha <<
-		(bool) itdb_device_supports_artwork(itdb->device) << "\n";
-	std::cout << "\tChapter Image? " << std::boolalpha <<
-		(bool) itdb_device_supports_chapter_image(itdb->device) << "\n";
-	std::cout << "\tPhotos?        " << std::boolalpha <<
-		(bool) itdb_device_supports_photo(itdb->device) << "\n";
-	std::cout << "\tPodcasts?      " << std::boolalpha <<
-		(bool) itdb_device_supports_podcast(itdb->device) << "\n";
-	std::cout << "\tVideos?        " << std::boolalpha <<
-		(bool) itdb_device_supports_video(itdb->device) << "\n";
-
-	// First thing's first: build a list of files on the iPod.
-
-	QSet<QString> ipodFiles;
-	mp.cd("iPod_Control");
-	mp.cd("Music");
-	QDirIterator walker(mp.absolutePath(), QDir::Files | QDir::NoSymLinks,
-		QDirIterator::Subdirectories);
-
-	while(walker.hasNext())
+	if(path.isEmpty())
 	{
-		walker.next();
-
-		ipodFiles.insert(
-			QDir::cleanPath(walker.fileInfo()
-				.absoluteFilePath()).replace(mountPoint, "")
-				.replace(QDir::separator(), ":")
-		);
+		std::cout << "You must provide the path of an " <<
+			"existing iPod to check.\n";
+		return IFSCK_ERROR;
 	}
 
-	// Next! Build a list of files from the iTunes DB.
-
-	QSet<QString> ipodDBFiles;
-	GList *trackList = g_list_first(itdb->tracks);
-	while(trackList != NULL)
+	if(deleteOrphans && reimportOrphans)
 	{
-		Itdb_Track *t = static_cast<Itdb_Track *>(trackList->data);
-		trackList = trackList->next;
-		ipodDBFiles.insert(QString::fromUtf8(t->ipod_path));
+		std::cout << "Orphaned files can either be deleted or " <<
+			"re-imported, but not both.\n";
+		return IFSCK_ERROR;
 	}
 
-	/*
-	 * Now, to start checking things: find any files that are on the
-	 * device, but not in the database.
-	 */
-
-	std::cout << "\n\nChecking for orphaned files...\n";
-
-	QSet<QString> difference = ipodFiles;
-	difference -= ipodDBFiles;
+	// Scan the iPod.
 
-	if(difference.count() > 0)
-	{
-		QSetIterator<QString> ofIter(difference);
+	CSIPodChecker checker(path);
 
-		while(ofIter.hasNext())
-		{
-			std::cout << "\t" << ofIter.next()
-				.toUtf8().data() << "\n";
-		}
-	}
-	else
+	if(!checker.scan())
 	{
-		std::cout << "\tNONE! :-)\n";
+		std::cout << "Error while loading iPod from path: " <<
+			"unable to read iTunes DB.\n";
+		return IFSCK_ERROR;
 	}
 
-#pragma message "TODO - Delete these files"
-
-	/*
-	 * Next, check the reverse: things that are in the database, but are
-	 * not present on the device.
-	 */
-
-	std::cout << "\n\nChecking for orphaned database entries...\n";
+	std::cout << "Successfully scanned iPod at " <<
+		checker.getMountPoint().toUtf8().data() << "\n";
+	std::cout << "\tTracks: " << checker.getTrackCount() << "\n";
+	std::cout << "\tFiles:  " << checker.getFileCount() << "\n";
 
-	difference = ipodDBFiles;
-	difference -= ipodFiles;
+	// Report what we found.
 
-	if(difference.count() > 0)
-	{
-		QSetIterator<QString> odIter(difference);
-		while(odIter.hasNext())
-		{
-			std::cout << "\t" << odIter.next()
-				.toUtf8().data() << "\n";
-		}
-	}
-	else
-	{
-		std::cout << "\tNONE! :-)\n";
-	}
+	QStringList lines;
 
-#pragma message "TODO - Prompt the user for repairs instead of proceeding automatically"
+	QList<CSIPodChecker::File> files = checker.getOrphanedFiles();
+	for(int i = 0; i < files.count(); ++i)
+		lines.append(files.at(i).path);
+	printSection("Orphaned files:", lines);
 
-	// Remove these orphaned database entries from the database.
+	lines.clear();
+	QList<CSITunesDBScanner::Track> tracks = checker.getOrphanedEntries();
+	for(int i = 0; i < tracks.count(); ++i)
+		lines.append(tracks.at(i).path);
+	printSection("Orphaned database entries:", lines);
 
-	trackList = g_list_first(itdb->tracks);
-	while(trackList != NULL)
+	lines.clear();
+	tracks = checker.getSizeMismatches();
+	for(int i = 0; i < tracks.count(); ++i)
 	{
-		Itdb_Track *t = static_cast<Itdb_Track *>(trackList->data);
-		trackList = trackList->next;
-
-		// Search for tracks that need to be removed from the database.
-
-		if(difference.contains(QString::fromUtf8(t->ipod_path)))
-		{
-			// Remove the track's thumbnails, if any.
+		lines.append(QString("%1 (database: %2, disk: %3)")
+			.arg(tracks.at(i).path).arg(tracks.at(i).size)
+			.arg(checker.getFileSize(tracks.at(i).path)));
+	}
+	printSection("Size mismatches:", lines);
 
-			itdb_track_remove_thumbnails(t);
+	lines.clear();
+	tracks = checker.getMissingFromMPL();
+	for(int i = 0; i < tracks.count(); ++i)
+		lines.append(tracks.at(i).path);
+	printSection("Tracks missing from the MPL:", lines);
 
-			// Remove the track from any playlists it is a part of.
+	if(!checker.hasProblems())
+		return IFSCK_OK;
 
-			GList *playlistList = g_list_first(itdb->playlists);
-			while(playlistList != NULL)
-			{
-				itdb_playlist_remove_track(
-					static_cast<Itdb_Playlist *>(
-					playlistList->data), t);
+	// Stop here, unless we were asked to make repairs.
 
-				playlistList = playlistList->next;
-			}
+	if(!deleteOrphans && !reimportOrphans && !deleteMismatched)
+		return IFSCK_UNREPAIRED;
 
-			// Remove the track from the database.
+	if(!yes && !confirm())
+		return IFSCK_UNREPAIRED;
 
-			itdb_track_remove(t);
-		}
+	if(deleteOrphans)
+	{
+		int deleted = checker.deleteOrphanedFiles();
+		std::cout << "\nDeleted " << deleted << " orphaned file(s).\n";
 	}
 
-	/*
-	 * Next, we want to see if there are any tracks in the iTunes DB that
-	 * are not in the MPL.
-	 */
-
-#pragma message "TODO - This should only check for tracks that SHOULD be in the MPL ie not podcasts"
-
-	std::cout << "\n\nChecking for MPL inconsistencies...\n";
-	uint64_t mplc;
-
-	trackList = g_list_first(itdb->tracks);
-	mplc = 0;
-	while(trackList != NULL)
+	if(deleteMismatched)
 	{
-		if(!itdb_playlist_contains_track(itdb_playlist_mpl(itdb),
-			static_cast<Itdb_Track *>(trackList->data)))
-		{
-			std::cout << "\t" << static_cast<Itdb_Track *>(
-				trackList->data)->ipod_path << "\n";
-
-			++mplc;
-		}
-
-		trackList = trackList->next;
+		int deleted = checker.deleteSizeMismatches();
+		std::cout << "\nDeleted " << deleted << " track(s) with " <<
+			"mismatched sizes.\n";
 	}
 
-	if(mplc == 0)
-		std::cout << "\tNONE! :-)\n";
-
-#pragma message "TODO - Add these track to the MPL"
-
-	// Save the iTunes DB to the device.
-
-	if(!itdb_write(itdb, &error))
+	if(reimportOrphans)
 	{
-		if(error != NULL)
-		{
-			std::cout << "Error writing iTunes DB: " <<
-				error->message << "\n";
-
-			g_error_free(error);
-			error = NULL;
-			return 1;
-		}
-		else
-		{
-			std::cout << "Unknown error writing iTunes DB.\n";
+		std::cout << "\nRe-importing " <<
+			checker.getOrphanedFiles().count() <<
+			" orphaned file(s)...\n";
+	}
 
-			return 1;
-		}
+	int changes = 0;
+	if(!checker.repairDatabase(reimportOrphans, &changes))
+	{
+		std::cout << "Error while repairing iTunes DB.\n";
+		return IFSCK_ERROR;
 	}
 
-	// Clean up & exit.
+	std::cout << "Made " << changes << " change(s) to the iTunes DB.\n";
 
-	itdb_free(itdb);
-	return 0;
+	return checker.hasProblems() ? IFSCK_UNREPAIRED : IFSCK_OK;
 }
@@ -21,11 +21,17 @@
 #include <QDataStream>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QSet>
+#include <QThreadPool>
 
 #include "libcute/defines.h"
 #include "libcute/collections/abstractcollectionconfigwidget.h"
+#include "libcute/collections/collectionsorter.h"
 #include "libcute/collections/generalcollectionconfigwidget.h"
 #include "libcute/collections/track.h"
+#include "libcute/collections/trackindex.h"
+#include "libcute/thread/collectionjob.h"
+#include "libcute/thread/pausablethread.h"
 #include "libcute/widgets/collectionmodel.h"
 
 /*!
@@ -37,10 +43,29 @@
 CSAbstractCollection::CSAbstractCollection(
 	CSCollectionModel *p)
 	: QAbstractTableModel(p), name(""), modified(false), enabled(true),
-		interruptible(true), interrupted(false), saveOnExit(false),
-		displayDescriptor(NULL)
+		interruptible(true), interrupted(0), jobRunning(0),
+		progressMinimum(0), progressMaximum(0), progressValue(0),
+		attached(1), validating(0), validationPending(0),
+		sortGeneration(0), saveOnExit(false), displayDescriptor(NULL),
+		unpublishedChanges(0)
 {
 	interruptibleMutex = new QMutex(QMutex::NonRecursive);
+	jobMutex = new QMutex(QMutex::Recursive);
+	trackMutex = new QMutex(QMutex::Recursive);
+	instrumentation = new CSJobInstrumentation();
+	trackIndex = new CSTrackIndex();
+
+	displayCache.setMaxCost(DisplayCacheSize);
+	updateDisplayColumns();
+
+	publishedSnapshot = std::shared_ptr<const TrackSnapshot>(
+		new TrackSnapshot());
+	displayedSnapshot = publishedSnapshot;
+	publishTimer.start();
+
+	catalogHeader.trackCount = -1;
+	catalogHeader.totalSize = -1;
+	catalogHeader.totalLength = -1;
 
 	QObject::connect(this, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
@@ -58,10 +83,29 @@ CSAbstractCollection::CSAbstractCollection(
 CSAbstractCollection::CSAbstractCollection(const QString &n,
 	CSCollectionModel *p)
 	: QAbstractTableModel(p), name(n), modified(false), enabled(true),
-		interruptible(true), interrupted(false), saveOnExit(false),
-		displayDescriptor(NULL)
+		interruptible(true), interrupted(0), jobRunning(0),
+		progressMinimum(0), progressMaximum(0), progressValue(0),
+		attached(1), validating(0), validationPending(0),
+		sortGeneration(0), saveOnExit(false), displayDescriptor(NULL),
+		unpublishedChanges(0)
 {
 	interruptibleMutex = new QMutex(QMutex::NonRecursive);
+	jobMutex = new QMutex(QMutex::Recursive);
+	trackMutex = new QMutex(QMutex::Recursive);
+	instrumentation = new CSJobInstrumentation();
+	trackIndex = new CSTrackIndex();
+
+	displayCache.setMaxCost(DisplayCacheSize);
+	updateDisplayColumns();
+
+	publishedSnapshot = std::shared_ptr<const TrackSnapshot>(
+		new TrackSnapshot());
+	displayedSnapshot = publishedSnapshot;
+	publishTimer.start();
+
+	catalogHeader.trackCount = -1;
+	catalogHeader.totalSize = -1;
+	catalogHeader.totalLength = -1;
 
 	QObject::connect(this, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
@@ -79,10 +123,29 @@ CSAbstractCollection::CSAbstractCollection(const QString &n,
 CSAbstractCollection::CSAbstractCollection(
 	const DisplayDescriptor *d, CSCollectionModel *p)
 	: QAbstractTableModel(p), name(""), modified(false), enabled(true),
-		interruptible(true), interrupted(false), saveOnExit(false),
-		displayDescriptor(d)
+		interruptible(true), interrupted(0), jobRunning(0),
+		progressMinimum(0), progressMaximum(0), progressValue(0),
+		attached(1), validating(0), validationPending(0),
+		sortGeneration(0), saveOnExit(false), displayDescriptor(d),
+		unpublishedChanges(0)
 {
 	interruptibleMutex = new QMutex(QMutex::NonRecursive);
+	jobMutex = new QMutex(QMutex::Recursive);
+	trackMutex = new QMutex(QMutex::Recursive);
+	instrumentation = new CSJobInstrumentation();
+	trackIndex = new CSTrackIndex();
+
+	displayCache.setMaxCost(DisplayCacheSize);
+	updateDisplayColumns();
+
+	publishedSnapshot = std::shared_ptr<const TrackSnapshot>(
+		new TrackSnapshot());
+	displayedSnapshot = publishedSnapshot;
+	publishTimer.start();
+
+	catalogHeader.trackCount = -1;
+	catalogHeader.totalSize = -1;
+	catalogHeader.totalLength = -1;
 
 	QObject::connect(this, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
@@ -101,9 +164,29 @@ CSAbstractCollection::CSAbstractCollection(
 CSAbstractCollection::CSAbstractCollection(const QString &n,
 	const DisplayDescriptor *d, CSCollectionModel *p)
 	: QAbstractTableModel(p), name(n), modified(false), enabled(true),
-		interrupted(false), saveOnExit(false), displayDescriptor(d)
+		interruptible(true), interrupted(0), jobRunning(0),
+		progressMinimum(0), progressMaximum(0), progressValue(0),
+		attached(1), validating(0), validationPending(0),
+		sortGeneration(0), saveOnExit(false), displayDescriptor(d),
+		unpublishedChanges(0)
 {
 	interruptibleMutex = new QMutex(QMutex::NonRecursive);
+	jobMutex = new QMutex(QMutex::Recursive);
+	trackMutex = new QMutex(QMutex::Recursive);
+	instrumentation = new CSJobInstrumentation();
+	trackIndex = new CSTrackIndex();
+
+	displayCache.setMaxCost(DisplayCacheSize);
+	updateDisplayColumns();
+
+	publishedSnapshot = std::shared_ptr<const TrackSnapshot>(
+		new TrackSnapshot());
+	displayedSnapshot = publishedSnapshot;
+	publishTimer.start();
+
+	catalogHeader.trackCount = -1;
+	catalogHeader.totalSize = -1;
+	catalogHeader.totalLength = -1;
 
 	QObject::connect(this, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
@@ -112,11 +195,15 @@ CSAbstractCollection::CSAbstractCollection(const QString &n,
 }
 
 /*!
- * This is a placeholder destructor, so we can properly subclass
- * QAbstractTableModel.
+ * This is our default destructor, which cleans up & destroys our object.
  */
 CSAbstractCollection::~CSAbstractCollection()
 {
+	delete trackIndex;
+	delete instrumentation;
+	delete trackMutex;
+	delete jobMutex;
+	delete interruptibleMutex;
 }
 
 /*!
@@ -162,29 +249,54 @@ CSAbstractCollectionConfigWidget *
  */
 QVariant CSAbstractCollection::getDisplayData(int r, int c) const
 {
-	if(displayDescriptor == NULL)
+	if( (c < 0) || (c >= displayColumns.count()) )
 		return QVariant(QVariant::Invalid);
 
-	if(!displayDescriptor->columns.contains(c))
+	if( (r < 0) || (r >= displayedSnapshot->rows.count()) )
 		return QVariant(QVariant::Invalid);
 
-	CSAbstractCollection::Column col =
-		displayDescriptor->columns.value(c);
-	QVariant d = getSortData(r, col);
+	/*
+	 * Formatting a row's cells is comparatively expensive, and views ask
+	 * for the same rows over and over again while scrolling, so we keep
+	 * the formatted cells of recently displayed rows around.
+	 */
+
+	QVector<QVariant> *cells = displayCache.object(r);
 
-	switch(col)
+	if(cells == NULL)
 	{
-		// Convert the length to an hh:mm:ss format.
-		case CSAbstractCollection::Length:
-			d = QVariant(CSTrack::getLengthDisplay(
-				d.value<int>()));
-			break;
+		const CSTrack *track = displayedSnapshot->rows.at(r).get();
+		cells = new QVector<QVariant>(displayColumns.count());
 
-		default:
-			break;
-	};
+		for(int i = 0; i < displayColumns.count(); ++i)
+		{
+			if(displayColumns.at(i) < 0)
+				continue;
 
-	return d;
+			Column col = static_cast<Column>(displayColumns.at(i));
+			QVariant d = track->getColumn(col);
+
+			switch(col)
+			{
+				// Convert the length to an hh:mm:ss format.
+				case CSAbstractCollection::Length:
+					d = QVariant(CSTrack::getLengthDisplay(
+						d.value<int>()));
+					break;
+
+				default:
+					break;
+			};
+
+			(*cells)[i] = d;
+		}
+
+		QVariant d = cells->at(c);
+		displayCache.insert(r, cells);
+		return d;
+	}
+
+	return cells->at(c);
 }
 
 /*!
@@ -200,9 +312,11 @@ QVariant CSAbstractCollection::getSortData(int r,
 	CSAbstractCollection::Column c) const
 {
 	if(displayDescriptor == NULL) return QVariant(QVariant::Invalid);
-	if( (r < 0) || (r >= count()) ) return QVariant(QVariant::Invalid);
 
-	return trackSort.at(r)->getColumn(c);
+	if( (r < 0) || (r >= displayedSnapshot->rows.count()) )
+		return QVariant(QVariant::Invalid);
+
+	return displayedSnapshot->rows.at(r)->getColumn(c);
 }
 
 /*!
@@ -218,9 +332,16 @@ void CSAbstractCollection::clear(bool f)
 {
 	if(f) flush();
 
-	trackHash.clear();
-	while(!trackSort.isEmpty())
-		delete trackSort.takeLast();
+	{
+		QMutexLocker locker(trackMutex);
+
+		trackHash.clear();
+		trackSort.clear();
+		removedTracks.clear();
+		trackIndex->clear();
+	}
+
+	publishSnapshot();
 
 	modified = false;
 }
@@ -270,12 +391,153 @@ bool CSAbstractCollection::isEnabled() const
  * probably call this in subclasses in functions that are starting some big
  * action, e.g., synchronizing.
  *
+ * Note that this must be called on our own thread; from any other thread, use
+ * a queued QMetaObject::invokeMethod() instead.
+ *
  * \param e Our new enabled state (true means enabled, false means disabled).
  */
 void CSAbstractCollection::setEnabled(bool e)
-{
+{ /* SLOT */
+
 	enabled = e;
 	Q_EMIT enabledChanged();
+
+}
+
+/*!
+ * This function tests whether or not our collection's tracks have been loaded.
+ * Collections restored from our catalog start out detached: they know their
+ * name, path and summary statistics (see getCatalogHeader()), but their tracks
+ * aren't loaded until attach() is called. All other collections are always
+ * attached.
+ *
+ * \return True if our tracks are loaded, or false otherwise.
+ */
+bool CSAbstractCollection::isAttached() const
+{
+	return (attached.loadAcquire() != 0);
+}
+
+/*!
+ * This function returns the catalog header this collection was restored from.
+ * For collections which weren't restored from a catalog, the header's fields
+ * are empty.
+ *
+ * \return The header we were restored from.
+ */
+CSCollectionCatalog::Header CSAbstractCollection::getCatalogHeader() const
+{
+	return catalogHeader;
+}
+
+/*!
+ * This function marks our collection as detached, so that its tracks will be
+ * loaded from the given catalog file the first time attach() is called. This
+ * should be called right after the collection is created, before it is handed
+ * to any other thread.
+ *
+ * \param f The path to the catalog file to load our tracks from.
+ * \param h The header of that catalog file.
+ */
+void CSAbstractCollection::detach(const QString &f,
+	const CSCollectionCatalog::Header &h)
+{
+	catalogEntry = f;
+	catalogHeader = h;
+
+	attached.storeRelease(0);
+}
+
+/*!
+ * This function loads our tracks from the catalog file we were restored from,
+ * if we are detached (see detach()). If the catalog data can't be read, then
+ * we load the collection from its path instead. If we are already attached,
+ * then nothing happens. This should be called from our own thread, as part of
+ * a job.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSAbstractCollection::attach()
+{
+	if(isAttached())
+		return true;
+
+	attached.storeRelease(1);
+
+	QByteArray d = CSCollectionCatalog::readPayload(catalogEntry);
+
+	if(d.isEmpty())
+		return loadCollectionFromPath(catalogHeader.path);
+
+	unserialize(d);
+	return true;
+}
+
+/*!
+ * This function tests whether or not our collection is currently being
+ * validated (see validate()). While this is the case, our contents were loaded
+ * from cached data and may be out of date.
+ *
+ * \return True if we are being validated, or false otherwise.
+ */
+bool CSAbstractCollection::isValidating() const
+{
+	return (validating.loadAcquire() != 0);
+}
+
+/*!
+ * This function tests whether or not our contents were loaded from cached data
+ * which hasn't been validated yet (see validate()).
+ *
+ * \return True if we need to be validated, or false otherwise.
+ */
+bool CSAbstractCollection::isValidationPending() const
+{
+	return (validationPending.loadAcquire() != 0);
+}
+
+/*!
+ * This function returns our most recently published track snapshot. This is
+ * safe to call from any thread, and never blocks on jobs which are modifying
+ * our collection; the snapshot may, however, lag slightly behind the tracks
+ * we actually contain (see publishSnapshot()).
+ *
+ * \return Our current track snapshot.
+ */
+std::shared_ptr<const CSAbstractCollection::TrackSnapshot>
+	CSAbstractCollection::getSnapshot() const
+{
+	return std::atomic_load(&publishedSnapshot);
+}
+
+/*!
+ * This function publishes the current state of our track table as a new
+ * immutable snapshot, replacing our previous one. The table itself is
+ * implicitly shared with the snapshot, so this is cheap; the next change to
+ * the table copies it instead.
+ *
+ * This is done automatically while our table is being modified, at most once
+ * per publish interval (see noteTrackChange()), and whenever a job finishes.
+ * Once it is done, we emit snapshotPublished(), so views can adopt the new
+ * snapshot (see adoptSnapshot()).
+ */
+void CSAbstractCollection::publishSnapshot()
+{
+	{
+		QMutexLocker locker(trackMutex);
+		compactTracks();
+
+		TrackSnapshot *snapshot = new TrackSnapshot();
+		snapshot->rows = trackSort;
+		snapshot->tracks = trackHash;
+
+		std::atomic_store(&publishedSnapshot,
+			std::shared_ptr<const TrackSnapshot>(snapshot));
+		unpublishedChanges = 0;
+		publishTimer.restart();
+	}
+
+	Q_EMIT snapshotPublished();
 }
 
 /*!
@@ -294,11 +556,162 @@ bool CSAbstractCollection::isSavedOnExit() const
 /*!
  * This function sorts our collection according to our display descriptor. If
  * no display descriptor has been set, then no action is taken.
+ *
+ * Note that this sorts synchronously, on the calling thread; for large
+ * collections being displayed, prefer sortInBackground().
  */
-void CSAbstractCollection::sort() const
+void CSAbstractCollection::sort()
 {
 	if(displayDescriptor == NULL) return;
-	quicksort(0, count() - 1);
+
+	// Supersede any background sorts which are still running.
+	CSCollectionSorter *sorter = createSorter(
+		sortGeneration.fetchAndAddOrdered(1) + 1);
+
+	applySort(sorter->sortKeys());
+
+	delete sorter;
+}
+
+/*!
+ * This slot sorts our collection according to our display descriptor, like
+ * sort() does, except that the sort itself is performed on a worker thread
+ * against a snapshot of our tracks. Once it is done, the new order is swapped
+ * in on our own thread, with a single layout change.
+ *
+ * If this is called again before an earlier sort has finished, the earlier
+ * sort's result is simply discarded.
+ */
+void CSAbstractCollection::sortInBackground()
+{ /* SLOT */
+
+	if(displayDescriptor == NULL)
+		return;
+
+	CSCollectionSorter *sorter = createSorter(
+		sortGeneration.fetchAndAddOrdered(1) + 1);
+
+	QObject::connect(sorter, SIGNAL(finished(int, const QStringList &)),
+		this, SLOT(doSortFinished(int, const QStringList &)),
+		Qt::QueuedConnection);
+
+	QThreadPool::globalInstance()->start(sorter);
+
+}
+
+/*!
+ * This slot switches the data our model presents to our most recently
+ * published snapshot. Our model functions (e.g. rowCount() and data()) only
+ * ever read the snapshot we have adopted, so this MUST be called on the thread
+ * our views live on; typically in response to our snapshotPublished() signal.
+ *
+ * While a collection is being loaded, each new snapshot usually just appends
+ * tracks to the one before it; in that case we report the new rows as having
+ * been inserted, so views (and proxy models) don't need to re-map the rows
+ * they already have. Otherwise, we switch snapshots with a single layout
+ * change.
+ */
+void CSAbstractCollection::adoptSnapshot()
+{ /* SLOT */
+
+	std::shared_ptr<const TrackSnapshot> next = getSnapshot();
+	std::shared_ptr<const TrackSnapshot> previous = displayedSnapshot;
+
+	if(next == previous)
+		return;
+
+	const QList<std::shared_ptr<CSTrack> > &oldRows = previous->rows;
+	const QList<std::shared_ptr<CSTrack> > &newRows = next->rows;
+
+	bool appended = (newRows.count() >= oldRows.count());
+	for(int i = 0; appended && (i < oldRows.count()); ++i)
+		appended = (newRows.at(i) == oldRows.at(i));
+
+	if(appended)
+	{
+		if(newRows.count() == oldRows.count())
+		{
+			displayedSnapshot = next;
+			return;
+		}
+
+		beginInsertRows(QModelIndex(), oldRows.count(),
+			newRows.count() - 1);
+		displayedSnapshot = next;
+		endInsertRows();
+
+		return;
+	}
+
+	Q_EMIT layoutAboutToBeChanged();
+
+	// Remember which track each persistent index was pointing at.
+
+	QModelIndexList from = persistentIndexList();
+	QList<CSTrack *> tracks;
+
+	for(int i = 0; i < from.count(); ++i)
+	{
+		int row = from.at(i).row();
+
+		tracks.append(((row >= 0) && (row < oldRows.count())) ?
+			oldRows.at(row).get() : NULL);
+	}
+
+	displayedSnapshot = next;
+	displayCache.clear();
+
+	/*
+	 * Point each persistent index at its track's new row. Only the tracks
+	 * which have actually moved are hashed, so this is a single pass over
+	 * the new snapshot, no matter how large it is.
+	 */
+
+	if(!from.isEmpty())
+	{
+		QHash<CSTrack *, int> moved;
+
+		for(int i = 0; i < from.count(); ++i)
+		{
+			int row = from.at(i).row();
+
+			if( (tracks.at(i) != NULL) &&
+				( (row >= newRows.count()) ||
+				(newRows.at(row).get() != tracks.at(i)) ) )
+			{
+				moved.insert(tracks.at(i), -1);
+			}
+		}
+
+		for(int i = 0; !moved.isEmpty() && (i < newRows.count()); ++i)
+		{
+			QHash<CSTrack *, int>::iterator it =
+				moved.find(newRows.at(i).get());
+
+			if(it != moved.end())
+				it.value() = i;
+		}
+
+		QModelIndexList to;
+
+		for(int i = 0; i < from.count(); ++i)
+		{
+			int row = from.at(i).row();
+
+			if(tracks.at(i) == NULL)
+				row = -1;
+			else if(moved.contains(tracks.at(i)))
+				row = moved.value(tracks.at(i));
+
+			to.append((row >= 0) ? index(row,
+				from.at(i).column()) : QModelIndex());
+		}
+
+		changePersistentIndexList(from, to);
+	}
+
+	Q_EMIT layoutChanged();
+
 }
 
 /*!
@@ -325,6 +738,23 @@ bool CSAbstractCollection::refresh()
 	return reload();
 }
 
+/*!
+ * This function validates our collection's contents against the disk, if a
+ * validation is pending (see setValidationPending()). Collections which are
+ * loaded from cached data should override this to check that data, applying
+ * any corrections incrementally, so the collection stays usable while it is
+ * being validated. Implementations should call setValidating() while they
+ * run. By default, there is nothing to validate, so we just clear the
+ * pending validation.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSAbstractCollection::validate()
+{
+	setValidationPending(false);
+	return true;
+}
+
 /*!
  * This function sets whether or not our collection should be saved on exit.
  *
@@ -351,23 +781,25 @@ bool CSAbstractCollection::deleteTracks(const QStringList &k)
 	QString r, t;
 
 	Q_EMIT jobStarted(tr("Deleting tracks..."), false);
-	Q_EMIT progressLimitsUpdated(0, k.count());
+	setProgressLimits(0, k.count());
 
 	for(int p = 0; p < k.count(); ++p)
 	{
-		if(interrupted)
+		if(!checkpoint())
 		{
 			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
+		instrumentation->beginPhase("delete");
 		if(!quietDeleteTrack(k.at(p)))
 		{
 			r.append(QString("Failed to delete: %1\n")
 				.arg(k.at(p)));
 		}
+		instrumentation->endPhase("delete");
 
-		Q_EMIT progressUpdated(p+1);
+		setProgress(p+1);
 	}
 
 	Q_EMIT jobFinished(r);
@@ -390,20 +822,22 @@ bool CSAbstractCollection::copyTracks(
 	QString r, t;
 
 	Q_EMIT jobStarted(tr("Copying tracks..."), false);
-	Q_EMIT progressLimitsUpdated(0, k.count());
+	setProgressLimits(0, k.count());
 
 	for(int p = 0; p < k.count(); ++p)
 	{
-		if(interrupted)
+		if(!checkpoint())
 		{
 			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
+		instrumentation->beginPhase("copy");
 		if(!quietCopyTrack(s, k.at(p)))
 			r.append(QString("Failed to copy: %1\n").arg(k.at(p)));
+		instrumentation->endPhase("copy");
 
-		Q_EMIT progressUpdated(p+1);
+		setProgress(p+1);
 	}
 
 	Q_EMIT jobFinished(r);
@@ -424,57 +858,96 @@ bool CSAbstractCollection::syncFrom(CSAbstractCollection *o)
 { /* SLOT */
 	QString r, t;
 
+	/*
+	 * The source collection may live on another worker thread, so its
+	 * enabled state must be changed on its own thread.
+	 */
+
+	auto setSourceEnabled = [o](bool e)
+	{
+		QMetaObject::invokeMethod(o, "setEnabled",
+			Qt::QueuedConnection, Q_ARG(bool, e));
+	};
+
 	Q_EMIT jobStarted(tr("Synchronizing collections..."), false);
-	o->setEnabled(false);
+	setSourceEnabled(false);
 
+	instrumentation->beginPhase("diff");
 	QList<QString> del = keysDifference(o), cp = o->keysDifference(this);
+	instrumentation->endPhase("diff");
 
-	Q_EMIT progressLimitsUpdated(0, del.count() + cp.count());
+	setProgressLimits(0, del.count() + cp.count());
 	int p = 0;
 
 	// Delete stuff first.
 	while(!del.isEmpty())
 	{
-		if(interrupted)
+		if(!checkpoint())
 		{
 			flush();
-			o->setEnabled(true);
+			setSourceEnabled(true);
 			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
 		t = del.takeLast();
+		instrumentation->beginPhase("delete");
 		if(!quietDeleteTrack(t))
 			r.append(QString("Failed to delete: %1\n").arg(t));
+		instrumentation->endPhase("delete");
 
-		Q_EMIT progressUpdated(++p);
+		setProgress(++p);
 	}
 
 	// Now copy new stuff.
 	while(!cp.isEmpty())
 	{
-		if(interrupted)
+		if(!checkpoint())
 		{
 			flush();
-			o->setEnabled(true);
+			setSourceEnabled(true);
 			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
 		t = cp.takeLast();
+		instrumentation->beginPhase("copy");
 		if(!quietCopyTrack(o, t))
 			r.append(QString("Failed to copy: %1\n").arg(t));
+		instrumentation->endPhase("copy");
 
-		Q_EMIT progressUpdated(++p);
+		setProgress(++p);
 	}
 
 	flush();
 
-	o->setEnabled(true);
+	setSourceEnabled(true);
 	Q_EMIT jobFinished(r);
 	return r.isEmpty();
 }
 
+/*!
+ * This function returns the progress of our current job, if we are running
+ * one. This may safely be called from any thread (the values are stored
+ * atomically), and is intended to be polled periodically by the GUI.
+ *
+ * \param d This will be set to the number of items processed so far.
+ * \param t This will be set to the total number of items to process.
+ * \return True if we are currently running a job, or false otherwise.
+ */
+bool CSAbstractCollection::getProgress(int *d, int *t) const
+{
+	int min = progressMinimum.loadAcquire();
+
+	if(d != NULL)
+		*d = progressValue.loadAcquire() - min;
+
+	if(t != NULL)
+		*t = progressMaximum.loadAcquire() - min;
+
+	return (jobRunning.loadAcquire() != 0);
+}
+
 /*!
  * This function tests whether or not our collection contains a track with the
  * given key.
@@ -484,6 +957,7 @@ bool CSAbstractCollection::syncFrom(CSAbstractCollection *o)
  */
 bool CSAbstractCollection::containsKey(const QString &k) const
 {
+	QMutexLocker locker(trackMutex);
 	return trackHash.contains(k);
 }
 
@@ -494,6 +968,7 @@ bool CSAbstractCollection::containsKey(const QString &k) const
  */
 int CSAbstractCollection::count() const
 {
+	QMutexLocker locker(trackMutex);
 	return trackHash.count();
 }
 
@@ -505,9 +980,49 @@ int CSAbstractCollection::count() const
  */
 bool CSAbstractCollection::isEmpty() const
 {
+	QMutexLocker locker(trackMutex);
 	return trackHash.isEmpty();
 }
 
+/*!
+ * This function returns the total size of all of the tracks in our collection.
+ *
+ * \return The total size of our tracks, in bytes.
+ */
+int64_t CSAbstractCollection::getTotalSize() const
+{
+	QMutexLocker locker(trackMutex);
+	int64_t r = 0;
+
+	for(QHash<QString, std::shared_ptr<CSTrack> >::const_iterator it =
+		trackHash.begin(); it != trackHash.end(); ++it)
+	{
+		r += it.value()->getSize();
+	}
+
+	return r;
+}
+
+/*!
+ * This function returns the total length of all of the tracks in our
+ * collection.
+ *
+ * \return The total length of our tracks, in seconds.
+ */
+int64_t CSAbstractCollection::getTotalLength() const
+{
+	QMutexLocker locker(trackMutex);
+	int64_t r = 0;
+
+	for(QHash<QString, std::shared_ptr<CSTrack> >::const_iterator it =
+		trackHash.begin(); it != trackHash.end(); ++it)
+	{
+		r += it.value()->getLength();
+	}
+
+	return r;
+}
+
 /*!
  * This function returns a QList containing all of the keys present in our
  * collection.
@@ -516,28 +1031,93 @@ bool CSAbstractCollection::isEmpty() const
  */
 QList<QString> CSAbstractCollection::getKeysList() const
 {
+	QMutexLocker locker(trackMutex);
 	return trackHash.keys();
 }
 
+/*!
+ * This function returns the key of the track displayed at the given row of our
+ * model. Like our other model functions, this reads the snapshot our views
+ * have adopted (see adoptSnapshot()), so it should only be called on their
+ * thread.
+ *
+ * \param r The row of the desired track.
+ * \return The track's key, or an empty string if the row is out-of-bounds.
+ */
+QString CSAbstractCollection::getKeyAt(int r) const
+{
+	if( (r < 0) || (r >= displayedSnapshot->rows.count()) )
+		return QString();
+
+	return displayedSnapshot->rows.at(r)->getHash();
+}
+
+/*!
+ * This function returns the track displayed at the given row of our model.
+ * This should only be called on our views' thread (see getKeyAt()).
+ *
+ * \param r The row of the desired track.
+ * \return The desired track, or NULL if the row is out-of-bounds.
+ */
+const CSTrack *CSAbstractCollection::getDisplayedTrack(int r) const
+{
+	if( (r < 0) || (r >= displayedSnapshot->rows.count()) )
+		return NULL;
+
+	return displayedSnapshot->rows.at(r).get();
+}
+
+/*!
+ * This function returns the displayed track with the given key. This should
+ * only be called on our views' thread (see getKeyAt()).
+ *
+ * \param k The key of the desired track.
+ * \return The desired track, or NULL if it isn't being displayed.
+ */
+const CSTrack *CSAbstractCollection::getDisplayedTrack(
+	const QString &k) const
+{
+	return displayedSnapshot->tracks.value(k).get();
+}
+
+/*!
+ * This function searches our collection for tracks matching the given query,
+ * using our inverted index (see CSTrackIndex::search()). This is safe to call
+ * from any thread, even while a job is modifying our collection.
+ *
+ * \param q The query to search for.
+ * \return The keys of the matching tracks.
+ */
+QSet<QString> CSAbstractCollection::search(const QString &q) const
+{
+	return trackIndex->search(q);
+}
+
 /*!
  * This function returns a QList containing all of the keys that ARE present in
  * our collection, but that are NOT present in the given other collection. This
  * can be useful e.g. for syncing two collections.
  *
+ * Both collections are compared using their most recently published snapshots
+ * (see getSnapshot()), so this never blocks on, or races with, jobs which are
+ * modifying either collection.
+ *
  * \param o The other collection to compare ourself to.
  * \return A list of keys in our collection that are not in the other one.
  */
 QList<QString> CSAbstractCollection::keysDifference(
 	const CSAbstractCollection *o) const
 {
-#pragma message "TODO - This functions performance should be improved"
-
-	QList<QString> srcK = getKeysList(), destK = o->getKeysList();
+	std::shared_ptr<const TrackSnapshot> src = getSnapshot();
+	std::shared_ptr<const TrackSnapshot> dest = o->getSnapshot();
 	QList<QString> diff;
 
-	for(int i = 0; i < srcK.count(); ++i)
-		if(!destK.contains(srcK.at(i)))
-			diff.append(srcK.at(i));
+	for(QHash<QString, std::shared_ptr<CSTrack> >::const_iterator it =
+		src->tracks.begin(); it != src->tracks.end(); ++it)
+	{
+		if(!dest->tracks.contains(it.key()))
+			diff.append(it.key());
+	}
 
 	return diff;
 }
@@ -576,9 +1156,9 @@ const CSAbstractCollection::DisplayDescriptor *
  * ALWAYS going to be something created by our displaying object and given to
  * us, and as such it is up to our display object to free it if need be.
  *
- * Note that this function automagically sorts the data in our model, updates
- * our column count, and then emits the appropriate signals to alert any views
- * using us.
+ * Note that this function automagically updates our column count, emits the
+ * appropriate signals to alert any views using us, and then starts sorting the
+ * data in our model in the background (see sortInBackground()).
  *
  * \param d The display descriptor to use.
  */
@@ -588,9 +1168,12 @@ void CSAbstractCollection::setDisplayDescriptor(
 	Q_EMIT beginResetModel();
 
 	displayDescriptor = d;
-	sort();
+	displayedSnapshot = getSnapshot();
+	updateDisplayColumns();
 
 	Q_EMIT endResetModel();
+
+	sortInBackground();
 }
 
 /*!
@@ -602,7 +1185,7 @@ void CSAbstractCollection::setDisplayDescriptor(
  */
 int CSAbstractCollection::rowCount(const QModelIndex &UNUSED(p)) const
 {
-	return count();
+	return displayedSnapshot->rows.count();
 }
 
 /*!
@@ -614,10 +1197,7 @@ int CSAbstractCollection::rowCount(const QModelIndex &UNUSED(p)) const
  */
 int CSAbstractCollection::columnCount(const QModelIndex &UNUSED(p)) const
 {
-	if(displayDescriptor != NULL)
-		return displayDescriptor->columns.count();
-	else
-		return 0;
+	return displayColumns.count();
 }
 
 /*!
@@ -672,17 +1252,44 @@ QVariant CSAbstractCollection::headerData(
 	if(r != Qt::DisplayRole)
 		return QVariant(QVariant::Invalid);
 
-	if(!displayDescriptor->columns.contains(s))
+	if( (s < 0) || (s >= displayColumns.count()) ||
+		(displayColumns.at(s) < 0) )
 	{
 		return QVariant(QVariant::Invalid);
 	}
 	else
 	{
 		return QVariant(CSAbstractCollection::getColumnName(
-			displayDescriptor->columns.value(s)));
+			static_cast<Column>(displayColumns.at(s))));
 	}
 }
 
+/*!
+ * This function acquires our job lock, blocking until it is available. Any job
+ * that reads or modifies this collection from a worker thread other than the
+ * one the collection lives on (e.g., the source collection of a sync, which is
+ * run on the destination's worker) must hold this lock for the duration of the
+ * job, so two workers never operate on the same collection at once.
+ *
+ * The lock is recursive, so a job which already holds it may safely call other
+ * functions that acquire it again. If you need to lock more than one
+ * collection, see CSCollectionJobExecutor, which always acquires them in a
+ * consistent order to avoid deadlocks.
+ */
+void CSAbstractCollection::lockJobs() const
+{
+	jobMutex->lock();
+}
+
+/*!
+ * This function releases our job lock, which must have previously been
+ * acquired by the calling thread via lockJobs().
+ */
+void CSAbstractCollection::unlockJobs() const
+{
+	jobMutex->unlock();
+}
+
 /*!
  * This function returns whether or not whatever current action is being
  * performed by this object is gracefully interruptible.
@@ -699,18 +1306,23 @@ bool CSAbstractCollection::isInterruptible() const
 }
 
 /*!
- * This function sets whether or not our current job has been interrupted. If
- * you interrupt a job, then the job is expected to notice and halt itself
- * after some reasonably short amount of time. Note that this will work
- * identically regardless if the job is interruptible or not - if you want to
- * be really nice about it, you are expected to check isInterruptible()
+ * This function sets whether or not ALL jobs on this collection should be
+ * interrupted. If you interrupt a job, then the job is expected to notice and
+ * halt itself after some reasonably short amount of time. Note that this will
+ * work identically regardless if the job is interruptible or not - if you want
+ * to be really nice about it, you are expected to check isInterruptible()
  * yourself.
  *
+ * This flag stays set until it is explicitly cleared, so it is intended for
+ * collections which are about to be destroyed. To cancel a single job, cancel
+ * it through the thread pool instead (see CSCollectionJob). This function is
+ * thread-safe.
+ *
  * \param i True means interrupt, false means don't.
  */
 void CSAbstractCollection::setInterrupted(bool i)
 {
-	interrupted = i;
+	interrupted.storeRelease(i ? 1 : 0);
 }
 
 /*!
@@ -735,7 +1347,16 @@ void CSAbstractCollection::setInterrupted()
  */
 QList<CSTrack *> CSAbstractCollection::allTracks() const
 {
-	return trackHash.values();
+	QMutexLocker locker(trackMutex);
+	QList<CSTrack *> tracks;
+
+	for(QHash<QString, std::shared_ptr<CSTrack> >::const_iterator it =
+		trackHash.begin(); it != trackHash.end(); ++it)
+	{
+		tracks.append(it.value().get());
+	}
+
+	return tracks;
 }
 
 /*!
@@ -748,8 +1369,11 @@ QList<CSTrack *> CSAbstractCollection::allTracks() const
  */
 CSTrack *CSAbstractCollection::trackAt(int r) const
 {
-	if( (r < 0) || (r >= count()) ) return NULL;
-	return trackSort.at(r);
+	QMutexLocker locker(trackMutex);
+	compactTracks();
+
+	if( (r < 0) || (r >= trackSort.count()) ) return NULL;
+	return trackSort.at(r).get();
 }
 
 /*!
@@ -762,7 +1386,8 @@ CSTrack *CSAbstractCollection::trackAt(int r) const
  */
 CSTrack *CSAbstractCollection::trackAt(const QString &k) const
 {
-	return trackHash.value(k, NULL);
+	QMutexLocker locker(trackMutex);
+	return trackHash.value(k).get();
 }
 
 /*!
@@ -775,11 +1400,15 @@ CSTrack *CSAbstractCollection::trackAt(const QString &k) const
  */
 void CSAbstractCollection::removeTrack(int r)
 {
-	if( (r < 0) || (r >= count()) ) return;
+	QMutexLocker locker(trackMutex);
+	compactTracks();
+
+	if( (r < 0) || (r >= trackSort.count()) ) return;
 
-	CSTrack *track = trackSort.takeAt(r);
+	std::shared_ptr<CSTrack> track = trackSort.takeAt(r);
 	trackHash.remove(track->getHash());
-	delete track;
+	trackIndex->removeTrack(track->getHash());
+	noteTrackChange();
 }
 
 /*!
@@ -788,14 +1417,21 @@ void CSAbstractCollection::removeTrack(int r)
  * have ownership of all track pointers - so the memory will be freed
  * appropriately. Note, though, that we won't delete anything from the disk.
  *
+ * Finding the track's row would mean searching our entire collection, so the
+ * track is only removed from our rows the next time they are needed (see
+ * compactTracks()); this way, removing many tracks costs a single pass.
+ *
  * \param k The key of the desired track.
  */
 void CSAbstractCollection::removeTrack(const QString &k)
 {
-	CSTrack *track = trackHash.value(k, NULL);
-	if(track == NULL) return;
-	trackSort.removeAll(track);
-	delete track;
+	QMutexLocker locker(trackMutex);
+
+	std::shared_ptr<CSTrack> track = trackHash.take(k);
+	if(!track) return;
+	removedTracks.insert(track.get());
+	trackIndex->removeTrack(k);
+	noteTrackChange();
 }
 
 /*!
@@ -814,25 +1450,253 @@ void CSAbstractCollection::removeTrack(const QString &k)
 bool CSAbstractCollection::addTrack(CSTrack *t)
 {
 	if(t == NULL) return false;
+
+	QMutexLocker locker(trackMutex);
+
 	if(trackHash.contains(t->getHash())) return false;
 
-	trackHash.insert(t->getHash(), t);
-	trackSort.append(t);
+	std::shared_ptr<CSTrack> track(t);
+	trackHash.insert(t->getHash(), track);
+	trackSort.append(track);
+	trackIndex->addTrack(t);
+	noteTrackChange();
+
 	return true;
 }
 
 /*!
- * This function tests if the current job has been asked to interrupt itself.
- * See setInterrupted() for more information. Subclasses are expected to check
- * the return value of this function periodically while performing a job, so as
- * to exit as nicely as possible when asked. Note that you should terminate
- * REGARDLESS of whether or not your job is considered "interruptible."
+ * This function replaces the track descriptor at the given row with the given
+ * new descriptor, keeping its position in our collection. Since published
+ * snapshots may still refer to the old descriptor, this is how subclasses
+ * should update a track, rather than modifying it in place; the old
+ * descriptor is freed once no snapshot refers to it anymore.
+ *
+ * If the given row is out-of-bounds, or if the new track's hash belongs to a
+ * different track we contain, then no action is taken. Otherwise (i.e., if we
+ * return true), we take ownership of the new track object - you SHOULD NOT
+ * free it yourself.
+ *
+ * \param r The row of the track to replace.
+ * \param t The new track descriptor.
+ * \return True if the track was replaced, or false otherwise.
+ */
+bool CSAbstractCollection::replaceTrack(int r, CSTrack *t)
+{
+	if(t == NULL) return false;
+
+	QMutexLocker locker(trackMutex);
+	compactTracks();
+
+	if( (r < 0) || (r >= trackSort.count()) ) return false;
+
+	QString k = trackSort.at(r)->getHash();
+
+	if( (t->getHash() != k) && trackHash.contains(t->getHash()) )
+		return false;
+
+	std::shared_ptr<CSTrack> track(t);
+	trackHash.remove(k);
+	trackHash.insert(t->getHash(), track);
+	trackSort[r] = track;
+	trackIndex->removeTrack(k);
+	trackIndex->addTrack(t);
+	noteTrackChange();
+
+	return true;
+}
+
+/*!
+ * This function replaces ALL of our track descriptors with the given ones, in
+ * the given order, rebuilding our track table in a single pass; this is much
+ * faster than calling replaceTrack() for every track. Any given tracks whose
+ * hashes duplicate an earlier one are freed. Just like with replaceTrack(),
+ * published snapshots keep the old descriptors alive for as long as they need
+ * them, and we take ownership of the new track objects.
+ *
+ * \param t The new track descriptors.
+ */
+void CSAbstractCollection::replaceTracks(const QList<CSTrack *> &t)
+{
+	{
+		QMutexLocker locker(trackMutex);
+
+		QList<std::shared_ptr<CSTrack> > rows;
+		QHash<QString, std::shared_ptr<CSTrack> > tracks;
+
+		rows.reserve(t.count());
+		tracks.reserve(t.count());
+		trackIndex->clear();
+
+		for(int i = 0; i < t.count(); ++i)
+		{
+			if( (t.at(i) == NULL) ||
+				tracks.contains(t.at(i)->getHash()) )
+			{
+				delete t.at(i);
+				continue;
+			}
+
+			std::shared_ptr<CSTrack> track(t.at(i));
+			tracks.insert(track->getHash(), track);
+			rows.append(track);
+			trackIndex->addTrack(t.at(i));
+		}
+
+		trackSort = rows;
+		trackHash = tracks;
+		removedTracks.clear();
+	}
+
+	publishSnapshot();
+}
+
+/*!
+ * This function replaces our entire track table with the contents of the
+ * given snapshot, and publishes the result. This is used to put a collection
+ * back the way it was when a job which rebuilds it (e.g., loading a collection
+ * from a path) is cancelled part of the way through; take a snapshot with
+ * publishSnapshot() and getSnapshot() before starting.
+ *
+ * \param s The snapshot to restore our tracks from.
+ */
+void CSAbstractCollection::restoreSnapshot(
+	const std::shared_ptr<const TrackSnapshot> &s)
+{
+	if(!s) return;
+
+	{
+		QMutexLocker locker(trackMutex);
+
+		trackSort = s->rows;
+		trackHash = s->tracks;
+		removedTracks.clear();
+
+		trackIndex->clear();
+		for(int i = 0; i < trackSort.count(); ++i)
+			trackIndex->addTrack(trackSort.at(i).get());
+	}
+
+	publishSnapshot();
+}
+
+/*!
+ * This function tests if the current job has been asked to interrupt itself;
+ * i.e., if either this collection has been interrupted (see setInterrupted()),
+ * or if the job running on the calling thread has been cancelled (see
+ * CSCollectionJob). Subclasses are expected to check the return value of this
+ * function periodically while performing a job, so as to exit as nicely as
+ * possible when asked. Note that you should terminate REGARDLESS of whether or
+ * not your job is considered "interruptible."
  *
  * \return True if we have been interrupted, or false otherwise.
  */
 bool CSAbstractCollection::isInterrupted() const
 {
-	return interrupted;
+	if(interrupted.loadAcquire() != 0)
+		return true;
+
+	CSCollectionJob *j = CSCollectionJob::current();
+
+	return (j != NULL) && (!j->checkpoint());
+}
+
+/*!
+ * This function should be called by our job loops between each item they
+ * process. If our worker thread has been paused, we block here until it is
+ * resumed (while still noticing interruptions, so a paused job can be
+ * cancelled). Afterwards, we report whether or not the job should continue.
+ *
+ * \return True if the job should continue, or false if it was interrupted.
+ */
+bool CSAbstractCollection::checkpoint() const
+{
+	// Wait in short slices, so we notice interruptions while paused.
+
+	while(!isInterrupted())
+	{
+		if(CSPausableThread::checkpoint(250))
+			return true;
+	}
+
+	return false;
+}
+
+/*!
+ * This function sets the range of progress values the current job will report
+ * via setProgress(). This should be called once at the start of each job, so
+ * the job's progress can be displayed.
+ *
+ * \param min The minimum progress value.
+ * \param max The maximum progress value.
+ */
+void CSAbstractCollection::setProgressLimits(int min, int max)
+{
+	progressMinimum.storeRelease(min);
+	progressMaximum.storeRelease(max);
+	progressValue.storeRelease(min);
+
+	instrumentation->setItemsTotal(max - min);
+}
+
+/*!
+ * This function updates the current job's progress. This is meant to be cheap
+ * enough to call for every item a job processes: rather than emitting a
+ * signal, we just store the value, and the GUI samples it at its own pace (see
+ * getProgress() and CSProgressAggregator). Our statistics are published via
+ * our statisticsUpdated() signal at most a couple of times per second.
+ *
+ * \param p The current progress value.
+ */
+void CSAbstractCollection::setProgress(int p)
+{
+	progressValue.storeRelease(p);
+
+	instrumentation->setItemsDone(p - progressMinimum.loadAcquire());
+
+	if(instrumentation->isPublishDue())
+		Q_EMIT statisticsUpdated(instrumentation->getStatistics());
+}
+
+/*!
+ * This function returns the object our jobs' statistics are collected with.
+ * Our progress signals are fed into it automatically; subclasses should use
+ * it to record the bytes they read and write, and to time the interesting
+ * phases of their jobs (see CSPhaseTimer).
+ *
+ * \return Our job instrumentation object.
+ */
+CSJobInstrumentation *CSAbstractCollection::getInstrumentation() const
+{
+	return instrumentation;
+}
+
+/*!
+ * This function sets whether or not we are currently being validated. This
+ * should be called by validate() implementations when they start and finish.
+ *
+ * \param v True if we are being validated, or false otherwise.
+ */
+void CSAbstractCollection::setValidating(bool v)
+{
+	validating.storeRelease(v ? 1 : 0);
+	Q_EMIT validatingChanged();
+}
+
+/*!
+ * This function sets whether or not our contents need to be validated. This
+ * should be called by subclasses after loading cached data (e.g., in
+ * unserialize()); rather than validating it synchronously, we emit
+ * validationRequested() so the validation can be scheduled as a background
+ * job.
+ *
+ * \param p True if we need to be validated, or false otherwise.
+ */
+void CSAbstractCollection::setValidationPending(bool p)
+{
+	validationPending.storeRelease(p ? 1 : 0);
+
+	if(p)
+		Q_EMIT validationRequested();
 }
 
 /*!
@@ -848,145 +1712,155 @@ void CSAbstractCollection::setModified(bool m)
 }
 
 /*!
- * This is our backend quicksort function that sorts our collection's items. It
- * accepts a left and right index, so it can be used recursively. It decides
- * /how/ to do the sorting based on our display descriptor. WE EXPECT OUR
+ * This function creates a new sorter for our collection, containing a snapshot
+ * of our tracks' keys and sort data taken under our track lock. WE EXPECT OUR
  * CALLER TO MAKE SURE OUR OBJECT HAS A VALID DISPLAY DESCRIPTOR IF YOU DON'T
  * IT WILL SEGFAULT!
  *
- * \param l The left-most index to sort.
- * \param r The right-most index to sort.
+ * \param g The generation to give the sorter.
+ * \return A new sorter, which the caller takes ownership of.
  */
-void CSAbstractCollection::quicksort(int l, int r) const
+CSCollectionSorter *CSAbstractCollection::createSorter(int g) const
 {
-	int pivot, i, j;
-
-	// Choose a pivot value.
-	pivot = l + ((r - l) / 2);
-
-	// Initialize loop indices.
-	i = l;
-	j = r;
+	QVector<CSCollectionSorter::Entry> entries;
 
-	// Get a compare modifier; if descending, we need to flip our compares.
+	{
+		QMutexLocker locker(trackMutex);
+		compactTracks();
 
-	int cm = displayDescriptor->s_order == Qt::AscendingOrder ? 1 : -1;
+		entries.reserve(trackSort.count());
 
-	/*
-	 * Keep looping until we have swapped all values to the correct side of
-	 * the pivot.
-	 */
+		for(int i = 0; i < trackSort.count(); ++i)
+		{
+			CSCollectionSorter::Entry entry;
+			entry.key = trackSort.at(i)->getHash();
 
-	while(i <= j)
-	{
-		/*
-		 * Move right until we find a value on the wrong side of the
-		 * pivot.
-		 */
+			for(int j = 0; j < displayDescriptor->s_columns.count();
+				++j)
+			{
+				entry.data.append(trackSort.at(i)->getColumn(
+					displayDescriptor->s_columns.at(j)));
+			}
 
-		while((sortCmp(i, pivot) * cm) == -1)
-			++i;
+			entries.append(entry);
+		}
+	}
 
-		/*
-		 * Move left until we find a value that is on the wrong side of
-		 * the pivot.
-		 */
+	return new CSCollectionSorter(g, *displayDescriptor, entries);
+}
 
-		while((sortCmp(j, pivot) * cm) == 1)
-			--j;
+/*!
+ * This function reorders our tracks to match the given list of keys. Because
+ * the keys may come from a snapshot which is now out-of-date, keys we no
+ * longer contain are skipped, and any tracks which were added since are kept
+ * (in their current relative order) at the end of the collection.
+ *
+ * \param k Our tracks' keys, in their new order.
+ */
+void CSAbstractCollection::applySort(const QStringList &k)
+{
+	{
+		QMutexLocker locker(trackMutex);
+		compactTracks();
 
-		/*
-		 * If our left index is still left of our right index, then
-		 * swap the two items.
-		 */
+		QList<std::shared_ptr<CSTrack> > sorted;
+		QSet<CSTrack *> placed;
+		sorted.reserve(trackSort.count());
 
-		if(i < j)
+		for(int i = 0; i < k.count(); ++i)
 		{
-			// Update our pivot if we are swapping its location.
-			if(i == pivot)
-				pivot = j;
-			else if(j == pivot)
-				pivot = i;
-
-			// Swap our elements.
-			trackSort.swap(i, j);
-		}
+			std::shared_ptr<CSTrack> track =
+				trackHash.value(k.at(i));
 
-		// Move indices one more place for the next iteration.
+			if(track)
+			{
+				sorted.append(track);
+				placed.insert(track.get());
+			}
+		}
 
-		if(i <= j)
+		for(int i = 0; (sorted.count() < trackSort.count()) &&
+			(i < trackSort.count()); ++i)
 		{
-			++i;
-			--j;
+			if(!placed.contains(trackSort.at(i).get()))
+				sorted.append(trackSort.at(i));
 		}
-	}
 
-	// If our left-most chunk is of size >= 1, then recurse on it.
-	if(l < j) quicksort(l, j);
+		trackSort = sorted;
+	}
 
-	// If our right-most chunk is of size >= 1, then recurse on it.
-	if(i < r) quicksort(i, r);
+	publishSnapshot();
 }
 
 /*!
- * This function compares two track descriptors. It returns -1 if a < b, 0 if
- * a = b, and 1 if a > b. WE EXPECT OUR CALLER TO MAKE SURE OUR OBJECT HAS A
- * VALID DISPLAY DESCRIPTOR IF YOU DON'T IT WILL SEGFAULT!
- *
- * \param ra The first row to compare.
- * \param rb The second row to compare.
- * \return The result of the comparison.
+ * This function records that our track table has been modified. Since the
+ * first change after each publish copies the whole table, changes are only
+ * published to readers (see publishSnapshot()) once per publish interval:
+ * SnapshotInterval milliseconds, plus as much again for every
+ * SnapshotIntervalRows tracks we contain. This keeps the time spent copying
+ * the table (and adopting snapshots on the GUI thread) a small fraction of
+ * the time spent building it, no matter how large the collection is.
  */
-int CSAbstractCollection::sortCmp(int ra, int rb) const
+void CSAbstractCollection::noteTrackChange()
 {
-	Column c;
+	QMutexLocker locker(trackMutex);
 
-	// A row is obviously equal to itself.s
+	++unpublishedChanges;
 
-	if(ra == rb)
-		return 0;
+	qint64 interval = static_cast<qint64>(SnapshotInterval) *
+		(1 + (trackHash.count() / SnapshotIntervalRows));
 
-	for(int i = 0; i < displayDescriptor->s_columns.count(); ++i)
-	{
-		c = displayDescriptor->s_columns.at(i);
-		QVariant ad = getSortData(ra, c), bd = getSortData(rb, c);
+	if(publishTimer.elapsed() >= interval)
+		publishSnapshot();
+}
 
-		switch(c)
-		{
-			// QString type columns.
-			case Artist:
-			case Album:
-			case Title:
-			{
-				if(ad.value<QString>() < bd.value<QString>())
-				{
-					return -1;
-				}
-				else if(ad.value<QString>() >
-					bd.value<QString>())
-				{
-					return 1;
-				}
-			}
-			break;
+/*!
+ * This function removes the tracks which have been removed by key (see
+ * removeTrack()) from our rows, in a single pass. Anything which accesses our
+ * rows should call this first. Our track lock MUST be held by the caller.
+ */
+void CSAbstractCollection::compactTracks() const
+{
+	if(removedTracks.isEmpty())
+		return;
 
-			// Integer type columns.
-			case DiscNumber:
-			case TrackNumber:
-			case TrackCount:
-			case Length:
-			case Year:
-			{
-				if(ad.value<int>() < bd.value<int>())
-					return -1;
-				else if(ad.value<int>() > bd.value<int>())
-					return 1;
-			}
-			break;
-		};
+	QList<std::shared_ptr<CSTrack> > rows;
+	rows.reserve(trackSort.count() - removedTracks.count());
+
+	for(int i = 0; i < trackSort.count(); ++i)
+	{
+		if(!removedTracks.contains(trackSort.at(i).get()))
+			rows.append(trackSort.at(i));
 	}
 
-	return 0;
+	trackSort = rows;
+	removedTracks.clear();
+}
+
+/*!
+ * This function flattens our display descriptor's column map into a vector,
+ * indexed by display column, so our model functions don't need to perform a
+ * hash lookup for every cell. Display columns which aren't mapped to anything
+ * are stored as -1. This also discards any cached display data, since it may
+ * have been formatted for our old columns.
+ */
+void CSAbstractCollection::updateDisplayColumns()
+{
+	displayColumns.clear();
+	displayCache.clear();
+
+	if(displayDescriptor == NULL)
+		return;
+
+	displayColumns.fill(-1, displayDescriptor->columns.count());
+
+	for(QHash<int, Column>::const_iterator it =
+		displayDescriptor->columns.begin();
+		it != displayDescriptor->columns.end(); ++it)
+	{
+		if( (it.key() >= 0) && (it.key() < displayColumns.count()) )
+			displayColumns[it.key()] = static_cast<int>(it.value());
+	}
 }
 
 /*!
@@ -1037,28 +1911,68 @@ void CSAbstractCollection::doConfigurationReset()
 
 /*!
  * This function handles our own jobStarted() signal being emitted by updating
- * our internal interruptible status to the reported value.
+ * our internal interruptible status to the reported value, and starting to
+ * collect statistics for the new job.
  *
- * \param j The job description (UNUSED).
+ * \param j The job description.
  * \param i The new interruptible status for this object.
  */
-void CSAbstractCollection::doJobStarted(const QString &UNUSED(j), bool i)
+void CSAbstractCollection::doJobStarted(const QString &j, bool i)
 { /* SLOT */
 
 	setInterruptible(i);
+	instrumentation->start(j);
+
+	progressMinimum.storeRelease(0);
+	progressMaximum.storeRelease(0);
+	progressValue.storeRelease(0);
+	jobRunning.storeRelease(1);
 
 }
 
 /*!
  * This function handles our own jobFinished() signal by resetting our internal
- * interruptible status back to true.
+ * interruptible status back to true. The finished job's final statistics are
+ * published via our statisticsUpdated() signal, and logged if logging is
+ * enabled (see CSJobInstrumentation::setLogPath()).
  *
  * \param r The result string for the job (UNUSED).
  */
 void CSAbstractCollection::doJobFinished(const QString &UNUSED(r))
 { /* SLOT */
 
+	// Make sure readers see everything the job did.
+	publishSnapshot();
+
 	setInterruptible(true);
+	jobRunning.storeRelease(0);
+
+	if(instrumentation->isRunning())
+	{
+		instrumentation->finish();
+
+		CSJobStatistics s = instrumentation->getStatistics();
+		CSJobInstrumentation::log(s);
+		Q_EMIT statisticsUpdated(s);
+	}
+
+}
+
+/*!
+ * This slot handles one of our background sorts finishing, by applying its
+ * result to our track table and publishing it. Results from sorts which have
+ * since been superseded are discarded.
+ *
+ * \param g The generation of the sort which finished.
+ * \param k Our tracks' keys, in their new order.
+ */
+void CSAbstractCollection::doSortFinished(int g, const QStringList &k)
+{ /* SLOT */
+
+	if(g != sortGeneration.load())
+		return;
+
+	applySort(k);
 
 }
 
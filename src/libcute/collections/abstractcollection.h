@@ -20,17 +20,28 @@
 #define INCLUDE_LIBCUTE_COLLECTIONS_ABSTRACT_COLLECTION_H
 
 #include <cstdint>
+#include <memory>
 
+#include <QAtomicInt>
+#include <QCache>
+#include <QElapsedTimer>
 #include <QList>
 #include <QString>
 #include <QAbstractTableModel>
 #include <QHash>
+#include <QSet>
 #include <QStringList>
+#include <QVector>
+
+#include "libcute/collections/collectioncatalog.h"
+#include "libcute/util/jobinstrumentation.h"
 
 class QMutex;
 
 class CSCollectionModel;
+class CSCollectionSorter;
 class CSTrack;
+class CSTrackIndex;
 class CSAbstractCollectionConfigWidget;
 class CSGeneralCollectionConfigWidget;
 
@@ -43,7 +54,8 @@ class CSGeneralCollectionConfigWidget;
  * provide as much general, common functionality as possible, but requires
  * subclasses to implement base functionality.
  *
- * Things that should notify of progress via our signals:
+ * Things that should report progress via setProgressLimits() and
+ * setProgress():
  *
  *     - bool loadCollectionFromPath(const QString &, bool)
  *     - bool syncFrom(const CSAbstractCollection *)
@@ -99,6 +111,23 @@ class CSAbstractCollection : public QAbstractTableModel
 			QHash<int, CSAbstractCollection::Column> columns;
 		} DisplayDescriptor;
 
+		/*!
+		 * This structure stores an immutable snapshot of our track
+		 * table: our tracks in display order, and hashed by key. Once
+		 * a snapshot has been published it is never modified, so it
+		 * can be read from any thread without locking; the tracks it
+		 * refers to stay alive for as long as the snapshot does.
+		 */
+		typedef struct TrackSnapshot
+		{
+			QList<std::shared_ptr<CSTrack> > rows;
+			QHash<QString, std::shared_ptr<CSTrack> > tracks;
+		} TrackSnapshot;
+
+		static const int SnapshotInterval = 250;
+		static const int SnapshotIntervalRows = 100000;
+		static const int DisplayCacheSize = 4096;
+
 		CSAbstractCollection(CSCollectionModel *p = 0);
 		CSAbstractCollection(const QString &n,
 			CSCollectionModel *p = 0);
@@ -152,15 +181,16 @@ class CSAbstractCollection : public QAbstractTableModel
 		virtual QString getName() const;
 		virtual void setName(const QString &n);
 		virtual bool isEnabled() const;
-		virtual void setEnabled(bool e);
 		virtual bool isSavedOnExit() const;
 
-		virtual void sort() const;
+		virtual void sort();
 
 		virtual bool reload();
 		virtual bool refresh();
+		virtual bool validate();
 
 	public Q_SLOTS:
+		virtual void setEnabled(bool e);
 		virtual void setSaveOnExit(bool s);
 
 		virtual bool deleteTracks(const QStringList &k);
@@ -173,16 +203,36 @@ class CSAbstractCollection : public QAbstractTableModel
 	 */
 
 	public:
+		bool getProgress(int *d, int *t) const;
+
 		bool containsKey(const QString &k) const;
 		int count() const;
 		bool isEmpty() const;
+		int64_t getTotalSize() const;
+		int64_t getTotalLength() const;
 
 		QList<QString> getKeysList() const;
+		QString getKeyAt(int r) const;
+		const CSTrack *getDisplayedTrack(int r) const;
+		const CSTrack *getDisplayedTrack(const QString &k) const;
+		QSet<QString> search(const QString &q) const;
 		QList<QString> keysDifference(
 			const CSAbstractCollection *o) const;
 
 		bool isModified() const;
 
+		bool isAttached() const;
+		CSCollectionCatalog::Header getCatalogHeader() const;
+		void detach(const QString &f,
+			const CSCollectionCatalog::Header &h);
+		bool attach();
+
+		bool isValidating() const;
+		bool isValidationPending() const;
+
+		std::shared_ptr<const TrackSnapshot> getSnapshot() const;
+		void publishSnapshot();
+
 		const DisplayDescriptor *getDisplayDescriptor() const;
 		void setDisplayDescriptor(const DisplayDescriptor *d);
 
@@ -195,12 +245,18 @@ class CSAbstractCollection : public QAbstractTableModel
 		virtual QVariant headerData(int s, Qt::Orientation o,
 			int r = Qt::DisplayRole) const;
 
+		void lockJobs() const;
+		void unlockJobs() const;
+
 		bool isInterruptible() const;
 		void setInterrupted(bool i);
 
 	public Q_SLOTS:
 		void setInterrupted();
 
+		void sortInBackground();
+		void adoptSnapshot();
+
 	protected:
 		QList<CSTrack *> allTracks() const;
 		CSTrack *trackAt(int r) const;
@@ -208,14 +264,31 @@ class CSAbstractCollection : public QAbstractTableModel
 		void removeTrack(int r);
 		void removeTrack(const QString &k);
 		bool addTrack(CSTrack *t);
+		bool replaceTrack(int r, CSTrack *t);
+		void replaceTracks(const QList<CSTrack *> &t);
+		void restoreSnapshot(
+			const std::shared_ptr<const TrackSnapshot> &s);
 
 		bool isInterrupted() const;
+		bool checkpoint() const;
+
+		CSJobInstrumentation *getInstrumentation() const;
+
+		void setProgressLimits(int min, int max);
+		void setProgress(int p);
+
+		void setValidating(bool v);
+		void setValidationPending(bool p);
 
 		void setModified(bool m);
 
 	private:
-		void quicksort(int l, int r) const;
-		int sortCmp(int ra, int rb) const;
+		CSCollectionSorter *createSorter(int g) const;
+		void applySort(const QStringList &k);
+		void noteTrackChange();
+		void compactTracks() const;
+
+		void updateDisplayColumns();
 
 		void setInterruptible(bool i);
 
@@ -226,6 +299,8 @@ class CSAbstractCollection : public QAbstractTableModel
 		void doJobStarted(const QString &j, bool i);
 		void doJobFinished(const QString &r);
 
+		void doSortFinished(int g, const QStringList &k);
+
 	/*
 	 * Static utility methods we provide. (Don't override these either.)
 	 */
@@ -249,10 +324,15 @@ class CSAbstractCollection : public QAbstractTableModel
 		void contentsChanged();
 
 		void jobStarted(const QString &, bool);
-		void progressLimitsUpdated(int, int);
-		void progressUpdated(int);
 		void jobFinished(const QString &);
 
+		void statisticsUpdated(const CSJobStatistics &);
+
+		void validatingChanged();
+		void validationRequested();
+
+		void snapshotPublished();
+
 	/*
 	 * Member variables.
 	 */
@@ -262,12 +342,33 @@ class CSAbstractCollection : public QAbstractTableModel
 		bool modified;
 		bool enabled;
 		mutable QMutex *interruptibleMutex;
+		mutable QMutex *jobMutex;
+		mutable QMutex *trackMutex;
+		CSJobInstrumentation *instrumentation;
+		CSTrackIndex *trackIndex;
 		bool interruptible;
-		bool interrupted;
+		QAtomicInt interrupted;
+		QAtomicInt jobRunning;
+		QAtomicInt progressMinimum;
+		QAtomicInt progressMaximum;
+		QAtomicInt progressValue;
+		QAtomicInt attached;
+		QString catalogEntry;
+		CSCollectionCatalog::Header catalogHeader;
+		QAtomicInt validating;
+		QAtomicInt validationPending;
+		mutable QAtomicInt sortGeneration;
 		bool saveOnExit;
 		const DisplayDescriptor *displayDescriptor;
-		mutable QList<CSTrack *> trackSort;
-		QHash<QString, CSTrack *> trackHash;
+		QVector<int> displayColumns;
+		mutable QCache<int, QVector<QVariant> > displayCache;
+		mutable QList<std::shared_ptr<CSTrack> > trackSort;
+		mutable QSet<const CSTrack *> removedTracks;
+		QHash<QString, std::shared_ptr<CSTrack> > trackHash;
+		int unpublishedChanges;
+		QElapsedTimer publishTimer;
+		std::shared_ptr<const TrackSnapshot> publishedSnapshot;
+		std::shared_ptr<const TrackSnapshot> displayedSnapshot;
 };
 
 #endif
@@ -0,0 +1,596 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "catalogdiff.h"
+
+#include <QDataStream>
+#include <QStringList>
+
+#include "libcute/defines.h"
+#include "libcute/collections/catalogreader.h"
+#include "libcute/collections/track.h"
+#include "libcute/util/externalsorter.h"
+#include "libcute/util/trace.h"
+
+/*!
+ * This is our default constructor, which creates a new comparison between the
+ * two given catalog files. Nothing is read until run() is called.
+ *
+ * \param s The path to the source collection's catalog file.
+ * \param d The path to the destination collection's catalog file.
+ */
+CSCatalogDiff::CSCatalogDiff(const QString &s, const QString &d)
+	: sourcePath(s), destinationPath(d),
+		externalThreshold(DefaultExternalThreshold), external(false),
+		plan()
+{
+}
+
+/*!
+ * This is our default destructor, which cleans up and destroys our object.
+ */
+CSCatalogDiff::~CSCatalogDiff()
+{
+}
+
+/*!
+ * This function returns the number of tracks above which we compare our
+ * catalogs using external sorting, rather than by building an index in memory.
+ *
+ * \return Our external threshold.
+ */
+qint32 CSCatalogDiff::getExternalThreshold() const
+{
+	return externalThreshold;
+}
+
+/*!
+ * This function sets the number of tracks above which we compare our catalogs
+ * using external sorting. If the smaller of our two catalogs has more tracks
+ * than this, run() will use external sorting.
+ *
+ * \param t Our new external threshold.
+ */
+void CSCatalogDiff::setExternalThreshold(qint32 t)
+{
+	externalThreshold = t;
+}
+
+/*!
+ * This function compares our two catalogs, and builds the plan which would
+ * make the destination match the source (see getPlan()).
+ *
+ * \return True on success, or false on failure (see getError()).
+ */
+bool CSCatalogDiff::run()
+{
+	CSTraceSpan span("catalog", "diff");
+
+	plan = Plan();
+
+	index.clear();
+	identities.clear();
+	error = QString();
+
+	CSCatalogReader src(sourcePath);
+	CSCatalogReader dest(destinationPath);
+
+	if(!src.open())
+	{
+		error = QString("Unable to read catalog: %1").arg(sourcePath);
+		return false;
+	}
+
+	if(!dest.open())
+	{
+		error = QString("Unable to read catalog: %1")
+			.arg(destinationPath);
+		return false;
+	}
+
+	sourceHeader = src.getHeader();
+	destinationHeader = dest.getHeader();
+
+	external = (qMin(src.getTrackCount(), dest.getTrackCount()) >
+		externalThreshold);
+
+	if(external)
+		return runExternal(&src, &dest);
+
+	return runIndexed(&src, &dest);
+}
+
+/*!
+ * This function returns whether or not our most recent call to run() used
+ * external sorting (see setExternalThreshold()).
+ *
+ * \return True if we used external sorting, or false otherwise.
+ */
+bool CSCatalogDiff::isExternal() const
+{
+	return external;
+}
+
+/*!
+ * This function compares the two given catalogs by building an index in memory.
+ * The smaller catalog is read once, to build our index. The larger catalog is
+ * then read twice: first to find the tracks which are unchanged, and then to
+ * pair up the rest. Doing it in two passes means a track is never reported as
+ * an update when the destination also has an exact copy of it.
+ *
+ * \param src The reader for our source catalog, which should be open.
+ * \param dest The reader for our destination catalog, which should be open.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::runIndexed(CSCatalogReader *src, CSCatalogReader *dest)
+{
+	// Index the smaller catalog.
+
+	bool streamSource = (src->getTrackCount() >= dest->getTrackCount());
+	CSCatalogReader *small = streamSource ? dest : src;
+	CSCatalogReader *large = streamSource ? src : dest;
+	QString smallPath = streamSource ? destinationPath : sourcePath;
+	QString largePath = streamSource ? sourcePath : destinationPath;
+
+	if(!indexCatalog(small))
+	{
+		error = QString("Unable to read catalog: %1").arg(smallPath);
+		return false;
+	}
+
+	small->close();
+
+	// Stream the larger catalog past it.
+
+	QSet<QString> matched;
+
+	if(!matchKeys(large, &matched) || !large->open() ||
+		!matchRemaining(large, matched, streamSource))
+	{
+		error = QString("Unable to read catalog: %1").arg(largePath);
+		return false;
+	}
+
+	addRemaining(!streamSource);
+
+	return true;
+}
+
+/*!
+ * This function compares the two given catalogs using external sorting. Each
+ * catalog is sorted by key, and the two are merged to find the tracks which are
+ * unchanged. The tracks which remain on each side are then sorted by identity,
+ * and merged again to pair up updates; anything left over is only on one side.
+ *
+ * \param src The reader for our source catalog, which should be open.
+ * \param dest The reader for our destination catalog, which should be open.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::runExternal(CSCatalogReader *src, CSCatalogReader *dest)
+{
+	CSExternalSorter srcKeys;
+	CSExternalSorter destKeys;
+
+	if(!sortCatalog(src, &srcKeys))
+	{
+		error = src->hasError() ? QString("Unable to read catalog: %1")
+			.arg(sourcePath) : QString("Unable to sort catalog: %1")
+			.arg(sourcePath);
+		return false;
+	}
+
+	src->close();
+
+	if(!sortCatalog(dest, &destKeys))
+	{
+		error = dest->hasError() ? QString("Unable to read catalog: %1")
+			.arg(destinationPath) : QString("Unable to sort " \
+			"catalog: %1").arg(destinationPath);
+		return false;
+	}
+
+	dest->close();
+
+	// Merge the two catalogs by key.
+
+	CSExternalSorter srcOnly;
+	CSExternalSorter destOnly;
+	QString sk, dk;
+	QByteArray sd, dd;
+
+	bool hs = srcKeys.next(&sk, &sd);
+	bool hd = destKeys.next(&dk, &dd);
+
+	while(hs || hd)
+	{
+		if(hs && hd && (sk == dk))
+		{
+			++plan.unchanged;
+			plan.unchangedBytes += decode(sd).entry.size;
+
+			hs = srcKeys.next(&sk, &sd);
+			hd = destKeys.next(&dk, &dd);
+		}
+		else if(hs && (!hd || (sk < dk)))
+		{
+			srcOnly.add(decode(sd).identity, sd);
+			hs = srcKeys.next(&sk, &sd);
+		}
+		else
+		{
+			destOnly.add(decode(dd).identity, dd);
+			hd = destKeys.next(&dk, &dd);
+		}
+	}
+
+	if(srcKeys.hasError() || destKeys.hasError() || !srcOnly.finish() ||
+		!destOnly.finish())
+	{
+		error = QString("Unable to merge catalogs");
+		return false;
+	}
+
+	// Merge the remaining tracks by identity.
+
+	hs = srcOnly.next(&sk, &sd);
+	hd = destOnly.next(&dk, &dd);
+
+	while(hs || hd)
+	{
+		if(hs && hd && (sk == dk))
+		{
+			addUpdate(decode(sd).entry, decode(dd).entry, true);
+
+			hs = srcOnly.next(&sk, &sd);
+			hd = destOnly.next(&dk, &dd);
+		}
+		else if(hs && (!hd || (sk < dk)))
+		{
+			addOneSided(decode(sd).entry, true);
+			hs = srcOnly.next(&sk, &sd);
+		}
+		else
+		{
+			addOneSided(decode(dd).entry, false);
+			hd = destOnly.next(&dk, &dd);
+		}
+	}
+
+	if(srcOnly.hasError() || destOnly.hasError())
+	{
+		error = QString("Unable to merge catalogs");
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * This function returns a description of the error which caused run() to
+ * fail, if it did.
+ *
+ * \return Our most recent error, or an empty string.
+ */
+QString CSCatalogDiff::getError() const
+{
+	return error;
+}
+
+/*!
+ * This function returns the header of our source catalog. It is only valid
+ * after run() has been called.
+ *
+ * \return Our source catalog's header.
+ */
+CSCollectionCatalog::Header CSCatalogDiff::getSourceHeader() const
+{
+	return sourceHeader;
+}
+
+/*!
+ * This function returns the header of our destination catalog. It is only
+ * valid after run() has been called.
+ *
+ * \return Our destination catalog's header.
+ */
+CSCollectionCatalog::Header CSCatalogDiff::getDestinationHeader() const
+{
+	return destinationHeader;
+}
+
+/*!
+ * This function returns the plan built by our most recent call to run(). Note
+ * that the tracks in each of its lists are in no particular order.
+ *
+ * \return Our plan.
+ */
+const CSCatalogDiff::Plan &CSCatalogDiff::getPlan() const
+{
+	return plan;
+}
+
+/*!
+ * This function reads every track from the given catalog into our index.
+ *
+ * \param r The reader for the catalog to index.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::indexCatalog(CSCatalogReader *r)
+{
+	CSTrack *t;
+
+	while((t = r->next()) != NULL)
+	{
+		Indexed i;
+		i.entry = createEntry(r, t);
+		i.identity = getIdentity(t);
+		delete t;
+
+		if(index.contains(i.entry.key))
+			continue;
+
+		index.insert(i.entry.key, i);
+		identities.insert(i.identity, i.entry.key);
+	}
+
+	return !r->hasError();
+}
+
+/*!
+ * This function reads every track from the given catalog, and removes each
+ * track which also has an exact match (i.e., the same key) from our index.
+ * Those tracks are unchanged; their keys are added to the given set.
+ *
+ * \param r The reader for the catalog to stream.
+ * \param m The set of keys to add unchanged tracks to.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::matchKeys(CSCatalogReader *r, QSet<QString> *m)
+{
+	CSTrack *t;
+
+	while((t = r->next()) != NULL)
+	{
+		QString key = t->getHash();
+		delete t;
+
+		if(!index.contains(key))
+			continue;
+
+		Indexed i = index.take(key);
+		identities.remove(i.identity, key);
+
+		m->insert(key);
+		++plan.unchanged;
+		plan.unchangedBytes += i.entry.size;
+	}
+
+	return !r->hasError();
+}
+
+/*!
+ * This function reads every track from the given catalog which wasn't found to
+ * be unchanged by matchKeys(). Each of them either replaces a track remaining
+ * in our index which has the same identity, or is only in the given catalog.
+ *
+ * \param r The reader for the catalog to stream.
+ * \param m The keys of the tracks which are unchanged.
+ * \param s True if the given catalog is our source catalog.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::matchRemaining(CSCatalogReader *r,
+	const QSet<QString> &m, bool s)
+{
+	CSTrack *t;
+
+	while((t = r->next()) != NULL)
+	{
+		if(m.contains(t->getHash()))
+		{
+			delete t;
+			continue;
+		}
+
+		Entry e = createEntry(r, t);
+		QString identity = getIdentity(t);
+		delete t;
+
+		if(identities.contains(identity))
+		{
+			QString key = identities.value(identity);
+			identities.remove(identity, key);
+
+			addUpdate(e, index.take(key).entry, s);
+		}
+		else
+		{
+			addOneSided(e, s);
+		}
+	}
+
+	return !r->hasError();
+}
+
+/*!
+ * This function adds every track remaining in our index to our plan, as being
+ * only in the catalog we indexed, and then clears our index.
+ *
+ * \param s True if the catalog we indexed is our source catalog.
+ */
+void CSCatalogDiff::addRemaining(bool s)
+{
+	QHash<QString, Indexed>::const_iterator it;
+	for(it = index.constBegin(); it != index.constEnd(); ++it)
+		addOneSided(it.value().entry, s);
+
+	index.clear();
+	identities.clear();
+}
+
+/*!
+ * This function adds the given track, which is only in one of our catalogs, to
+ * our plan: tracks only in the source should be copied, and tracks only in the
+ * destination should be deleted.
+ *
+ * \param e The track to add.
+ * \param s True if the track is from our source catalog.
+ */
+void CSCatalogDiff::addOneSided(const Entry &e, bool s)
+{
+	if(s)
+	{
+		plan.copies.append(e);
+		plan.copyBytes += e.size;
+	}
+	else
+	{
+		plan.deletions.append(e);
+		plan.deleteBytes += e.size;
+	}
+}
+
+/*!
+ * This function adds an update to our plan, given two versions of the same
+ * track (one from each of our catalogs).
+ *
+ * \param e The version of the track from the catalog we streamed.
+ * \param o The version of the track from the catalog we indexed.
+ * \param s True if the catalog we streamed is our source catalog.
+ */
+void CSCatalogDiff::addUpdate(const Entry &e, const Entry &o, bool s)
+{
+	Update u;
+	u.source = s ? e : o;
+	u.destination = s ? o : e;
+
+	plan.updates.append(u);
+	plan.updateBytes += u.source.size;
+}
+
+/*!
+ * This function reads every track from the given catalog into the given
+ * sorter, keyed by track key, and then finishes the sorter so it is ready to
+ * be merged.
+ *
+ * \param r The reader for the catalog to sort.
+ * \param s The sorter to add the catalog's tracks to.
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogDiff::sortCatalog(CSCatalogReader *r, CSExternalSorter *s)
+{
+	CSTrack *t;
+
+	while((t = r->next()) != NULL)
+	{
+		Indexed i;
+		i.entry = createEntry(r, t);
+		i.identity = getIdentity(t);
+		delete t;
+
+		if(!s->add(i.entry.key, encode(i)))
+			return false;
+	}
+
+	if(r->hasError())
+		return false;
+
+	return s->finish();
+}
+
+/*!
+ * This function creates an entry describing the given track, which should have
+ * been read from the given catalog reader.
+ *
+ * \param r The reader the track was read from.
+ * \param t The track to describe.
+ * \return An entry describing the given track.
+ */
+CSCatalogDiff::Entry CSCatalogDiff::createEntry(const CSCatalogReader *r,
+	const CSTrack *t)
+{
+	Entry e;
+
+	e.key = t->getHash();
+	e.path = r->getRelativePath(t);
+	e.size = static_cast<qint64>(t->getSize());
+
+	return e;
+}
+
+/*!
+ * This function returns the given track's identity: a string which is the same
+ * for two versions of the same track, even if (unlike their keys) their
+ * lengths, sizes or less important tags differ.
+ *
+ * \param t The track to identify.
+ * \return The track's identity.
+ */
+QString CSCatalogDiff::getIdentity(const CSTrack *t)
+{
+	QStringList l;
+
+	l.append(t->getArtist());
+	l.append(t->getAlbum());
+	l.append(QString::number(t->getCDNumber()));
+	l.append(QString::number(t->getTrackNumber()));
+	l.append(t->getTitle());
+
+	return l.join(QChar(0x1F));
+}
+
+/*!
+ * This function serializes the given indexed track, so it can be passed
+ * through a CSExternalSorter.
+ *
+ * \param i The track to serialize.
+ * \return The serialized track.
+ */
+QByteArray CSCatalogDiff::encode(const Indexed &i)
+{
+	QByteArray d;
+	QDataStream out(&d, QIODevice::WriteOnly);
+	out.setVersion(SERIALIZATION_VERSION);
+
+	out << i.entry.key;
+	out << i.entry.path;
+	out << i.entry.size;
+	out << i.identity;
+
+	return d;
+}
+
+/*!
+ * This function restores an indexed track serialized by encode().
+ *
+ * \param d The serialized track.
+ * \return The restored track.
+ */
+CSCatalogDiff::Indexed CSCatalogDiff::decode(const QByteArray &d)
+{
+	Indexed i;
+	QDataStream in(d);
+	in.setVersion(SERIALIZATION_VERSION);
+
+	in >> i.entry.key;
+	in >> i.entry.path;
+	in >> i.entry.size;
+	in >> i.identity;
+
+	return i;
+}
@@ -0,0 +1,161 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCLUDE_LIBCUTE_COLLECTIONS_CATALOG_DIFF_H
+#define INCLUDE_LIBCUTE_COLLECTIONS_CATALOG_DIFF_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+#include "libcute/collections/collectioncatalog.h"
+
+class CSCatalogReader;
+class CSExternalSorter;
+class CSTrack;
+
+/*!
+ * \brief This class compares two saved collections using only their catalogs.
+ *
+ * Both catalog files are streamed with a CSCatalogReader, so neither
+ * collection is ever created, and none of their files are touched. The tracks
+ * of the smaller catalog are indexed by key (see CSTrack::getHash()); the
+ * larger catalog is then streamed past this index, so we only ever need memory
+ * proportional to the smaller side (plus the plan itself).
+ *
+ * Tracks whose keys differ but which are otherwise the same track (i.e., they
+ * have the same artist, album, disc number, track number and title) are
+ * reported as updates, rather than as a copy plus a deletion.
+ *
+ * If even the smaller catalog has more tracks than our external threshold, we
+ * don't build an index at all. Instead, each catalog's tracks are sorted by key
+ * with a CSExternalSorter, and the two sorted streams are merged; the tracks
+ * only on one side are then sorted and merged again by identity, to find the
+ * updates. This is slower, but it needs only a bounded amount of memory (plus
+ * the plan itself), no matter how large the catalogs are.
+ */
+class CSCatalogDiff
+{
+	public:
+		/*!
+		 * This structure describes a single track in one of the
+		 * catalogs we are comparing.
+		 */
+		typedef struct Entry
+		{
+			QString key;
+			QString path;
+			qint64 size;
+		} Entry;
+
+		/*!
+		 * This structure describes a track which should be replaced:
+		 * the source's version of the track, and the destination's
+		 * (out-of-date) version of it.
+		 */
+		typedef struct Update
+		{
+			Entry source;
+			Entry destination;
+		} Update;
+
+		/*!
+		 * This structure stores the result of a comparison: the tracks
+		 * which should be copied to the destination, deleted from the
+		 * destination or replaced, along with the number of bytes
+		 * each of those involves. Update bytes are the sizes of the
+		 * source's versions, since those are what would be copied.
+		 */
+		typedef struct Plan
+		{
+			QList<Entry> copies;
+			QList<Entry> deletions;
+			QList<Update> updates;
+			qint32 unchanged;
+			qint64 copyBytes;
+			qint64 deleteBytes;
+			qint64 updateBytes;
+			qint64 unchangedBytes;
+		} Plan;
+
+		static const qint32 DefaultExternalThreshold = 1000000;
+
+		CSCatalogDiff(const QString &s, const QString &d);
+		virtual ~CSCatalogDiff();
+
+		qint32 getExternalThreshold() const;
+		void setExternalThreshold(qint32 t);
+
+		bool run();
+		bool isExternal() const;
+
+		QString getError() const;
+		CSCollectionCatalog::Header getSourceHeader() const;
+		CSCollectionCatalog::Header getDestinationHeader() const;
+		const Plan &getPlan() const;
+
+	private:
+		/*!
+		 * This structure stores a single track of the smaller catalog
+		 * in our index.
+		 */
+		typedef struct Indexed
+		{
+			Entry entry;
+			QString identity;
+		} Indexed;
+
+		QString sourcePath;
+		QString destinationPath;
+		QString error;
+		qint32 externalThreshold;
+		bool external;
+		CSCollectionCatalog::Header sourceHeader;
+		CSCollectionCatalog::Header destinationHeader;
+		Plan plan;
+
+		QHash<QString, Indexed> index;
+		QMultiHash<QString, QString> identities;
+
+		bool runIndexed(CSCatalogReader *src, CSCatalogReader *dest);
+		bool runExternal(CSCatalogReader *src, CSCatalogReader *dest);
+
+		bool indexCatalog(CSCatalogReader *r);
+		bool matchKeys(CSCatalogReader *r, QSet<QString> *m);
+		bool matchRemaining(CSCatalogReader *r, const QSet<QString> &m,
+			bool s);
+		void addRemaining(bool s);
+
+		void addOneSided(const Entry &e, bool s);
+		void addUpdate(const Entry &e, const Entry &o, bool s);
+
+		static bool sortCatalog(CSCatalogReader *r,
+			CSExternalSorter *s);
+
+		static Entry createEntry(const CSCatalogReader *r,
+			const CSTrack *t);
+		static QString getIdentity(const CSTrack *t);
+
+		static QByteArray encode(const Indexed &i);
+		static Indexed decode(const QByteArray &d);
+};
+
+#endif
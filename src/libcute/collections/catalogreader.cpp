@@ -0,0 +1,278 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "catalogreader.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+
+#include "libcute/defines.h"
+#include "libcute/collections/dircollection.h"
+#include "libcute/collections/dirtrack.h"
+#include "libcute/collections/ipodcollection.h"
+#include "libcute/collections/ipodtrack.h"
+
+/*!
+ * This is our default constructor, which creates a new reader for the given
+ * catalog file. The file isn't opened until open() is called.
+ *
+ * \param f The path to the catalog file to read.
+ */
+CSCatalogReader::CSCatalogReader(const QString &f)
+	: path(f), file(NULL), stream(NULL), error(false), ipod(false),
+		trackCount(0), trackIndex(0)
+{
+}
+
+/*!
+ * This is our default destructor, which closes our catalog file (if it is
+ * open) and cleans up our object.
+ */
+CSCatalogReader::~CSCatalogReader()
+{
+	close();
+}
+
+/*!
+ * This function opens our catalog file, and reads its header along with the
+ * collection data which precedes its tracks. Afterwards, the tracks can be
+ * read one at a time with next().
+ *
+ * Only directory and iPod collections are supported. Note that iPod catalog
+ * entries saved by older versions of our application don't contain any
+ * tracks, so they can't be read either.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSCatalogReader::open()
+{
+	close();
+	error = true;
+
+	file = new QFile(path);
+	if(!file->open(QIODevice::ReadOnly))
+		return false;
+
+	stream = new QDataStream(file);
+	if(!CSCollectionCatalog::readHeaderFrom(*stream, &header))
+		return false;
+
+	if(header.type == QString(
+		CSIPodCollection::staticMetaObject.className()))
+	{
+		ipod = true;
+	}
+	else if(header.type != QString(
+		CSDirCollection::staticMetaObject.className()))
+	{
+		return false;
+	}
+
+	/*
+	 * Our collection data is stored as a QByteArray, which is its length
+	 * followed by its contents. Rather than reading all of it into memory
+	 * at once, we skip the length and read the contents directly from the
+	 * file (see CSDirCollection::serialize() and
+	 * CSIPodCollection::serialize() for the format).
+	 */
+
+	quint32 length;
+	qint32 version;
+	QString name;
+
+	*stream >> length;
+	*stream >> version;
+
+	if( (stream->status() != QDataStream::Ok) ||
+		(length == 0xFFFFFFFF) || (version > SERIALIZATION_VERSION) )
+	{
+		return false;
+	}
+
+	stream->setVersion(version);
+
+	*stream >> name;
+	*stream >> root;
+
+	if(ipod)
+	{
+		bool artwork;
+		QByteArray signature;
+
+		*stream >> artwork;
+
+		if(stream->atEnd())
+			return false;
+
+		*stream >> signature;
+	}
+	else
+	{
+		bool recursive, organize;
+
+		*stream >> recursive;
+		*stream >> organize;
+	}
+
+	*stream >> trackCount;
+
+	if( (stream->status() != QDataStream::Ok) || (trackCount < 0) )
+		return false;
+
+	trackIndex = 0;
+	error = false;
+	return true;
+}
+
+/*!
+ * This function closes our catalog file, if it is open.
+ */
+void CSCatalogReader::close()
+{
+	delete stream;
+	stream = NULL;
+
+	delete file;
+	file = NULL;
+
+	ipod = false;
+	root = QString();
+	trackCount = 0;
+	trackIndex = 0;
+}
+
+/*!
+ * This function returns whether or not our catalog file has been opened
+ * successfully.
+ *
+ * \return True if we are open, or false otherwise.
+ */
+bool CSCatalogReader::isOpen() const
+{
+	return (stream != NULL) && !error;
+}
+
+/*!
+ * This function returns whether or not an error has occurred while opening or
+ * reading our catalog file. Note that next() returns NULL both on error and
+ * once every track has been read; this function can be used to tell the two
+ * apart.
+ *
+ * \return True if an error has occurred, or false otherwise.
+ */
+bool CSCatalogReader::hasError() const
+{
+	return error;
+}
+
+/*!
+ * This function returns the header of our catalog file. It is only valid
+ * after open() has been called.
+ *
+ * \return Our catalog file's header.
+ */
+CSCollectionCatalog::Header CSCatalogReader::getHeader() const
+{
+	return header;
+}
+
+/*!
+ * This function returns the root path of the collection stored in our catalog
+ * file (i.e., its mount point). It is only valid after open() has been called.
+ *
+ * \return Our collection's root path.
+ */
+QString CSCatalogReader::getRoot() const
+{
+	return root;
+}
+
+/*!
+ * This function returns the number of tracks stored in our catalog file. It is
+ * only valid after open() has been called.
+ *
+ * \return Our catalog file's track count.
+ */
+qint32 CSCatalogReader::getTrackCount() const
+{
+	return trackCount;
+}
+
+/*!
+ * This function reads the next track from our catalog file. The track returned
+ * is a standalone descriptor, which isn't part of any collection; it is owned
+ * by the caller, who is responsible for deleting it.
+ *
+ * \return The next track, or NULL if there are no more tracks (or on error).
+ */
+CSTrack *CSCatalogReader::next()
+{
+	if(!isOpen() || (trackIndex >= trackCount))
+		return NULL;
+
+	QByteArray td;
+	*stream >> td;
+
+	if(stream->status() != QDataStream::Ok)
+	{
+		error = true;
+		return NULL;
+	}
+
+	++trackIndex;
+
+	CSTrack *t;
+	if(ipod)
+		t = new CSIPodTrack(NULL);
+	else
+		t = new CSDirTrack(QString(""));
+
+	t->unserialize(td);
+	return t;
+}
+
+/*!
+ * This function returns the path of the given track (which should have been
+ * returned by next()), relative to our collection's root path.
+ *
+ * \param t The track to inspect.
+ * \return The track's relative path.
+ */
+QString CSCatalogReader::getRelativePath(const CSTrack *t) const
+{
+	if(ipod)
+	{
+		const CSIPodTrack *it = dynamic_cast<const CSIPodTrack *>(t);
+		if( (it == NULL) || (it->getTrack() == NULL) ||
+			(it->getTrack()->ipod_path == NULL) )
+		{
+			return QString("");
+		}
+
+		gchar *p = g_strdup(it->getTrack()->ipod_path);
+		itdb_filename_ipod2fs(p);
+
+		QString r = QString::fromUtf8(p);
+		g_free(p);
+		return r;
+	}
+
+	return t->getPath().replace(root, "");
+}
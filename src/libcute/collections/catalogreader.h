@@ -0,0 +1,72 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCLUDE_LIBCUTE_COLLECTIONS_CATALOG_READER_H
+#define INCLUDE_LIBCUTE_COLLECTIONS_CATALOG_READER_H
+
+#include <QString>
+
+#include "libcute/collections/collectioncatalog.h"
+
+class QDataStream;
+class QFile;
+
+class CSTrack;
+
+/*!
+ * \brief This class reads the tracks stored in a catalog file one at a time.
+ *
+ * Unlike restoring a collection from its catalog entry, this never creates a
+ * collection or touches the collection's files: it only reads the catalog
+ * file itself, and it only ever holds a single track in memory. This makes it
+ * suitable for inspecting saved collections which are very large, or which
+ * aren't currently available (e.g., an iPod which isn't plugged in).
+ */
+class CSCatalogReader
+{
+	public:
+		CSCatalogReader(const QString &f);
+		virtual ~CSCatalogReader();
+
+		bool open();
+		void close();
+
+		bool isOpen() const;
+		bool hasError() const;
+
+		CSCollectionCatalog::Header getHeader() const;
+		QString getRoot() const;
+		qint32 getTrackCount() const;
+
+		CSTrack *next();
+		QString getRelativePath(const CSTrack *t) const;
+
+	private:
+		QString path;
+		QFile *file;
+		QDataStream *stream;
+		bool error;
+		bool ipod;
+		CSCollectionCatalog::Header header;
+		QString root;
+		qint32 trackCount;
+		qint32 trackIndex;
+};
+
+#endif
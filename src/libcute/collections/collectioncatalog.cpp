@@ -0,0 +1,348 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "collectioncatalog.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+#include "libcute/defines.h"
+#include "libcute/collections/abstractcollection.h"
+
+// The magic number every catalog file starts with ("CSCT").
+#define CS_CATALOG_MAGIC 0x43534354
+
+// The version of our catalog file format (not of the collection data).
+#define CS_CATALOG_VERSION 1
+
+// The file extension our catalog files use.
+#define CS_CATALOG_EXTENSION ".cscat"
+
+/*!
+ * This is our default constructor, which creates a new catalog stored in the
+ * given directory. The directory is created if it doesn't already exist.
+ *
+ * \param d The directory to store our catalog files in.
+ */
+CSCollectionCatalog::CSCollectionCatalog(const QString &d)
+	: directory(d)
+{
+	QDir().mkpath(directory);
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCollectionCatalog::~CSCollectionCatalog()
+{
+}
+
+/*!
+ * This function returns the directory our catalog files are stored in.
+ *
+ * \return Our catalog directory.
+ */
+QString CSCollectionCatalog::getDirectory() const
+{
+	return directory;
+}
+
+/*!
+ * This function returns the paths of all of the catalog files in our
+ * directory, in no particular order. Use readHeader() to find out which
+ * collection each one contains.
+ *
+ * \return A list of catalog file paths.
+ */
+QStringList CSCollectionCatalog::getEntries() const
+{
+	QDir d(directory);
+	QStringList r;
+
+	QStringList files = d.entryList(QStringList() <<
+		(QString("*") + CS_CATALOG_EXTENSION), QDir::Files);
+
+	for(int i = 0; i < files.count(); ++i)
+		r.append(d.absoluteFilePath(files.at(i)));
+
+	return r;
+}
+
+/*!
+ * This function writes a catalog file containing the given header and
+ * serialized collection data, replacing any existing file for a collection
+ * with the same name. The write is atomic: the existing file is only replaced
+ * once the new one has been written completely.
+ *
+ * \param h The header describing the collection.
+ * \param d The collection's serialized data (see serialize()).
+ * \return True on success, or false on failure.
+ */
+bool CSCollectionCatalog::write(const Header &h, const QByteArray &d)
+{
+	QSaveFile f(getEntryPath(h.name));
+
+	if(!f.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out(&f);
+
+	out << static_cast<quint32>(CS_CATALOG_MAGIC);
+	out << static_cast<quint32>(CS_CATALOG_VERSION);
+	out << static_cast<qint32>(SERIALIZATION_VERSION);
+
+	out.setVersion(SERIALIZATION_VERSION);
+
+	out << h.name;
+	out << h.path;
+	out << h.type;
+	out << h.trackCount;
+	out << h.totalSize;
+	out << h.totalLength;
+	out << h.saved;
+
+	out << d;
+
+	if(out.status() != QDataStream::Ok)
+	{
+		f.cancelWriting();
+		return false;
+	}
+
+	return f.commit();
+}
+
+/*!
+ * This function removes the catalog file for the collection with the given
+ * name, if there is one.
+ *
+ * \param n The name of the collection to remove.
+ * \return True if the file was removed, or false otherwise.
+ */
+bool CSCollectionCatalog::remove(const QString &n)
+{
+	return QFile::remove(getEntryPath(n));
+}
+
+/*!
+ * This function removes the catalog files for every collection whose name is
+ * NOT in the given list. Files we can't read are left alone.
+ *
+ * \param n The names of the collections to keep.
+ */
+void CSCollectionCatalog::prune(const QStringList &n)
+{
+	QSet<QString> keep = n.toSet();
+	QStringList entries = getEntries();
+	Header h;
+
+	for(int i = 0; i < entries.count(); ++i)
+	{
+		if(!readHeader(entries.at(i), &h))
+			continue;
+
+		if(!keep.contains(h.name))
+			QFile::remove(entries.at(i));
+	}
+}
+
+/*!
+ * This function imports a list of collections serialized by an older version
+ * of our application (which stored them in its settings instead). Since the
+ * old format only recorded each collection's name and path, the statistics in
+ * the resulting headers are unknown.
+ *
+ * \param l The list of serialized collections to import.
+ * \return True if every collection was imported, or false otherwise.
+ */
+bool CSCollectionCatalog::migrate(const QList<QVariant> &l)
+{
+	bool r = true;
+
+	for(int i = 0; i < l.count(); ++i)
+	{
+		QByteArray d = l.at(i).value<QByteArray>();
+		QDataStream in(d);
+		qint32 version;
+		Header h;
+
+		// Read the version, name and path the collection starts with.
+
+		in >> version;
+
+		if( (in.status() != QDataStream::Ok) ||
+			(version > SERIALIZATION_VERSION) )
+		{
+			r = false;
+			continue;
+		}
+
+		in.setVersion(version);
+
+		in >> h.name;
+		in >> h.path;
+
+		if(in.status() != QDataStream::Ok)
+		{
+			r = false;
+			continue;
+		}
+
+		h.trackCount = -1;
+		h.totalSize = -1;
+		h.totalLength = -1;
+		h.saved = QDateTime::currentDateTime();
+
+		if(!write(h, d))
+			r = false;
+	}
+
+	return r;
+}
+
+/*!
+ * This function creates a catalog header describing the given collection.
+ *
+ * \param c The collection to describe.
+ * \return A header for the given collection.
+ */
+CSCollectionCatalog::Header CSCollectionCatalog::createHeader(
+	const CSAbstractCollection *c)
+{
+	Header h;
+
+	h.name = c->getName();
+	h.path = c->getMountPoint();
+	h.type = QString(c->metaObject()->className());
+	h.trackCount = static_cast<qint32>(c->count());
+	h.totalSize = static_cast<qint64>(c->getTotalSize());
+	h.totalLength = static_cast<qint64>(c->getTotalLength());
+	h.saved = QDateTime::currentDateTime();
+
+	return h;
+}
+
+/*!
+ * This function reads the header of the given catalog file. Only the header
+ * itself is read from the disk; the (potentially large) collection data
+ * following it is skipped.
+ *
+ * \param f The path to the catalog file.
+ * \param h The header to read into.
+ * \return True on success, or false if the file isn't a valid catalog file.
+ */
+bool CSCollectionCatalog::readHeader(const QString &f, Header *h)
+{
+	QFile file(f);
+
+	if(!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+	return readHeaderFrom(in, h);
+}
+
+/*!
+ * This function reads the serialized collection data from the given catalog
+ * file, suitable to be passed to the collection's unserialize() function.
+ *
+ * \param f The path to the catalog file.
+ * \return The collection data, or an empty QByteArray on error.
+ */
+QByteArray CSCollectionCatalog::readPayload(const QString &f)
+{
+	QFile file(f);
+
+	if(!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	QDataStream in(&file);
+	Header h;
+
+	if(!readHeaderFrom(in, &h))
+		return QByteArray();
+
+	QByteArray d;
+	in >> d;
+
+	if(in.status() != QDataStream::Ok)
+		return QByteArray();
+
+	return d;
+}
+
+/*!
+ * This function returns the path of the catalog file for the collection with
+ * the given name. Names may contain any characters at all, so the file name is
+ * derived from a hash of the name instead of the name itself.
+ *
+ * \param n The name of the collection.
+ * \return The path to the collection's catalog file.
+ */
+QString CSCollectionCatalog::getEntryPath(const QString &n) const
+{
+	QByteArray hash = QCryptographicHash::hash(n.toUtf8(),
+		QCryptographicHash::Sha1).toHex();
+
+	return QDir(directory).absoluteFilePath(QString::fromLatin1(hash) +
+		CS_CATALOG_EXTENSION);
+}
+
+/*!
+ * This function reads a catalog header from the given stream, which should be
+ * positioned at the start of a catalog file. Afterwards, the stream is
+ * positioned at the start of the collection data.
+ *
+ * \param in The stream to read from.
+ * \param h The header to read into.
+ * \return True on success, or false if the stream isn't a valid catalog file.
+ */
+bool CSCollectionCatalog::readHeaderFrom(QDataStream &in, Header *h)
+{
+	quint32 magic, format;
+	qint32 version;
+
+	in >> magic;
+	in >> format;
+	in >> version;
+
+	if(in.status() != QDataStream::Ok)
+		return false;
+
+	if( (magic != CS_CATALOG_MAGIC) || (format > CS_CATALOG_VERSION) ||
+		(version > SERIALIZATION_VERSION) )
+	{
+		return false;
+	}
+
+	in.setVersion(version);
+
+	in >> h->name;
+	in >> h->path;
+	in >> h->type;
+	in >> h->trackCount;
+	in >> h->totalSize;
+	in >> h->totalLength;
+	in >> h->saved;
+
+	return (in.status() == QDataStream::Ok);
+}
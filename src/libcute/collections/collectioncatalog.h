@@ -0,0 +1,89 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_COLLECTIONS_COLLECTION_CATALOG_H
+#define INCLUDE_LIBCUTE_COLLECTIONS_COLLECTION_CATALOG_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+class CSAbstractCollection;
+
+/*!
+ * \brief This class stores saved collections in a directory of catalog files.
+ *
+ * Each saved collection gets its own file, which starts with a small header
+ * (the collection's name, path, type and some summary statistics) followed by
+ * the collection's serialized data. This means we can list our saved
+ * collections by reading only their headers, without touching any track data.
+ *
+ * Files are always written to a temporary file which is then renamed over the
+ * original, so a crash while saving never leaves a half-written catalog.
+ */
+class CSCollectionCatalog
+{
+	public:
+		/*!
+		 * This structure stores the header of a single catalog file.
+		 * Statistics which aren't known (e.g., for collections
+		 * migrated from an older version) are set to -1.
+		 *
+		 * Note that if this structure is updated, then our catalog
+		 * file format needs to be updated to reflect that change as
+		 * well.
+		 */
+		typedef struct Header
+		{
+			QString name;
+			QString path;
+			QString type;
+			qint32 trackCount;
+			qint64 totalSize;
+			qint64 totalLength;
+			QDateTime saved;
+		} Header;
+
+		CSCollectionCatalog(const QString &d);
+		virtual ~CSCollectionCatalog();
+
+		QString getDirectory() const;
+		QStringList getEntries() const;
+
+		bool write(const Header &h, const QByteArray &d);
+		bool remove(const QString &n);
+		void prune(const QStringList &n);
+
+		bool migrate(const QList<QVariant> &l);
+
+		static Header createHeader(const CSAbstractCollection *c);
+		static bool readHeader(const QString &f, Header *h);
+		static QByteArray readPayload(const QString &f);
+		static bool readHeaderFrom(QDataStream &in, Header *h);
+
+	private:
+		QString directory;
+
+		QString getEntryPath(const QString &n) const;
+};
+
+#endif
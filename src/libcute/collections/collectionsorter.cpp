@@ -0,0 +1,184 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "collectionsorter.h"
+
+#include <algorithm>
+
+#include "libcute/util/trace.h"
+
+/*!
+ * \brief This functor compares two snapshot entries for CSCollectionSorter.
+ *
+ * The comparison rules are the same ones our collections have always used:
+ * text columns compare as strings, numeric columns compare as integers, and
+ * earlier sort columns take precedence over later ones.
+ */
+class CSCollectionSorterCompare
+{
+	public:
+		/*!
+		 * This constructor creates a new comparison functor, which
+		 * sorts according to the given display descriptor.
+		 *
+		 * \param d The display descriptor to sort by.
+		 */
+		CSCollectionSorterCompare(
+			const CSAbstractCollection::DisplayDescriptor *d)
+			: descriptor(d)
+		{
+		}
+
+		/*!
+		 * This function tests if the first given entry should be
+		 * sorted before the second one.
+		 *
+		 * \param a The first entry to compare.
+		 * \param b The second entry to compare.
+		 * \return True if a belongs before b, or false otherwise.
+		 */
+		bool operator()(const CSCollectionSorter::Entry &a,
+			const CSCollectionSorter::Entry &b) const
+		{
+			int c = compare(a, b);
+
+			if(descriptor->s_order == Qt::AscendingOrder)
+				return c < 0;
+			else
+				return c > 0;
+		}
+
+	private:
+		const CSAbstractCollection::DisplayDescriptor *descriptor;
+
+		/*!
+		 * This function compares two entries. It returns -1 if a < b,
+		 * 0 if a = b, and 1 if a > b.
+		 *
+		 * \param a The first entry to compare.
+		 * \param b The second entry to compare.
+		 * \return The result of the comparison.
+		 */
+		int compare(const CSCollectionSorter::Entry &a,
+			const CSCollectionSorter::Entry &b) const
+		{
+			for(int i = 0; i < descriptor->s_columns.count(); ++i)
+			{
+				const QVariant &ad = a.data.at(i);
+				const QVariant &bd = b.data.at(i);
+
+				switch(descriptor->s_columns.at(i))
+				{
+					// QString type columns.
+					case CSAbstractCollection::Artist:
+					case CSAbstractCollection::Album:
+					case CSAbstractCollection::Title:
+					{
+						int r = QString::compare(
+							ad.toString(),
+							bd.toString());
+
+						if(r != 0)
+							return r < 0 ? -1 : 1;
+					}
+					break;
+
+					// Integer type columns.
+					case CSAbstractCollection::DiscNumber:
+					case CSAbstractCollection::TrackNumber:
+					case CSAbstractCollection::TrackCount:
+					case CSAbstractCollection::Length:
+					case CSAbstractCollection::Year:
+					{
+						if(ad.toInt() < bd.toInt())
+							return -1;
+						else if(ad.toInt() > bd.toInt())
+							return 1;
+					}
+					break;
+				};
+			}
+
+			return 0;
+		}
+};
+
+/*!
+ * This is our default constructor, which creates a new sorter for the given
+ * snapshot.
+ *
+ * \param g The generation of this sort, which is reported with our result.
+ * \param d The display descriptor to sort by.
+ * \param e The snapshot entries to sort.
+ */
+CSCollectionSorter::CSCollectionSorter(int g,
+	const CSAbstractCollection::DisplayDescriptor &d,
+	const QVector<Entry> &e)
+	: QObject(), QRunnable(), generation(g), descriptor(d), entries(e)
+{
+	setAutoDelete(true);
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCollectionSorter::~CSCollectionSorter()
+{
+}
+
+/*!
+ * This function returns the generation we were created with. Collections use
+ * this to discard results from sorts which have since been superseded.
+ *
+ * \return Our sort's generation.
+ */
+int CSCollectionSorter::getGeneration() const
+{
+	return generation;
+}
+
+/*!
+ * This function sorts our snapshot, and returns the keys of its entries in
+ * their new order. This can be called directly to sort synchronously.
+ *
+ * \return Our snapshot's keys, in sorted order.
+ */
+QStringList CSCollectionSorter::sortKeys()
+{
+	CSTraceSpan span("collection", "sort");
+
+	std::stable_sort(entries.begin(), entries.end(),
+		CSCollectionSorterCompare(&descriptor));
+
+	QStringList keys;
+	keys.reserve(entries.count());
+
+	for(int i = 0; i < entries.count(); ++i)
+		keys.append(entries.at(i).key);
+
+	return keys;
+}
+
+/*!
+ * This function sorts our snapshot on whatever thread we are run on, and then
+ * reports the result via our finished() signal.
+ */
+void CSCollectionSorter::run()
+{
+	Q_EMIT finished(generation, sortKeys());
+}
@@ -0,0 +1,76 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_COLLECTIONS_COLLECTION_SORTER_H
+#define INCLUDE_LIBCUTE_COLLECTIONS_COLLECTION_SORTER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+#include "libcute/collections/abstractcollection.h"
+
+/*!
+ * \brief This class sorts an immutable snapshot of a collection's tracks.
+ *
+ * The snapshot contains only each track's key and the values of the columns
+ * being sorted on, so sorting it never touches the collection itself. This
+ * means the (potentially expensive) sort can run on a worker thread, while the
+ * collection keeps being modified and displayed; the resulting order is
+ * reported as a list of keys, which the collection applies when it is ready.
+ */
+class CSCollectionSorter : public QObject, public QRunnable
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		 * This structure stores a single track in our snapshot: its
+		 * key, and its sort data for each of our sort columns, in
+		 * order.
+		 */
+		typedef struct Entry
+		{
+			QString key;
+			QVariantList data;
+		} Entry;
+
+		CSCollectionSorter(int g,
+			const CSAbstractCollection::DisplayDescriptor &d,
+			const QVector<Entry> &e);
+		virtual ~CSCollectionSorter();
+
+		int getGeneration() const;
+
+		QStringList sortKeys();
+
+		virtual void run();
+
+	private:
+		int generation;
+		CSAbstractCollection::DisplayDescriptor descriptor;
+		QVector<Entry> entries;
+
+	Q_SIGNALS:
+		void finished(int, const QStringList &);
+};
+
+#endif
@@ -22,18 +22,23 @@
 #include <QFileInfo>
 #include <QString>
 #include <QByteArray>
+#include <QList>
+#include <QStringList>
 
 #include "libcute/defines.h"
 #include "libcute/collections/abstractcollection.h"
+#include "libcute/collections/collectioncatalog.h"
 #include "libcute/collections/dircollection.h"
 #include "libcute/collections/ipodcollection.h"
+#include "libcute/thread/devicescheduler.h"
+#include "libcute/util/trace.h"
 #include "libcute/widgets/collectionlistitem.h"
 
 /*!
  * This is our default constructor, which creates a new resolver object.
  */
 CSCollectionTypeResolver::CSCollectionTypeResolver(QObject *p)
-	: QObject(p)
+	: QObject(p), scheduler(NULL)
 {
 }
 
@@ -44,6 +49,18 @@ CSCollectionTypeResolver::~CSCollectionTypeResolver()
 {
 }
 
+/*!
+ * This function sets the device scheduler our collections should be loaded
+ * through. If one is set, then loading a collection waits until the device it
+ * lives on is available. Note that we do not take ownership of the scheduler.
+ *
+ * \param s The new device scheduler to use, or NULL to not use one.
+ */
+void CSCollectionTypeResolver::setDeviceScheduler(CSDeviceScheduler *s)
+{
+	scheduler = s;
+}
+
 /*!
  * This function uses our class's resolver to create a new collection but,
  * instead of loading the collection from a path, we instead load the given
@@ -61,6 +78,7 @@ void CSCollectionTypeResolver::unserializeCollection(const QString &n,
 	const QString &p, const QByteArray &d)
 { /* SLOT */
 
+	CSTraceSpan span("resolver", "unserialize");
 	CSAbstractCollection *c = NULL;
 
 	/*
@@ -88,26 +106,92 @@ void CSCollectionTypeResolver::unserializeCollection(const QString &n,
 
 	QObject::connect(c, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
-	QObject::connect(c, SIGNAL(progressLimitsUpdated(int, int)),
-		this, SLOT(doProgressLimitsUpdated(int, int)));
-	QObject::connect(c, SIGNAL(progressUpdated(int)),
-		this, SLOT(doProgressUpdated(int)));
 	QObject::connect(c, SIGNAL(jobFinished(const QString &)),
 		this, SLOT(doJobFinished(const QString &)));
+	QObject::connect(c, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)), this, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)));
 
 	/*
 	 * The collection has been created, but we still need to load its data.
 	 * Emit the signal indicating that the collection exists, but set it
-	 * disabled (until it has been loaded).
+	 * disabled (until it has been loaded). We hold its job lock while
+	 * loading, so no other worker can start a job on it in the meantime.
 	 */
 
+	c->lockJobs();
 	c->setEnabled(false);
 	Q_EMIT(collectionCreated(c));
 
 	// Try to load the collection from the path provided.
 
+	QList<quint64> devices;
+	if(scheduler != NULL)
+		devices = scheduler->acquire(QStringList(p));
+
 	c->unserialize(d);
 
+	if(scheduler != NULL)
+		scheduler->release(devices);
+
+	c->unlockJobs();
+
+}
+
+/*!
+ * This function creates a new collection from the header of the given catalog
+ * file, without loading any of its tracks. The new collection is detached (see
+ * CSAbstractCollection::detach()), so this is fast enough to be done for every
+ * saved collection at startup; the tracks themselves are loaded the first time
+ * the collection is attached.
+ *
+ * If the header records the type of collection that was saved, then we create
+ * a collection of that type. Otherwise, we resolve the type from its path as
+ * newCollection() does.
+ *
+ * \param f The path to the catalog file to restore.
+ */
+void CSCollectionTypeResolver::restoreCollection(const QString &f)
+{ /* SLOT */
+
+	CSTraceSpan span("resolver", "restore");
+	CSCollectionCatalog::Header h;
+	CSAbstractCollection *c = NULL;
+
+	if(!CSCollectionCatalog::readHeader(f, &h))
+	{
+#pragma message "TODO - Errors need to be handled here by emitting a signal"
+		return;
+	}
+
+	c = createCollection(h);
+
+	if(c == NULL)
+	{
+#pragma message "TODO - Errors need to be handled here by emitting a signal"
+		return;
+	}
+
+	c->detach(f, h);
+	c->setSaveOnExit(true);
+
+	// Connect the collection to our slots.
+
+	QObject::connect(c, SIGNAL(jobStarted(const QString &, bool)),
+		this, SLOT(doJobStarted(const QString &, bool)));
+	QObject::connect(c, SIGNAL(jobFinished(const QString &)),
+		this, SLOT(doJobFinished(const QString &)));
+	QObject::connect(c, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)), this, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)));
+
+	/*
+	 * There is nothing to load yet, so the collection can be used (and
+	 * attached) as soon as it has been created.
+	 */
+
+	Q_EMIT(collectionCreated(c));
+
 }
 
 /*!
@@ -137,6 +221,7 @@ void CSCollectionTypeResolver::newCollection(const QString &n,
 	const QString &p, bool s)
 { /* SLOT */
 
+	CSTraceSpan span("resolver", "load");
 	CSAbstractCollection *c = NULL;
 
 	// Create our new collection object.
@@ -159,38 +244,50 @@ void CSCollectionTypeResolver::newCollection(const QString &n,
 
 	QObject::connect(c, SIGNAL(jobStarted(const QString &, bool)),
 		this, SLOT(doJobStarted(const QString &, bool)));
-	QObject::connect(c, SIGNAL(progressLimitsUpdated(int, int)),
-		this, SLOT(doProgressLimitsUpdated(int, int)));
-	QObject::connect(c, SIGNAL(progressUpdated(int)),
-		this, SLOT(doProgressUpdated(int)));
 	QObject::connect(c, SIGNAL(jobFinished(const QString &)),
 		this, SLOT(doJobFinished(const QString &)));
+	QObject::connect(c, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)), this, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)));
 
 	/*
 	 * The collection has been created, but we still need to load its data.
 	 * Emit the signal indicating that the collection exists, but set it
-	 * disabled (until it has been loaded).
+	 * disabled (until it has been loaded). We hold its job lock while
+	 * loading, so no other worker can start a job on it in the meantime.
 	 */
 
+	c->lockJobs();
 	c->setEnabled(false);
 	Q_EMIT(collectionCreated(c));
 
 	// Try to load the collection from the path provided.
 
+	QList<quint64> devices;
+	if(scheduler != NULL)
+		devices = scheduler->acquire(QStringList(p));
+
 	c->loadCollectionFromPath(p);
 
+	if(scheduler != NULL)
+		scheduler->release(devices);
+
+	c->unlockJobs();
+
 }
 
 /*!
- * This is a private utility function which creates a new collection using
- * the given collection details. We resolve the type of the collection, and
- * return an appropriate subclass of CSAbstractCollection.
+ * This is a utility function which creates a new collection using the given
+ * collection details. We resolve the type of the collection, and return an
+ * appropriate subclass of CSAbstractCollection. Note that the collection is
+ * not loaded; the caller takes ownership of it.
  *
  * \param n The name of the collection.
  * \param p The path of the collection.
+ * \return A new, empty collection of the appropriate type.
  */
 CSAbstractCollection *CSCollectionTypeResolver::createCollection(
-	const QString &n, const QString &p) const
+	const QString &n, const QString &p)
 {
 	CSAbstractCollection *c = NULL;
 
@@ -217,9 +314,34 @@ CSAbstractCollection *CSCollectionTypeResolver::createCollection(
 	return c;
 }
 
+/*!
+ * This is a utility function which creates a new collection for the given
+ * catalog header. If we know the type of collection that was saved, we create
+ * one of that type; otherwise, we resolve its type from its path, as above.
+ * Note that the collection is not loaded; the caller takes ownership of it.
+ *
+ * \param h The catalog header of the collection.
+ * \return A new, empty collection of the appropriate type.
+ */
+CSAbstractCollection *CSCollectionTypeResolver::createCollection(
+	const CSCollectionCatalog::Header &h)
+{
+	QString ipodType(CSIPodCollection::staticMetaObject.className());
+	QString dirType(CSDirCollection::staticMetaObject.className());
+
+	if(h.type == ipodType)
+		return new CSIPodCollection(h.name);
+	else if(h.type == dirType)
+		return new CSDirCollection(h.name);
+	else
+		return createCollection(h.name, h.path);
+}
+
 /*!
  * This slot handles a new job being started by updating our job member, and
- * emitting an appropriate signal.
+ * emitting an appropriate signal. The collection running the job is disabled
+ * until it finishes, unless the job is a validation (see
+ * CSAbstractCollection::validate()), which leaves the collection usable.
  *
  * \param j The string describing the job.
  * \param i Whether or not the job is interruptible.
@@ -230,40 +352,13 @@ void CSCollectionTypeResolver::doJobStarted(const QString &j, bool i)
 	CSAbstractCollection *s =
 		dynamic_cast<CSAbstractCollection *>(sender());
 
-	if(s != NULL)
+	if( (s != NULL) && (!s->isValidating()) )
 		s->setEnabled(false);
 
 	Q_EMIT jobStarted(j, i);
 
 }
 
-/*!
- * This slot handles the progress limits on a job being updated by emitting an
- * appropriate signal.
- *
- * \param min The new minimum limit.
- * \param max The new maximum limit.
- */
-void CSCollectionTypeResolver::doProgressLimitsUpdated(int min, int max)
-{ /* SLOT */
-
-	Q_EMIT progressLimitsUpdated(min, max);
-
-}
-
-/*!
- * This slot handles the current progress of a job being updated by emitting an
- * appropriate signal.
- *
- * \param p The new current progress of the current job.
- */
-void CSCollectionTypeResolver::doProgressUpdated(int p)
-{ /* SLOT */
-
-	Q_EMIT progressUpdated(p);
-
-}
-
 /*!
  * This slot handles the current job being finished by clearing out our job
  * member, and by emitting an appropriate signal.
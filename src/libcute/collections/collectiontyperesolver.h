@@ -21,11 +21,15 @@
 
 #include <QObject>
 
+#include "libcute/collections/collectioncatalog.h"
+#include "libcute/util/jobinstrumentation.h"
+
 class QString;
 class QByteArray;
 
 class CSAbstractCollection;
 class CSCollectionListItem;
+class CSDeviceScheduler;
 
 /*!
  * \brief This class can determine the type of collection a path contains.
@@ -44,27 +48,31 @@ class CSCollectionTypeResolver : public QObject
 		CSCollectionTypeResolver(QObject *p = 0);
 		virtual ~CSCollectionTypeResolver();
 
+		void setDeviceScheduler(CSDeviceScheduler *s);
+
+		static CSAbstractCollection *createCollection(
+			const QString &n, const QString &p);
+		static CSAbstractCollection *createCollection(
+			const CSCollectionCatalog::Header &h);
+
 	public Q_SLOTS:
 		void unserializeCollection(const QString &n,
 			const QString &p, const QByteArray &d);
+		void restoreCollection(const QString &f);
 		void newCollection(const QString &n,
 			const QString &p, bool s);
 
 	private:
-		CSAbstractCollection *createCollection(const QString &n,
-			const QString &p) const;
+		CSDeviceScheduler *scheduler;
 
 	private Q_SLOTS:
 		void doJobStarted(const QString &j, bool i);
-		void doProgressLimitsUpdated(int min, int max);
-		void doProgressUpdated(int p);
 		void doJobFinished(const QString &r);
 
 	Q_SIGNALS:
 		void jobStarted(const QString &, bool);
-		void progressLimitsUpdated(int, int);
-		void progressUpdated(int);
 		void jobFinished(const QString &);
+		void statisticsUpdated(const CSJobStatistics &);
 
 		void collectionCreated(CSAbstractCollection *);
 };
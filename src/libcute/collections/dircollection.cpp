@@ -32,6 +32,7 @@
 #include "libcute/tags/taggedfile.h"
 #include "libcute/util/guiutils.h"
 #include "libcute/util/systemutils.h"
+#include "libcute/util/trace.h"
 #include "libcute/widgets/collectionmodel.h"
 
 /*!
@@ -142,7 +143,7 @@ QString CSDirCollection::getAboutText() const
 /*!
  * This function loads a new directory-based collection from the disk. By
  * default we flush the current collection (if any), although this behavior is
- * optional.
+ * optional. If we are interrupted, our previous collection is restored.
  *
  * \param p The path to the collection that is to be loaded.
  * \param f Whether the current collection should be flushed or discarded.
@@ -150,30 +151,50 @@ QString CSDirCollection::getAboutText() const
  */
 bool CSDirCollection::loadCollectionFromPath(const QString &p, bool f)
 {
+	// Copy the path, since it may refer to our own root (see reload()).
+	QString path = p;
+
 	Q_EMIT jobStarted(tr("Loading collection from path..."), true);
 
-	// Clear the old collection.
-	clear(f);
+	// Clear the old collection, keeping it in case we are interrupted.
+
+	if(f) flush();
+
+	publishSnapshot();
+	std::shared_ptr<const TrackSnapshot> previous = getSnapshot();
+	QString previousRoot = root;
+	bool previousModified = isModified();
+
+	clear(false);
 
 	// Setup progress bounds.
 
-	int fileCount = static_cast<int>(CSSystemUtils::getFileCount(
-		p.toStdString()));
-	Q_EMIT progressLimitsUpdated(0, fileCount);
+	int fileCount;
+	{
+		CSTraceSpan span("dir", "enumerate");
+		fileCount = static_cast<int>(CSSystemUtils::getFileCount(
+			path.toStdString()));
+	}
+
+	setProgressLimits(0, fileCount);
 
 	// Iterate through again to process each file.
 
 	CSDirTrack *track;
-	QDirIterator walker(p, QDir::Files | QDir::NoSymLinks,
+	QDirIterator walker(path, QDir::Files | QDir::NoSymLinks,
 		getRecursive() ? QDirIterator::Subdirectories :
 		QDirIterator::NoIteratorFlags);
 
 	fileCount = 0;
 	while(walker.hasNext())
 	{
-		if(isInterrupted())
+		if(!checkpoint())
 		{
-			clear(false);
+			restoreSnapshot(previous);
+			root = previousRoot;
+			setModified(previousModified);
+
+			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
@@ -182,17 +203,21 @@ bool CSDirCollection::loadCollectionFromPath(const QString &p, bool f)
 		track = new CSDirTrack(
 			walker.fileInfo().absoluteFilePath());
 
-		if(!track->refresh())
+		getInstrumentation()->beginPhase("tags");
+		bool loaded = track->refresh();
+		getInstrumentation()->endPhase("tags");
+
+		if(!loaded)
 		{
 			delete track;
 			track = NULL;
 
-			Q_EMIT progressUpdated(++fileCount);
+			setProgress(++fileCount);
 			continue;
 		}
 
 		addTrack(track);
-		Q_EMIT progressUpdated(++fileCount);
+		setProgress(++fileCount);
 	}
 
 	root = walker.path();
@@ -204,7 +229,8 @@ bool CSDirCollection::loadCollectionFromPath(const QString &p, bool f)
 /*!
  * This function refreshes the contents of our directory collection, without
  * reloading tracks that haven't changed (this is determined very simply using
- * the file's path, filesize and last modified time).
+ * the file's path, filesize and last modified time). If we are interrupted,
+ * the changes made so far are kept.
  *
  * \return True on success, or false on failure.
  */
@@ -216,22 +242,25 @@ bool CSDirCollection::refresh()
 
 	int fileCount = static_cast<int>(CSSystemUtils::getFileCount(
 		root.toStdString()));
-	Q_EMIT progressLimitsUpdated(0, fileCount);
+	setProgressLimits(0, fileCount);
 
 	// Some temporary variables.
 
 	int pcount = 0;
 	CSTrack *track;
-	QList<int> toRemove;
 	QSet<QString> paths;
 
-	// Check if any of our existing tracks need to be updated or removed.
+	/*
+	 * Check if any of our existing tracks need to be updated or removed.
+	 * We go backwards, so removing a track doesn't affect the rows we have
+	 * yet to visit.
+	 */
 
-	for(int i = 0; i < count(); ++i)
+	for(int i = count() - 1; i >= 0; --i)
 	{
-		if(isInterrupted())
+		if(!checkpoint())
 		{
-			clear(false);
+			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
@@ -242,15 +271,17 @@ bool CSDirCollection::refresh()
 		if(!f.exists())
 		{ // If track no longer exists, remove it from the collection.
 
-			toRemove.append(i);
+			removeTrack(i);
 
 		}
 		else if( (! (f.size() == track->getSize()) ) ||
 			(f.lastModified() > track->getModifyTime()) )
 		{ // Otherwise, if tracks's size or mod. time changed, update.
 
-			track->refresh();
-			paths.insert(track->getPath());
+			QString path = track->getPath();
+
+			if(reloadTrack(i, path))
+				paths.insert(path);
 
 		}
 		else
@@ -260,7 +291,7 @@ bool CSDirCollection::refresh()
 
 		}
 
-		Q_EMIT progressUpdated(++pcount);
+		setProgress(++pcount);
 	}
 
 	// Check if there are any new tracks that need to be added.
@@ -271,9 +302,9 @@ bool CSDirCollection::refresh()
 
 	while(walker.hasNext())
 	{
-		if(isInterrupted())
+		if(!checkpoint())
 		{
-			clear(false);
+			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
@@ -286,25 +317,178 @@ bool CSDirCollection::refresh()
 			track = new CSDirTrack(
 				walker.fileInfo().absoluteFilePath());
 
-			if(!track->refresh())
+			getInstrumentation()->beginPhase("tags");
+			bool loaded = track->refresh();
+			getInstrumentation()->endPhase("tags");
+
+			if(!loaded)
 			{
 				delete track;
 				track = NULL;
 
-				Q_EMIT progressUpdated(++pcount);
+				setProgress(++pcount);
 				continue;
 			}
 
 			addTrack(track);
 		}
 
-		Q_EMIT progressUpdated(++pcount);
+		setProgress(++pcount);
 	}
 
 	Q_EMIT jobFinished(QString());
 	return true;
 }
 
+/*!
+ * This function validates the contents of our collection, after they have been
+ * loaded from cached data (see unserialize()). This is equivalent to
+ * refresh(), except that our collection stays enabled while it runs: tracks
+ * which have been removed or modified are corrected as they are found, and we
+ * emit contentsChanged() after every batch of corrections. If we are
+ * interrupted, the corrections made so far are kept, but our validation stays
+ * pending, so it is scheduled again.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSDirCollection::validate()
+{
+	if(!isValidationPending())
+		return true;
+
+	setValidating(true);
+
+	Q_EMIT jobStarted(tr("Validating collection..."), true);
+
+	// Setup progress bounds.
+
+	int fileCount = static_cast<int>(CSSystemUtils::getFileCount(
+		root.toStdString()));
+	setProgressLimits(0, fileCount);
+
+	// Some temporary variables.
+
+	int pcount = 0;
+	int corrections = 0;
+	bool r = true;
+	CSTrack *track;
+	QSet<QString> paths;
+
+	/*
+	 * Check if any of our existing tracks need to be updated or removed.
+	 * We go backwards, so removing a track doesn't affect the rows we have
+	 * yet to visit.
+	 */
+
+	for(int i = count() - 1; i >= 0; --i)
+	{
+		if(!checkpoint())
+		{
+			r = false;
+			break;
+		}
+
+		track = trackAt(i);
+
+		QFileInfo f(track->getPath());
+
+		if(!f.exists())
+		{ // If track no longer exists, remove it from the collection.
+
+			removeTrack(i);
+			++corrections;
+
+		}
+		else if( (! (f.size() == track->getSize()) ) ||
+			(f.lastModified() > track->getModifyTime()) )
+		{ // Otherwise, if tracks's size or mod. time changed, update.
+
+			QString path = track->getPath();
+
+			if(reloadTrack(i, path))
+				paths.insert(path);
+			++corrections;
+
+		}
+		else
+		{ // Do nothing with this track.
+
+			paths.insert(track->getPath());
+
+		}
+
+		if(corrections >= CSDirCollection::ValidationBatchSize)
+		{
+			Q_EMIT contentsChanged();
+			corrections = 0;
+		}
+
+		setProgress(++pcount);
+	}
+
+	// Check if there are any new tracks that need to be added.
+
+	QDirIterator walker(root, QDir::Files | QDir::NoSymLinks,
+		getRecursive() ? QDirIterator::Subdirectories :
+		QDirIterator::NoIteratorFlags);
+
+	while(r && walker.hasNext())
+	{
+		if(!checkpoint())
+		{
+			r = false;
+			break;
+		}
+
+		walker.next();
+
+		// If track isn't already present, create a new one and add it.
+
+		if(!paths.contains(walker.fileInfo().absoluteFilePath()))
+		{
+			track = new CSDirTrack(
+				walker.fileInfo().absoluteFilePath());
+
+			getInstrumentation()->beginPhase("tags");
+			bool loaded = track->refresh();
+			getInstrumentation()->endPhase("tags");
+
+			if( (!loaded) || (!addTrack(track)) )
+			{
+				delete track;
+				track = NULL;
+			}
+			else
+			{
+				++corrections;
+			}
+		}
+
+		if(corrections >= CSDirCollection::ValidationBatchSize)
+		{
+			Q_EMIT contentsChanged();
+			corrections = 0;
+		}
+
+		setProgress(++pcount);
+	}
+
+	if(corrections > 0)
+		Q_EMIT contentsChanged();
+
+	setValidating(false);
+
+	/*
+	 * Only a validation which visited every track and file counts; if we
+	 * were interrupted part way through, request another one.
+	 */
+
+	setValidationPending(!r);
+
+	Q_EMIT jobFinished(QString());
+	return r;
+}
+
 /*!
  * This function returns our collection's mount point - i.e., the parent
  * directory of the collection that was given to loadCollectionFromPath(). If
@@ -461,10 +645,12 @@ QByteArray CSDirCollection::serialize() const
 
 /*!
  * This function restores a directory collection from the given serialized
- * data. We also call refresh(), so as to ensure that nothing has changed since
- * we were saved - any tracks that have been added, removed or modified will be
- * picked up. Note that this is generally MUCH faster than calling
- * loadCollectionFromPath() or similar.
+ * data. The restored tracks are trusted as-is, so this doesn't touch the disk
+ * at all; instead, we are marked as needing validation, and validate() later
+ * checks our contents against the disk in the background, picking up any
+ * tracks that have been added, removed or modified since we were saved. Note
+ * that this is generally MUCH faster than calling loadCollectionFromPath() or
+ * similar.
  *
  * \param d The QByteArray to load our state from.
  */
@@ -523,10 +709,13 @@ void CSDirCollection::unserialize(const QByteArray &d)
 			delete t;
 	}
 
-	// Try to refresh our contents now that we've loaded everything.
+	/*
+	 * Trust what we've loaded for now, and let our contents be validated
+	 * against the disk in the background (see validate()).
+	 */
 
 	setSaveOnExit(true);
-	if(!refresh()) clear(false);
+	setValidationPending(true);
 }
 
 /*!
@@ -587,6 +776,8 @@ bool CSDirCollection::quietCopyTrack(const CSAbstractCollection *s,
 	if(!s->containsKey(k))
 		return false;
 
+	CSTraceSpan span("dir", "copy");
+
 	// Figure out where we are going to put the file.
 
 	QString dPath = getAbsoluteWritePath(s, k);
@@ -618,8 +809,24 @@ bool CSDirCollection::quietCopyTrack(const CSAbstractCollection *s,
 	// Do the copy!
 
 	int64_t read;
-	while( (read = i.read(buf, 5242880)) > 0 )
-		o.write(buf, read);
+	for(;;)
+	{
+		getInstrumentation()->beginPhase("read");
+		read = i.read(buf, 5242880);
+		getInstrumentation()->endPhase("read");
+
+		if(read <= 0)
+			break;
+
+		getInstrumentation()->addBytesRead(read);
+
+		getInstrumentation()->beginPhase("write");
+		int64_t written = o.write(buf, read);
+		getInstrumentation()->endPhase("write");
+
+		if(written > 0)
+			getInstrumentation()->addBytesWritten(written);
+	}
 
 	i.close();
 	o.close();
@@ -627,7 +834,12 @@ bool CSDirCollection::quietCopyTrack(const CSAbstractCollection *s,
 	// Add the new track to our collection.
 
 	CSDirTrack *track = new CSDirTrack(dPath);
-	if(!track->refresh())
+
+	getInstrumentation()->beginPhase("tags");
+	bool loaded = track->refresh();
+	getInstrumentation()->endPhase("tags");
+
+	if(!loaded)
 	{
 		delete track;
 		QFile::remove(dPath);
@@ -641,6 +853,36 @@ bool CSDirCollection::quietCopyTrack(const CSAbstractCollection *s,
 	return true;
 }
 
+/*!
+ * This function re-reads the track at the given row from the given file,
+ * after the file has been modified. Published snapshots may still refer to the
+ * existing track descriptor, so rather than modifying it, we replace it with a
+ * new one. If the file can no longer be read, or if it is now a duplicate of
+ * another track in our collection, then the track is removed instead.
+ *
+ * \param r The row of the track to reload.
+ * \param p The path to the track's file.
+ * \return True if the track was reloaded, or false if it was removed.
+ */
+bool CSDirCollection::reloadTrack(int r, const QString &p)
+{
+	CSDirTrack *track = new CSDirTrack(p);
+
+	getInstrumentation()->beginPhase("tags");
+	bool loaded = track->refresh();
+	getInstrumentation()->endPhase("tags");
+
+	if( (!loaded) || (!replaceTrack(r, track)) )
+	{
+		delete track;
+		removeTrack(r);
+
+		return false;
+	}
+
+	return true;
+}
+
 /*!
  * This function processes a given string, and returns a version of it which is
  * valid for filenames (i.e., with all non-ASCII characters removed or
@@ -44,6 +44,12 @@ class CSDirCollection : public CSAbstractCollection
 	Q_OBJECT
 
 	public:
+		/*!
+		 * The number of corrections validate() makes before notifying
+		 * anyone displaying us that our contents have changed.
+		 */
+		static const int ValidationBatchSize = 64;
+
 		CSDirCollection(CSCollectionModel *p = 0);
 		CSDirCollection(const QString &n,
 			CSCollectionModel *p = 0);
@@ -60,6 +66,7 @@ class CSDirCollection : public CSAbstractCollection
 		virtual bool loadCollectionFromPath(const QString &p,
 			bool f = true);
 		virtual bool refresh();
+		virtual bool validate();
 
 		virtual QString getMountPoint() const;
 		virtual QString getRelativePath(const QString &k) const;
@@ -94,6 +101,8 @@ class CSDirCollection : public CSAbstractCollection
 			const CSAbstractCollection *s,
 			const QString &k) const;
 
+		bool reloadTrack(int r, const QString &p);
+
 		void startJob(const QString &j);
 		void finishJob();
 
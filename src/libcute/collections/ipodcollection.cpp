@@ -27,9 +27,11 @@
 
 #include <QFile>
 #include <QList>
+#include <QSet>
 #include <QDir>
 #include <QDataStream>
 #include <QFileInfo>
+#include <QCryptographicHash>
 
 #include "libcute/defines.h"
 #include "libcute/collections/ipodcollectionconfigwidget.h"
@@ -38,39 +40,37 @@
 #include "libcute/tags/taggedfile.h"
 #include "libcute/util/guiutils.h"
 #include "libcute/util/systemutils.h"
+#include "libcute/util/trace.h"
 #include "libcute/widgets/collectionmodel.h"
 
 extern "C" {
 	#include <gdk-pixbuf/gdk-pixbuf.h>
 }
 
-#ifdef CUTESYNC_DEBUG
-	/*!
-	 * This is a debugging function which creates a new false iPod
-	 * directory structure in the given path. This is mainly useful for
-	 * testing purposes.
-	 *
-	 * \param n The name of the new iPod.
-	 * \param p The path in which to initialize a new iPod structure.
-	 * \return True on success, or false otherwise.
-	 */
-	bool CSIPodCollection::createFalseIPod(
-		const QString &n, const QString &p)
-	{
-		GError *error = NULL;
-
-		if(!itdb_init_ipod(p.toStdString().c_str(), "C297",
-			n.toStdString().c_str(), &error))
-		{
-			if(error != NULL)
-				g_error_free(error);
+/*!
+ * This is a utility function which creates a new, empty false iPod directory
+ * structure in the given path. This is mainly useful for testing purposes,
+ * e.g. when generating a test corpus (see cutesync-corpus).
+ *
+ * \param n The name of the new iPod.
+ * \param p The path in which to initialize a new iPod structure.
+ * \return True on success, or false otherwise.
+ */
+bool CSIPodCollection::createFalseIPod(const QString &n, const QString &p)
+{
+	GError *error = NULL;
 
-			return false;
-		}
+	if(!itdb_init_ipod(p.toStdString().c_str(), "C297",
+		n.toStdString().c_str(), &error))
+	{
+		if(error != NULL)
+			g_error_free(error);
 
-		return true;
+		return false;
 	}
-#endif
+
+	return true;
+}
 
 /*!
  * This is our default constructor, which creates a new uninitialized
@@ -80,7 +80,7 @@ extern "C" {
  */
 CSIPodCollection::CSIPodCollection(CSCollectionModel *p)
 	: CSAbstractCollection(p), optionsModified(false), artwork(true),
-		caselessSort(true), ignorePrefixes(true), itdb(NULL), root("")
+		caselessSort(true), ignorePrefixes(true), itdb(), root("")
 {
 }
 
@@ -95,7 +95,7 @@ CSIPodCollection::CSIPodCollection(const QString &n,
 	CSCollectionModel *p)
 	: CSAbstractCollection(n, p), optionsModified(false),
 		artwork(true), caselessSort(true), ignorePrefixes(true),
-		itdb(NULL), root("")
+		itdb(), root("")
 {
 }
 
@@ -110,7 +110,7 @@ CSIPodCollection::CSIPodCollection(const DisplayDescriptor *d,
 	CSCollectionModel *p)
 	: CSAbstractCollection(d, p), optionsModified(false),
 		artwork(true), caselessSort(true), ignorePrefixes(true),
-		itdb(NULL), root("")
+		itdb(), root("")
 {
 }
 
@@ -126,7 +126,7 @@ CSIPodCollection::CSIPodCollection(const QString &n,
 	const DisplayDescriptor *d, CSCollectionModel *p)
 	: CSAbstractCollection(n, d, p), optionsModified(false),
 		artwork(true), caselessSort(true), ignorePrefixes(true),
-		itdb(NULL), root("")
+		itdb(), root("")
 {
 }
 
@@ -177,7 +177,7 @@ QString CSIPodCollection::getAboutText() const
 		CSSystemUtils::getDeviceCapacity(
 		getMountPoint().toLatin1().data()))) + QString("\n");
 
-	if(itdb != NULL)
+	if(itdb)
 	{
 		const Itdb_IpodInfo *itdbInfo =
 			itdb_device_get_ipod_info(itdb->device);
@@ -214,7 +214,8 @@ QString CSIPodCollection::getAboutText() const
 /*!
  * This function loads a new iTunes DB from the given iPod mount point. By
  * default we flush the current collection (if any), although this behavior is
- * optional.
+ * optional. If the DB can't be parsed, our collection is cleared; if we are
+ * interrupted, our previous collection is restored instead.
  *
  * \param p The path at which an iPod is mounted.
  * \param f Whether or not we flush the current collection or just discard it.
@@ -229,15 +230,18 @@ bool CSIPodCollection::loadCollectionFromPath(const QString &p, bool f)
 	Itdb_iTunesDB *i = NULL;
 	int pr = 0;
 
-	Q_EMIT jobStarted(tr("Loading collection from path..."), true);
+	// Copy the path, since it may refer to our own root (see reload()).
+	QString path = p;
 
-	// Clean up the current collection.
+	Q_EMIT jobStarted(tr("Loading collection from path..."), true);
 
-	clear(f);
+	if(f) flush();
 
 	// Try loading the given collection
 
-	i = itdb_parse(p.toUtf8().data(), &error);
+	getInstrumentation()->beginPhase("database");
+	i = itdb_parse(path.toUtf8().data(), &error);
+	getInstrumentation()->endPhase("database");
 
 	if( (error != NULL) || (i == NULL) )
 	{
@@ -259,31 +263,53 @@ std::cout << "Unknown error while loading collection from path.\n";
 		}
 
 		if(i != NULL) itdb_free(i);
+
+		clear(false);
+
+		Q_EMIT jobFinished(QString("Failed to load iTunes DB: %1\n")
+			.arg(path));
 		return false;
 	}
 
-	itdb = i;
+	// Clean up the current collection, keeping it in case we are stopped.
+
+	publishSnapshot();
+	std::shared_ptr<const TrackSnapshot> previous = getSnapshot();
+	std::shared_ptr<Itdb_iTunesDB> previousItdb = itdb;
+	QString previousRoot = root;
+	QByteArray previousSignature = signature;
+	bool previousModified = isModified();
+
+	clear(false);
+
+	itdb = std::shared_ptr<Itdb_iTunesDB>(i, itdb_free);
 
 	// Iterate through the collection, and grab the tracks we care about.
 
-	Q_EMIT progressLimitsUpdated(0, itdb_tracks_number(itdb));
+	setProgressLimits(0, itdb_tracks_number(itdb.get()));
 	trackList = g_list_first(itdb->tracks);
 	while(trackList != NULL)
 	{
-		if(isInterrupted())
+		if(!checkpoint())
 		{
-			clear(false);
+			restoreSnapshot(previous);
+			itdb = previousItdb;
+			root = previousRoot;
+			signature = previousSignature;
+			setModified(previousModified);
+
+			Q_EMIT jobFinished(QString());
 			return false;
 		}
 
 		Itdb_Track *t = static_cast<Itdb_Track *>(trackList->data);
 		trackList = trackList->next;
-		Q_EMIT progressUpdated(++pr);
+		setProgress(++pr);
 
 		if(t->mediatype == 0x00000001)
 		{
 			// 0x 00 00 00 01 means AUDIO; all we care about.
-			addTrack(new CSIPodTrack(t));
+			addTrack(new CSIPodTrack(t, itdb));
 		}
 	}
 
@@ -291,8 +317,9 @@ std::cout << "Unknown error while loading collection from path.\n";
 
 	setModified(false);
 
-	QDir mp(p);
+	QDir mp(path);
 	root = mp.absolutePath();
+	signature = getDatabaseSignature(root);
 
 	// Set our collection options.
 
@@ -435,7 +462,12 @@ void CSIPodCollection::setIgnoreCommonPrefixes(bool i)
  */
 bool CSIPodCollection::flush()
 {
-	if(itdb == NULL) return false;
+	// If we were restored from a snapshot, there may be nothing to write.
+
+	if( (!itdb) && (!optionsModified) && (!isModified()) )
+		return true;
+
+	if(!ensureDatabase()) return false;
 
 	/* If our options have changed, apply them to the iTunes DB before it
 	 * is flushed to the device.
@@ -494,7 +526,10 @@ bool CSIPodCollection::flush()
 	GError *error = NULL;
 	if(isModified())
 	{
-		if(!itdb_write(itdb, &error))
+		CSPhaseTimer phase(getInstrumentation(), "database");
+		CSTraceSpan span("ipod", "itdb_write");
+
+		if(!itdb_write(itdb.get(), &error))
 		{
 			if(error != NULL)
 			{
@@ -515,6 +550,10 @@ std::cout << "Unknown error writing iTunes DB.\n";
 				return false;
 			}
 		}
+
+		// Our snapshot now describes the iTunes DB we just wrote.
+
+		signature = getDatabaseSignature(root);
 	}
 
 	setModified(false);
@@ -531,20 +570,22 @@ void CSIPodCollection::clear(bool f)
 {
 	CSAbstractCollection::clear(f);
 
-	if(itdb != NULL)
-	{
-		itdb_free(itdb);
-		itdb = NULL;
-	}
+	/*
+	 * Our tracks share ownership of the iTunes DB, so it is only actually
+	 * freed once no published snapshot refers to any of them anymore.
+	 */
+
+	itdb.reset();
 
 	root = "";
+	signature.clear();
 }
 
 /*!
  * This function serializes our collection into a QByteArray so it could be,
- * e.g., saved to the disk to be loaded later. Note that, because of the way
- * iPods work, we don't bother to serialize track descriptors - it is already
- * really fast to load them from the device, so it isn't worth it.
+ * e.g., saved to the disk to be loaded later. Along with our options, we store
+ * a snapshot of our track descriptors, and the signature of the iTunes DB they
+ * were read from (see getDatabaseSignature()).
  *
  * \return A QByteArray containing our collection's state.
  */
@@ -569,13 +610,25 @@ QByteArray CSIPodCollection::serialize() const
 
 	out << artwork;
 
+	// Write our track snapshot.
+
+	out << signature;
+
+	QList<CSTrack *> tracks = allTracks();
+	out << static_cast<qint32>(tracks.count());
+
+	for(int i = 0; i < tracks.count(); ++i)
+		out << tracks.at(i)->serialize();
+
 	return obuf;
 }
 
 /*!
- * This function restores our collection from a serialized QByteArray. This
- * mostly just restores the collection name and path; tracks are re-loaded from
- * the iTunes database on the device.
+ * This function restores our collection from a serialized QByteArray. If the
+ * iTunes DB on the device still matches the signature of our track snapshot,
+ * our tracks are restored from the snapshot and parsing the iTunes DB is
+ * deferred until we need to write to it (see ensureDatabase()). Otherwise, our
+ * tracks are re-loaded from the iTunes DB on the device.
  *
  * \param d The QByteArray to restore our state from.
  */
@@ -612,9 +665,51 @@ void CSIPodCollection::unserialize(const QByteArray &d)
 
 	in >> artwork;
 
-	// Refresh the collection.
-
 	setSaveOnExit(true);
+
+	// Try to restore our tracks from our snapshot.
+
+	QByteArray sig;
+	qint32 tc = 0;
+
+	if(!in.atEnd())
+	{
+		in >> sig;
+		in >> tc;
+	}
+
+	if( (in.status() == QDataStream::Ok) && (!sig.isEmpty()) &&
+		(sig == getDatabaseSignature(root)) )
+	{
+		setProgressLimits(0, tc);
+
+		QByteArray td;
+		for(qint32 i = 0; i < tc; ++i)
+		{
+			CSIPodTrack *t = new CSIPodTrack(NULL);
+			in >> td;
+			t->unserialize(td);
+
+			if(!addTrack(t))
+				delete t;
+
+			setProgress(i + 1);
+		}
+
+		if(in.status() == QDataStream::Ok)
+		{
+			signature = sig;
+			setModified(false);
+			refreshCollectionOptions();
+
+			return;
+		}
+
+		CSAbstractCollection::clear(false);
+	}
+
+	// Our snapshot is out of date, so refresh the collection.
+
 	if(!refresh()) clear(false);
 
 	// Set our collection options from the parsed collection.
@@ -660,7 +755,7 @@ CSAbstractCollectionConfigWidget *
  */
 bool CSIPodCollection::quietDeleteTrack(const QString &k)
 {
-	if(itdb == NULL) return false;
+	if(!ensureDatabase()) return false;
 	CSIPodTrack *track = dynamic_cast<CSIPodTrack *>(
 		trackAt(k));
 	if(track == NULL) return false;
@@ -702,10 +797,14 @@ bool CSIPodCollection::quietDeleteTrack(const QString &k)
 			itdb_playlist_remove(emptyPlaylists.at(i));
 	}
 
-	// Remove the track itself from our collection and the iTunes DB.
+	/*
+	 * Remove the track itself from our collection and the iTunes DB. Once
+	 * it is unlinked, the track belongs to its descriptor, which is freed
+	 * once no published snapshot refers to it anymore.
+	 */
 
 	QString hash = track->getHash();
-	itdb_track_remove(track->getTrack());
+	itdb_track_unlink(track->getTrack());
 	removeTrack(hash);
 
 	// Set our database as having been modified.
@@ -727,14 +826,19 @@ bool CSIPodCollection::quietCopyTrack(
 {
 #pragma message "TODO - Use slotsignal error reporting"
 
-	if(itdb == NULL) return false;
+	if(!ensureDatabase()) return false;
 	if(!s->containsKey(k)) return false;
 
+	CSTraceSpan span("ipod", "copy");
+
 	// Create the new track object we will be adding.
 
 	QString p = s->getAbsolutePath(k);
 
+	getInstrumentation()->beginPhase("tags");
 	CSIPodTrack *track = CSIPodTrack::createTrackFromFile(p);
+	getInstrumentation()->endPhase("tags");
+
 	if(track == NULL)
 	{
 #ifdef CUTESYNC_DEBUG
@@ -752,12 +856,14 @@ std::cout << "Error creating new track object.\n";
 	 * we need to set this.
 	 */
 
-	track->getTrack()->itdb = itdb;
+	track->getTrack()->itdb = itdb.get();
 
 	// Try to set the track's artwork, if it is enabled.
 
 	if(getAlbumArtworkEnabled())
 	{
+		CSPhaseTimer phase(getInstrumentation(), "artwork");
+
 		gpointer cover = getTrackCoverArt(s, k);
 		if(cover != NULL)
 		{
@@ -775,9 +881,14 @@ std::cout << "Error setting track thumbnail: " <<
 	// Copy the track to the iPod.
 
 	GError *error = NULL;
+
+	getInstrumentation()->beginPhase("transfer");
 //itdb_cp_track_to_ipod @ itdb_itunesdb.c:7563
-	if(!itdb_cp_track_to_ipod(track->getTrack(),
-		p.toUtf8().data(), &error))
+	bool copied = itdb_cp_track_to_ipod(track->getTrack(),
+		p.toUtf8().data(), &error);
+	getInstrumentation()->endPhase("transfer");
+
+	if(!copied)
 	{
 		if(error != NULL)
 		{
@@ -795,16 +906,26 @@ std::cout << "Unknown error copying track to iPod!\n";
 #endif
 		}
 
+		track->getTrack()->itdb = NULL;
 		delete track;
 		return false;
 	}
 
+	getInstrumentation()->addBytesRead(QFileInfo(p).size());
+	getInstrumentation()->addBytesWritten(track->getTrack()->size);
+
 	// Add track to the ITDB, the MPL, our lists, and set ourself modified.
 
-	itdb_track_add(itdb, track->getTrack(), -1);
-	itdb_playlist_add_track(itdb_playlist_mpl(itdb),
-		track->getTrack(), -1);
-	addTrack(track);
+	Itdb_Track *t = track->takeTrack();
+	delete track;
+
+	itdb_track_add(itdb.get(), t, -1);
+	itdb_playlist_add_track(itdb_playlist_mpl(itdb.get()), t, -1);
+
+	track = new CSIPodTrack(t, itdb);
+	if(!addTrack(track))
+		delete track;
+
 	setModified(true);
 
 	return true;
@@ -838,7 +959,7 @@ gpointer CSIPodCollection::getTrackCoverArt(
 
 	// Do some sanity checks.
 
-	if(itdb == NULL) return NULL;
+	if(!itdb) return NULL;
 	if(!s->containsKey(k)) return NULL;
 
 	path = s->getAbsolutePath(k);
@@ -914,7 +1035,7 @@ gpointer CSIPodCollection::getTrackCoverArt(
  */
 void CSIPodCollection::refreshCollectionOptions()
 {
-	if(itdb != NULL)
+	if(!getMountPoint().isEmpty())
 	{
 
 		QFile optionsFile(getMountPoint() +
@@ -952,6 +1073,157 @@ void CSIPodCollection::refreshCollectionOptions()
 	}
 }
 
+/*!
+ * This function makes sure our iTunes DB has been parsed, which is needed
+ * before we can write to it. If we were restored from a snapshot (see
+ * unserialize()), then our tracks don't belong to any iTunes DB yet; we parse
+ * the DB now, and swap each of our tracks for the parsed track with the same
+ * database ID. If the DB no longer matches our snapshot, then our tracks are
+ * re-loaded from the parsed DB instead.
+ *
+ * \return True if our iTunes DB is available, or false otherwise.
+ */
+bool CSIPodCollection::ensureDatabase()
+{
+	if(itdb) return true;
+	if(root.isEmpty()) return false;
+
+	GError *error = NULL;
+	Itdb_iTunesDB *i = NULL;
+
+	getInstrumentation()->beginPhase("database");
+	i = itdb_parse(root.toUtf8().data(), &error);
+	getInstrumentation()->endPhase("database");
+
+	if( (error != NULL) || (i == NULL) )
+	{
+		if(error != NULL)
+		{
+#ifdef CUTESYNC_DEBUG
+std::cout << "Error while parsing iTunes DB: " << error->message << "\n";
+#endif
+
+			g_error_free(error);
+			error = NULL;
+		}
+
+		if(i != NULL) itdb_free(i);
+		return false;
+	}
+
+	itdb = std::shared_ptr<Itdb_iTunesDB>(i, itdb_free);
+
+	// Index the parsed audio tracks by their database IDs.
+
+	QHash<quint64, Itdb_Track *> parsed;
+	GList *trackList = g_list_first(itdb->tracks);
+	while(trackList != NULL)
+	{
+		Itdb_Track *t = static_cast<Itdb_Track *>(trackList->data);
+		trackList = trackList->next;
+
+		// 0x 00 00 00 01 means AUDIO; all we care about.
+		if(t->mediatype == 0x00000001)
+			parsed.insert(static_cast<quint64>(t->dbid), t);
+	}
+
+	// Check that every one of our tracks is still there.
+
+	int n = count();
+	bool matched = (n == parsed.count());
+	QSet<quint64> seen;
+
+	for(int j = 0; matched && (j < n); ++j)
+	{
+		CSIPodTrack *t = dynamic_cast<CSIPodTrack *>(trackAt(j));
+
+		matched = (t != NULL) && (t->getTrack() != NULL);
+
+		if(matched)
+		{
+			quint64 dbid =
+				static_cast<quint64>(t->getTrack()->dbid);
+
+			matched = parsed.contains(dbid) &&
+				!seen.contains(dbid);
+			seen.insert(dbid);
+		}
+	}
+
+	/*
+	 * Published snapshots may still refer to our restored tracks, so we
+	 * don't modify them; instead, we replace all of them at once with new
+	 * descriptors for the equivalent parsed tracks, in the same order.
+	 */
+
+	if(matched)
+	{
+		QList<CSTrack *> tracks;
+		tracks.reserve(n);
+
+		for(int j = 0; j < n; ++j)
+		{
+			CSIPodTrack *t =
+				dynamic_cast<CSIPodTrack *>(trackAt(j));
+			quint64 dbid =
+				static_cast<quint64>(t->getTrack()->dbid);
+
+			tracks.append(new CSIPodTrack(
+				parsed.value(dbid), itdb));
+		}
+
+		replaceTracks(tracks);
+	}
+
+	if(!matched)
+	{
+		CSAbstractCollection::clear(false);
+
+		QHash<quint64, Itdb_Track *>::const_iterator it;
+		for(it = parsed.constBegin(); it != parsed.constEnd(); ++it)
+			addTrack(new CSIPodTrack(it.value(), itdb));
+
+		Q_EMIT contentsChanged();
+	}
+
+	signature = getDatabaseSignature(root);
+	return true;
+}
+
+/*!
+ * This function computes the signature of the iTunes DB on the iPod mounted at
+ * the given path. The signature consists of the DB's size, its modification
+ * time and a checksum of its header, so it changes whenever the DB is
+ * rewritten. If there is no readable iTunes DB at the given path, an empty
+ * signature is returned.
+ *
+ * \param p The path at which an iPod is mounted.
+ * \return The signature of the iPod's iTunes DB.
+ */
+QByteArray CSIPodCollection::getDatabaseSignature(const QString &p)
+{
+	QFile db(QDir::cleanPath(p).append(
+		QString("/iPod_Control/iTunes/iTunesDB")
+		.replace('/', QDir::separator())));
+
+	if(!db.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	QFileInfo info(db);
+	QByteArray header = db.read(4096);
+	db.close();
+
+	QByteArray obuf;
+	QDataStream out(&obuf, QIODevice::ReadWrite);
+	out.setVersion(SERIALIZATION_VERSION);
+
+	out << static_cast<qint64>(info.size());
+	out << info.lastModified();
+	out << QCryptographicHash::hash(header, QCryptographicHash::Sha1);
+
+	return obuf;
+}
+
 /*!
  * This slot handles one of our configuration widgets requesting that its
  * current state be applied to our collection.
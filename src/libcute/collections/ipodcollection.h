@@ -21,6 +21,8 @@
 
 #include "libcute/collections/abstractcollection.h"
 
+#include <memory>
+
 #include <QString>
 #include <QList>
 #include <QHash>
@@ -38,16 +40,20 @@ class CSCollectionModel;
  *
  * It is designed to load an iTunes DB stored on an iPod device via libgpod and
  * parse the information into a usable format.
+ *
+ * When serialized, we also store a snapshot of our track table, along with a
+ * signature of the iTunes DB it was read from (its size, modification time and
+ * a checksum of its header). If the iTunes DB still matches that signature when
+ * we are unserialized, our tracks are restored from the snapshot, and parsing
+ * the iTunes DB is deferred until we actually need to write to it.
  */
 class CSIPodCollection : public CSAbstractCollection
 {
 	Q_OBJECT
 
 	public:
-		#ifdef CUTESYNC_DEBUG
-			static bool createFalseIPod(
-				const QString &n, const QString &p);
-		#endif
+		static bool createFalseIPod(const QString &n,
+			const QString &p);
 
 		CSIPodCollection(CSCollectionModel *p = 0);
 		CSIPodCollection(const QString &n,
@@ -94,15 +100,19 @@ class CSIPodCollection : public CSAbstractCollection
 
 	private:
 		bool optionsModified, artwork, caselessSort, ignorePrefixes;
-		Itdb_iTunesDB *itdb;
+		std::shared_ptr<Itdb_iTunesDB> itdb;
 		bool itdbModified;
 		QString root;
+		QByteArray signature;
 
 		gpointer getTrackCoverArt(const CSAbstractCollection *s,
 			const QString &k);
 
 		void refreshCollectionOptions();
 
+		bool ensureDatabase();
+		static QByteArray getDatabaseSignature(const QString &p);
+
 	private Q_SLOTS:
 		void doConfigurationApply();
 		void doConfigurationReset();
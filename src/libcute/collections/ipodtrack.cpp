@@ -18,6 +18,8 @@
 
 #include "ipodtrack.h"
 
+#include <QDataStream>
+
 #include "libcute/defines.h"
 #include "libcute/tags/filetyperesolver.h"
 #include "libcute/tags/taggedfile.h"
@@ -91,23 +93,40 @@ CSIPodTrack *CSIPodTrack::createTrackFromFile(const QString &p)
 
 /*!
  * This constructor creates a new iPod track descriptor based on the given
- * existing libgpod track object. Note that we take ownership of this track
- * object; we will call itdb_track_free on it, so DO NOT do it yourself!
+ * existing libgpod track object, which must not belong to an iTunes DB. Note
+ * that we take ownership of this track object; we will call itdb_track_free on
+ * it, so DO NOT do it yourself!
  *
  * \param t The track object we will represent.
  */
 CSIPodTrack::CSIPodTrack(Itdb_Track *t)
-	: track(t)
+	: track(t), database()
+{
+}
+
+/*!
+ * This constructor creates a new iPod track descriptor for a track belonging
+ * to the given parsed iTunes DB. The DB owns the track, so we don't free it;
+ * instead, we share ownership of the DB, so it isn't freed before we are. If
+ * the track is later unlinked from the DB (see itdb_track_unlink()), then it
+ * is ours, and we will free it.
+ *
+ * \param t The track object we will represent.
+ * \param d The iTunes DB the track belongs to.
+ */
+CSIPodTrack::CSIPodTrack(Itdb_Track *t,
+	const std::shared_ptr<Itdb_iTunesDB> &d)
+	: track(t), database(d)
 {
 }
 
 /*!
- * This is our default destructor, which frees our libgpod track (if any) and
- * cleans up our object.
+ * This is our default destructor, which frees our libgpod track (if we own
+ * it; i.e., if it doesn't belong to an iTunes DB) and cleans up our object.
  */
 CSIPodTrack::~CSIPodTrack()
 {
-	if(track != NULL)
+	if( (track != NULL) && (track->itdb == NULL) )
 		itdb_track_free(track);
 }
 
@@ -116,10 +135,10 @@ CSIPodTrack::~CSIPodTrack()
  * Note that, depending on what you gave the constructor, this function can
  * return NULL.
  *
- * Also note that these track descriptors ALWAYS maintain ownership of their
- * libgpod track objects; this class will handle freeing memory appropriately,
- * so you should never do that manually on the pointer returned by this
- * function.
+ * Also note that these track descriptors (or the iTunes DB they share) ALWAYS
+ * maintain ownership of their libgpod track objects; this class will handle
+ * freeing memory appropriately, so you should never do that manually on the
+ * pointer returned by this function.
  *
  * \return A pointer to the libgpod track we represent.
  */
@@ -128,6 +147,22 @@ Itdb_Track *CSIPodTrack::getTrack() const
 	return track;
 }
 
+/*!
+ * This function releases our ownership of the libgpod track we represent, and
+ * returns it. After this, we no longer represent any track, and it is up to the
+ * caller to free the returned track (or to add it to an iTunes DB, which will
+ * then own it).
+ *
+ * \return The track we represented, or NULL if we didn't represent one.
+ */
+Itdb_Track *CSIPodTrack::takeTrack()
+{
+	Itdb_Track *t = track;
+	track = NULL;
+
+	return t;
+}
+
 /*!
  * This function returns the absolute path to the track we represent. This is
  * going to be a path on the iPod device.
@@ -382,30 +417,160 @@ QDateTime CSIPodTrack::getModifyTime() const
 }
 
 /*!
- * iPod tracks are not serializable. This is because, since all of the
- * information about them is stored in the iTunes DB on an iPod, reading an
- * entire collection of tracks is VERY fast - therefore, there is really no
- * purpose behind serializing track descriptors to read them later.
+ * This function serializes our track descriptor, so it can be restored later
+ * without parsing the iTunes DB it came from. Only the attributes we actually
+ * use (our tags, our location on the iPod and our database ID) are stored.
  *
- * \return An empty byte array.
+ * \return A byte array containing our track descriptor's state.
  */
 QByteArray CSIPodTrack::serialize() const
 {
-	return QByteArray();
+	QByteArray obuf;
+	QDataStream out(&obuf, QIODevice::ReadWrite);
+
+	out.setVersion(SERIALIZATION_VERSION);
+	if(out.status() != QDataStream::Ok) return QByteArray();
+	if(track == NULL) return QByteArray();
+
+	// Write our version number.
+	out << static_cast<qint32>(SERIALIZATION_VERSION);
+
+	// Write our attributes!
+
+	out << static_cast<quint64>(track->dbid);
+	out << QByteArray(track->ipod_path);
+	out << QByteArray(track->filetype);
+	out << getTitle();
+	out << getArtist();
+	out << getAlbum();
+	out << getComment();
+	out << getGenre();
+	out << getAlbumArtist();
+	out << getComposer();
+	out << static_cast<qint32>(track->year);
+	out << static_cast<qint32>(track->track_nr);
+	out << static_cast<qint32>(track->tracks);
+	out << static_cast<qint32>(track->cd_nr);
+	out << static_cast<qint32>(track->tracklen);
+	out << static_cast<qint32>(track->bitrate);
+	out << static_cast<qint32>(track->samplerate);
+	out << static_cast<qint64>(track->size);
+	out << static_cast<qint64>(track->time_modified);
+	out << static_cast<quint32>(track->mediatype);
+
+	// Done.
+
+	return obuf;
 }
 
 /*!
- * iPod tracks are not serializable. This is because, since all of the
- * information about them is stored in the iTunes DB on an iPod, reading an
- * entire collection of tracks is VERY fast - therefore, there is really no
- * purpose behind serializing track descriptors to read them later.
+ * This function restores our track descriptor from a serialized state (see
+ * serialize()). If we don't already represent a libgpod track, a new one is
+ * created; note that it doesn't belong to any iTunes DB, so it can only be
+ * used to read our attributes (see CSIPodCollection::ensureDatabase(), which
+ * replaces such descriptors with ones for the equivalent parsed tracks).
  *
- * As such, this function does nothing.
- *
- * \return A byte array to unserialize (unused).
+ * \param d The byte array containing a stored track descriptor state.
  */
-void CSIPodTrack::unserialize(const QByteArray &UNUSED(d))
+void CSIPodTrack::unserialize(const QByteArray &d)
 {
+	qint32 version;
+
+	// Create our input stream.
+
+	QDataStream in(d);
+	if(in.status() != QDataStream::Ok) return;
+
+	// Read our version.
+
+	in >> version;
+	if(version > SERIALIZATION_VERSION) return;
+
+	in.setVersion(version);
+	if(in.status() != QDataStream::Ok) return;
+
+	if(track == NULL)
+		track = itdb_track_new();
+
+	auto toGString = [](const QString &s) -> gchar *
+	{
+		return g_strdup(s.toUtf8().data());
+	};
+
+	// Read our identifying attributes.
+
+	quint64 u64b;
+	QByteArray bab;
+
+	in >> u64b;
+	track->dbid = static_cast<guint64>(u64b);
+
+	in >> bab;
+	track->ipod_path = g_strdup(bab.data());
+
+	in >> bab;
+	track->filetype = g_strdup(bab.data());
+
+	// Read our string attributes!
+
+	QString sb;
+
+	in >> sb;
+	track->title = toGString(sb);
+
+	in >> sb;
+	track->artist = toGString(sb);
+
+	in >> sb;
+	track->album = toGString(sb);
+
+	in >> sb;
+	track->comment = toGString(sb);
+
+	in >> sb;
+	track->genre = toGString(sb);
+
+	in >> sb;
+	track->albumartist = toGString(sb);
+
+	in >> sb;
+	track->composer = toGString(sb);
+
+	// Read our numeric attributes.
+
+	qint32 i32b;
+	qint64 i64b;
+	quint32 u32b;
+
+	in >> i32b;
+	track->year = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->track_nr = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->tracks = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->cd_nr = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->tracklen = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->bitrate = static_cast<gint32>(i32b);
+
+	in >> i32b;
+	track->samplerate = static_cast<guint16>(i32b);
+
+	in >> i64b;
+	track->size = static_cast<guint32>(i64b);
+
+	in >> i64b;
+	track->time_modified = static_cast<time_t>(i64b);
+
+	in >> u32b;
+	track->mediatype = static_cast<guint32>(u32b);
 }
 
 /*!
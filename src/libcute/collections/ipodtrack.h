@@ -22,6 +22,7 @@
 #include "libcute/collections/track.h"
 
 #include <cstdint>
+#include <memory>
 
 extern "C" {
 	#include <glib.h>
@@ -34,9 +35,14 @@ extern "C" {
  * Track attributes are retrieved via libgpod, rather than by reading the tags
  * from the track files themselves.
  *
- * Also note that this track descriptor doesn't do serialization: because of
- * how fast it is to read track data fro the iTunes DB file on iPod devices, it
- * isn't worthwhile to serialize the data encapsulated by one of these objects.
+ * Track descriptors can be serialized, so an iPod collection can be restored
+ * from a snapshot without parsing its iTunes DB (see CSIPodCollection).
+ *
+ * A descriptor either owns its libgpod track outright, or represents a track
+ * belonging to a parsed iTunes DB. In the latter case, it shares ownership of
+ * the DB itself, so the DB (and the track) stay alive for as long as any track
+ * snapshot still refers to the descriptor, even after the collection has let
+ * go of the DB.
  */
 class CSIPodTrack : public CSTrack
 {
@@ -45,9 +51,12 @@ class CSIPodTrack : public CSTrack
 			const QString &p);
 
 		CSIPodTrack(Itdb_Track *t);
+		CSIPodTrack(Itdb_Track *t,
+			const std::shared_ptr<Itdb_iTunesDB> &d);
 		virtual ~CSIPodTrack();
 
 		Itdb_Track *getTrack() const;
+		Itdb_Track *takeTrack();
 
 		virtual QString getPath() const;
 		virtual QString getTitle() const;
@@ -76,6 +85,7 @@ class CSIPodTrack : public CSTrack
 
 	private:
 		Itdb_Track *track;
+		std::shared_ptr<Itdb_iTunesDB> database;
 };
 
 #endif
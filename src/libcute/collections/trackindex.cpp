@@ -0,0 +1,217 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trackindex.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegExp>
+
+#include "libcute/collections/track.h"
+
+/*!
+ * This is our default constructor, which creates a new, empty index.
+ */
+CSTrackIndex::CSTrackIndex()
+{
+	mutex = new QMutex(QMutex::NonRecursive);
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSTrackIndex::~CSTrackIndex()
+{
+	delete mutex;
+}
+
+/*!
+ * This function removes every track from our index.
+ */
+void CSTrackIndex::clear()
+{
+	QMutexLocker locker(mutex);
+
+	postings.clear();
+	trackTokens.clear();
+}
+
+/*!
+ * This function adds the given track to our index, under its key. If a track
+ * with the same key is already indexed, then it is replaced.
+ *
+ * \param t The track to index.
+ */
+void CSTrackIndex::addTrack(const CSTrack *t)
+{
+	if(t == NULL)
+		return;
+
+	QString key = t->getHash();
+
+	QStringList fields;
+	fields << t->getArtist() << t->getAlbum() << t->getTitle()
+		<< t->getGenre() << t->getComposer();
+
+	QStringList tokens = tokenize(fields.join(" "));
+	tokens.removeDuplicates();
+
+	// Replace any track which was already indexed under this key.
+	removeTrack(key);
+
+	QMutexLocker locker(mutex);
+
+	for(int i = 0; i < tokens.count(); ++i)
+		postings[tokens.at(i)].insert(key);
+
+	trackTokens.insert(key, tokens);
+}
+
+/*!
+ * This function removes the track with the given key from our index. If no
+ * such track is indexed, then no action is taken.
+ *
+ * \param k The key of the track to remove.
+ */
+void CSTrackIndex::removeTrack(const QString &k)
+{
+	QMutexLocker locker(mutex);
+
+	QStringList tokens = trackTokens.take(k);
+
+	for(int i = 0; i < tokens.count(); ++i)
+	{
+		QMap<QString, QSet<QString> >::iterator it =
+			postings.find(tokens.at(i));
+
+		if(it == postings.end())
+			continue;
+
+		it.value().remove(k);
+
+		if(it.value().isEmpty())
+			postings.erase(it);
+	}
+}
+
+/*!
+ * This function returns the number of tracks in our index.
+ *
+ * \return The number of indexed tracks.
+ */
+int CSTrackIndex::count() const
+{
+	QMutexLocker locker(mutex);
+	return trackTokens.count();
+}
+
+/*!
+ * This function returns the keys of all of the tracks which match the given
+ * query. The query is tokenized the same way our tracks are, and each of its
+ * terms is treated as a prefix; a track matches if, for every term, one of its
+ * tokens starts with that term. An empty query matches nothing.
+ *
+ * \param q The query to search for.
+ * \return The keys of the matching tracks.
+ */
+QSet<QString> CSTrackIndex::search(const QString &q) const
+{
+	QStringList terms = tokenize(q);
+
+	if(terms.isEmpty())
+		return QSet<QString>();
+
+	/*
+	 * Longer terms tend to match fewer tokens, so we use the longest one
+	 * to find our candidates, and then check the rest of the terms
+	 * against each candidate's own tokens.
+	 */
+
+	int seed = 0;
+	for(int i = 1; i < terms.count(); ++i)
+		if(terms.at(i).length() > terms.at(seed).length())
+			seed = i;
+
+	QString seedTerm = terms.takeAt(seed);
+
+	QMutexLocker locker(mutex);
+
+	QSet<QString> matches = searchPrefix(seedTerm);
+
+	if(terms.isEmpty())
+		return matches;
+
+	QSet<QString>::iterator it = matches.begin();
+	while(it != matches.end())
+	{
+		QStringList tokens = trackTokens.value(*it);
+		bool all = true;
+
+		for(int i = 0; all && (i < terms.count()); ++i)
+		{
+			bool found = false;
+
+			for(int j = 0; !found && (j < tokens.count()); ++j)
+				found = tokens.at(j).startsWith(terms.at(i));
+
+			all = found;
+		}
+
+		if(all)
+			++it;
+		else
+			it = matches.erase(it);
+	}
+
+	return matches;
+}
+
+/*!
+ * This function splits the given string into the tokens we index: lowercase
+ * words, with any punctuation and whitespace removed.
+ *
+ * \param s The string to tokenize.
+ * \return The string's tokens, in order.
+ */
+QStringList CSTrackIndex::tokenize(const QString &s)
+{
+	return s.toLower().split(QRegExp("\\W+"), QString::SkipEmptyParts);
+}
+
+/*!
+ * This function returns the keys of all of the tracks with a token starting
+ * with the given prefix. WE EXPECT OUR CALLER TO BE HOLDING OUR MUTEX.
+ *
+ * \param p The prefix to search for.
+ * \return The keys of the matching tracks.
+ */
+QSet<QString> CSTrackIndex::searchPrefix(const QString &p) const
+{
+	QSet<QString> matches;
+
+	for(QMap<QString, QSet<QString> >::const_iterator it =
+		postings.lowerBound(p); it != postings.end(); ++it)
+	{
+		if(!it.key().startsWith(p))
+			break;
+
+		matches.unite(it.value());
+	}
+
+	return matches;
+}
@@ -0,0 +1,67 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_COLLECTIONS_TRACK_INDEX_H
+#define INCLUDE_LIBCUTE_COLLECTIONS_TRACK_INDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QMutex;
+
+class CSTrack;
+
+/*!
+ * \brief This class provides an inverted index over a collection's tracks.
+ *
+ * Each track's artist, album, title, genre and composer are split into
+ * lowercase word tokens, and we map each token to the keys of the tracks which
+ * contain it. Tokens are stored in sorted order, so a query term matches every
+ * token it is a prefix of; a query with multiple terms matches the tracks
+ * which match all of them.
+ *
+ * The index is updated incrementally as tracks are added and removed, and it
+ * is safe to search it from one thread while it is being updated on another.
+ */
+class CSTrackIndex
+{
+	public:
+		CSTrackIndex();
+		virtual ~CSTrackIndex();
+
+		void clear();
+		void addTrack(const CSTrack *t);
+		void removeTrack(const QString &k);
+
+		int count() const;
+		QSet<QString> search(const QString &q) const;
+
+		static QStringList tokenize(const QString &s);
+
+	private:
+		mutable QMutex *mutex;
+		QMap<QString, QSet<QString> > postings;
+		QHash<QString, QStringList> trackTokens;
+
+		QSet<QString> searchPrefix(const QString &p) const;
+};
+
+#endif
@@ -0,0 +1,645 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ipodchecker.h"
+
+#ifdef CUTESYNC_DEBUG
+	#include <iostream>
+#endif
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+
+#include "libcute/collections/ipodtrack.h"
+
+/*!
+ * \brief This runnable walks a single subdirectory of an iPod's music folder.
+ *
+ * The files it finds are merged into a shared hash (guarded by the given mutex)
+ * once the whole subdirectory has been walked, so workers rarely contend.
+ */
+class CSIPodCheckerWalker : public QRunnable
+{
+	public:
+		/*!
+		 * This constructor creates a new walker for the given
+		 * directory.
+		 *
+		 * \param m The iPod's mount point.
+		 * \param d The directory to walk.
+		 * \param f The hash to merge the files we find into.
+		 * \param l The mutex guarding the hash.
+		 */
+		CSIPodCheckerWalker(const QString &m, const QString &d,
+			QHash<QString, int64_t> *f, QMutex *l)
+			: mountPoint(m), directory(d), files(f), lock(l)
+		{
+		}
+
+		/*!
+		 * This function walks our directory, recording the path (in
+		 * the iTunes DB's format) and size of each file.
+		 */
+		virtual void run()
+		{
+			QHash<QString, int64_t> found;
+
+			QDirIterator walker(directory,
+				QDir::Files | QDir::NoSymLinks,
+				QDirIterator::Subdirectories);
+
+			while(walker.hasNext())
+			{
+				walker.next();
+
+				found.insert(QDir::cleanPath(walker.fileInfo()
+					.absoluteFilePath()).replace(
+					mountPoint, "").replace(
+					QDir::separator(), ":"),
+					walker.fileInfo().size());
+			}
+
+			QMutexLocker locker(lock);
+			files->unite(found);
+		}
+
+	private:
+		QString mountPoint;
+		QString directory;
+		QHash<QString, int64_t> *files;
+		QMutex *lock;
+};
+
+/*!
+ * \brief This runnable parses the tags of a single orphaned file.
+ *
+ * The resulting libgpod track is stored in the given slot of a shared vector.
+ * Each runnable has its own slot, so no locking is needed.
+ */
+class CSIPodCheckerImporter : public QRunnable
+{
+	public:
+		/*!
+		 * This constructor creates a new importer for the given file.
+		 *
+		 * \param p The absolute path to the file to import.
+		 * \param t The slot to store the new track in.
+		 */
+		CSIPodCheckerImporter(const QString &p, Itdb_Track **t)
+			: path(p), track(t)
+		{
+		}
+
+		/*!
+		 * This function reads our file's tags into a new libgpod
+		 * track, or leaves our slot set to NULL on failure.
+		 */
+		virtual void run()
+		{
+			CSIPodTrack *t = CSIPodTrack::createTrackFromFile(path);
+
+			if(t == NULL)
+				return;
+
+			*track = t->takeTrack();
+			delete t;
+		}
+
+	private:
+		QString path;
+		Itdb_Track **track;
+};
+
+/*!
+ * This is our default constructor, which creates a new checker for the iPod
+ * mounted at the given path.
+ *
+ * \param m The path at which an iPod is mounted.
+ */
+CSIPodChecker::CSIPodChecker(const QString &m)
+	: mountPoint(QDir(m).absolutePath()), trackCount(0)
+{
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSIPodChecker::~CSIPodChecker()
+{
+}
+
+/*!
+ * This function returns the absolute path of the iPod we are checking.
+ *
+ * \return Our iPod's mount point.
+ */
+QString CSIPodChecker::getMountPoint() const
+{
+	return mountPoint;
+}
+
+/*!
+ * This function converts a path in the iTunes DB's colon-separated format into
+ * an absolute path on our iPod.
+ *
+ * \param p A path, relative to our mount point, in the iTunes DB's format.
+ * \return The equivalent absolute path.
+ */
+QString CSIPodChecker::getAbsolutePath(const QString &p) const
+{
+	return mountPoint + QString(p).replace(':', QDir::separator());
+}
+
+/*!
+ * This function scans our iPod, comparing its iTunes DB to the files on its
+ * disk. Any previous results are discarded. The problems found can be
+ * retrieved with our other accessors afterward.
+ *
+ * \return True if the scan succeeded, or false if the iTunes DB couldn't be
+ *     read.
+ */
+bool CSIPodChecker::scan()
+{
+	clear();
+
+	// Start walking each subdirectory of the music folder in parallel.
+
+	QMutex lock(QMutex::NonRecursive);
+	QThreadPool pool;
+
+	QDir music(mountPoint);
+	music.cd("iPod_Control");
+	music.cd("Music");
+
+	QStringList dirs = music.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+	for(int i = 0; i < dirs.count(); ++i)
+	{
+		pool.start(new CSIPodCheckerWalker(mountPoint,
+			music.absoluteFilePath(dirs.at(i)), &files, &lock));
+	}
+
+	// Meanwhile, read the iTunes DB on this thread.
+
+	CSITunesDBScanner scanner(mountPoint);
+	QList<CSITunesDBScanner::Track> tracks;
+	QList<uint32_t> mpl;
+	bool r = scanner.open();
+
+	if(r)
+	{
+		CSITunesDBScanner::Track t;
+
+		while(scanner.next(&t))
+			tracks.append(t);
+
+		r = !scanner.hasError();
+	}
+
+	if(r && !scanner.getMasterPlaylist(&mpl))
+	{
+#ifdef CUTESYNC_DEBUG
+std::cout << "Unable to read the master playlist.\n";
+#endif
+	}
+
+	scanner.close();
+	pool.waitForDone();
+
+	if(!r)
+	{
+		clear();
+		return false;
+	}
+
+	trackCount = tracks.count();
+
+	// Compare the database against the files we found.
+
+	QSet<QString> paths;
+	QSet<uint32_t> mplTracks = mpl.toSet();
+
+	for(int i = 0; i < tracks.count(); ++i)
+	{
+		const CSITunesDBScanner::Track &t = tracks.at(i);
+		paths.insert(t.path);
+
+		if(!files.contains(t.path))
+			orphanedEntries.append(t);
+		else if(files.value(t.path) != t.size)
+			sizeMismatches.append(t);
+
+#pragma message "TODO - This should only check for tracks that SHOULD be in the MPL ie not podcasts"
+		if( (!mpl.isEmpty()) && (!mplTracks.contains(t.id)) )
+			missingFromMPL.append(t);
+	}
+
+	QHash<QString, int64_t>::const_iterator it;
+	for(it = files.constBegin(); it != files.constEnd(); ++it)
+	{
+		if(!paths.contains(it.key()))
+		{
+			File f;
+			f.path = it.key();
+			f.size = it.value();
+
+			orphanedFiles.append(f);
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * This function tests whether or not our last scan found any problems.
+ *
+ * \return True if there are problems, or false otherwise.
+ */
+bool CSIPodChecker::hasProblems() const
+{
+	return ( (!orphanedFiles.isEmpty()) || (!orphanedEntries.isEmpty()) ||
+		(!sizeMismatches.isEmpty()) || (!missingFromMPL.isEmpty()) );
+}
+
+/*!
+ * This function returns the number of tracks in the iTunes DB, as of our last
+ * scan.
+ *
+ * \return The number of tracks in the database.
+ */
+int CSIPodChecker::getTrackCount() const
+{
+	return trackCount;
+}
+
+/*!
+ * This function returns the number of files on the iPod's disk, as of our last
+ * scan.
+ *
+ * \return The number of files on the disk.
+ */
+int CSIPodChecker::getFileCount() const
+{
+	return files.count();
+}
+
+/*!
+ * This function returns the on-disk size of the file with the given path, as
+ * of our last scan.
+ *
+ * \param p A path, in the iTunes DB's format.
+ * \return The file's size, or -1 if it wasn't found.
+ */
+int64_t CSIPodChecker::getFileSize(const QString &p) const
+{
+	return files.value(p, -1);
+}
+
+/*!
+ * This function returns the files on the disk which aren't in the database.
+ *
+ * \return Our list of orphaned files.
+ */
+QList<CSIPodChecker::File> CSIPodChecker::getOrphanedFiles() const
+{
+	return orphanedFiles;
+}
+
+/*!
+ * This function returns the tracks in the database whose files are missing.
+ *
+ * \return Our list of orphaned database entries.
+ */
+QList<CSITunesDBScanner::Track> CSIPodChecker::getOrphanedEntries() const
+{
+	return orphanedEntries;
+}
+
+/*!
+ * This function returns the tracks whose on-disk size doesn't match the size
+ * recorded in the database. See getFileSize() for their actual sizes.
+ *
+ * \return Our list of tracks with mismatched sizes.
+ */
+QList<CSITunesDBScanner::Track> CSIPodChecker::getSizeMismatches() const
+{
+	return sizeMismatches;
+}
+
+/*!
+ * This function returns the tracks which aren't members of the master
+ * playlist.
+ *
+ * \return Our list of tracks missing from the MPL.
+ */
+QList<CSITunesDBScanner::Track> CSIPodChecker::getMissingFromMPL() const
+{
+	return missingFromMPL;
+}
+
+/*!
+ * This function deletes every orphaned file found by our last scan from the
+ * disk. This doesn't touch the database. Files which couldn't be deleted are
+ * still reported as orphaned.
+ *
+ * \return The number of files which were deleted.
+ */
+int CSIPodChecker::deleteOrphanedFiles()
+{
+	int r = 0;
+	QList<File> failed;
+
+	for(int i = 0; i < orphanedFiles.count(); ++i)
+	{
+		const File &f = orphanedFiles.at(i);
+
+		if(QFile::remove(getAbsolutePath(f.path)))
+		{
+			files.remove(f.path);
+			++r;
+		}
+		else
+		{
+			failed.append(f);
+		}
+	}
+
+	orphanedFiles = failed;
+	return r;
+}
+
+/*!
+ * This function deletes the files of every track whose size didn't match the
+ * database in our last scan. A file of the wrong size is most likely truncated
+ * or corrupt, so rather than trusting it, we remove it; its track then becomes
+ * an orphaned entry, which repairDatabase() will remove from the database (so
+ * the track will be copied to the iPod again by the next sync). Tracks whose
+ * files couldn't be deleted are still reported as size mismatches.
+ *
+ * \return The number of files which were deleted.
+ */
+int CSIPodChecker::deleteSizeMismatches()
+{
+	int r = 0;
+	QList<CSITunesDBScanner::Track> failed;
+
+	for(int i = 0; i < sizeMismatches.count(); ++i)
+	{
+		const CSITunesDBScanner::Track &t = sizeMismatches.at(i);
+
+		if(QFile::remove(getAbsolutePath(t.path)))
+		{
+			files.remove(t.path);
+			orphanedEntries.append(t);
+			++r;
+		}
+		else
+		{
+			failed.append(t);
+		}
+	}
+
+	sizeMismatches = failed;
+	return r;
+}
+
+/*!
+ * This function repairs the database problems found by our last scan. Orphaned
+ * entries are removed, and tracks missing from the MPL are added to it. If
+ * requested, orphaned files are also re-imported into the database (otherwise,
+ * they are left alone; see deleteOrphanedFiles()). Files whose tags couldn't
+ * be parsed aren't imported, so they are still reported as orphaned.
+ *
+ * Size mismatches are NOT repaired here: we can't tell whether the database or
+ * the file is wrong, and accepting a truncated file's size would hide the
+ * problem. They stay reported until they are dealt with (see
+ * deleteSizeMismatches()).
+ *
+ * The database is only parsed with libgpod if there is something to repair,
+ * and is only written if something was actually changed.
+ *
+ * \param r Whether or not orphaned files should be re-imported.
+ * \param c If not NULL, this will be set to the number of changes made.
+ * \return True on success, or false on failure.
+ */
+bool CSIPodChecker::repairDatabase(bool r, int *c)
+{
+	int changes = 0;
+
+	if(c != NULL)
+		*c = 0;
+
+	if( orphanedEntries.isEmpty() && missingFromMPL.isEmpty() &&
+		(!r || orphanedFiles.isEmpty()) )
+	{
+		return true;
+	}
+
+	// Load the iTunes DB with libgpod, so we can modify it.
+
+	GError *error = NULL;
+	Itdb_iTunesDB *itdb = itdb_parse(mountPoint.toUtf8().data(), &error);
+
+	if( (error != NULL) || (itdb == NULL) )
+	{
+		if(error != NULL)
+		{
+#ifdef CUTESYNC_DEBUG
+std::cout << "Error while parsing iTunes DB: " << error->message << "\n";
+#endif
+
+			g_error_free(error);
+		}
+
+		if(itdb != NULL) itdb_free(itdb);
+		return false;
+	}
+
+	Itdb_Playlist *mpl = itdb_playlist_mpl(itdb);
+
+	// Collect the paths and IDs of the tracks we need to fix.
+
+	QSet<QString> orphaned;
+	for(int i = 0; i < orphanedEntries.count(); ++i)
+		orphaned.insert(orphanedEntries.at(i).path);
+
+	QSet<uint32_t> unlisted;
+	for(int i = 0; i < missingFromMPL.count(); ++i)
+		unlisted.insert(missingFromMPL.at(i).id);
+
+	GList *trackList = g_list_first(itdb->tracks);
+	while(trackList != NULL)
+	{
+		Itdb_Track *t = static_cast<Itdb_Track *>(trackList->data);
+		trackList = trackList->next;
+
+		QString path = QString::fromUtf8(t->ipod_path);
+
+		if(orphaned.contains(path))
+		{
+			// Remove the track's thumbnails, if any.
+
+			itdb_track_remove_thumbnails(t);
+
+			// Remove the track from any playlists it is a part of.
+
+			GList *playlistList = g_list_first(itdb->playlists);
+			while(playlistList != NULL)
+			{
+				itdb_playlist_remove_track(
+					static_cast<Itdb_Playlist *>(
+					playlistList->data), t);
+
+				playlistList = playlistList->next;
+			}
+
+			// Remove the track from the database.
+
+			itdb_track_remove(t);
+			++changes;
+
+			continue;
+		}
+
+		if( (mpl != NULL) && unlisted.contains(t->id) &&
+			!itdb_playlist_contains_track(mpl, t) )
+		{
+			itdb_playlist_add_track(mpl, t, -1);
+			++changes;
+		}
+	}
+
+	// Re-import orphaned files, if requested.
+
+	QVector<Itdb_Track *> imported;
+	QList<File> unimported;
+
+	if(r)
+		imported = importOrphanedFiles();
+
+	for(int i = 0; i < imported.count(); ++i)
+	{
+		const File &f = orphanedFiles.at(i);
+		Itdb_Track *t = imported.at(i);
+
+		if(t == NULL)
+		{
+			unimported.append(f);
+			continue;
+		}
+
+		/*
+		 * The file is already on the iPod, so we just point the new
+		 * track at it instead of copying it.
+		 */
+
+		t->ipod_path = g_strdup(f.path.toUtf8().data());
+		t->size = static_cast<guint32>(f.size);
+		t->transferred = TRUE;
+
+		itdb_track_add(itdb, t, -1);
+		if(mpl != NULL)
+			itdb_playlist_add_track(mpl, t, -1);
+
+		++changes;
+	}
+
+	// Save the iTunes DB to the device, if we changed anything.
+
+	bool ret = true;
+
+	if(changes > 0)
+	{
+		if(!itdb_write(itdb, &error))
+		{
+			if(error != NULL)
+			{
+#ifdef CUTESYNC_DEBUG
+std::cout << "Error writing iTunes DB: " << error->message << "\n";
+#endif
+
+				g_error_free(error);
+				error = NULL;
+			}
+
+			ret = false;
+		}
+	}
+
+	itdb_free(itdb);
+
+	if(ret)
+	{
+		orphanedEntries.clear();
+		missingFromMPL.clear();
+
+		if(r)
+			orphanedFiles = unimported;
+	}
+
+	if(c != NULL)
+		*c = changes;
+
+	return ret;
+}
+
+/*!
+ * This function reads the tags of every orphaned file found by our last scan,
+ * creating a new libgpod track for each one. Parsing tags is by far the most
+ * expensive part of re-importing files, so the files are parsed in parallel,
+ * on a pool of worker threads.
+ *
+ * \return A new track for each orphaned file, in the same order as our list
+ *     of orphaned files, or NULL for files which couldn't be parsed.
+ */
+QVector<Itdb_Track *> CSIPodChecker::importOrphanedFiles() const
+{
+	QVector<Itdb_Track *> tracks(orphanedFiles.count(), NULL);
+	QThreadPool pool;
+
+	for(int i = 0; i < orphanedFiles.count(); ++i)
+	{
+		pool.start(new CSIPodCheckerImporter(getAbsolutePath(
+			orphanedFiles.at(i).path), tracks.data() + i));
+	}
+
+	pool.waitForDone();
+
+	return tracks;
+}
+
+/*!
+ * This function discards the results of our last scan.
+ */
+void CSIPodChecker::clear()
+{
+	trackCount = 0;
+	files.clear();
+
+	orphanedFiles.clear();
+	orphanedEntries.clear();
+	sizeMismatches.clear();
+	missingFromMPL.clear();
+}
@@ -0,0 +1,109 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_IPOD_IPOD_CHECKER_H
+#define INCLUDE_LIBCUTE_IPOD_IPOD_CHECKER_H
+
+#include <cstdint>
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "libcute/ipod/itunesdbscanner.h"
+
+extern "C" {
+	#include <glib.h>
+	#include <gpod-1.0/gpod/itdb.h>
+}
+
+/*!
+ * \brief This class checks an iPod's iTunes DB for consistency with its disk.
+ *
+ * A scan compares the iTunes DB (read with CSITunesDBScanner) against the files
+ * actually present in the iPod's iPod_Control/Music directory, and finds:
+ *
+ *     - Orphaned files: files on the disk which aren't in the database.
+ *     - Orphaned entries: tracks in the database whose files are missing.
+ *     - Size mismatches: tracks whose file size differs from the database.
+ *     - Tracks which are missing from the master playlist (MPL).
+ *
+ * The music directory is split into many subdirectories (F00, F01, ...), which
+ * are walked in parallel, while the database is being read.
+ *
+ * Problems can then be repaired: orphaned files can either be deleted, or
+ * re-imported into the database (their tags are parsed in parallel, and they
+ * are added to the database and the MPL in place, without being copied). The
+ * database is only parsed with libgpod (and written) if there is actually
+ * something in it to repair. Size mismatches are never "repaired" by trusting
+ * the disk, since the file may well be truncated; instead, their files can be
+ * deleted, so the tracks are removed and copied again by the next sync.
+ */
+class CSIPodChecker
+{
+	public:
+		/*!
+		 * This structure stores a single file found on the iPod's disk.
+		 * Its path is in the iTunes DB's colon-separated format,
+		 * relative to the iPod's mount point.
+		 */
+		typedef struct File
+		{
+			QString path;
+			int64_t size;
+		} File;
+
+		CSIPodChecker(const QString &m);
+		virtual ~CSIPodChecker();
+
+		QString getMountPoint() const;
+		QString getAbsolutePath(const QString &p) const;
+
+		bool scan();
+		bool hasProblems() const;
+
+		int getTrackCount() const;
+		int getFileCount() const;
+		int64_t getFileSize(const QString &p) const;
+
+		QList<File> getOrphanedFiles() const;
+		QList<CSITunesDBScanner::Track> getOrphanedEntries() const;
+		QList<CSITunesDBScanner::Track> getSizeMismatches() const;
+		QList<CSITunesDBScanner::Track> getMissingFromMPL() const;
+
+		int deleteOrphanedFiles();
+		int deleteSizeMismatches();
+		bool repairDatabase(bool r, int *c = NULL);
+
+	private:
+		QString mountPoint;
+		int trackCount;
+		QHash<QString, int64_t> files;
+
+		QList<File> orphanedFiles;
+		QList<CSITunesDBScanner::Track> orphanedEntries;
+		QList<CSITunesDBScanner::Track> sizeMismatches;
+		QList<CSITunesDBScanner::Track> missingFromMPL;
+
+		QVector<Itdb_Track *> importOrphanedFiles() const;
+
+		void clear();
+};
+
+#endif
@@ -0,0 +1,444 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "itunesdbscanner.h"
+
+#include <QDir>
+#include <QVector>
+
+#include "libcute/util/bitwise.h"
+
+/*!
+ * This is our default constructor, which creates a new scanner for the iTunes
+ * DB of the iPod mounted at the given path. The database isn't actually opened
+ * until open() is called.
+ *
+ * \param m The path at which an iPod is mounted.
+ */
+CSITunesDBScanner::CSITunesDBScanner(const QString &m)
+	: file(getDatabasePath(m).toStdString()), length(0), error(false),
+		trackCount(0), tracksLeft(0), trackOffset(0)
+{
+}
+
+/*!
+ * This is our default destructor, which closes our database (if it is open).
+ */
+CSITunesDBScanner::~CSITunesDBScanner()
+{
+	close();
+}
+
+/*!
+ * This function returns the path to the iTunes DB file of the iPod mounted at
+ * the given path.
+ *
+ * \param m The path at which an iPod is mounted.
+ * \return The path to the iPod's iTunes DB.
+ */
+QString CSITunesDBScanner::getDatabasePath(const QString &m)
+{
+	return QDir::cleanPath(m).append(
+		QString("/iPod_Control/iTunes/iTunesDB")
+		.replace('/', QDir::separator()));
+}
+
+/*!
+ * This function opens our iTunes DB, and locates its track list. After this
+ * succeeds, tracks can be read using next().
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSITunesDBScanner::open()
+{
+	uint32_t h;
+	uint64_t o;
+
+	close();
+	error = false;
+
+	if(!file.open(CSMMIOHandle::ReadOnly))
+		return false;
+
+	length = file.getLength();
+
+	// Find the track list data set, and the track list inside of it.
+
+	if(!findDataSet(1, &o) || !checkRecord(o, "mhlt", &h))
+	{
+		error = true;
+		close();
+		return false;
+	}
+
+	trackCount = static_cast<int>(CSBitwise::fromLittleEndianInt32(
+		file, o + 8));
+	tracksLeft = trackCount;
+	trackOffset = o + h;
+
+	return true;
+}
+
+/*!
+ * This function tests whether or not our iTunes DB is currently open.
+ *
+ * \return True if we are open, or false otherwise.
+ */
+bool CSITunesDBScanner::isOpen() const
+{
+	return file.isOpen();
+}
+
+/*!
+ * This function closes our iTunes DB. If it isn't open, no action is taken.
+ */
+void CSITunesDBScanner::close()
+{
+	if(file.isOpen())
+		file.close();
+
+	length = 0;
+	trackCount = 0;
+	tracksLeft = 0;
+	trackOffset = 0;
+}
+
+/*!
+ * This function tests whether or not we've found a malformed record in our
+ * iTunes DB. If so, open() or next() will have stopped early.
+ *
+ * \return True if our iTunes DB is malformed, or false otherwise.
+ */
+bool CSITunesDBScanner::hasError() const
+{
+	return error;
+}
+
+/*!
+ * This function returns the number of track records our iTunes DB's track list
+ * contains. Note that this includes non-audio tracks (e.g., videos or
+ * podcasts); see Track::mediatype.
+ *
+ * \return The number of tracks in our iTunes DB.
+ */
+int CSITunesDBScanner::getTrackCount() const
+{
+	return trackCount;
+}
+
+/*!
+ * This function reads the next track record from our iTunes DB. Tracks are
+ * returned in the order they are stored in the database.
+ *
+ * \param t The structure to store the track's attributes in.
+ * \return True if a track was read, or false at the end of the track list (or
+ *     on error - see hasError()).
+ */
+bool CSITunesDBScanner::next(Track *t)
+{
+	uint32_t h, mh;
+
+	if( (tracksLeft <= 0) || (t == NULL) )
+		return false;
+
+	uint64_t o = trackOffset;
+
+	if(!checkRecord(o, "mhit", &h) || (h < 44))
+	{
+		error = true;
+		tracksLeft = 0;
+		return false;
+	}
+
+	uint32_t total = CSBitwise::fromLittleEndianInt32(file, o + 8);
+	uint32_t mhods = CSBitwise::fromLittleEndianInt32(file, o + 12);
+
+	if( (total < h) || ((o + total) > length) )
+	{
+		error = true;
+		tracksLeft = 0;
+		return false;
+	}
+
+	// Read the attributes stored in the track's header.
+
+	t->id = CSBitwise::fromLittleEndianInt32(file, o + 16);
+	t->size = static_cast<int64_t>(
+		CSBitwise::fromLittleEndianInt32(file, o + 36));
+	t->length = static_cast<int>(
+		CSBitwise::fromLittleEndianInt32(file, o + 40));
+
+	// Older databases have shorter headers, without these fields.
+
+	t->dbid = (h >= 120) ?
+		CSBitwise::fromLittleEndianInt64(file, o + 112) : 0;
+
+	// 0x 00 00 00 01 means AUDIO, which is all older iPods support.
+	t->mediatype = (h >= 212) ?
+		CSBitwise::fromLittleEndianInt32(file, o + 208) : 0x00000001;
+
+	t->path.clear();
+	t->title.clear();
+	t->artist.clear();
+	t->album.clear();
+	t->genre.clear();
+
+	// Read the string attributes stored in the track's mhod children.
+
+	uint64_t c = o + h;
+
+	for(uint32_t i = 0; i < mhods; ++i)
+	{
+		if(!checkRecord(c, "mhod", &mh) || (mh < 16))
+		{
+			error = true;
+			tracksLeft = 0;
+			return false;
+		}
+
+		uint32_t mt = CSBitwise::fromLittleEndianInt32(file, c + 8);
+
+		if( (mt < mh) || ((c + mt) > (o + total)) )
+		{
+			error = true;
+			tracksLeft = 0;
+			return false;
+		}
+
+		switch(CSBitwise::fromLittleEndianInt32(file, c + 12))
+		{
+			case 1: t->title = readString(c); break;
+			case 2: t->path = readString(c); break;
+			case 3: t->album = readString(c); break;
+			case 4: t->artist = readString(c); break;
+			case 5: t->genre = readString(c); break;
+			default: break;
+		};
+
+		c += mt;
+	}
+
+	trackOffset = o + total;
+	--tracksLeft;
+
+	return true;
+}
+
+/*!
+ * This function reads the IDs of the tracks in our iTunes DB's master playlist
+ * (MPL), i.e. the playlist every track should be a member of. These IDs can be
+ * compared with Track::id.
+ *
+ * \param l The list to store the track IDs in.
+ * \return True on success, or false if the MPL couldn't be read.
+ */
+bool CSITunesDBScanner::getMasterPlaylist(QList<uint32_t> *l)
+{
+	uint32_t h;
+	uint64_t o;
+
+	if( (l == NULL) || !isOpen() )
+		return false;
+
+	// Find the playlist list data set, and the playlist list inside of it.
+
+	if(!findDataSet(2, &o) || !checkRecord(o, "mhlp", &h))
+		return false;
+
+	uint32_t playlists = CSBitwise::fromLittleEndianInt32(file, o + 8);
+	o += h;
+
+	for(uint32_t i = 0; i < playlists; ++i)
+	{
+		if(!checkRecord(o, "mhyp", &h) || (h < 21))
+		{
+			error = true;
+			return false;
+		}
+
+		uint32_t total = CSBitwise::fromLittleEndianInt32(file, o + 8);
+		uint32_t mhods = CSBitwise::fromLittleEndianInt32(file, o + 12);
+		uint32_t mhips = CSBitwise::fromLittleEndianInt32(file, o + 16);
+
+		if( (total < h) || ((o + total) > length) )
+		{
+			error = true;
+			return false;
+		}
+
+		// The MPL is the playlist with its "hidden" flag set.
+
+		if(file.at(o + 20) == 0)
+		{
+			o += total;
+			continue;
+		}
+
+		/*
+		 * Skip over the playlist's mhod children, and then read the
+		 * track ID of each of its items.
+		 */
+
+		uint64_t c = o + h;
+
+		for(uint32_t j = 0; j < (mhods + mhips); ++j)
+		{
+			uint32_t ch;
+			bool item = (j >= mhods);
+
+			if(!checkRecord(c, item ? "mhip" : "mhod", &ch) ||
+				(item && (ch < 28)))
+			{
+				error = true;
+				return false;
+			}
+
+			uint32_t ct = CSBitwise::fromLittleEndianInt32(
+				file, c + 8);
+
+			if( (ct < ch) || ((c + ct) > (o + total)) )
+			{
+				error = true;
+				return false;
+			}
+
+			if(item)
+			{
+				l->append(CSBitwise::fromLittleEndianInt32(
+					file, c + 24));
+			}
+
+			c += ct;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+/*!
+ * This function checks that a record with the given magic string (e.g.,
+ * "mhit") starts at the given offset, and that its header fits within our
+ * file.
+ *
+ * \param o The offset of the record.
+ * \param m The four-character magic string the record should start with.
+ * \param h This will be set to the length of the record's header.
+ * \return True if the record is valid, or false otherwise.
+ */
+bool CSITunesDBScanner::checkRecord(uint64_t o, const char *m,
+	uint32_t *h) const
+{
+	if( (o + 12) > length )
+		return false;
+
+	for(int i = 0; i < 4; ++i)
+	{
+		if(file.at(o + i) != static_cast<uint8_t>(m[i]))
+			return false;
+	}
+
+	*h = CSBitwise::fromLittleEndianInt32(file, o + 4);
+
+	return ( (*h >= 12) && ((o + *h) <= length) );
+}
+
+/*!
+ * This function finds the data set (mhsd) of the given type in our database,
+ * and returns the offset of its child record (e.g., the track list).
+ *
+ * \param t The type of data set to find (1 = tracks, 2 = playlists).
+ * \param o This will be set to the offset of the data set's child record.
+ * \return True if the data set was found, or false otherwise.
+ */
+bool CSITunesDBScanner::findDataSet(uint32_t t, uint64_t *o) const
+{
+	uint32_t h;
+
+	if(!checkRecord(0, "mhbd", &h) || (h < 24))
+		return false;
+
+	uint32_t sets = CSBitwise::fromLittleEndianInt32(file, 20);
+	uint64_t c = h;
+
+	for(uint32_t i = 0; i < sets; ++i)
+	{
+		if(!checkRecord(c, "mhsd", &h) || (h < 16))
+			return false;
+
+		uint32_t total = CSBitwise::fromLittleEndianInt32(file, c + 8);
+
+		if( (total < h) || ((c + total) > length) )
+			return false;
+
+		if(CSBitwise::fromLittleEndianInt32(file, c + 12) == t)
+		{
+			*o = c + h;
+			return true;
+		}
+
+		c += total;
+	}
+
+	return false;
+}
+
+/*!
+ * This function reads the string stored in the string mhod record at the given
+ * offset. Strings are stored either as UTF-16 (little-endian) or as UTF-8,
+ * depending on the record's encoding field. The caller must have already
+ * checked that the record lies within our file.
+ *
+ * \param o The offset of the mhod record.
+ * \return The string the record contains, or an empty string on error.
+ */
+QString CSITunesDBScanner::readString(uint64_t o) const
+{
+	uint32_t h = CSBitwise::fromLittleEndianInt32(file, o + 4);
+	uint32_t total = CSBitwise::fromLittleEndianInt32(file, o + 8);
+
+	if( (h != 24) || (total < 40) )
+		return QString();
+
+	uint32_t encoding = CSBitwise::fromLittleEndianInt32(file, o + 24);
+	uint32_t l = CSBitwise::fromLittleEndianInt32(file, o + 28);
+
+	if(l > (total - 40))
+		return QString();
+
+	// An encoding of 2 means UTF-8; anything else is UTF-16.
+
+	if(encoding == 2)
+	{
+		QByteArray b(static_cast<int>(l), '\0');
+		file.at(o + 40, reinterpret_cast<uint8_t *>(b.data()), l);
+
+		return QString::fromUtf8(b);
+	}
+
+	QVector<ushort> u(static_cast<int>(l / 2));
+
+	for(int i = 0; i < u.count(); ++i)
+	{
+		u[i] = CSBitwise::fromLittleEndianInt16(file,
+			o + 40 + (2 * static_cast<uint64_t>(i)));
+	}
+
+	return QString::fromUtf16(u.constData(), u.count());
+}
@@ -0,0 +1,109 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_IPOD_ITUNES_DB_SCANNER_H
+#define INCLUDE_LIBCUTE_IPOD_ITUNES_DB_SCANNER_H
+
+#include <cstdint>
+
+#include <QList>
+#include <QString>
+
+#include "libcute/util/mmiohandle.h"
+
+/*!
+ * \brief This class provides fast, read-only access to an iPod's iTunes DB.
+ *
+ * Rather than building libgpod's entire object graph, we memory-map the iTunes
+ * DB file and walk its record structure directly:
+ *
+ *     mhbd (database)
+ *         mhsd (data set, type 1 = tracks)
+ *             mhlt (track list)
+ *                 mhit (track)
+ *                     mhod (string: title, location, etc.)
+ *         mhsd (data set, type 2 = playlists)
+ *             mhlp (playlist list)
+ *                 mhyp (playlist)
+ *                     mhip (playlist item)
+ *
+ * Tracks are streamed one at a time via next(), so nothing is allocated per
+ * track beyond the strings we return. This is intended for things which only
+ * need a few attributes of each track (e.g., its location and size), like
+ * consistency checks and quick summaries. Anything which needs to modify the
+ * database should still use libgpod.
+ *
+ * All multi-byte values in the iTunes DB are little-endian. Every record is
+ * bounds-checked against the file before it is read; if a malformed record is
+ * found, we stop and hasError() returns true.
+ */
+class CSITunesDBScanner
+{
+	public:
+		/*!
+		 * This structure stores the attributes of a single track
+		 * record. The track's length is in milliseconds, and its path
+		 * is its location on the iPod, in the iTunes DB's own
+		 * colon-separated format (e.g., ":iPod_Control:Music:F00:A.mp3").
+		 */
+		typedef struct Track
+		{
+			uint32_t id;
+			uint64_t dbid;
+			uint32_t mediatype;
+			int64_t size;
+			int length;
+			QString path;
+			QString title;
+			QString artist;
+			QString album;
+			QString genre;
+		} Track;
+
+		CSITunesDBScanner(const QString &m);
+		virtual ~CSITunesDBScanner();
+
+		static QString getDatabasePath(const QString &m);
+
+		bool open();
+		bool isOpen() const;
+		void close();
+
+		bool hasError() const;
+
+		int getTrackCount() const;
+		bool next(Track *t);
+
+		bool getMasterPlaylist(QList<uint32_t> *l);
+
+	private:
+		CSMMIOHandle file;
+		uint64_t length;
+		bool error;
+
+		int trackCount;
+		int tracksLeft;
+		uint64_t trackOffset;
+
+		bool checkRecord(uint64_t o, const char *m,
+			uint32_t *h) const;
+		bool findDataSet(uint32_t t, uint64_t *o) const;
+		QString readString(uint64_t o) const;
+};
+
+#endif
@@ -34,6 +34,8 @@
 #include <taglib/trueaudiofile.h>
 #include <taglib/wavpackfile.h>
 
+#include "libcute/util/trace.h"
+
 extern "C" {
 	#include <gio/gio.h>
 	#include <gdk-pixbuf/gdk-pixbuf.h>
@@ -52,6 +54,8 @@ CSTaggedFile::CSTaggedFile(const QString &p,
 	TagLib::AudioProperties::ReadStyle aps)
 	: file(NULL), info(NULL)
 {
+	CSTraceSpan span("tags", "parse");
+
 	file = r.createFile(p.toUtf8().data(), ap, aps);
 	if(file != NULL)
 		info = new QFileInfo(p);
@@ -1381,6 +1385,8 @@ gpointer CSTaggedFile::getCoverArtwork() const
 {
 	if(isNull()) return NULL;
 
+	CSTraceSpan span("tags", "artwork decode");
+
 	TagLib::ByteVector data;
 
 	switch(getFileType())
@@ -0,0 +1,330 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "collectionjob.h"
+
+#include <QThreadStorage>
+
+QAtomicInt CSCollectionJob::nextID(1);
+
+namespace
+{
+	/*
+	 * The job currently running on each thread. This is wrapped in a
+	 * structure, since QThreadStorage takes ownership of (and deletes)
+	 * any pointer it holds directly.
+	 */
+
+	struct CSCurrentJob
+	{
+		CSCurrentJob() : job(NULL) {}
+		CSCollectionJob *job;
+	};
+
+	QThreadStorage<CSCurrentJob> currentJob;
+}
+
+/*!
+ * This is our default constructor, which creates a new job of the given type
+ * with the given priority. Each job is given a unique ID, which can be used to
+ * refer to it once it has been queued.
+ *
+ * \param t The type of job this is.
+ * \param p The job's initial priority.
+ */
+CSCollectionJob::CSCollectionJob(Type t, Priority p)
+	: id(static_cast<quint64>(nextID.fetchAndAddOrdered(1))), type(t),
+		priority(p), cancelled(0), save(false)
+{
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCollectionJob::~CSCollectionJob()
+{
+}
+
+/*!
+ * This function returns this job's unique ID.
+ *
+ * \return Our job ID.
+ */
+quint64 CSCollectionJob::getID() const
+{
+	return id;
+}
+
+/*!
+ * This function returns what kind of job this is.
+ *
+ * \return Our job type.
+ */
+CSCollectionJob::Type CSCollectionJob::getType() const
+{
+	return type;
+}
+
+/*!
+ * This function returns this job's priority. Higher priority jobs are run
+ * before lower priority ones.
+ *
+ * \return Our priority.
+ */
+CSCollectionJob::Priority CSCollectionJob::getPriority() const
+{
+	return priority;
+}
+
+/*!
+ * This function sets this job's priority. Note that this has no effect on a
+ * job which has already been queued; use the executor's setJobPriority()
+ * instead, so the job is moved within the queue.
+ *
+ * \param p Our new priority.
+ */
+void CSCollectionJob::setPriority(Priority p)
+{
+	priority = p;
+}
+
+/*!
+ * This function returns whether or not this job has been cancelled. This is
+ * safe to call from any thread.
+ *
+ * \return True if we have been cancelled, or false otherwise.
+ */
+bool CSCollectionJob::isCancelled() const
+{
+	return cancelled.loadAcquire() != 0;
+}
+
+/*!
+ * This function cancels this job. If it hasn't started yet, it won't be run;
+ * if it is running, it will stop at its next checkpoint. This is safe to call
+ * from any thread.
+ */
+void CSCollectionJob::cancel()
+{
+	cancelled.storeRelease(1);
+}
+
+/*!
+ * This function should be called by a running job between units of work (e.g.,
+ * between tracks). It returns whether or not the job should keep going.
+ *
+ * \return True if the job should continue, or false if it should stop.
+ */
+bool CSCollectionJob::checkpoint() const
+{
+	return !isCancelled();
+}
+
+/*!
+ * This function returns whether or not this job operates on the given
+ * collection, either as its target or as its source.
+ *
+ * \param c The collection to check for.
+ * \return True if we involve the given collection, or false otherwise.
+ */
+bool CSCollectionJob::involves(const CSAbstractCollection *c) const
+{
+	return (c != NULL) && ((collection.data() == c) ||
+		(source.data() == c));
+}
+
+/*!
+ * This function returns the name of the collection to be created, for load
+ * and unserialize jobs.
+ *
+ * \return The name of the collection.
+ */
+QString CSCollectionJob::getName() const
+{
+	return name;
+}
+
+/*!
+ * This function sets the name of the collection to be created, for load and
+ * unserialize jobs.
+ *
+ * \param n The name of the collection.
+ */
+void CSCollectionJob::setName(const QString &n)
+{
+	name = n;
+}
+
+/*!
+ * This function returns the path of the collection to be created, for load and
+ * unserialize jobs. For restore jobs, this is instead the path of the catalog
+ * file to restore the collection from.
+ *
+ * \return The path to the collection.
+ */
+QString CSCollectionJob::getPath() const
+{
+	return path;
+}
+
+/*!
+ * This function sets the path of the collection to be created, for load and
+ * unserialize jobs. For restore jobs, this is instead the path of the catalog
+ * file to restore the collection from.
+ *
+ * \param p The path to the collection.
+ */
+void CSCollectionJob::setPath(const QString &p)
+{
+	path = p;
+}
+
+/*!
+ * This function returns the serialized collection data to load, for
+ * unserialize jobs.
+ *
+ * \return The serialized collection data.
+ */
+QByteArray CSCollectionJob::getData() const
+{
+	return data;
+}
+
+/*!
+ * This function sets the serialized collection data to load, for unserialize
+ * jobs.
+ *
+ * \param d The serialized collection data.
+ */
+void CSCollectionJob::setData(const QByteArray &d)
+{
+	data = d;
+}
+
+/*!
+ * This function returns whether or not the collection to be created should be
+ * saved on exit, for load jobs.
+ *
+ * \return Whether or not the new collection is saved on exit.
+ */
+bool CSCollectionJob::isSavedOnExit() const
+{
+	return save;
+}
+
+/*!
+ * This function sets whether or not the collection to be created should be
+ * saved on exit, for load jobs.
+ *
+ * \param s Whether or not the new collection is saved on exit.
+ */
+void CSCollectionJob::setSaveOnExit(bool s)
+{
+	save = s;
+}
+
+/*!
+ * This function returns the track keys to operate on, for copy and delete
+ * jobs.
+ *
+ * \return The list of track keys.
+ */
+QStringList CSCollectionJob::getKeys() const
+{
+	return keys;
+}
+
+/*!
+ * This function sets the track keys to operate on, for copy and delete jobs.
+ *
+ * \param k The list of track keys.
+ */
+void CSCollectionJob::setKeys(const QStringList &k)
+{
+	keys = k;
+}
+
+/*!
+ * This function returns the collection this job operates on (for syncs and
+ * copies, this is the destination). If the collection has been deleted since
+ * the job was created, then NULL is returned instead.
+ *
+ * \return The collection we operate on.
+ */
+CSAbstractCollection *CSCollectionJob::getCollection() const
+{
+	return collection.data();
+}
+
+/*!
+ * This function sets the collection this job operates on (for syncs and
+ * copies, this is the destination).
+ *
+ * \param c The collection we operate on.
+ */
+void CSCollectionJob::setCollection(CSAbstractCollection *c)
+{
+	collection = c;
+}
+
+/*!
+ * This function returns the source collection, for sync and copy jobs. If the
+ * collection has been deleted since the job was created, then NULL is returned
+ * instead.
+ *
+ * \return Our source collection.
+ */
+CSAbstractCollection *CSCollectionJob::getSource() const
+{
+	return source.data();
+}
+
+/*!
+ * This function sets the source collection, for sync and copy jobs.
+ *
+ * \param s Our source collection.
+ */
+void CSCollectionJob::setSource(CSAbstractCollection *s)
+{
+	source = s;
+}
+
+/*!
+ * This function returns the job currently running on the calling thread, or
+ * NULL if no job is running on it.
+ *
+ * \return The calling thread's current job.
+ */
+CSCollectionJob *CSCollectionJob::current()
+{
+	if(!currentJob.hasLocalData())
+		return NULL;
+
+	return currentJob.localData().job;
+}
+
+/*!
+ * This function sets the job currently running on the calling thread. This
+ * should only be called by the job executor.
+ *
+ * \param j The calling thread's new current job, or NULL.
+ */
+void CSCollectionJob::setCurrent(CSCollectionJob *j)
+{
+	currentJob.localData().job = j;
+}
@@ -0,0 +1,119 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_THREAD_COLLECTION_JOB_H
+#define INCLUDE_LIBCUTE_THREAD_COLLECTION_JOB_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+
+#include "libcute/collections/abstractcollection.h"
+
+/*!
+ * \brief This class describes a single job to be run on a worker thread.
+ *
+ * Jobs are queued on the job executor belonging to the worker of the
+ * collection they operate on, where they are run in order of priority (and in
+ * the order they were queued within a single priority). Until a job starts it
+ * can be reprioritized or cancelled; once it is running, cancelling it sets its
+ * cancellation token, which the collection polls between items via
+ * checkpoint(). Cancelling one job never affects any other job.
+ *
+ * While a job is running, it is available to the code it calls via current(),
+ * so collections don't need to be handed the job explicitly.
+ */
+class CSCollectionJob
+{
+	public:
+		enum Type
+		{
+			Load,
+			Unserialize,
+			Restore,
+			Attach,
+			Reload,
+			Refresh,
+			Validate,
+			Sync,
+			Copy,
+			Delete
+		};
+
+		enum Priority
+		{
+			Background  = 0,
+			Normal      = 1,
+			Interactive = 2
+		};
+
+		CSCollectionJob(Type t, Priority p = Normal);
+		virtual ~CSCollectionJob();
+
+		quint64 getID() const;
+		Type getType() const;
+
+		Priority getPriority() const;
+		void setPriority(Priority p);
+
+		bool isCancelled() const;
+		void cancel();
+		bool checkpoint() const;
+
+		bool involves(const CSAbstractCollection *c) const;
+
+		QString getName() const;
+		void setName(const QString &n);
+		QString getPath() const;
+		void setPath(const QString &p);
+		QByteArray getData() const;
+		void setData(const QByteArray &d);
+		bool isSavedOnExit() const;
+		void setSaveOnExit(bool s);
+		QStringList getKeys() const;
+		void setKeys(const QStringList &k);
+
+		CSAbstractCollection *getCollection() const;
+		void setCollection(CSAbstractCollection *c);
+		CSAbstractCollection *getSource() const;
+		void setSource(CSAbstractCollection *s);
+
+		static CSCollectionJob *current();
+		static void setCurrent(CSCollectionJob *j);
+
+	private:
+		static QAtomicInt nextID;
+
+		quint64 id;
+		Type type;
+		Priority priority;
+		QAtomicInt cancelled;
+
+		QString name;
+		QString path;
+		QByteArray data;
+		bool save;
+		QStringList keys;
+
+		QPointer<CSAbstractCollection> collection;
+		QPointer<CSAbstractCollection> source;
+};
+
+#endif
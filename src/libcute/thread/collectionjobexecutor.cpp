@@ -19,42 +19,463 @@
 #include "collectionjobexecutor.h"
 
 #include <QThread>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
 
 #include "libcute/collections/abstractcollection.h"
+#include "libcute/collections/collectiontyperesolver.h"
+#include "libcute/thread/devicescheduler.h"
+#include "libcute/thread/pausablethread.h"
+#include "libcute/util/trace.h"
 
 /*!
  * This is our default constructor, which creates a new instance of our job
- * executor running on the given thread.
+ * executor running on the given thread. If a device scheduler is given, then
+ * our jobs will wait for the devices they touch to become available before
+ * they start. Note that we do not take ownership of the scheduler.
  *
  * \param t The thread to run jobs on.
+ * \param s The device scheduler to use, if any.
  */
-CSCollectionJobExecutor::CSCollectionJobExecutor(QThread *t)
-	: QObject()
+CSCollectionJobExecutor::CSCollectionJobExecutor(QThread *t,
+	CSDeviceScheduler *s)
+	: QObject(), scheduler(s), resolver(NULL), running(NULL)
 {
+	queueMutex = new QMutex(QMutex::NonRecursive);
+
 	moveToThread(t);
 }
 
 /*!
- * This is our default destructor, which cleans up & destroys our object.
+ * This is our default destructor, which cleans up & destroys our object. Any
+ * jobs which are still queued are discarded.
  */
 CSCollectionJobExecutor::~CSCollectionJobExecutor()
 {
+	qDeleteAll(queue);
+	delete queueMutex;
+}
+
+/*!
+ * This function sets the collection type resolver we use to run load and
+ * unserialize jobs. The resolver should live on the same thread we do. Note
+ * that we do not take ownership of the resolver.
+ *
+ * \param r The resolver to use.
+ */
+void CSCollectionJobExecutor::setResolver(CSCollectionTypeResolver *r)
+{
+	resolver = r;
+}
+
+/*!
+ * This function adds the given job to our queue. It will be run on our worker
+ * thread after any jobs of the same or higher priority which were queued
+ * before it. This function is thread-safe. Note that we take ownership of the
+ * job; it is deleted once it has been run or cancelled.
+ *
+ * \param j The job to queue.
+ */
+void CSCollectionJobExecutor::enqueue(CSCollectionJob *j)
+{
+	if(j == NULL)
+		return;
+
+	queueMutex->lock();
+	insert(j);
+	queueMutex->unlock();
+
+	QMetaObject::invokeMethod(this, "runNextJob", Qt::QueuedConnection);
+}
+
+/*!
+ * This function cancels the job with the given ID. If it is still queued, it
+ * is removed from our queue; if it is running, its cancellation token is set,
+ * and it will stop at its next checkpoint. This function is thread-safe.
+ *
+ * \param id The ID of the job to cancel.
+ * \return True if we found the job, or false otherwise.
+ */
+bool CSCollectionJobExecutor::cancelJob(quint64 id)
+{
+	QMutexLocker locker(queueMutex);
+
+	if( (running != NULL) && (running->getID() == id) )
+	{
+		running->cancel();
+		return true;
+	}
+
+	for(int i = 0; i < queue.count(); ++i)
+	{
+		if(queue.at(i)->getID() == id)
+		{
+			finish(queue.takeAt(i));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * This function changes the priority of the queued job with the given ID,
+ * moving it within our queue accordingly. Jobs which have already started are
+ * unaffected. This function is thread-safe.
+ *
+ * \param id The ID of the job to reprioritize.
+ * \param p The job's new priority.
+ * \return True if we found the job, or false otherwise.
+ */
+bool CSCollectionJobExecutor::setJobPriority(quint64 id,
+	CSCollectionJob::Priority p)
+{
+	QMutexLocker locker(queueMutex);
+
+	for(int i = 0; i < queue.count(); ++i)
+	{
+		if(queue.at(i)->getID() == id)
+		{
+			CSCollectionJob *j = queue.takeAt(i);
+			j->setPriority(p);
+			insert(j);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * This function cancels every job (queued or running) which involves the given
+ * collection. This should be done before a collection is deleted. This
+ * function is thread-safe.
+ *
+ * \param c The collection whose jobs should be cancelled.
+ */
+void CSCollectionJobExecutor::cancelJobs(const CSAbstractCollection *c)
+{
+	QMutexLocker locker(queueMutex);
+
+	if( (running != NULL) && running->involves(c) )
+		running->cancel();
+
+	for(int i = queue.count() - 1; i >= 0; --i)
+		if(queue.at(i)->involves(c))
+			finish(queue.takeAt(i));
+}
+
+/*!
+ * This function cancels all of our jobs; queued jobs are discarded, and the
+ * running job (if any) is cancelled. This function is thread-safe.
+ */
+void CSCollectionJobExecutor::cancelAll()
+{
+	QMutexLocker locker(queueMutex);
+
+	if(running != NULL)
+		running->cancel();
+
+	while(!queue.isEmpty())
+		finish(queue.takeFirst());
 }
 
 /*!
- * This function starts a new collection synchronization job in our worker
- * thread.
+ * This function returns the number of jobs waiting in our queue, not including
+ * any job which is currently running.
  *
- * \param s The source collection to sync from.
- * \param d The destination collection to sync to.
+ * \return The number of queued jobs.
  */
-void CSCollectionJobExecutor::syncCollections(
-	CSAbstractCollection *s, CSAbstractCollection *d)
+int CSCollectionJobExecutor::getQueuedCount() const
+{
+	QMutexLocker locker(queueMutex);
+	return queue.count();
+}
+
+/*!
+ * This function returns whether or not the job we are currently running (if
+ * any) involves the given collection. A collection must not be deleted while
+ * this is the case, even if the job has been cancelled, since the job may
+ * still be using it until it reaches its next checkpoint. This function is
+ * thread-safe.
+ *
+ * \param c The collection to look for.
+ * \return True if our running job involves the collection.
+ */
+bool CSCollectionJobExecutor::isRunning(const CSAbstractCollection *c) const
+{
+	QMutexLocker locker(queueMutex);
+	return (running != NULL) && running->involves(c);
+}
+
+/*!
+ * This function inserts the given job into our queue, after all jobs of the
+ * same or higher priority. The caller must hold our queue mutex.
+ *
+ * \param j The job to insert.
+ */
+void CSCollectionJobExecutor::insert(CSCollectionJob *j)
+{
+	int i = 0;
+
+	while( (i < queue.count()) &&
+		(queue.at(i)->getPriority() >= j->getPriority()) )
+	{
+		++i;
+	}
+
+	queue.insert(i, j);
+}
+
+/*!
+ * This function is called once we are done with the given job, because it has
+ * either been run or been cancelled, and deletes it. If the job would have
+ * created a new collection, we also emit creationFinished(), whether or not
+ * the collection was actually created.
+ *
+ * \param j The job we are done with.
+ */
+void CSCollectionJobExecutor::finish(CSCollectionJob *j)
+{
+	bool c = (j->getType() == CSCollectionJob::Load) ||
+		(j->getType() == CSCollectionJob::Unserialize) ||
+		(j->getType() == CSCollectionJob::Restore);
+
+	delete j;
+
+	if(c)
+		Q_EMIT creationFinished();
+}
+
+/*!
+ * This function actually runs the given job on our worker thread, taking the
+ * collection and device locks it needs.
+ *
+ * \param j The job to run.
+ */
+void CSCollectionJobExecutor::run(CSCollectionJob *j)
+{
+	CSAbstractCollection *c = j->getCollection();
+	CSAbstractCollection *s = j->getSource();
+	QStringList paths;
+
+	switch(j->getType())
+	{
+		// These jobs create a new collection.
+
+		case CSCollectionJob::Load:
+			if(resolver != NULL)
+			{
+				resolver->newCollection(j->getName(),
+					j->getPath(), j->isSavedOnExit());
+			}
+			return;
+
+		case CSCollectionJob::Unserialize:
+			if(resolver != NULL)
+			{
+				resolver->unserializeCollection(j->getName(),
+					j->getPath(), j->getData());
+			}
+			return;
+
+		case CSCollectionJob::Restore:
+			if(resolver != NULL)
+				resolver->restoreCollection(j->getPath());
+			return;
+
+		// These jobs operate on a single existing collection.
+
+		case CSCollectionJob::Attach:
+		case CSCollectionJob::Reload:
+		case CSCollectionJob::Refresh:
+		case CSCollectionJob::Validate:
+		case CSCollectionJob::Delete:
+			if(c == NULL)
+				return;
+
+			Q_ASSERT(thread() == c->thread());
+			s = c;
+			break;
+
+		// These jobs operate on a source and a destination collection.
+
+		case CSCollectionJob::Sync:
+		case CSCollectionJob::Copy:
+			if( (c == NULL) || (s == NULL) )
+				return;
+
+			Q_ASSERT(thread() == c->thread());
+			break;
+	};
+
+	QList<quint64> devices;
+	{
+		CSTraceSpan span("executor", "wait");
+
+		lockCollections(s, c);
+
+		paths.append(getDevicePath(c));
+		if(s != c)
+			paths.append(getDevicePath(s));
+
+		if(scheduler != NULL)
+			devices = scheduler->acquire(paths);
+	}
+
+	// A job may have been cancelled while it was waiting for its locks.
+
+	if(j->checkpoint())
+	{
+		/*
+		 * Every job needs the tracks of the collections it involves, so
+		 * attach any that are still detached before doing anything else.
+		 */
+
+		if(!c->isAttached())
+			c->attach();
+		if(!s->isAttached())
+			s->attach();
+
+		switch(j->getType())
+		{
+			case CSCollectionJob::Reload:
+				c->reload();
+				break;
+
+			case CSCollectionJob::Refresh:
+				c->refresh();
+				break;
+
+			case CSCollectionJob::Validate:
+				c->validate();
+				break;
+
+			case CSCollectionJob::Delete:
+				c->deleteTracks(j->getKeys());
+				break;
+
+			case CSCollectionJob::Sync:
+				c->syncFrom(s);
+				break;
+
+			case CSCollectionJob::Copy:
+				c->copyTracks(s, j->getKeys());
+				break;
+
+			default:
+				break;
+		};
+	}
+
+	if(scheduler != NULL)
+		scheduler->release(devices);
+
+	unlockCollections(s, c);
+}
+
+/*!
+ * This function returns the path identifying the device the given collection
+ * lives on. Detached collections don't know their mount point until they are
+ * attached, so we use the path recorded in their catalog header instead.
+ *
+ * \param c The collection to examine.
+ * \return A path on the device the collection lives on.
+ */
+QString CSCollectionJobExecutor::getDevicePath(const CSAbstractCollection *c)
+{
+	if(c->isAttached())
+		return c->getMountPoint();
+
+	return c->getCatalogHeader().path;
+}
+
+/*!
+ * This function acquires the job locks of both of the given collections.
+ * Locks are always acquired in the same (address) order, regardless of the
+ * order of our parameters, so two workers locking the same pair of collections
+ * can never deadlock.
+ *
+ * \param a The first collection to lock.
+ * \param b The second collection to lock.
+ */
+void CSCollectionJobExecutor::lockCollections(const CSAbstractCollection *a,
+	const CSAbstractCollection *b)
+{
+	if(a == b)
+	{
+		a->lockJobs();
+		return;
+	}
+
+	if(a > b)
+		qSwap(a, b);
+
+	a->lockJobs();
+	b->lockJobs();
+}
+
+/*!
+ * This function releases the job locks previously acquired with
+ * lockCollections().
+ *
+ * \param a The first collection to unlock.
+ * \param b The second collection to unlock.
+ */
+void CSCollectionJobExecutor::unlockCollections(const CSAbstractCollection *a,
+	const CSAbstractCollection *b)
+{
+	a->unlockJobs();
+
+	if(a != b)
+		b->unlockJobs();
+}
+
+/*!
+ * This slot takes the highest-priority job off of our queue and runs it. One
+ * invocation of this slot is queued for every job we are given, so jobs which
+ * were cancelled before they started simply result in an invocation with
+ * nothing to do.
+ */
+void CSCollectionJobExecutor::runNextJob()
 { /* SLOT */
 
-	Q_ASSERT(thread() == s->thread());
-	Q_ASSERT(s->thread() == d->thread());
+	// Don't start anything new while our worker thread is paused.
+
+	CSPausableThread::checkpoint();
+
+	queueMutex->lock();
+
+	if(queue.isEmpty())
+	{
+		queueMutex->unlock();
+		return;
+	}
+
+	running = queue.takeFirst();
+	CSCollectionJob *j = running;
+
+	queueMutex->unlock();
+
+	CSCollectionJob::setCurrent(j);
+
+	if(j->checkpoint())
+	{
+		CSTraceSpan span("executor", "run");
+		run(j);
+	}
+
+	CSCollectionJob::setCurrent(NULL);
+
+	queueMutex->lock();
+	running = NULL;
+	queueMutex->unlock();
+
+	finish(j);
 
-	d->syncFrom(s);
+	Q_EMIT jobDone();
 
 }
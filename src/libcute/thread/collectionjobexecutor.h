@@ -20,32 +20,80 @@
 #define INCLUDE_LIBCUTE_THREAD_COLLECTION_JOB_EXECUTOR_H
 
 #include <QObject>
+#include <QList>
+#include <QString>
+
+#include "libcute/thread/collectionjob.h"
 
 class QThread;
+class QMutex;
 
 class CSAbstractCollection;
+class CSCollectionTypeResolver;
+class CSDeviceScheduler;
 
 /*!
  * \brief This is a simple class for executing jobs in a worker thread.
  *
- * To communicate from our GUI thread to our collections (which run in the
- * worker thread), we use the signals/slots mechanism. However, signals are not
- * designed to communicate with only ONE PARTICULAR object. This class provides
- * a single object that can be connected to signals, which then starts a
- * particular job on the particular object the signaler wanted to communicate
- * with.
+ * Each worker thread has one executor, which owns a priority queue of the jobs
+ * (see CSCollectionJob) scheduled on that worker. Jobs may be queued from any
+ * thread; they are then run one at a time on our worker, highest priority
+ * first. Queued jobs can be reprioritized or cancelled individually, and
+ * running jobs can be cancelled via their cancellation token.
+ *
+ * Jobs involving more than one collection (i.e., syncs and copies) may touch
+ * collections living on other workers, so every job holds the job lock of each
+ * collection it involves while it runs. If we are given a device scheduler,
+ * every job also holds a slot on each device it touches while it runs.
+ *
+ * Whenever a job which would create a new collection is done with, whether it
+ * ran (successfully or not) or was cancelled, we emit creationFinished().
+ * Whenever a job we started is done running, we emit jobDone().
  */
 class CSCollectionJobExecutor : public QObject
 {
 	Q_OBJECT
 
 	public:
-		CSCollectionJobExecutor(QThread *t);
+		CSCollectionJobExecutor(QThread *t,
+			CSDeviceScheduler *s = NULL);
 		virtual ~CSCollectionJobExecutor();
 
-	public Q_SLOTS:
-		void syncCollections(CSAbstractCollection *s,
-			CSAbstractCollection *d);
+		void setResolver(CSCollectionTypeResolver *r);
+
+		void enqueue(CSCollectionJob *j);
+		bool cancelJob(quint64 id);
+		bool setJobPriority(quint64 id, CSCollectionJob::Priority p);
+		void cancelJobs(const CSAbstractCollection *c);
+		void cancelAll();
+
+		int getQueuedCount() const;
+		bool isRunning(const CSAbstractCollection *c) const;
+
+	private:
+		CSDeviceScheduler *scheduler;
+		CSCollectionTypeResolver *resolver;
+
+		mutable QMutex *queueMutex;
+		QList<CSCollectionJob *> queue;
+		CSCollectionJob *running;
+
+		void insert(CSCollectionJob *j);
+		void run(CSCollectionJob *j);
+		void finish(CSCollectionJob *j);
+
+		static QString getDevicePath(const CSAbstractCollection *c);
+		static void lockCollections(const CSAbstractCollection *a,
+			const CSAbstractCollection *b);
+		static void unlockCollections(const CSAbstractCollection *a,
+			const CSAbstractCollection *b);
+
+	private Q_SLOTS:
+		void runNextJob();
+
+	Q_SIGNALS:
+		void creationFinished();
+		void jobDone();
 };
 
 #endif
@@ -21,115 +21,251 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QMessageBox>
+#include <QThread>
 
 #include "libcute/defines.h"
 #include "libcute/collections/abstractcollection.h"
 #include "libcute/collections/collectiontyperesolver.h"
 #include "libcute/thread/collectionjobexecutor.h"
+#include "libcute/thread/devicescheduler.h"
 #include "libcute/thread/pausablethread.h"
 
 /*!
  * This is our default constructor, which initializes a new thread pool with
- * the given parent object.
+ * the given parent object and number of worker threads. If the given number of
+ * workers is not positive, then we create one worker per processor core (but
+ * always at least one).
  *
  * \param p Our parent object.
+ * \param w The number of worker threads to create.
  */
-CSCollectionThreadPool::CSCollectionThreadPool(QObject *p)
-	: QObject(p), interruptible(true)
+CSCollectionThreadPool::CSCollectionThreadPool(QObject *p, int w)
+	: QObject(p), paused(false)
 {
 	controlMutex = new QMutex(QMutex::NonRecursive);
 
-	// Create a new thread, as well as our collection type resolver.
+	qRegisterMetaType<CSAbstractCollection *>("CSAbstractCollection *");
+	qRegisterMetaType<CSJobStatistics>("CSJobStatistics");
 
-	thread = new CSPausableThread(this);
-	thread->start();
+	if(w <= 0)
+		w = qMax(1, QThread::idealThreadCount());
 
-	resolver = new CSCollectionTypeResolver();
-	resolver->moveToThread(thread);
+	scheduler = new CSDeviceScheduler();
 
-	executor = new CSCollectionJobExecutor(thread);
-
-	// Connect the collection type resolver's progress signals.
+	/*
+	 * Create our worker threads. Each worker gets its own collection type
+	 * resolver (so new collections are created with that worker's thread
+	 * affinity) and its own job executor.
+	 */
 
-	QObject::connect(resolver, SIGNAL(jobStarted(const QString &, bool)),
-		this, SIGNAL(jobStarted(const QString &, bool)));
-	QObject::connect(resolver, SIGNAL(progressLimitsUpdated(int, int)),
-		this, SIGNAL(progressLimitsUpdated(int, int)));
-	QObject::connect(resolver, SIGNAL(progressUpdated(int)),
-		this, SIGNAL(progressUpdated(int)));
-	QObject::connect(resolver, SIGNAL(jobFinished(const QString &)),
-		this, SIGNAL(jobFinished(const QString &)));
+	for(int i = 0; i < w; ++i)
+	{
+		CSPausableThread *thread = new CSPausableThread(this);
+		thread->start();
+
+		CSCollectionTypeResolver *resolver =
+			new CSCollectionTypeResolver();
+		resolver->setDeviceScheduler(scheduler);
+		resolver->moveToThread(thread);
+
+		CSCollectionJobExecutor *executor =
+			new CSCollectionJobExecutor(thread, scheduler);
+		executor->setResolver(resolver);
+
+		// Connect the collection type resolver's progress signals.
+
+		QObject::connect(resolver, SIGNAL(jobStarted(const QString &,
+			bool)), this, SIGNAL(jobStarted(const QString &, bool)));
+		QObject::connect(resolver, SIGNAL(jobFinished(const QString &)),
+			this, SIGNAL(jobFinished(const QString &)));
+		QObject::connect(resolver, SIGNAL(statisticsUpdated(
+			const CSJobStatistics &)), this, SIGNAL(
+			statisticsUpdated(const CSJobStatistics &)));
+
+		// Connect the type resolver's other signals to our slots.
+
+		QObject::connect(resolver, SIGNAL(collectionCreated(
+			CSAbstractCollection *)), this, SLOT(doCollectionCreated(
+			CSAbstractCollection *)));
+
+		/*
+		 * The executor may finish a creation job while holding its
+		 * queue lock (e.g., when one is cancelled from our thread), so
+		 * this connection must always be queued.
+		 */
+
+		QObject::connect(executor, SIGNAL(creationFinished()),
+			this, SLOT(doCreationFinished()),
+			Qt::QueuedConnection);
+		QObject::connect(executor, SIGNAL(jobDone()),
+			this, SLOT(doJobDone()), Qt::QueuedConnection);
+
+		threads.append(thread);
+		resolvers.append(resolver);
+		executors.append(executor);
+		workerLoad.append(0);
+	}
+}
 
-	QObject::connect(resolver, SIGNAL(jobStarted(const QString &, bool)),
-		this, SLOT(doJobStarted(const QString &, bool)));
-	QObject::connect(resolver, SIGNAL(jobFinished(const QString &)),
-		this, SLOT(doJobFinished(const QString &)));
+/*!
+ * This is our default destructor, which cleans up and destroys our object.
+ * Any worker threads which are still running are stopped first.
+ */
+CSCollectionThreadPool::~CSCollectionThreadPool()
+{
+	for(int i = 0; i < threads.count(); ++i)
+		threads.at(i)->quit();
 
-	// Connect our action signals to the collection type resolver.
+	for(int i = 0; i < threads.count(); ++i)
+		threads.at(i)->wait();
 
-	QObject::connect(this, SIGNAL(startUnserialize(const QString &,
-		const QString &, const QByteArray &)), resolver, SLOT(
-		unserializeCollection(const QString &, const QString &,
-		const QByteArray &)));
-	QObject::connect(this, SIGNAL(startNew(const QString &,
-		const QString &, bool)), resolver, SLOT(newCollection(
-		const QString &, const QString &, bool)));
+	// Nothing is running anymore, so any doomed collections can go.
+	qDeleteAll(doomed);
 
-	// Connect our action signals to the collection job executor.
+	qDeleteAll(resolvers);
+	qDeleteAll(executors);
+	delete scheduler;
 
-	QObject::connect(this, SIGNAL(startSync(CSAbstractCollection *,
-		CSAbstractCollection *)), executor, SLOT(syncCollections(
-		CSAbstractCollection *, CSAbstractCollection *)));
+	delete controlMutex;
+}
 
-	// Connect the type resolver's other signals to our signals.
+/*!
+ * This function returns the number of worker threads in our pool.
+ *
+ * \return The number of worker threads we have.
+ */
+int CSCollectionThreadPool::getWorkerCount() const
+{
+	return threads.count();
+}
 
-	QObject::connect(resolver, SIGNAL(collectionCreated(
-		CSAbstractCollection *)), this, SLOT(doCollectionCreated(
-		CSAbstractCollection *)));
+/*!
+ * This function returns the number of jobs which may run concurrently on any
+ * single device. See CSDeviceScheduler for details.
+ *
+ * \return Our per-device queue depth.
+ */
+int CSCollectionThreadPool::getDeviceQueueDepth() const
+{
+	return scheduler->getQueueDepth();
 }
 
 /*!
- * This is our default destructor, which cleans up and destroys our object.
+ * This function sets the number of jobs which may run concurrently on any
+ * single device. See CSDeviceScheduler for details.
+ *
+ * \param d The new per-device queue depth.
  */
-CSCollectionThreadPool::~CSCollectionThreadPool()
+void CSCollectionThreadPool::setDeviceQueueDepth(int d)
 {
-	delete resolver;
+	scheduler->setQueueDepth(d);
 }
 
 /*!
- * This function returns whether or not our thread pool's currently executing
- * job is easily interruptible. Jobs that aren't interruptible might include
- * things like synchronizing collections, which can leave the destination
- * collection in a semi-broken state if it is interrupted.
+ * This function returns whether or not all of our thread pool's currently
+ * executing jobs are easily interruptible. Jobs that aren't interruptible
+ * might include things like synchronizing collections, which can leave the
+ * destination collection in a semi-broken state if it is interrupted.
  *
- * \return Whether our not our current job is interruptible.
+ * \return Whether our not our current jobs are interruptible.
  */
 bool CSCollectionThreadPool::isInterruptible()
 {
-	controlMutex->lock();
-	bool i = interruptible;
-	controlMutex->unlock();
+	QMutexLocker locker(controlMutex);
+	return uninterruptible.isEmpty();
+}
+
+/*!
+ * This function cancels the job with the given ID, as returned by one of our
+ * slots. If the job hasn't started yet, it is discarded; otherwise, it stops
+ * at its next checkpoint. No other jobs are affected.
+ *
+ * \param id The ID of the job to cancel.
+ * \return True if the job was found, or false otherwise.
+ */
+bool CSCollectionThreadPool::cancelJob(quint64 id)
+{
+	for(int i = 0; i < executors.count(); ++i)
+		if(executors.at(i)->cancelJob(id))
+			return true;
+
+	return false;
+}
+
+/*!
+ * This function changes the priority of the queued job with the given ID, as
+ * returned by one of our slots. Jobs which have already started are
+ * unaffected.
+ *
+ * \param id The ID of the job to reprioritize.
+ * \param p The job's new priority.
+ * \return True if the job was found, or false otherwise.
+ */
+bool CSCollectionThreadPool::setJobPriority(quint64 id,
+	CSCollectionJob::Priority p)
+{
+	for(int i = 0; i < executors.count(); ++i)
+		if(executors.at(i)->setJobPriority(id, p))
+			return true;
+
+	return false;
+}
+
+/*!
+ * This function cancels every queued or running job which involves the given
+ * collection, on any of our workers. This should be done before the collection
+ * is destroyed.
+ *
+ * \param c The collection whose jobs should be cancelled.
+ */
+void CSCollectionThreadPool::cancelJobs(const CSAbstractCollection *c)
+{
+	for(int i = 0; i < executors.count(); ++i)
+		executors.at(i)->cancelJobs(c);
+}
 
-	return i;
+/*!
+ * This function deletes the given collection, which we take ownership of. Any
+ * jobs involving the collection are cancelled first (see cancelJobs()).
+ * However, a cancelled job keeps using its collections until it reaches its
+ * next checkpoint, and a sync or a copy runs on its destination's worker, not
+ * its source's. So, the collection is only actually deleted once no worker is
+ * running a job which involves it. No new jobs should be scheduled on the
+ * collection after calling this.
+ *
+ * \param c The collection to delete.
+ */
+void CSCollectionThreadPool::deleteCollection(CSAbstractCollection *c)
+{
+	if( (c == NULL) || doomed.contains(c) )
+		return;
+
+	cancelJobs(c);
+	doomed.append(c);
+
+	deleteIdleCollections();
 }
 
 /*!
- * This function pauses our worker thread(s). See our CSPausableThread class
- * for more details. The thread(s) can later be resumed with our resume()
- * function.
+ * This function pauses our worker threads. Running jobs stop at their next
+ * checkpoint (i.e., within one track), and queued jobs aren't started. See our
+ * CSPausableThread class for more details. The threads can later be resumed
+ * with our resume() function.
  */
 void CSCollectionThreadPool::pause()
 {
-	thread->pause();
+	for(int i = 0; i < threads.count(); ++i)
+		threads.at(i)->pause();
 }
 
 /*!
- * This function resumes our worker thread(s). See our CSPausableThread class
- * for more details.
+ * This function resumes our worker threads. See our CSPausableThread class for
+ * more details.
  */
 void CSCollectionThreadPool::resume()
 {
-	thread->resume();
+	for(int i = 0; i < threads.count(); ++i)
+		threads.at(i)->resume();
 }
 
 /*!
@@ -167,76 +303,352 @@ bool CSCollectionThreadPool::stopGracefully()
 
 	}
 
-	Q_EMIT(interruptAllJobs());
+	for(int j = 0; j < executors.count(); ++j)
+		executors.at(j)->cancelAll();
+
+	// Let any paused jobs run to their next checkpoint, so they can exit.
 
-	thread->quit();
-	thread->wait();
+	resume();
+
+	for(int j = 0; j < threads.count(); ++j)
+		threads.at(j)->quit();
+
+	for(int j = 0; j < threads.count(); ++j)
+		threads.at(j)->wait();
 
 	return true;
 }
 
 /*!
- * This function sets whether or not our current job is interruptible. Note
- * that this function is completely thread-safe.
+ * This function picks the worker a new collection should be assigned to. We
+ * choose the worker with the fewest collections assigned to it, and count the
+ * new collection against it immediately, so several collections created in
+ * quick succession (e.g., when restoring saved collections at startup) are
+ * spread across all of our workers. This reservation is released once the job
+ * creating the collection is done, however it ends (see doCreationFinished()).
  *
- * \param i The new interruptible status for our object.
+ * \return The index of the worker the new collection should be created on.
  */
-void CSCollectionThreadPool::setInterruptible(bool i)
+int CSCollectionThreadPool::reserveWorker()
 {
 	QMutexLocker locker(controlMutex);
-	interruptible = i;
+
+	int w = 0;
+
+	for(int i = 1; i < workerLoad.count(); ++i)
+		if(workerLoad.at(i) < workerLoad.at(w))
+			w = i;
+
+	++workerLoad[w];
+
+	return w;
+}
+
+/*!
+ * This function returns the index of the worker the given collection is
+ * assigned to, or -1 if the collection doesn't live on any of our workers.
+ *
+ * \param c The collection to search for.
+ * \return The index of the given collection's worker.
+ */
+int CSCollectionThreadPool::workerFor(const CSAbstractCollection *c) const
+{
+	if(c == NULL)
+		return -1;
+
+	for(int i = 0; i < threads.count(); ++i)
+		if(c->thread() == threads.at(i))
+			return i;
+
+	return -1;
+}
+
+/*!
+ * This function queues the given job on the given worker's executor.
+ *
+ * \param w The index of the worker to run the job on.
+ * \param j The job to queue.
+ * \return The queued job's ID.
+ */
+quint64 CSCollectionThreadPool::enqueue(int w, CSCollectionJob *j)
+{
+	quint64 id = j->getID();
+	executors.at(w)->enqueue(j);
+	return id;
+}
+
+/*!
+ * This slot handles a request to restore a saved collection from the given
+ * catalog file. The collection is created detached (only its catalog header is
+ * read), on the least-loaded worker thread; its tracks are loaded when it is
+ * attached (see attachCollection()).
+ *
+ * \param f The path to the catalog file to restore.
+ * \param r The priority of the job.
+ * \return The ID of the new job.
+ */
+quint64 CSCollectionThreadPool::restoreCollection(const QString &f,
+	CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	CSCollectionJob *j = new CSCollectionJob(
+		CSCollectionJob::Restore, r);
+	j->setPath(f);
+
+	return enqueue(reserveWorker(), j);
+
 }
 
 /*!
  * This slot handles a request to create a new collection using the given
- * details. This schedules a new collection action to be executed in a worker
- * thread at the end of any current event queue. The collection will be loaded
- * from the given serialized collection data, instead of loaded from the
- * given path.
+ * details. This schedules a new collection job to be executed on the
+ * least-loaded worker thread. The collection will be loaded from the given
+ * serialized collection data, instead of loaded from the given path.
  *
  * \param n The name of the new collection.
  * \param p The path of the collection.
  * \param d The serialized collection data to load.
+ * \param r The priority of the job.
+ * \return The ID of the new job.
  */
-void CSCollectionThreadPool::unserializeCollection(const QString &n,
-	const QString &p, const QByteArray &d)
+quint64 CSCollectionThreadPool::unserializeCollection(const QString &n,
+	const QString &p, const QByteArray &d, CSCollectionJob::Priority r)
 { /* SLOT */
 
-	Q_EMIT startUnserialize(n, p, d);
+	CSCollectionJob *j = new CSCollectionJob(
+		CSCollectionJob::Unserialize, r);
+	j->setName(n);
+	j->setPath(p);
+	j->setData(d);
+
+	return enqueue(reserveWorker(), j);
 
 }
 
 /*!
  * This slot handles a request to create a new collection using the given
- * details. This schedules a new collection action to be executed in a worker
- * thread at the end of any current event queue.
+ * details. This schedules a new collection job to be executed on the
+ * least-loaded worker thread.
  *
  * \param n The name of the new collection.
  * \param p The path of the collection.
  * \param s Whether or not the collection should be saved on exit.
+ * \param r The priority of the job.
+ * \return The ID of the new job.
+ */
+quint64 CSCollectionThreadPool::newCollection(const QString &n,
+	const QString &p, bool s, CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Load, r);
+	j->setName(n);
+	j->setPath(p);
+	j->setSaveOnExit(s);
+
+	return enqueue(reserveWorker(), j);
+
+}
+
+/*!
+ * This slot handles a request to reload the given collection. The reload will
+ * be queued on the collection's worker thread.
+ *
+ * \param c The collection to reload.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if the collection isn't ours.
+ */
+quint64 CSCollectionThreadPool::reloadCollection(CSAbstractCollection *c,
+	CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	int w = workerFor(c);
+
+	if(w == -1)
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Reload, r);
+	j->setCollection(c);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This slot handles a request to attach the given (detached) collection,
+ * loading its tracks from the catalog it was restored from. The attach will be
+ * queued on the collection's worker thread. Attaching a collection which is
+ * already attached does nothing.
+ *
+ * \param c The collection to attach.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if the collection isn't ours.
  */
-void CSCollectionThreadPool::newCollection(const QString &n,
-	const QString &p, bool s)
+quint64 CSCollectionThreadPool::attachCollection(CSAbstractCollection *c,
+	CSCollectionJob::Priority r)
 { /* SLOT */
 
-	Q_EMIT startNew(n, p, s);
+	int w = workerFor(c);
+
+	if(w == -1)
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Attach, r);
+	j->setCollection(c);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This slot handles a request to refresh the given collection. The refresh
+ * will be queued on the collection's worker thread.
+ *
+ * \param c The collection to refresh.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if the collection isn't ours.
+ */
+quint64 CSCollectionThreadPool::refreshCollection(CSAbstractCollection *c,
+	CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	int w = workerFor(c);
+
+	if(w == -1)
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Refresh, r);
+	j->setCollection(c);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This slot handles a request to validate the given collection's cached
+ * contents (see CSAbstractCollection::validate()). The validation will be
+ * queued on the collection's worker thread; by default, it runs at background
+ * priority, so it doesn't hold up anything the user asks for.
+ *
+ * \param c The collection to validate.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if the collection isn't ours.
+ */
+quint64 CSCollectionThreadPool::validateCollection(CSAbstractCollection *c,
+	CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	int w = workerFor(c);
+
+	if(w == -1)
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Validate, r);
+	j->setCollection(c);
+
+	return enqueue(w, j);
 
 }
 
 /*!
  * This slot handles a request to start a synchronization job between two
- * collections. This synchronization action will be executed in a worker thread
- * at the end of any current event queue.
+ * collections. The sync will be queued on the destination collection's worker
+ * thread.
  *
  * \param s The source collection being synchronized from.
  * \param d The destination collection being synchronized to.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if either collection isn't ours.
+ */
+quint64 CSCollectionThreadPool::syncCollections(CSAbstractCollection *s,
+	CSAbstractCollection *d, CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	int w = workerFor(d);
+
+	if( (w == -1) || (workerFor(s) == -1) )
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Sync, r);
+	j->setSource(s);
+	j->setCollection(d);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This slot handles a request to copy the given tracks from one collection to
+ * another. The copy will be queued on the destination collection's worker
+ * thread.
+ *
+ * \param s The source collection to copy from.
+ * \param d The destination collection to copy to.
+ * \param k The keys of the tracks to copy.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if either collection isn't ours.
+ */
+quint64 CSCollectionThreadPool::copyTracks(CSAbstractCollection *s,
+	CSAbstractCollection *d, const QStringList &k,
+	CSCollectionJob::Priority r)
+{ /* SLOT */
+
+	int w = workerFor(d);
+
+	if( (w == -1) || (workerFor(s) == -1) )
+		return 0;
+
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Copy, r);
+	j->setSource(s);
+	j->setCollection(d);
+	j->setKeys(k);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This slot handles a request to delete the given tracks from a collection.
+ * The deletion will be queued on the collection's worker thread.
+ *
+ * \param c The collection to delete tracks from.
+ * \param k The keys of the tracks to delete.
+ * \param r The priority of the job.
+ * \return The ID of the new job, or 0 if the collection isn't ours.
  */
-void CSCollectionThreadPool::syncCollections(
-	CSAbstractCollection *s, CSAbstractCollection *d)
+quint64 CSCollectionThreadPool::deleteTracks(CSAbstractCollection *c,
+	const QStringList &k, CSCollectionJob::Priority r)
 { /* SLOT */
 
-	Q_EMIT startSync(s, d);
+	int w = workerFor(c);
+
+	if(w == -1)
+		return 0;
 
+	CSCollectionJob *j = new CSCollectionJob(CSCollectionJob::Delete, r);
+	j->setCollection(c);
+	j->setKeys(k);
+
+	return enqueue(w, j);
+
+}
+
+/*!
+ * This function deletes each of the collections passed to deleteCollection()
+ * which no worker is running a job on anymore. Each collection is deleted by
+ * its own worker (via deleteLater()), since that is the thread it lives on.
+ */
+void CSCollectionThreadPool::deleteIdleCollections()
+{
+	for(int i = doomed.count() - 1; i >= 0; --i)
+	{
+		bool running = false;
+
+		for(int e = 0; !running && (e < executors.count()); ++e)
+			running = executors.at(e)->isRunning(doomed.at(i));
+
+		if(!running)
+			doomed.takeAt(i)->deleteLater();
+	}
 }
 
 /*!
@@ -249,23 +661,124 @@ void CSCollectionThreadPool::doCollectionCreated(CSAbstractCollection *c)
 { /* SLOT */
 
 	/*
-	 * Connect the signal/slot we use to interrupt collection actions. Note
-	 * that this MUST be a Qt::DirectConnection, or otherwise the
-	 * interruption won't actually occur until the collection's thread
-	 * returns control to the event dispatch loop (i.e., after the job is
-	 * already completely done anyway).
+	 * Remember which worker the collection was created on, and count it
+	 * against that worker until it is destroyed. (The slot reserved when
+	 * its creation was scheduled is released separately, once the job
+	 * which created it is done; see doCreationFinished().)
+	 */
+
+	controlMutex->lock();
+
+	int w = workerFor(c);
+	affinity.insert(c, w);
+
+	if( (w >= 0) && (w < workerLoad.count()) )
+		++workerLoad[w];
+
+	controlMutex->unlock();
+
+	QObject::connect(c, SIGNAL(destroyed(QObject *)),
+		this, SLOT(doCollectionDestroyed(QObject *)));
+
+	/*
+	 * Track the interruptibility of each collection's current job
+	 * separately, since jobs on different workers can overlap.
 	 */
 
-	QObject::connect(this, SIGNAL(interruptAllJobs()),
-		c, SLOT(setInterrupted()), Qt::DirectConnection);
+	QObject::connect(c, SIGNAL(jobStarted(const QString &, bool)),
+		this, SLOT(doJobStarted(const QString &, bool)));
+	QObject::connect(c, SIGNAL(jobFinished(const QString &)),
+		this, SLOT(doJobFinished(const QString &)));
+
+	/*
+	 * Schedule validation whenever the collection loads cached data. It
+	 * may already have done so before we connected to it.
+	 */
+
+	QObject::connect(c, SIGNAL(validationRequested()),
+		this, SLOT(doValidationRequested()));
+
+	if(c->isValidationPending())
+		validateCollection(c);
 
 	Q_EMIT collectionCreated(c);
 
 }
 
 /*!
- * This function handles a new job being started by setting our interruptible
- * status to the reported value.
+ * This function handles one of our collections requesting that its contents
+ * be validated, by scheduling a background validation job for it.
+ */
+void CSCollectionThreadPool::doValidationRequested()
+{ /* SLOT */
+
+	CSAbstractCollection *c =
+		dynamic_cast<CSAbstractCollection *>(sender());
+
+	if( (c != NULL) && !doomed.contains(c) )
+		validateCollection(c);
+
+}
+
+/*!
+ * This function handles one of our collections being destroyed by releasing
+ * its worker's load, so that worker will be preferred for new collections.
+ *
+ * \param o The collection that was destroyed.
+ */
+void CSCollectionThreadPool::doCollectionDestroyed(QObject *o)
+{ /* SLOT */
+
+	QMutexLocker locker(controlMutex);
+
+	uninterruptible.remove(o);
+
+	if(!affinity.contains(o))
+		return;
+
+	int w = affinity.take(o);
+
+	if( (w >= 0) && (w < workerLoad.count()) )
+		--workerLoad[w];
+
+}
+
+/*!
+ * This function handles one of our executors being done with a job which would
+ * have created a new collection, by releasing the slot reserved for it on that
+ * executor's worker (see reserveWorker()). This happens whether the collection
+ * was created, its creation failed, or the job was cancelled.
+ */
+void CSCollectionThreadPool::doCreationFinished()
+{ /* SLOT */
+
+	QMutexLocker locker(controlMutex);
+
+	CSCollectionJobExecutor *e =
+		dynamic_cast<CSCollectionJobExecutor *>(sender());
+
+	int w = executors.indexOf(e);
+
+	if( (w >= 0) && (w < workerLoad.count()) )
+		--workerLoad[w];
+
+}
+
+/*!
+ * This function handles one of our executors being done running a job, by
+ * deleting any collections which were waiting for that job to finish (see
+ * deleteCollection()).
+ */
+void CSCollectionThreadPool::doJobDone()
+{ /* SLOT */
+
+	deleteIdleCollections();
+
+}
+
+/*!
+ * This function handles a new job being started on one of our collections by
+ * recording whether or not that collection's job is interruptible.
  *
  * \param j The job's description (UNUSED).
  * \param i Whether or not the job is interruptible.
@@ -273,19 +786,25 @@ void CSCollectionThreadPool::doCollectionCreated(CSAbstractCollection *c)
 void CSCollectionThreadPool::doJobStarted(const QString &UNUSED(j), bool i)
 { /* SLOT */
 
-	setInterruptible(i);
+	QMutexLocker locker(controlMutex);
+
+	if(i)
+		uninterruptible.remove(sender());
+	else
+		uninterruptible.insert(sender());
 
 }
 
 /*!
- * This function handles a job being finished by resetting our interruptible
- * state back to true.
+ * This function handles a job being finished on one of our collections by
+ * resetting that collection's interruptible state back to true.
  *
  * \param r The result of the job (UNUSED).
  */
 void CSCollectionThreadPool::doJobFinished(const QString &UNUSED(r))
 { /* SLOT */
 
-	setInterruptible(true);
+	QMutexLocker locker(controlMutex);
+	uninterruptible.remove(sender());
 
 }
@@ -20,6 +20,13 @@
 #define INCLUDE_LIBCUTE_THREAD_COLLECTION_THREAD_POOL_H
 
 #include <QObject>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include "libcute/thread/collectionjob.h"
+#include "libcute/util/jobinstrumentation.h"
 
 class QThread;
 class QMutex;
@@ -28,23 +35,53 @@ class CSCollectionTypeResolver;
 class CSAbstractCollection;
 class CSPausableThread;
 class CSCollectionJobExecutor;
+class CSDeviceScheduler;
 
 /*!
  * \brief This class manages a pool of worker threads for our application.
  *
  * We deal with creating collections and moving them to an appropriate worker
  * thread, as well as gracefully stopping collection actions.
+ *
+ * Each collection is assigned to exactly one worker for its entire lifetime
+ * (the least-loaded worker at the time it is created), and every job on that
+ * collection runs on that worker. Jobs on collections assigned to different
+ * workers therefore run concurrently. Syncs are scheduled on the destination
+ * collection's worker; see CSCollectionJobExecutor for how the source
+ * collection is locked while this happens.
+ *
+ * Jobs are queued per worker by priority (see CSCollectionJobExecutor), and
+ * each job can be reprioritized or cancelled individually via the ID our slots
+ * return.
+ *
+ * Since a job may involve collections living on other workers, collections
+ * must be deleted via deleteCollection(), which waits for every job involving
+ * the collection to finish first.
+ *
+ * Underneath the workers, jobs are grouped by the physical device they touch
+ * (see CSDeviceScheduler): jobs on different devices run in parallel, while
+ * jobs on the same device are queued, so concurrent scans don't thrash a disk.
  */
 class CSCollectionThreadPool : public QObject
 {
 	Q_OBJECT
 
 	public:
-		CSCollectionThreadPool(QObject *p = 0);
+		CSCollectionThreadPool(QObject *p = 0, int w = 0);
 		virtual ~CSCollectionThreadPool();
 
+		int getWorkerCount() const;
+
+		int getDeviceQueueDepth() const;
+		void setDeviceQueueDepth(int d);
+
 		bool isInterruptible();
 
+		bool cancelJob(quint64 id);
+		bool setJobPriority(quint64 id, CSCollectionJob::Priority p);
+		void cancelJobs(const CSAbstractCollection *c);
+		void deleteCollection(CSAbstractCollection *c);
+
 		void pause();
 		void resume();
 		bool stopGracefully();
@@ -52,38 +89,69 @@ class CSCollectionThreadPool : public QObject
 	private:
 		QMutex *controlMutex;
 		bool paused;
-		bool interruptible;
+		QSet<const QObject *> uninterruptible;
+
+		CSDeviceScheduler *scheduler;
+
+		QList<CSPausableThread *> threads;
+		QList<CSCollectionTypeResolver *> resolvers;
+		QList<CSCollectionJobExecutor *> executors;
+		QList<int> workerLoad;
+		QHash<const QObject *, int> affinity;
+		QList<CSAbstractCollection *> doomed;
 
-		CSPausableThread *thread;
-		CSCollectionTypeResolver *resolver;
-		CSCollectionJobExecutor *executor;
+		int reserveWorker();
+		int workerFor(const CSAbstractCollection *c) const;
 
-		void setInterruptible(bool i);
+		quint64 enqueue(int w, CSCollectionJob *j);
+
+		void deleteIdleCollections();
 
 	public Q_SLOTS:
-		void unserializeCollection(const QString &n,
-			const QString &p, const QByteArray &d);
-		void newCollection(const QString &n, const QString &p, bool s);
-		void syncCollections(CSAbstractCollection *s,
-			CSAbstractCollection *d);
+		quint64 unserializeCollection(const QString &n,
+			const QString &p, const QByteArray &d,
+			CSCollectionJob::Priority r = CSCollectionJob::Normal);
+		quint64 restoreCollection(const QString &f,
+			CSCollectionJob::Priority r = CSCollectionJob::Normal);
+		quint64 newCollection(const QString &n, const QString &p,
+			bool s, CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 attachCollection(CSAbstractCollection *c,
+			CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 reloadCollection(CSAbstractCollection *c,
+			CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 refreshCollection(CSAbstractCollection *c,
+			CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 validateCollection(CSAbstractCollection *c,
+			CSCollectionJob::Priority r =
+			CSCollectionJob::Background);
+		quint64 syncCollections(CSAbstractCollection *s,
+			CSAbstractCollection *d, CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 copyTracks(CSAbstractCollection *s,
+			CSAbstractCollection *d, const QStringList &k,
+			CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
+		quint64 deleteTracks(CSAbstractCollection *c,
+			const QStringList &k, CSCollectionJob::Priority r =
+			CSCollectionJob::Interactive);
 
 	private Q_SLOTS:
 		void doCollectionCreated(CSAbstractCollection *c);
+		void doCollectionDestroyed(QObject *o);
+		void doCreationFinished();
+		void doJobDone();
+		void doValidationRequested();
 		void doJobStarted(const QString &j, bool i);
 		void doJobFinished(const QString &r);
 
 	Q_SIGNALS:
-		void interruptAllJobs();
-
 		void jobStarted(const QString &, bool);
-		void progressLimitsUpdated(int, int);
-		void progressUpdated(int);
 		void jobFinished(const QString &);
-
-		void startUnserialize(const QString &,
-			const QString &, const QByteArray &);
-		void startNew(const QString &, const QString &, bool);
-		void startSync(CSAbstractCollection *, CSAbstractCollection *);
+		void statisticsUpdated(const CSJobStatistics &);
 
 		void collectionCreated(CSAbstractCollection *);
 };
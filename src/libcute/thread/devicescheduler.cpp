@@ -0,0 +1,133 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "devicescheduler.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QtAlgorithms>
+
+#include "libcute/util/systemutils.h"
+
+/*!
+ * This is our default constructor, which creates a new scheduler allowing the
+ * given number of concurrent jobs per device.
+ *
+ * \param d The queue depth to use for each device.
+ */
+CSDeviceScheduler::CSDeviceScheduler(int d)
+	: depth(qMax(1, d))
+{
+	mutex = new QMutex(QMutex::NonRecursive);
+	available = new QWaitCondition();
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSDeviceScheduler::~CSDeviceScheduler()
+{
+	delete available;
+	delete mutex;
+}
+
+/*!
+ * This function returns the number of jobs which may run concurrently on a
+ * single device.
+ *
+ * \return Our per-device queue depth.
+ */
+int CSDeviceScheduler::getQueueDepth() const
+{
+	QMutexLocker locker(mutex);
+	return depth;
+}
+
+/*!
+ * This function sets the number of jobs which may run concurrently on a
+ * single device. Jobs which are already running are unaffected, but any jobs
+ * currently waiting for a device are re-evaluated against the new depth.
+ *
+ * \param d The new per-device queue depth; values below 1 are treated as 1.
+ */
+void CSDeviceScheduler::setQueueDepth(int d)
+{
+	QMutexLocker locker(mutex);
+
+	depth = qMax(1, d);
+	available->wakeAll();
+}
+
+/*!
+ * This function acquires a slot on each of the devices containing the given
+ * paths, blocking until all of them are available. Paths on the same device
+ * only count once. The returned list must be passed to release() once the job
+ * is done.
+ *
+ * Paths whose device can't be determined (e.g., because they don't exist yet)
+ * are ignored, rather than serializing every such job against each other.
+ *
+ * \param p The paths the job is going to touch.
+ * \return The devices which were acquired.
+ */
+QList<quint64> CSDeviceScheduler::acquire(const QStringList &p)
+{
+	QList<quint64> devices;
+
+	for(int i = 0; i < p.count(); ++i)
+	{
+		quint64 d = CSSystemUtils::getDeviceID(p.at(i).toStdString());
+
+		if( (d != 0) && (!devices.contains(d)) )
+			devices.append(d);
+	}
+
+	qSort(devices);
+
+	QMutexLocker locker(mutex);
+
+	for(int i = 0; i < devices.count(); ++i)
+	{
+		while(active.value(devices.at(i), 0) >= depth)
+			available->wait(mutex);
+
+		++active[devices.at(i)];
+	}
+
+	return devices;
+}
+
+/*!
+ * This function releases the device slots previously acquired with acquire(),
+ * waking up any jobs which were waiting for them.
+ *
+ * \param d The devices to release, as returned by acquire().
+ */
+void CSDeviceScheduler::release(const QList<quint64> &d)
+{
+	QMutexLocker locker(mutex);
+
+	for(int i = 0; i < d.count(); ++i)
+	{
+		if(--active[d.at(i)] <= 0)
+			active.remove(d.at(i));
+	}
+
+	available->wakeAll();
+}
@@ -0,0 +1,64 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_THREAD_DEVICE_SCHEDULER_H
+#define INCLUDE_LIBCUTE_THREAD_DEVICE_SCHEDULER_H
+
+#include <QList>
+#include <QHash>
+#include <QStringList>
+
+class QMutex;
+class QWaitCondition;
+
+/*!
+ * \brief This class serializes collection jobs which touch the same device.
+ *
+ * Running collection jobs concurrently only helps if they touch different
+ * devices; two scans of the same spinning disk just fight over the disk head.
+ * Before a job starts, its worker acquires a slot on every device the job
+ * touches (as identified by CSSystemUtils::getDeviceID()), blocking until one
+ * is free. Each device has a fixed number of slots (its "queue depth"), so with
+ * the default depth of 1, jobs on the same device run strictly in sequence,
+ * while jobs on different devices run in parallel.
+ *
+ * Devices are always acquired in ascending order of their identifiers, so two
+ * jobs which each touch the same pair of devices can never deadlock. Callers
+ * which also hold collection job locks must acquire those FIRST.
+ */
+class CSDeviceScheduler
+{
+	public:
+		CSDeviceScheduler(int d = 1);
+		virtual ~CSDeviceScheduler();
+
+		int getQueueDepth() const;
+		void setQueueDepth(int d);
+
+		QList<quint64> acquire(const QStringList &p);
+		void release(const QList<quint64> &d);
+
+	private:
+		mutable QMutex *mutex;
+		QWaitCondition *available;
+
+		int depth;
+		QHash<quint64, int> active;
+};
+
+#endif
@@ -20,6 +20,7 @@
 
 #include <QMutex>
 #include <QMutexLocker>
+#include <QWaitCondition>
 
 /*!
  * This is our default constructor, which creates a new pausable thread
@@ -28,12 +29,10 @@
  * \param parent The thread's parent object.
  */
 CSPausableThread::CSPausableThread(QObject *p)
-	: QThread(p), paused(false), resumeScheduled(false)
+	: QThread(p), paused(0)
 {
 	controlMutex = new QMutex(QMutex::NonRecursive);
-
-	QObject::connect(this, SIGNAL(finished()),
-		this, SLOT(doResume()));
+	resumed = new QWaitCondition();
 }
 
 /*!
@@ -41,13 +40,25 @@ CSPausableThread::CSPausableThread(QObject *p)
  */
 CSPausableThread::~CSPausableThread()
 {
+	delete resumed;
 	delete controlMutex;
 }
 
 /*!
- * This function pauses our thread's event dispatch loop. Any event that is
- * already being processed will continue running, but we will pause the thread
- * before processing any more events.
+ * This function returns whether or not our thread is currently paused. This
+ * may be called from any thread.
+ *
+ * \return True if we are paused, or false otherwise.
+ */
+bool CSPausableThread::isPaused() const
+{
+	return (paused.loadAcquire() != 0);
+}
+
+/*!
+ * This function pauses our thread. Any job running on the thread will block
+ * the next time it reaches a checkpoint (see checkpoint()), until resume() is
+ * called. This may be called from any thread.
  *
  * If the thread is already paused, then nothing happens.
  */
@@ -55,65 +66,64 @@ void CSPausableThread::pause()
 {
 	QMutexLocker locker(controlMutex);
 
-	if(paused)
-		return;
-
-	paused = true;
-
-	quit();
+	paused.storeRelease(1);
 }
 
 /*!
- * This function resumes the thread after it has been paused. If the thread is
- * still processing the same event it was processing when pause() was called,
- * then we schedule a restart to occur after the current event is done
- * processing and the thread is stopped. Any events that were in the event
- * queue before pause() was called will then be processed as per normal.
+ * This function resumes the thread after it has been paused. Any job blocked
+ * at a checkpoint continues from where it stopped. This may be called from any
+ * thread.
  *
- * If the thread isn't paused, or a resume has already been scheduled, then
- * nothing happens. If the thread is already totally stopped, we perform an
- * immediate resume, instead of scheduling the resume to occur when finished()
- * is emitted.
+ * If the thread isn't paused, then nothing happens.
  */
 void CSPausableThread::resume()
 {
 	QMutexLocker locker(controlMutex);
 
-	if(!paused)
-		return;
-
-	if(resumeScheduled)
-		return;
-
-	if(isFinished())
-	{
-		start();
-
-		paused = false;
-		resumeScheduled = false;
-	}
-	else
-	{
-		resumeScheduled = true;
-	}
+	paused.storeRelease(0);
+	resumed->wakeAll();
 }
 
 /*!
- * This function is connected to our thread's finished() signal, and it resumes
- * the thread if a resume was scheduled previously. See resume() for more
- * information.
+ * This function blocks the calling thread for as long as we are paused, or
+ * until the given timeout elapses. If we aren't paused, we return immediately.
+ * This should only be called from our own thread; see checkpoint().
+ *
+ * \param t The maximum time to wait, in milliseconds.
+ * \return True if we are no longer paused, or false if we timed out.
  */
-void CSPausableThread::doResume()
-{ /* SLOT */
+bool CSPausableThread::waitWhilePaused(unsigned long t)
+{
+	if(!isPaused())
+		return true;
 
 	QMutexLocker locker(controlMutex);
 
-	if(!resumeScheduled)
-		return;
+	if(isPaused())
+		resumed->wait(controlMutex, t);
+
+	return !isPaused();
+}
+
+/*!
+ * This function is a pause checkpoint for the calling thread. If the calling
+ * thread is a CSPausableThread which has been paused, we block until it is
+ * resumed, or until the given timeout elapses. Otherwise, we return
+ * immediately.
+ *
+ * Jobs which need to stay responsive to cancellation while paused should pass
+ * a short timeout, and call us in a loop while they are still wanted.
+ *
+ * \param t The maximum time to wait, in milliseconds.
+ * \return True if the calling thread is not paused, or false if we timed out.
+ */
+bool CSPausableThread::checkpoint(unsigned long t)
+{
+	CSPausableThread *thread =
+		qobject_cast<CSPausableThread *>(QThread::currentThread());
 
-	paused = false;
-	resumeScheduled = false;
+	if(thread == NULL)
+		return true;
 
-	wait();
-	start();
+	return thread->waitWhilePaused(t);
 }
@@ -20,16 +20,21 @@
 #define INCLUDE_LIBCUTE_THREAD_PAUSABLE_THREAD_H
 
 #include <QThread>
+#include <QAtomicInt>
+
+#include <climits>
 
 class QMutex;
+class QWaitCondition;
 
 /*!
  * \brief This class extends QThread by adding pause() and resume() functions.
  *
- * NOTE: This thread assumes that we are using the default implementation of
- * run(). Namely, we should be executing a standard event dispatch loop. If you
- * write your own run() function, then this class canot be used, and you will
- * need to implement your own pause/resume functionality.
+ * Pausing is cooperative: the thread keeps running its event loop, but any
+ * code running on it which calls checkpoint() will block there until the
+ * thread is resumed. Long-running jobs (e.g., the per-track loops in our
+ * collections) should call checkpoint() between items, so a pause takes effect
+ * within one item and the job continues exactly where it stopped.
  */
 class CSPausableThread : public QThread
 {
@@ -39,16 +44,18 @@ class CSPausableThread : public QThread
 		CSPausableThread(QObject *p = 0);
 		virtual ~CSPausableThread();
 
+		bool isPaused() const;
 		void pause();
 		void resume();
 
+		bool waitWhilePaused(unsigned long t = ULONG_MAX);
+
+		static bool checkpoint(unsigned long t = ULONG_MAX);
+
 	private:
 		QMutex *controlMutex;
-		bool paused;
-		bool resumeScheduled;
-
-	private Q_SLOTS:
-		void doResume();
+		QWaitCondition *resumed;
+		QAtomicInt paused;
 };
 
 #endif
@@ -0,0 +1,164 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "progressaggregator.h"
+
+#include <QTimer>
+
+#include "libcute/collections/abstractcollection.h"
+
+/*!
+ * This is our default constructor, which creates a new progress aggregator
+ * that samples its collections the given number of times per second.
+ *
+ * \param p Our parent object.
+ * \param r The number of samples to take per second.
+ */
+CSProgressAggregator::CSProgressAggregator(QObject *p, int r)
+	: QObject(p), lastDone(-1), lastTotal(-1)
+{
+	timer = new QTimer(this);
+	setFrameRate(r);
+
+	QObject::connect(timer, SIGNAL(timeout()), this, SLOT(doSample()));
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSProgressAggregator::~CSProgressAggregator()
+{
+}
+
+/*!
+ * This function returns the number of times per second we sample our
+ * collections' progress while a job is running.
+ *
+ * \return Our frame rate.
+ */
+int CSProgressAggregator::getFrameRate() const
+{
+	return 1000 / timer->interval();
+}
+
+/*!
+ * This function sets the number of times per second we sample our collections'
+ * progress while a job is running. Values less than 1 are treated as 1.
+ *
+ * \param r Our new frame rate.
+ */
+void CSProgressAggregator::setFrameRate(int r)
+{
+	timer->setInterval(1000 / qBound(1, r, 1000));
+}
+
+/*!
+ * This function adds the given collection to the list of collections whose
+ * progress we report. Collections are removed automatically when they are
+ * destroyed.
+ *
+ * \param c The collection to add.
+ */
+void CSProgressAggregator::addCollection(CSAbstractCollection *c)
+{
+	if(c == NULL)
+		return;
+
+	collections.append(QPointer<CSAbstractCollection>(c));
+}
+
+/*!
+ * This function removes the given collection from the list of collections
+ * whose progress we report.
+ *
+ * \param c The collection to remove.
+ */
+void CSProgressAggregator::removeCollection(CSAbstractCollection *c)
+{
+	for(int i = collections.count() - 1; i >= 0; --i)
+		if(collections.at(i).data() == c)
+			collections.removeAt(i);
+}
+
+/*!
+ * This slot starts sampling our collections' progress, if we weren't already.
+ * This should be called whenever a job is started; we stop sampling by
+ * ourselves once no jobs are running.
+ */
+void CSProgressAggregator::start()
+{ /* SLOT */
+
+	if(!timer->isActive())
+	{
+		lastDone = -1;
+		lastTotal = -1;
+		timer->start();
+	}
+
+}
+
+/*!
+ * This slot samples the progress of each of our collections' running jobs,
+ * and emits our progress signals if the combined progress has changed since
+ * the last sample. If no jobs are running, we stop sampling (without emitting
+ * anything, so the last job's final progress is left as-is).
+ */
+void CSProgressAggregator::doSample()
+{ /* SLOT */
+
+	int done = 0, total = 0;
+	bool running = false;
+
+	for(int i = collections.count() - 1; i >= 0; --i)
+	{
+		CSAbstractCollection *c = collections.at(i).data();
+
+		if(c == NULL)
+		{
+			collections.removeAt(i);
+			continue;
+		}
+
+		int d, t;
+		if(c->getProgress(&d, &t))
+		{
+			running = true;
+			done += d;
+			total += t;
+		}
+	}
+
+	if(!running)
+	{
+		timer->stop();
+		return;
+	}
+
+	if(total != lastTotal)
+	{
+		lastTotal = total;
+		Q_EMIT progressLimitsUpdated(0, total);
+	}
+
+	if(done != lastDone)
+	{
+		lastDone = done;
+		Q_EMIT progressUpdated(done);
+	}
+
+}
@@ -0,0 +1,72 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_THREAD_PROGRESS_AGGREGATOR_H
+#define INCLUDE_LIBCUTE_THREAD_PROGRESS_AGGREGATOR_H
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+
+class QTimer;
+
+class CSAbstractCollection;
+
+/*!
+ * \brief This class publishes the combined progress of our collections' jobs.
+ *
+ * Collections store their progress in atomic counters rather than emitting a
+ * signal per item (which, for a large scan, would flood the GUI thread with
+ * queued events). We sample those counters at a fixed frame rate while any
+ * job is running, and emit the sum of all running jobs' progress, only when
+ * it has actually changed.
+ *
+ * This object should live in the GUI thread.
+ */
+class CSProgressAggregator : public QObject
+{
+	Q_OBJECT
+
+	public:
+		CSProgressAggregator(QObject *p = 0, int r = 30);
+		virtual ~CSProgressAggregator();
+
+		int getFrameRate() const;
+		void setFrameRate(int r);
+
+		void addCollection(CSAbstractCollection *c);
+		void removeCollection(CSAbstractCollection *c);
+
+	public Q_SLOTS:
+		void start();
+
+	private:
+		QTimer *timer;
+		QList< QPointer<CSAbstractCollection> > collections;
+		int lastDone;
+		int lastTotal;
+
+	private Q_SLOTS:
+		void doSample();
+
+	Q_SIGNALS:
+		void progressLimitsUpdated(int, int);
+		void progressUpdated(int);
+};
+
+#endif
@@ -70,3 +70,61 @@ void CSBitwise::toSynchsafeInt32(
 	f.set(o + 1, static_cast<uint8_t>((i >> 14) & 0x7F));
 	f.set(o + 0, static_cast<uint8_t>((i >> 21) & 0x7F));
 }
+
+/*!
+ * This function reads a little-endian 16-bit integer (as found, e.g., in
+ * iTunes DB files) from the given MMIO file handle at the given offset.
+ *
+ * Note that it is your responsibility to make sure the offset provided is
+ * valid; we don't do any bounds-checking.
+ *
+ * \param f The file handle containing the raw data.
+ * \param o The offset in the file to start at.
+ * \return The value given as a normal 16-bit integer.
+ */
+uint16_t CSBitwise::fromLittleEndianInt16(
+	const CSMMIOHandle &f, uint64_t o)
+{
+	uint16_t result = 0;
+
+	result |= static_cast<uint16_t>( f.at(o+0) );
+	result |= static_cast<uint16_t>( f.at(o+1) ) << 8;
+
+	return result;
+}
+
+/*!
+ * This function reads a little-endian 32-bit integer from the given MMIO file
+ * handle at the given offset. See fromLittleEndianInt16() for more details.
+ *
+ * \param f The file handle containing the raw data.
+ * \param o The offset in the file to start at.
+ * \return The value given as a normal 32-bit integer.
+ */
+uint32_t CSBitwise::fromLittleEndianInt32(
+	const CSMMIOHandle &f, uint64_t o)
+{
+	uint32_t result = 0;
+
+	result |= static_cast<uint32_t>( f.at(o+0) );
+	result |= static_cast<uint32_t>( f.at(o+1) ) << 8;
+	result |= static_cast<uint32_t>( f.at(o+2) ) << 16;
+	result |= static_cast<uint32_t>( f.at(o+3) ) << 24;
+
+	return result;
+}
+
+/*!
+ * This function reads a little-endian 64-bit integer from the given MMIO file
+ * handle at the given offset. See fromLittleEndianInt16() for more details.
+ *
+ * \param f The file handle containing the raw data.
+ * \param o The offset in the file to start at.
+ * \return The value given as a normal 64-bit integer.
+ */
+uint64_t CSBitwise::fromLittleEndianInt64(
+	const CSMMIOHandle &f, uint64_t o)
+{
+	return static_cast<uint64_t>(fromLittleEndianInt32(f, o)) |
+		(static_cast<uint64_t>(fromLittleEndianInt32(f, o+4)) << 32);
+}
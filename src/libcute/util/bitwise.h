@@ -33,6 +33,13 @@ class CSBitwise
 			const CSMMIOHandle &f, uint64_t o);
 		static void toSynchsafeInt32(
 			CSMMIOHandle &f, uint64_t o, uint32_t i);
+
+		static uint16_t fromLittleEndianInt16(
+			const CSMMIOHandle &f, uint64_t o);
+		static uint32_t fromLittleEndianInt32(
+			const CSMMIOHandle &f, uint64_t o);
+		static uint64_t fromLittleEndianInt64(
+			const CSMMIOHandle &f, uint64_t o);
 };
 
 #endif
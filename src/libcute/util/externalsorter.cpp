@@ -0,0 +1,247 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "externalsorter.h"
+
+#include <algorithm>
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include "libcute/defines.h"
+#include "libcute/util/trace.h"
+
+/*!
+ * This is our default constructor, which creates a new, empty sorter.
+ *
+ * \param r The number of records to buffer before writing a run.
+ */
+CSExternalSorter::CSExternalSorter(int r)
+	: runSize(qMax(r, 1)), error(false), finished(false), directory(NULL)
+{
+}
+
+/*!
+ * This is our default destructor, which closes and removes our run files and
+ * cleans up our object.
+ */
+CSExternalSorter::~CSExternalSorter()
+{
+	for(int i = 0; i < runs.count(); ++i)
+	{
+		delete runs.at(i).stream;
+		delete runs.at(i).file;
+	}
+
+	delete directory;
+}
+
+/*!
+ * This function adds a record to be sorted. If our buffer is full, it is
+ * sorted and written out as a new run first. Records can't be added once
+ * finish() has been called.
+ *
+ * \param k The record's sort key.
+ * \param d The record's data.
+ * \return True on success, or false on failure.
+ */
+bool CSExternalSorter::add(const QString &k, const QByteArray &d)
+{
+	if(error || finished)
+		return false;
+
+	buffer.append(qMakePair(k, d));
+
+	if(buffer.count() >= runSize)
+		return writeRun();
+
+	return true;
+}
+
+/*!
+ * This function writes out any records still in our buffer, and then prepares
+ * our runs to be merged. After this, records can be read with next().
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSExternalSorter::finish()
+{
+	if(error || finished)
+		return false;
+
+	if(!buffer.isEmpty() && !writeRun())
+		return false;
+
+	finished = true;
+
+	for(int i = 0; i < runs.count(); ++i)
+	{
+		Run &run = runs[i];
+
+		if(!run.file->open(QIODevice::ReadOnly))
+		{
+			error = true;
+			return false;
+		}
+
+		run.stream = new QDataStream(run.file);
+		run.stream->setVersion(SERIALIZATION_VERSION);
+
+		if(readRecord(i))
+			heap.push(qMakePair(run.key, i));
+		else if(error)
+			return false;
+	}
+
+	return true;
+}
+
+/*!
+ * This function returns the next record, in key order. finish() must have
+ * been called first.
+ *
+ * \param k The key of the next record.
+ * \param d The data of the next record.
+ * \return True on success, or false if there are no more records (or on error).
+ */
+bool CSExternalSorter::next(QString *k, QByteArray *d)
+{
+	if(error || !finished || heap.empty())
+		return false;
+
+	int i = heap.top().second;
+	heap.pop();
+
+	Run &run = runs[i];
+	*k = run.key;
+	*d = run.data;
+
+	if(readRecord(i))
+		heap.push(qMakePair(run.key, i));
+
+	return !error;
+}
+
+/*!
+ * This function returns whether or not an error (e.g., being unable to write
+ * one of our temporary files) has occurred. Note that next() returns false both
+ * on error and once every record has been returned; this function can be used
+ * to tell the two apart.
+ *
+ * \return True if an error has occurred, or false otherwise.
+ */
+bool CSExternalSorter::hasError() const
+{
+	return error;
+}
+
+/*!
+ * This function returns the number of runs we have written so far.
+ *
+ * \return Our run count.
+ */
+int CSExternalSorter::getRunCount() const
+{
+	return runs.count();
+}
+
+/*!
+ * This function sorts the records in our buffer, writes them out to a new run
+ * file, and then clears our buffer.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSExternalSorter::writeRun()
+{
+	CSTraceSpan span("sort", "run");
+
+	if(directory == NULL)
+	{
+		directory = new QTemporaryDir();
+
+		if(!directory->isValid())
+		{
+			error = true;
+			return false;
+		}
+	}
+
+	std::sort(buffer.begin(), buffer.end(), [](
+		const QPair<QString, QByteArray> &a,
+		const QPair<QString, QByteArray> &b) -> bool
+	{
+		return a.first < b.first;
+	});
+
+	Run run;
+	run.file = new QFile(QDir(directory->path()).absoluteFilePath(
+		QString("run%1").arg(runs.count())));
+	run.stream = NULL;
+	runs.append(run);
+
+	if(!run.file->open(QIODevice::WriteOnly))
+	{
+		error = true;
+		return false;
+	}
+
+	QDataStream out(run.file);
+	out.setVersion(SERIALIZATION_VERSION);
+
+	for(int i = 0; i < buffer.count(); ++i)
+	{
+		out << buffer.at(i).first;
+		out << buffer.at(i).second;
+	}
+
+	buffer.clear();
+
+	if(out.status() != QDataStream::Ok)
+		error = true;
+
+	run.file->close();
+	return !error;
+}
+
+/*!
+ * This function reads the next record from the given run into its structure.
+ *
+ * \param i The index of the run to read from.
+ * \return True if a record was read, or false at the end of the run.
+ */
+bool CSExternalSorter::readRecord(int i)
+{
+	Run &run = runs[i];
+
+	if(run.stream->atEnd())
+		return false;
+
+	*run.stream >> run.key;
+	*run.stream >> run.data;
+
+	if(run.stream->status() != QDataStream::Ok)
+	{
+		error = true;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCLUDE_LIBCUTE_UTIL_EXTERNAL_SORTER_H
+#define INCLUDE_LIBCUTE_UTIL_EXTERNAL_SORTER_H
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class QDataStream;
+class QFile;
+class QTemporaryDir;
+
+/*!
+ * \brief This class sorts more records than will comfortably fit in memory.
+ *
+ * Records (each of which is a sort key plus some arbitrary data) are added
+ * with add(). Whenever enough records have been buffered, they are sorted and
+ * written out to a temporary "run" file. Once every record has been added,
+ * finish() is called, after which next() returns the records in key order by
+ * merging all of the runs at once. Only one buffer of records, plus a single
+ * record from each run, is ever held in memory.
+ *
+ * Records with equal keys are returned in no particular order. Our temporary
+ * files are removed when we are destroyed.
+ */
+class CSExternalSorter
+{
+	public:
+		static const int DefaultRunSize = 65536;
+
+		CSExternalSorter(int r = DefaultRunSize);
+		virtual ~CSExternalSorter();
+
+		bool add(const QString &k, const QByteArray &d);
+		bool finish();
+		bool next(QString *k, QByteArray *d);
+
+		bool hasError() const;
+		int getRunCount() const;
+
+	private:
+		/*!
+		 * This structure stores a single run file which is being
+		 * merged, along with the next record we've read from it.
+		 */
+		typedef struct Run
+		{
+			QFile *file;
+			QDataStream *stream;
+			QString key;
+			QByteArray data;
+		} Run;
+
+		typedef QPair<QString, int> HeapItem;
+
+		int runSize;
+		bool error;
+		bool finished;
+		QTemporaryDir *directory;
+		QList<QPair<QString, QByteArray> > buffer;
+		QList<Run> runs;
+		std::priority_queue<HeapItem, std::vector<HeapItem>,
+			std::greater<HeapItem> > heap;
+
+		bool writeRun();
+		bool readRecord(int i);
+};
+
+#endif
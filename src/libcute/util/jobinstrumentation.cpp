@@ -0,0 +1,435 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobinstrumentation.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+
+#include "libcute/util/systemutils.h"
+#include "libcute/util/trace.h"
+
+// How long our rolling throughput window is, in nanoseconds.
+#define CS_JOB_WINDOW_LENGTH 5000000000ULL
+
+// The minimum time between two samples in our window, in nanoseconds.
+#define CS_JOB_SAMPLE_INTERVAL 250000000ULL
+
+// The minimum time between two published statistics updates, in nanoseconds.
+#define CS_JOB_PUBLISH_INTERVAL 500000000ULL
+
+QMutex CSJobInstrumentation::logMutex;
+QString CSJobInstrumentation::logPath;
+
+/*!
+ * This is our default constructor, which creates a new, idle instrumentation
+ * object.
+ */
+CSJobInstrumentation::CSJobInstrumentation()
+	: running(false), cpuStart(0), lastPublish(0), traceStart(0)
+{
+	// Initialize our statistics, without considering a job to be running.
+
+	start(QString());
+	running = false;
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSJobInstrumentation::~CSJobInstrumentation()
+{
+}
+
+/*!
+ * This function resets all of our statistics, and starts timing a new job.
+ *
+ * \param j The description of the job being started.
+ */
+void CSJobInstrumentation::start(const QString &j)
+{
+	running = true;
+
+	statistics.job = j;
+	statistics.finished = false;
+	statistics.wallTime = 0;
+	statistics.cpuTime = 0;
+	statistics.itemsDone = 0;
+	statistics.itemsTotal = 0;
+	statistics.bytesRead = 0;
+	statistics.bytesWritten = 0;
+	statistics.itemsPerSecond = 0.0;
+	statistics.windowItemsPerSecond = 0.0;
+	statistics.windowBytesPerSecond = 0.0;
+	statistics.eta = -1;
+	statistics.phases.clear();
+
+	openPhases.clear();
+	window.clear();
+
+	timer.start();
+	cpuStart = CSSystemUtils::getThreadCPUTime();
+	lastPublish = 0;
+	traceStart = CSTrace::isEnabled() ? CSTrace::now() : 0;
+}
+
+/*!
+ * This function stops timing the current job. Any phases which are still open
+ * are closed. Our statistics remain available until the next job is started.
+ * If tracing is enabled, the whole job is recorded as a trace span.
+ */
+void CSJobInstrumentation::finish()
+{
+	if(!running)
+		return;
+
+	QList<QString> phases = openPhases.keys();
+	for(int i = 0; i < phases.count(); ++i)
+		endPhase(phases.at(i));
+
+	statistics.wallTime = static_cast<uint64_t>(timer.nsecsElapsed());
+	statistics.cpuTime = CSSystemUtils::getThreadCPUTime() - cpuStart;
+	statistics.finished = true;
+
+	if(CSTrace::isEnabled() && !statistics.job.isEmpty())
+	{
+		CSTrace::record("job", statistics.job, traceStart,
+			CSTrace::now() - traceStart);
+	}
+
+	running = false;
+}
+
+/*!
+ * This function returns whether or not we are currently timing a job.
+ *
+ * \return True if a job is running, or false otherwise.
+ */
+bool CSJobInstrumentation::isRunning() const
+{
+	return running;
+}
+
+/*!
+ * This function sets the total number of items the current job will process.
+ *
+ * \param t The total number of items.
+ */
+void CSJobInstrumentation::setItemsTotal(int t)
+{
+	statistics.itemsTotal = t;
+}
+
+/*!
+ * This function sets the number of items the current job has processed so far.
+ *
+ * \param d The number of items processed.
+ */
+void CSJobInstrumentation::setItemsDone(int d)
+{
+	statistics.itemsDone = d;
+	sample();
+}
+
+/*!
+ * This function records that the current job has read the given number of
+ * bytes.
+ *
+ * \param b The number of bytes read.
+ */
+void CSJobInstrumentation::addBytesRead(uint64_t b)
+{
+	statistics.bytesRead += b;
+}
+
+/*!
+ * This function records that the current job has written the given number of
+ * bytes.
+ *
+ * \param b The number of bytes written.
+ */
+void CSJobInstrumentation::addBytesWritten(uint64_t b)
+{
+	statistics.bytesWritten += b;
+}
+
+/*!
+ * This function starts timing the given phase of the current job. If the phase
+ * is already being timed (i.e., phases with the same name are nested), then
+ * this call is ignored and the outermost phase is timed.
+ *
+ * \param p The name of the phase.
+ */
+void CSJobInstrumentation::beginPhase(const QString &p)
+{
+	if(openPhases.contains(p))
+		return;
+
+	openPhases.insert(p, QPair<uint64_t, uint64_t>(
+		static_cast<uint64_t>(timer.nsecsElapsed()),
+		CSSystemUtils::getThreadCPUTime()));
+}
+
+/*!
+ * This function stops timing the given phase of the current job, and adds the
+ * time spent in it to that phase's totals. If tracing is enabled, the phase is
+ * also recorded as a trace span (see CSTrace).
+ *
+ * \param p The name of the phase.
+ */
+void CSJobInstrumentation::endPhase(const QString &p)
+{
+	if(!openPhases.contains(p))
+		return;
+
+	QPair<uint64_t, uint64_t> begin = openPhases.take(p);
+
+	CSJobStatistics::Phase phase = statistics.phases.value(p,
+		CSJobStatistics::Phase());
+
+	if(!statistics.phases.contains(p))
+	{
+		phase.wallTime = 0;
+		phase.cpuTime = 0;
+		phase.count = 0;
+	}
+
+	uint64_t wallTime = static_cast<uint64_t>(timer.nsecsElapsed()) -
+		begin.first;
+
+	if(CSTrace::isEnabled())
+	{
+		CSTrace::record("phase", p, CSTrace::now() - wallTime,
+			wallTime);
+	}
+
+	phase.wallTime += wallTime;
+	phase.cpuTime += CSSystemUtils::getThreadCPUTime() - begin.second;
+	++phase.count;
+
+	statistics.phases.insert(p, phase);
+}
+
+/*!
+ * This function returns whether or not enough time has passed since the last
+ * time this function returned true that our statistics should be published
+ * again. This keeps us from flooding our listeners with updates.
+ *
+ * \return True if our statistics should be published now.
+ */
+bool CSJobInstrumentation::isPublishDue()
+{
+	uint64_t now = static_cast<uint64_t>(timer.nsecsElapsed());
+
+	if( (lastPublish != 0) && ((now - lastPublish) <
+		CS_JOB_PUBLISH_INTERVAL) )
+	{
+		return false;
+	}
+
+	lastPublish = (now == 0) ? 1 : now;
+	return true;
+}
+
+/*!
+ * This function returns a snapshot of the current job's statistics, with its
+ * rates and ETA computed as of right now.
+ *
+ * \return The current job's statistics.
+ */
+CSJobStatistics CSJobInstrumentation::getStatistics() const
+{
+	CSJobStatistics s = statistics;
+
+	if(running)
+	{
+		s.wallTime = static_cast<uint64_t>(timer.nsecsElapsed());
+		s.cpuTime = CSSystemUtils::getThreadCPUTime() - cpuStart;
+	}
+
+	// Compute our overall and windowed rates.
+
+	if(s.wallTime > 0)
+	{
+		s.itemsPerSecond = static_cast<double>(s.itemsDone) /
+			(static_cast<double>(s.wallTime) / 1000000000.0);
+	}
+
+	if(!window.isEmpty())
+	{
+		const Sample &first = window.first();
+		uint64_t span = s.wallTime - first.time;
+
+		if(span > 0)
+		{
+			double seconds = static_cast<double>(span) /
+				1000000000.0;
+
+			s.windowItemsPerSecond = static_cast<double>(
+				s.itemsDone - first.items) / seconds;
+			s.windowBytesPerSecond = static_cast<double>(
+				(s.bytesRead + s.bytesWritten) - first.bytes) /
+				seconds;
+		}
+	}
+
+	// Estimate the time remaining, preferring our current speed.
+
+	double rate = (s.windowItemsPerSecond > 0.0) ?
+		s.windowItemsPerSecond : s.itemsPerSecond;
+
+	if(s.finished || (s.itemsDone >= s.itemsTotal))
+		s.eta = 0;
+	else if(rate > 0.0)
+		s.eta = static_cast<int64_t>(static_cast<double>(
+			s.itemsTotal - s.itemsDone) / rate * 1000.0);
+	else
+		s.eta = -1;
+
+	return s;
+}
+
+/*!
+ * This function returns the path of the file finished jobs' statistics are
+ * logged to. If this is empty, then logging is disabled.
+ *
+ * \return The path to our log file.
+ */
+QString CSJobInstrumentation::getLogPath()
+{
+	QMutexLocker locker(&logMutex);
+	return logPath;
+}
+
+/*!
+ * This function sets the path of the file finished jobs' statistics are
+ * logged to. Pass an empty string to disable logging. This may be called from
+ * any thread.
+ *
+ * \param p The path to our log file.
+ */
+void CSJobInstrumentation::setLogPath(const QString &p)
+{
+	QMutexLocker locker(&logMutex);
+	logPath = p;
+}
+
+/*!
+ * This function appends a one-line summary of the given statistics to our log
+ * file, if logging is enabled. This may be called from any thread.
+ *
+ * \param s The statistics to log.
+ */
+void CSJobInstrumentation::log(const CSJobStatistics &s)
+{
+	QMutexLocker locker(&logMutex);
+
+	if(logPath.isEmpty())
+		return;
+
+	QFile f(logPath);
+	if(!f.open(QIODevice::WriteOnly | QIODevice::Append |
+		QIODevice::Text))
+	{
+		return;
+	}
+
+	QStringList phases;
+	QList<QString> names = s.phases.keys();
+	names.sort();
+
+	for(int i = 0; i < names.count(); ++i)
+	{
+		const CSJobStatistics::Phase &p = s.phases[names.at(i)];
+
+		phases.append(QString("%1=%2s/%3s/%4")
+			.arg(names.at(i))
+			.arg(static_cast<double>(p.wallTime) / 1000000000.0,
+				0, 'f', 3)
+			.arg(static_cast<double>(p.cpuTime) / 1000000000.0,
+				0, 'f', 3)
+			.arg(p.count));
+	}
+
+	QTextStream out(&f);
+	out << QDateTime::currentDateTime().toString(Qt::ISODate) << "\t"
+		<< s.job << "\t"
+		<< s.itemsDone << "/" << s.itemsTotal << " items\t"
+		<< QString::number(static_cast<double>(s.wallTime) /
+			1000000000.0, 'f', 3) << "s wall\t"
+		<< QString::number(static_cast<double>(s.cpuTime) /
+			1000000000.0, 'f', 3) << "s cpu\t"
+		<< s.bytesRead << " bytes read\t"
+		<< s.bytesWritten << " bytes written\t"
+		<< QString::number(s.itemsPerSecond, 'f', 2) << " items/s\t"
+		<< phases.join(" ") << "\n";
+}
+
+/*!
+ * This function adds a sample of our current progress to our rolling window,
+ * and drops samples which have fallen out of it. Samples are rate-limited, so
+ * this is cheap to call for every item.
+ */
+void CSJobInstrumentation::sample()
+{
+	uint64_t now = static_cast<uint64_t>(timer.nsecsElapsed());
+
+	if( (!window.isEmpty()) &&
+		((now - window.last().time) < CS_JOB_SAMPLE_INTERVAL) )
+	{
+		return;
+	}
+
+	Sample s;
+	s.time = now;
+	s.items = statistics.itemsDone;
+	s.bytes = statistics.bytesRead + statistics.bytesWritten;
+	window.append(s);
+
+	while( (window.count() > 2) &&
+		((now - window.first().time) > CS_JOB_WINDOW_LENGTH) )
+	{
+		window.removeFirst();
+	}
+}
+
+/*!
+ * This is our default constructor, which begins timing the given phase using
+ * the given instrumentation object.
+ *
+ * \param i The instrumentation object to record the phase with.
+ * \param p The name of the phase.
+ */
+CSPhaseTimer::CSPhaseTimer(CSJobInstrumentation *i, const QString &p)
+	: instrumentation(i), phase(p)
+{
+	if(instrumentation != NULL)
+		instrumentation->beginPhase(phase);
+}
+
+/*!
+ * This is our default destructor, which stops timing our phase.
+ */
+CSPhaseTimer::~CSPhaseTimer()
+{
+	if(instrumentation != NULL)
+		instrumentation->endPhase(phase);
+}
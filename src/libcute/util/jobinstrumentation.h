@@ -0,0 +1,142 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_UTIL_JOB_INSTRUMENTATION_H
+#define INCLUDE_LIBCUTE_UTIL_JOB_INSTRUMENTATION_H
+
+#include <cstdint>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+/*!
+ * This structure stores a snapshot of the statistics for a single collection
+ * job. All times are in nanoseconds, except for the ETA, which is in
+ * milliseconds (and is negative if it can't be estimated yet). The "window"
+ * rates only consider the last few seconds of the job, so they reflect its
+ * current speed rather than its average speed.
+ *
+ * Phases are named parts of a job (e.g., "tags" or "write"). Each phase
+ * records the total wall and CPU time spent in it, and how many times it was
+ * entered; comparing the two times tells us whether a phase is limited by
+ * computation or by I/O.
+ */
+typedef struct CSJobStatistics
+{
+	typedef struct Phase
+	{
+		uint64_t wallTime;
+		uint64_t cpuTime;
+		uint64_t count;
+	} Phase;
+
+	QString job;
+	bool finished;
+	uint64_t wallTime;
+	uint64_t cpuTime;
+	int itemsDone;
+	int itemsTotal;
+	uint64_t bytesRead;
+	uint64_t bytesWritten;
+	double itemsPerSecond;
+	double windowItemsPerSecond;
+	double windowBytesPerSecond;
+	int64_t eta;
+	QHash<QString, Phase> phases;
+} CSJobStatistics;
+
+Q_DECLARE_METATYPE(CSJobStatistics)
+
+/*!
+ * \brief This class collects timing and throughput statistics for a job.
+ *
+ * A collection owns one of these, and feeds it as its jobs progress. Since CPU
+ * times are measured per-thread, every function (except the static logging
+ * functions) must be called from the thread running the job.
+ */
+class CSJobInstrumentation
+{
+	public:
+		CSJobInstrumentation();
+		virtual ~CSJobInstrumentation();
+
+		void start(const QString &j);
+		void finish();
+		bool isRunning() const;
+
+		void setItemsTotal(int t);
+		void setItemsDone(int d);
+		void addBytesRead(uint64_t b);
+		void addBytesWritten(uint64_t b);
+
+		void beginPhase(const QString &p);
+		void endPhase(const QString &p);
+
+		bool isPublishDue();
+		CSJobStatistics getStatistics() const;
+
+		static QString getLogPath();
+		static void setLogPath(const QString &p);
+		static void log(const CSJobStatistics &s);
+
+	private:
+		typedef struct Sample
+		{
+			uint64_t time;
+			int items;
+			uint64_t bytes;
+		} Sample;
+
+		static QMutex logMutex;
+		static QString logPath;
+
+		bool running;
+		QElapsedTimer timer;
+		uint64_t cpuStart;
+		uint64_t lastPublish;
+		uint64_t traceStart;
+		CSJobStatistics statistics;
+		QHash<QString, QPair<uint64_t, uint64_t> > openPhases;
+		QList<Sample> window;
+
+		void sample();
+};
+
+/*!
+ * \brief This class times a single phase of a job for as long as it exists.
+ *
+ * The phase begins when we are constructed, and ends when we are destroyed, so
+ * a phase can be timed simply by declaring one of these at the top of a block.
+ */
+class CSPhaseTimer
+{
+	public:
+		CSPhaseTimer(CSJobInstrumentation *i, const QString &p);
+		virtual ~CSPhaseTimer();
+
+	private:
+		CSJobInstrumentation *instrumentation;
+		QString phase;
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <fstream>
 
 #ifdef _WIN32
 	#include <lmcons.h>
@@ -33,7 +34,12 @@
 		#include <sys/statvfs.h>
 		#include <sys/types.h>
 		#include <sys/stat.h>
+		#include <time.h>
 		#include <unistd.h>
+
+		#ifdef __linux__
+			#include <sys/sysmacros.h>
+		#endif
 	}
 #endif
 
@@ -324,6 +330,138 @@ double CSSystemUtils::getDeviceUsedPercent(const std::string &p)
 	#endif
 }
 
+/*!
+ * This function returns an identifier for the physical device containing the
+ * given path. Two paths which return the same identifier share the same disk,
+ * so I/O to one will compete with I/O to the other. The path provided can be
+ * any file or directory inside the device, or the mount point itself.
+ *
+ * On Windows, this is the serial number of the volume containing the path.
+ *
+ * On Linux, this is the device number of the whole block device backing the
+ * path's filesystem; i.e., two partitions on the same disk return the same
+ * identifier. For filesystems not backed by a block device (e.g. NFS or SMB
+ * mounts), this is the filesystem's own device number.
+ *
+ * On other UNIX-like platforms (including Mac), this is the st_dev value of
+ * the filesystem containing the path.
+ *
+ * This function is currently implemented on:
+ *     Windows
+ *     Linux/UNIX
+ *     Mac
+ *
+ * \param p A path inside the desired device, or its mount point.
+ * \return An identifier for the device containing the path, or 0 on error.
+ */
+uint64_t CSSystemUtils::getDeviceID(const std::string &p)
+{
+	#ifdef _WIN32
+		char volume[MAX_PATH + 1];
+		DWORD serial;
+
+		if(!GetVolumePathName(p.c_str(), volume, MAX_PATH + 1))
+			return 0;
+
+		if(!GetVolumeInformation(volume, NULL, 0, &serial,
+			NULL, NULL, NULL, 0))
+		{
+			return 0;
+		}
+
+		return static_cast<uint64_t>(serial);
+	#else
+		struct stat info;
+
+		if(stat(p.c_str(), &info) != 0)
+			return 0;
+
+		uint64_t dev = static_cast<uint64_t>(info.st_dev);
+
+		#ifdef __linux__
+			/*
+			 * If the filesystem lives on a partition, sysfs lets us
+			 * find the disk containing it: the partition's
+			 * directory has a "partition" attribute, and its parent
+			 * directory (the whole disk) has a "dev" attribute of
+			 * the form "major:minor".
+			 */
+
+			std::ostringstream sys;
+			sys << "/sys/dev/block/" << major(info.st_dev) << ":"
+				<< minor(info.st_dev);
+
+			std::ifstream partition((sys.str() +
+				"/partition").c_str());
+
+			if(!partition.good())
+				return dev;
+
+			std::ifstream disk((sys.str() + "/../dev").c_str());
+			unsigned int maj, min;
+			char sep;
+
+			if(disk >> maj >> sep >> min)
+			{
+				if(sep == ':')
+				{
+					dev = static_cast<uint64_t>(
+						makedev(maj, min));
+				}
+			}
+		#endif
+
+		return dev;
+	#endif
+}
+
+/*!
+ * This function returns the amount of CPU time the calling thread has consumed
+ * so far. Comparing two values from the same thread tells us how much of the
+ * wall time between them was actually spent computing, rather than waiting on
+ * I/O or locks.
+ *
+ * On Windows, this is the sum of the kernel and user times reported by
+ * GetThreadTimes().
+ *
+ * On Linux/UNIX/Mac, this is the value of the CLOCK_THREAD_CPUTIME_ID clock.
+ *
+ * This function is currently implemented on:
+ *     Windows
+ *     Linux/UNIX
+ *     Mac
+ *
+ * \return The calling thread's CPU time in nanoseconds, or 0 on error.
+ */
+uint64_t CSSystemUtils::getThreadCPUTime()
+{
+	#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+
+		if(!GetThreadTimes(GetCurrentThread(), &creation, &exit,
+			&kernel, &user))
+		{
+			return 0;
+		}
+
+		uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime)
+			<< 32) | kernel.dwLowDateTime;
+		uint64_t u = (static_cast<uint64_t>(user.dwHighDateTime)
+			<< 32) | user.dwLowDateTime;
+
+		// FILETIME values are in 100-nanosecond units.
+		return (k + u) * 100;
+	#else
+		struct timespec t;
+
+		if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0)
+			return 0;
+
+		return (static_cast<uint64_t>(t.tv_sec) * 1000000000ULL) +
+			static_cast<uint64_t>(t.tv_nsec);
+	#endif
+}
+
 /*!
  * This function returns the number of files present in a given directory.
  * Symlinks (for UNIX-like platforms) are IGNORED - they do not count as files,
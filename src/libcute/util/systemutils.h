@@ -42,6 +42,8 @@ class CSSystemUtils
 		static uint64_t getDeviceAvailable(const std::string &p);
 		static uint64_t getDeviceCapacity(const std::string &p);
 		static double getDeviceUsedPercent(const std::string &p);
+		static uint64_t getDeviceID(const std::string &p);
+		static uint64_t getThreadCPUTime();
 
 		static int64_t getFileCount(const std::string &p,
 			bool r = true);
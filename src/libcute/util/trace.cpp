@@ -0,0 +1,299 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadStorage>
+
+QAtomicInt CSTrace::enabled(0);
+QMutex CSTrace::bufferMutex;
+QList<CSTrace::Buffer *> CSTrace::buffers;
+QString CSTrace::outputPath;
+QElapsedTimer CSTrace::clock;
+
+namespace
+{
+	/*
+	 * The trace buffer belonging to each thread. This is wrapped in a
+	 * structure, since QThreadStorage takes ownership of (and deletes)
+	 * any pointer it holds directly; our buffers need to outlive their
+	 * threads, so they can be written out at exit.
+	 */
+
+	struct CSTraceThread
+	{
+		CSTraceThread() : buffer(NULL) {}
+		void *buffer;
+	};
+
+	QThreadStorage<CSTraceThread> traceThread;
+}
+
+/*!
+ * This function enables tracing if the CUTESYNC_TRACE environment variable is
+ * set, in which case our trace is written to the file it names when the
+ * application exits. This should be called once, right after the application
+ * object has been created.
+ */
+void CSTrace::initialize()
+{
+	QString path = QString::fromLocal8Bit(qgetenv("CUTESYNC_TRACE"));
+
+	if(path.isEmpty())
+		return;
+
+	setOutputPath(path);
+	qAddPostRoutine(CSTrace::writeAtExit);
+}
+
+/*!
+ * This function returns the path our trace will be written to.
+ *
+ * \return Our output path, or an empty string if tracing is disabled.
+ */
+QString CSTrace::getOutputPath()
+{
+	QMutexLocker locker(&bufferMutex);
+	return outputPath;
+}
+
+/*!
+ * This function sets the path our trace will be written to. Setting a
+ * non-empty path enables tracing, and setting an empty one disables it; spans
+ * which have already been recorded are kept either way.
+ *
+ * \param p The new output path.
+ */
+void CSTrace::setOutputPath(const QString &p)
+{
+	QMutexLocker locker(&bufferMutex);
+
+	outputPath = p;
+
+	if(!clock.isValid())
+		clock.start();
+
+	enabled.storeRelease(p.isEmpty() ? 0 : 1);
+}
+
+/*!
+ * This function returns the current time on our trace's clock, which started
+ * when tracing was first enabled.
+ *
+ * \return The current time, in nanoseconds.
+ */
+uint64_t CSTrace::now()
+{
+	return static_cast<uint64_t>(clock.nsecsElapsed());
+}
+
+/*!
+ * This function records a single completed span on the calling thread. This
+ * never blocks, except the first time a given thread records a span (when its
+ * buffer is created).
+ *
+ * \param c The span's category.
+ * \param n The span's name.
+ * \param s The time the span started (see now()).
+ * \param d The span's duration, in nanoseconds.
+ */
+void CSTrace::record(const char *c, const QString &n, uint64_t s,
+	uint64_t d)
+{
+	if(!isEnabled())
+		return;
+
+	Buffer *buffer = getBuffer();
+	Chunk *chunk = buffer->tail;
+	int count = chunk->count.load();
+
+	if(count == ChunkSize)
+	{
+		Chunk *next = new Chunk();
+		chunk->next.storeRelease(next);
+
+		buffer->tail = next;
+		chunk = next;
+		count = 0;
+	}
+
+	Event &event = chunk->events[count];
+	event.category = c;
+	event.name = n;
+	event.start = s;
+	event.duration = d;
+
+	chunk->count.storeRelease(count + 1);
+}
+
+/*!
+ * This function writes every span recorded so far to our output path, in
+ * Chrome's trace event format. Spans which are still being recorded by other
+ * threads may or may not be included.
+ *
+ * \return True on success, or false on failure.
+ */
+bool CSTrace::write()
+{
+	QMutexLocker locker(&bufferMutex);
+
+	if(outputPath.isEmpty())
+		return false;
+
+	QFile file(outputPath);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	QTextStream out(&file);
+	out.setCodec("UTF-8");
+
+	qint64 pid = QCoreApplication::applicationPid();
+	bool first = true;
+
+	out << "{\"traceEvents\":[\n";
+
+	for(int i = 0; i < buffers.count(); ++i)
+	{
+		const Buffer *buffer = buffers.at(i);
+
+		// Name the thread, so it is labeled in the timeline.
+
+		out << (first ? "" : ",\n");
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" <<
+			pid << ",\"tid\":" << buffer->id <<
+			",\"args\":{\"name\":\"" << escape(buffer->thread) <<
+			"\"}}";
+		first = false;
+
+		// Write each of its spans, with times in microseconds.
+
+		for(const Chunk *chunk = buffer->head; chunk != NULL;
+			chunk = chunk->next.loadAcquire())
+		{
+			int count = chunk->count.loadAcquire();
+
+			for(int j = 0; j < count; ++j)
+			{
+				const Event &event = chunk->events[j];
+
+				out << ",\n{\"name\":\"" <<
+					escape(event.name) <<
+					"\",\"cat\":\"" << escape(
+					QString::fromLatin1(event.category)) <<
+					"\",\"ph\":\"X\",\"ts\":" <<
+					QString::number(event.start / 1000.0,
+					'f', 3) << ",\"dur\":" <<
+					QString::number(event.duration /
+					1000.0, 'f', 3) << ",\"pid\":" <<
+					pid << ",\"tid\":" << buffer->id <<
+					"}";
+			}
+		}
+	}
+
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	out.flush();
+
+	return (file.error() == QFile::NoError);
+}
+
+/*!
+ * This function returns the calling thread's trace buffer, creating it if
+ * this is the first span the thread has recorded.
+ *
+ * \return The calling thread's buffer.
+ */
+CSTrace::Buffer *CSTrace::getBuffer()
+{
+	CSTraceThread &local = traceThread.localData();
+
+	if(local.buffer != NULL)
+		return static_cast<Buffer *>(local.buffer);
+
+	QMutexLocker locker(&bufferMutex);
+
+	Buffer *buffer = new Buffer();
+	buffer->id = buffers.count() + 1;
+	buffer->head = new Chunk();
+	buffer->tail = buffer->head;
+
+	QThread *thread = QThread::currentThread();
+	buffer->thread = thread->objectName();
+
+	if(buffer->thread.isEmpty())
+	{
+		if( (QCoreApplication::instance() != NULL) &&
+			(QCoreApplication::instance()->thread() == thread) )
+		{
+			buffer->thread = "Main";
+		}
+		else
+		{
+			buffer->thread = QString("Thread %1").arg(buffer->id);
+		}
+	}
+
+	buffers.append(buffer);
+	local.buffer = buffer;
+
+	return buffer;
+}
+
+/*!
+ * This function escapes the given string, so it can be included in a JSON
+ * string literal.
+ *
+ * \param s The string to escape.
+ * \return The escaped string.
+ */
+QString CSTrace::escape(const QString &s)
+{
+	QString r;
+	r.reserve(s.length());
+
+	for(int i = 0; i < s.length(); ++i)
+	{
+		QChar c = s.at(i);
+
+		if( (c == '"') || (c == '\\') )
+			r.append('\\').append(c);
+		else if(c.unicode() < 0x20)
+		{
+			r.append(QString("\\u%1").arg(c.unicode(), 4, 16,
+				QChar('0')));
+		}
+		else
+			r.append(c);
+	}
+
+	return r;
+}
+
+/*!
+ * This function writes our trace as the application exits (see
+ * initialize()).
+ */
+void CSTrace::writeAtExit()
+{
+	write();
+}
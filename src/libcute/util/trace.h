@@ -0,0 +1,165 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_UTIL_TRACE_H
+#define INCLUDE_LIBCUTE_UTIL_TRACE_H
+
+#include <cstdint>
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+/*!
+ * \brief This class records a timeline of what each of our threads is doing.
+ *
+ * Tracing is opt-in: it is enabled by setting the CUTESYNC_TRACE environment
+ * variable to the path of a file (see initialize()), or by calling
+ * setOutputPath(). While enabled, spans of time (see CSTraceSpan) are recorded
+ * into a buffer belonging to the thread they happened on, so recording never
+ * takes a lock. When the application exits, every thread's spans are written
+ * out in Chrome's trace event format, which can be opened with Perfetto or
+ * chrome://tracing.
+ *
+ * While tracing is disabled, a span costs a single atomic load.
+ */
+class CSTrace
+{
+	public:
+		/*!
+		 * This structure stores a single completed span.
+		 */
+		typedef struct Event
+		{
+			const char *category;
+			QString name;
+			uint64_t start;
+			uint64_t duration;
+		} Event;
+
+		static const int ChunkSize = 4096;
+
+		static void initialize();
+
+		/*!
+		 * This function tests whether or not tracing is enabled. This
+		 * is defined inline, since it is called for every span.
+		 *
+		 * \return True if tracing is enabled, or false otherwise.
+		 */
+		static inline bool isEnabled()
+		{
+			return (enabled.load() != 0);
+		}
+
+		static QString getOutputPath();
+		static void setOutputPath(const QString &p);
+
+		static uint64_t now();
+		static void record(const char *c, const QString &n,
+			uint64_t s, uint64_t d);
+
+		static bool write();
+
+	private:
+		/*!
+		 * This structure stores a fixed-size block of events. Only the
+		 * thread which owns a chunk ever writes to it; it publishes
+		 * each new event by incrementing the chunk's count, so readers
+		 * never see a partially written event.
+		 */
+		typedef struct Chunk
+		{
+			Event events[ChunkSize];
+			QAtomicInt count;
+			QAtomicPointer<struct Chunk> next;
+		} Chunk;
+
+		/*!
+		 * This structure stores all of the events recorded by a single
+		 * thread, as a list of chunks.
+		 */
+		typedef struct Buffer
+		{
+			int id;
+			QString thread;
+			Chunk *head;
+			Chunk *tail;
+		} Buffer;
+
+		static QAtomicInt enabled;
+		static QMutex bufferMutex;
+		static QList<Buffer *> buffers;
+		static QString outputPath;
+		static QElapsedTimer clock;
+
+		static Buffer *getBuffer();
+		static QString escape(const QString &s);
+		static void writeAtExit();
+};
+
+/*!
+ * \brief This class records a span covering its own lifetime.
+ *
+ * Creating one of these on the stack traces the rest of the enclosing scope.
+ * Its category and name must be string literals (or otherwise outlive the
+ * trace), since they aren't copied until the span ends.
+ */
+class CSTraceSpan
+{
+	public:
+		CSTraceSpan(const char *c, const char *n);
+		~CSTraceSpan();
+
+	private:
+		const char *category;
+		const char *name;
+		bool active;
+		uint64_t start;
+};
+
+/*!
+ * This is our default constructor, which starts our span if tracing is
+ * enabled. This is defined inline, so a disabled span costs almost nothing.
+ *
+ * \param c The span's category.
+ * \param n The span's name.
+ */
+inline CSTraceSpan::CSTraceSpan(const char *c, const char *n)
+	: category(c), name(n), active(CSTrace::isEnabled()), start(0)
+{
+	if(active)
+		start = CSTrace::now();
+}
+
+/*!
+ * This is our default destructor, which ends our span and records it.
+ */
+inline CSTraceSpan::~CSTraceSpan()
+{
+	if(active)
+	{
+		CSTrace::record(category, QString::fromLatin1(name), start,
+			CSTrace::now() - start);
+	}
+}
+
+#endif
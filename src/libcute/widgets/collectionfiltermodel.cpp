@@ -0,0 +1,158 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "collectionfiltermodel.h"
+
+#include "libcute/defines.h"
+#include "libcute/collections/abstractcollection.h"
+#include "libcute/collections/trackindex.h"
+
+/*!
+ * This is our default constructor, which creates a new filter model with no
+ * collection.
+ *
+ * \param p Our parent object.
+ */
+CSCollectionFilterModel::CSCollectionFilterModel(QObject *p)
+	: QSortFilterProxyModel(p), collection(NULL), filtering(false)
+{
+	// Our collections sort themselves; we only filter.
+	setDynamicSortFilter(false);
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCollectionFilterModel::~CSCollectionFilterModel()
+{
+}
+
+/*!
+ * This function returns the collection we are currently filtering, if any.
+ *
+ * \return Our current collection.
+ */
+CSAbstractCollection *CSCollectionFilterModel::getCollection() const
+{
+	return collection;
+}
+
+/*!
+ * This function sets the collection we are filtering. Our current query is
+ * re-run against the new collection.
+ *
+ * \param c The collection to filter.
+ */
+void CSCollectionFilterModel::setCollection(CSAbstractCollection *c)
+{
+	collection = c;
+	setSourceModel(collection);
+	refreshQuery();
+}
+
+/*!
+ * This function returns the query we are currently filtering with.
+ *
+ * \return Our current query.
+ */
+QString CSCollectionFilterModel::getQuery() const
+{
+	return query;
+}
+
+/*!
+ * This function returns whether or not we are currently hiding any tracks;
+ * that is, whether our current query is non-empty.
+ *
+ * \return True if we are filtering, or false otherwise.
+ */
+bool CSCollectionFilterModel::isFiltering() const
+{
+	return filtering;
+}
+
+/*!
+ * This function returns the keys of all of the tracks matching our current
+ * query, including any which aren't displayed yet. If we aren't filtering,
+ * then this list is empty.
+ *
+ * \return The keys of the matching tracks.
+ */
+QStringList CSCollectionFilterModel::getMatchingKeys() const
+{
+	return matchingKeys.toList();
+}
+
+/*!
+ * This slot sets the query we filter our collection's tracks with. See
+ * CSTrackIndex::search() for the query syntax.
+ *
+ * \param q The new query.
+ */
+void CSCollectionFilterModel::setQuery(const QString &q)
+{ /* SLOT */
+
+	query = q;
+	refreshQuery();
+
+}
+
+/*!
+ * This slot re-runs our current query. This should be called whenever our
+ * collection's displayed tracks change (see
+ * CSAbstractCollection::adoptSnapshot()).
+ */
+void CSCollectionFilterModel::refreshQuery()
+{ /* SLOT */
+
+	filtering = !CSTrackIndex::tokenize(query).isEmpty();
+	matchingKeys.clear();
+	matchingTracks.clear();
+
+	if( (collection != NULL) && filtering )
+		matchingKeys = collection->search(query);
+
+	for(QSet<QString>::const_iterator it = matchingKeys.begin();
+		it != matchingKeys.end(); ++it)
+	{
+		const CSTrack *track = collection->getDisplayedTrack(*it);
+
+		if(track != NULL)
+			matchingTracks.insert(track);
+	}
+
+	invalidateFilter();
+
+}
+
+/*!
+ * This function decides whether the given row of our collection should be
+ * displayed.
+ *
+ * \param r The row in our collection.
+ * \param p The parent index, which is ignored.
+ * \return True if the row should be displayed, or false otherwise.
+ */
+bool CSCollectionFilterModel::filterAcceptsRow(int r,
+	const QModelIndex &UNUSED(p)) const
+{
+	if( (collection == NULL) || !filtering )
+		return true;
+
+	return matchingTracks.contains(collection->getDisplayedTrack(r));
+}
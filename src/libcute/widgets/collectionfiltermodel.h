@@ -0,0 +1,69 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_WIDGETS_COLLECTION_FILTER_MODEL_H
+#define INCLUDE_LIBCUTE_WIDGETS_COLLECTION_FILTER_MODEL_H
+
+#include <QSet>
+#include <QSortFilterProxyModel>
+#include <QString>
+#include <QStringList>
+
+class CSAbstractCollection;
+class CSTrack;
+
+/*!
+ * \brief This class filters a collection's tracks with a search query.
+ *
+ * Rather than matching the query against each row's text, as
+ * QSortFilterProxyModel normally would, we ask the collection's inverted index
+ * (see CSTrackIndex) for the matching tracks once per query, so filtering
+ * costs a single set lookup per row. An empty query shows every track.
+ */
+class CSCollectionFilterModel : public QSortFilterProxyModel
+{
+	Q_OBJECT
+
+	public:
+		CSCollectionFilterModel(QObject *p = 0);
+		virtual ~CSCollectionFilterModel();
+
+		CSAbstractCollection *getCollection() const;
+		void setCollection(CSAbstractCollection *c);
+
+		QString getQuery() const;
+		bool isFiltering() const;
+		QStringList getMatchingKeys() const;
+
+	public Q_SLOTS:
+		void setQuery(const QString &q);
+		void refreshQuery();
+
+	protected:
+		virtual bool filterAcceptsRow(int r,
+			const QModelIndex &p) const;
+
+	private:
+		CSAbstractCollection *collection;
+		QString query;
+		bool filtering;
+		QSet<QString> matchingKeys;
+		QSet<const CSTrack *> matchingTracks;
+};
+
+#endif
@@ -25,30 +25,43 @@
 
 #include "libcute/defines.h"
 #include "libcute/collections/abstractcollection.h"
+#include "libcute/collections/collectioncatalog.h"
+#include "libcute/collections/track.h"
 #include "libcute/thread/collectionthreadpool.h"
+#include "libcute/thread/progressaggregator.h"
+#include "libcute/util/systemutils.h"
 #include "libcute/widgets/collectionlistitem.h"
 
 /*!
  * This is our default constructor, which creates a new model object with the
- * given parent.
+ * given parent. Our collections are loaded, synced, etc. by a pool of the given
+ * number of worker threads; if this is not positive, a sensible default is
+ * chosen by the thread pool.
  *
  * \param p Our parent object.
+ * \param w The number of worker threads to use.
  */
-CSCollectionModel::CSCollectionModel(QObject *p)
+CSCollectionModel::CSCollectionModel(QObject *p, int w)
 	: QAbstractListModel(p)
 {
-	threadPool = new CSCollectionThreadPool(this);
+	threadPool = new CSCollectionThreadPool(this, w);
+	progressAggregator = new CSProgressAggregator(this);
 
 	// Connect the thread pool's progress signals to our signals.
 
 	QObject::connect(threadPool, SIGNAL(jobStarted(const QString &, bool)),
 		this, SIGNAL(jobStarted(const QString &, bool)));
-	QObject::connect(threadPool, SIGNAL(progressLimitsUpdated(int, int)),
-		this, SIGNAL(progressLimitsUpdated(int, int)));
-	QObject::connect(threadPool, SIGNAL(progressUpdated(int)),
+	QObject::connect(threadPool, SIGNAL(jobStarted(const QString &, bool)),
+		progressAggregator, SLOT(start()));
+	QObject::connect(progressAggregator, SIGNAL(progressLimitsUpdated(int,
+		int)), this, SIGNAL(progressLimitsUpdated(int, int)));
+	QObject::connect(progressAggregator, SIGNAL(progressUpdated(int)),
 		this, SIGNAL(progressUpdated(int)));
 	QObject::connect(threadPool, SIGNAL(jobFinished(const QString &)),
 		this, SIGNAL(jobFinished(const QString &)));
+	QObject::connect(threadPool, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)), this, SIGNAL(statisticsUpdated(
+		const CSJobStatistics &)));
 
 	// Connect our actions to the thread pool's slots.
 
@@ -56,12 +69,27 @@ CSCollectionModel::CSCollectionModel(QObject *p)
 		const QString &, const QByteArray &)), threadPool,
 		SLOT(unserializeCollection(const QString &, const QString &,
 		const QByteArray &)));
+	QObject::connect(this, SIGNAL(startRestore(const QString &)),
+		threadPool, SLOT(restoreCollection(const QString &)));
+	QObject::connect(this, SIGNAL(startAttach(CSAbstractCollection *)),
+		threadPool, SLOT(attachCollection(CSAbstractCollection *)));
 	QObject::connect(this, SIGNAL(startNew(const QString &,
 		const QString &, bool)), threadPool, SLOT(newCollection(
 		const QString &, const QString &, bool)));
+	QObject::connect(this, SIGNAL(startReload(CSAbstractCollection *)),
+		threadPool, SLOT(reloadCollection(CSAbstractCollection *)));
+	QObject::connect(this, SIGNAL(startRefresh(CSAbstractCollection *)),
+		threadPool, SLOT(refreshCollection(CSAbstractCollection *)));
 	QObject::connect(this, SIGNAL(startSync(CSAbstractCollection *,
 		CSAbstractCollection *)), threadPool, SLOT(syncCollections(
 		CSAbstractCollection *, CSAbstractCollection *)));
+	QObject::connect(this, SIGNAL(startCopy(CSAbstractCollection *,
+		CSAbstractCollection *, const QStringList &)), threadPool,
+		SLOT(copyTracks(CSAbstractCollection *, CSAbstractCollection *,
+		const QStringList &)));
+	QObject::connect(this, SIGNAL(startDelete(CSAbstractCollection *,
+		const QStringList &)), threadPool, SLOT(deleteTracks(
+		CSAbstractCollection *, const QStringList &)));
 
 	// Connect the thread pool's result signals to our slots / signals.
 
@@ -91,8 +119,10 @@ int CSCollectionModel::rowCount(const QModelIndex &UNUSED(p)) const
 
 /*!
  * This function returns the display data for a given cell in the model. This
- * function handles both the display text of a collection (its name) and the
- * icon it uses (via getDisplayIcon() on the collection superclass).
+ * function handles the display text of a collection (its name, marked while
+ * its cached contents are being validated), the icon it uses (via
+ * getDisplayIcon() on the collection superclass) and a tooltip summarizing its
+ * contents (see getSummary()).
  *
  * \param i The index in our model. The column index is ignored.
  * \param r The display role for the desired data.
@@ -106,10 +136,13 @@ QVariant CSCollectionModel::data(const QModelIndex &i, int r) const
 				CSAbstractCollection *c =
 					collectionAt(i.row());
 
-				if(c != NULL)
-					return QVariant(c->getName());
-				else
+				if(c == NULL)
 					return QVariant(QVariant::Invalid);
+				else if(c->isValidating())
+					return QVariant(tr("%1 (validating)")
+						.arg(c->getName()));
+				else
+					return QVariant(c->getName());
 			}
 
 		case Qt::DecorationRole:
@@ -123,6 +156,17 @@ QVariant CSCollectionModel::data(const QModelIndex &i, int r) const
 					return QVariant(QVariant::Invalid);
 			}
 
+		case Qt::ToolTipRole:
+			{
+				CSAbstractCollection *c =
+					collectionAt(i.row());
+
+				if(c != NULL)
+					return QVariant(getSummary(c));
+				else
+					return QVariant(QVariant::Invalid);
+			}
+
 		default:
 			return QVariant(QVariant::Invalid);
 	};
@@ -243,10 +287,17 @@ void CSCollectionModel::removeCollectionAt(int i)
 
 	itemList.removeAt(itemList.indexOf(it));
 
+	progressAggregator->removeCollection(c);
 	c->setInterrupted(true);
 
+	/*
+	 * Jobs on other workers may still be using the collection (e.g., as
+	 * the source of a sync), so let our thread pool delete it once they're
+	 * done with it.
+	 */
+
 	delete it;
-	c->deleteLater();
+	threadPool->deleteCollection(c);
 
 	Q_EMIT endResetModel();
 }
@@ -273,8 +324,11 @@ void CSCollectionModel::appendCollection(CSAbstractCollection *c)
 
 	QObject::connect(c, SIGNAL(enabledChanged()),
 		this, SLOT(doCollectionEnabledChanged()));
+	QObject::connect(c, SIGNAL(validatingChanged()),
+		this, SLOT(doCollectionValidatingChanged()));
 
 	itemList.append(i);
+	progressAggregator->addCollection(c);
 
 	Q_EMIT dataChanged(createIndex(itemList.count() - 1, 0),
 		createIndex(itemList.count() - 1, 0));
@@ -297,28 +351,47 @@ QList<QString> CSCollectionModel::getCollectionNameList() const
 }
 
 /*!
- * This function returns a list of QByteArrays, each of which stores a
- * serialized collection. Note that only collections that have the
- * "isSafedOnExit()" property will be included in this list.
+ * This function saves every collection which should be saved on exit to the
+ * given catalog, and removes any catalog entries for collections which are no
+ * longer being saved. Our worker threads should be stopped before calling
+ * this (see stopGracefully()), so no job is modifying a collection while it is
+ * serialized.
  *
- * Note that you should probably call this once all of our collections will no
- * longer be modified (i.e., in the closeEvent() function on a main window).
- *
- * \return A list of QByteArrays containing the saved collections in our model.
+ * \param c The catalog to save our collections to.
+ * \return True if every collection was saved, or false otherwise.
  */
-QList<QVariant> CSCollectionModel::getSerializedList() const
+bool CSCollectionModel::saveCatalog(CSCollectionCatalog *c) const
 {
-	QList<QVariant> r;
-	CSAbstractCollection *c;
+	bool r = true;
+	QStringList names;
+	CSAbstractCollection *col;
 
 	for(int i = 0; i < count(); ++i)
 	{
-		c = collectionAt(i);
+		col = collectionAt(i);
+
+		if(!col->isSavedOnExit())
+			continue;
+
+		/*
+		 * Collections which were never attached haven't changed since
+		 * they were saved, so we just keep their existing entries.
+		 */
 
-		if(c->isSavedOnExit())
-			r.append(QVariant(c->serialize()));
+		names.append(col->getName());
+
+		if(!col->isAttached())
+			continue;
+
+		if(!c->write(CSCollectionCatalog::createHeader(col),
+			col->serialize()))
+		{
+			r = false;
+		}
 	}
 
+	c->prune(names);
+
 	return r;
 }
 
@@ -334,57 +407,45 @@ bool CSCollectionModel::stopGracefully()
 }
 
 /*!
- * This function loads a serialized list of collections previously generated by
- * getSerializedList(). Note that any collections we already contain will be
- * cleared.
+ * This function sets the number of jobs our thread pool allows to run
+ * concurrently on any single device.
  *
- * \param c The list of serialized collections to load.
+ * \param d The new per-device queue depth.
  */
-void CSCollectionModel::loadSerializedList(const QList<QVariant> &c)
-{ /* SLOT */
+void CSCollectionModel::setDeviceQueueDepth(int d)
+{
+	threadPool->setDeviceQueueDepth(d);
+}
 
-	int i;
-	qint32 version;
-	QString name;
-	QString path;
+/*!
+ * This function loads every collection stored in the given catalog. Only each
+ * catalog file's header is read; the collections are restored on our worker
+ * threads in a detached state, and their tracks are only loaded when they are
+ * first used (see attachCollection()).
+ *
+ * \param c The catalog to load collections from.
+ */
+void CSCollectionModel::loadCatalog(const CSCollectionCatalog *c)
+{
+	QStringList entries = c->getEntries();
+	CSCollectionCatalog::Header h;
 
-	for(i = 0; i < c.count(); ++i)
+	for(int i = 0; i < entries.count(); ++i)
 	{
 #pragma message "TODO - Emit warnings via signals and deal with them properly."
-		// Create our input stream.
-
-		QDataStream in(c.at(i).value<QByteArray>());
-
-		if(in.status() != QDataStream::Ok)
+		if(!CSCollectionCatalog::readHeader(entries.at(i), &h))
 			continue;
 
-		// Read our version.
-
-		in >> version;
-
-		if(version > SERIALIZATION_VERSION)
-			continue;
-
-		in.setVersion(version);
-
-		if(in.status() != QDataStream::Ok)
-			continue;
-
-		// Read our name and path.
-
-		in >> name;
-		in >> path;
-
 		// Ensure the path actually exists.
 
-		QFileInfo f(path);
+		QFileInfo f(h.path);
 
 		if( (!f.isDir()) || (!f.exists()) )
 			continue;
 
 		// Make sure our name is unique.
 
-		if(alreadyContainsName(name))
+		if(alreadyContainsName(h.name))
 		{
 			QMessageBox::critical(0, tr("Error"),
 				tr("Collection name already in use!"));
@@ -392,10 +453,8 @@ void CSCollectionModel::loadSerializedList(const QList<QVariant> &c)
 			continue;
 		}
 
-		Q_EMIT startUnserialize(name,
-			path, c.at(i).value<QByteArray>());
+		Q_EMIT startRestore(entries.at(i));
 	}
-
 }
 
 /*!
@@ -427,32 +486,47 @@ void CSCollectionModel::newCollection(const QString &n,
 }
 
 /*!
- * This function reloads the given collection. This slot is intended to be a
- * thread boundary; the model should be in a different thread than the caller,
- * and using this slot will cross the thread boundary so the reload doesn't tie
- * up the GUI thread.
+ * This function attaches the given collection, if it is detached (see
+ * CSAbstractCollection::attach()). This is typically called when the user
+ * selects the collection, so its tracks are loaded before they are needed.
+ * This action will be performed in another thread - connect to this class's
+ * signals for status updates.
+ *
+ * \param c The collection to attach.
+ */
+void CSCollectionModel::attachCollection(CSAbstractCollection *c)
+{ /* SLOT */
+
+	if( (c == NULL) || c->isAttached() )
+		return;
+
+	Q_EMIT startAttach(c);
+
+}
+
+/*!
+ * This function reloads the given collection. The reload is performed on the
+ * collection's worker thread, so it doesn't tie up the GUI thread.
  *
  * \param c The collection to reload.
  */
 void CSCollectionModel::reloadCollection(CSAbstractCollection *c)
 { /* SLOT */
 
-	c->reload();
+	Q_EMIT startReload(c);
 
 }
 
 /*!
- * This function refreshes the given collection. This slot is intended to be a
- * thread boundary; the model should be in a different thread than the caller,
- * and using this slot will cross the thread boundary so the refresh doesn't
- * tie up the GUI thread.
+ * This function refreshes the given collection. The refresh is performed on
+ * the collection's worker thread, so it doesn't tie up the GUI thread.
  *
  * \param c The collection to refresh.
  */
 void CSCollectionModel::refreshCollection(CSAbstractCollection *c)
 { /* SLOT */
 
-	c->refresh();
+	Q_EMIT startRefresh(c);
 
 }
 
@@ -473,6 +547,39 @@ void CSCollectionModel::syncCollections(
 
 }
 
+/*!
+ * This function copies the tracks with the given keys from the given source
+ * collection to the given destination collection. The copy is performed on the
+ * destination collection's worker thread, so it doesn't tie up the GUI thread.
+ *
+ * \param s The source collection.
+ * \param d The destination collection.
+ * \param k The keys of the tracks to copy.
+ */
+void CSCollectionModel::copyTracks(CSAbstractCollection *s,
+	CSAbstractCollection *d, const QStringList &k)
+{ /* SLOT */
+
+	Q_EMIT startCopy(s, d, k);
+
+}
+
+/*!
+ * This function deletes the tracks with the given keys from the given
+ * collection. The deletion is performed on the collection's worker thread, so
+ * it doesn't tie up the GUI thread.
+ *
+ * \param c The collection to delete tracks from.
+ * \param k The keys of the tracks to delete.
+ */
+void CSCollectionModel::deleteTracks(CSAbstractCollection *c,
+	const QStringList &k)
+{ /* SLOT */
+
+	Q_EMIT startDelete(c, k);
+
+}
+
 /*!
  * This function returns the collection list item which represents the given
  * collection in our model. If no such list item could be found, then we return
@@ -491,6 +598,62 @@ CSCollectionListItem *CSCollectionModel::itemForCollection(
 	return NULL;
 }
 
+/*!
+ * This function returns a short, human-readable summary of the given
+ * collection, for use as its tooltip. For detached collections, the statistics
+ * come from the catalog header they were restored from, so we can display them
+ * without loading any tracks. For attached collections, the statistics are only
+ * computed while no job is running on the collection.
+ *
+ * \param c The collection to summarize.
+ * \return A summary of the given collection.
+ */
+QString CSCollectionModel::getSummary(const CSAbstractCollection *c) const
+{
+	QString path;
+	qint64 tracks = -1, size = -1, length = -1;
+
+	if(!c->isAttached())
+	{
+		CSCollectionCatalog::Header h = c->getCatalogHeader();
+
+		path = h.path;
+		tracks = h.trackCount;
+		size = h.totalSize;
+		length = h.totalLength;
+	}
+	else
+	{
+		path = c->getMountPoint();
+
+		if(!c->getProgress(NULL, NULL))
+		{
+			tracks = c->count();
+			size = c->getTotalSize();
+			length = c->getTotalLength();
+		}
+	}
+
+	QString r;
+
+	r += tr("Path: %1").arg(path) + QString("\n");
+
+	r += tr("Tracks: %1").arg( (tracks < 0) ? tr("unknown") :
+		QString::number(tracks) ) + QString("\n");
+
+	r += tr("Size: %1").arg( (size < 0) ? tr("unknown") :
+		QString::fromStdString(CSSystemUtils::getHumanReadableSize(
+		static_cast<uint64_t>(size))) ) + QString("\n");
+
+	r += tr("Length: %1").arg( (length < 0) ? tr("unknown") :
+		CSTrack::getLengthDisplay(static_cast<int>(length)) );
+
+	if(!c->isAttached())
+		r += QString("\n") + tr("(Not loaded yet)");
+
+	return r;
+}
+
 /*!
  * This function returns whether or not our model already contains a collection
  * with the given name. This is useful when adding new collections to the
@@ -540,6 +703,32 @@ void CSCollectionModel::doCollectionEnabledChanged()
 
 }
 
+/*!
+ * This function handles one of our collections starting or finishing a
+ * validation, by telling any views that its display text has changed.
+ */
+void CSCollectionModel::doCollectionValidatingChanged()
+{ /* SLOT */
+
+	CSAbstractCollection *c =
+		dynamic_cast<CSAbstractCollection *>(sender());
+
+	if(c == NULL)
+		return;
+
+	for(int i = 0; i < count(); ++i)
+	{
+		if(collectionAt(i) == c)
+		{
+			Q_EMIT dataChanged(createIndex(i, 0),
+				createIndex(i, 0));
+
+			break;
+		}
+	}
+
+}
+
 /*!
  * This slot handles a new collection being created by appending that
  * collection to our model.
@@ -21,12 +21,16 @@
 
 #include <QAbstractListModel>
 #include <QList>
+#include <QStringList>
 #include <QThread>
 
 #include "libcute/collections/collectiontyperesolver.h"
+#include "libcute/util/jobinstrumentation.h"
 
 class CSAbstractCollection;
+class CSCollectionCatalog;
 class CSCollectionThreadPool;
+class CSProgressAggregator;
 class CSCollectionListItem;
 
 /*!
@@ -41,7 +45,7 @@ class CSCollectionModel : public QAbstractListModel
 	Q_OBJECT
 
 	public:
-		CSCollectionModel(QObject *p = 0);
+		CSCollectionModel(QObject *p = 0, int w = 0);
 		virtual ~CSCollectionModel();
 
 		virtual int rowCount(const QModelIndex &p =
@@ -61,30 +65,39 @@ class CSCollectionModel : public QAbstractListModel
 
 		QList<QString> getCollectionNameList() const;
 
-		QList<QVariant> getSerializedList() const;
+		bool saveCatalog(CSCollectionCatalog *c) const;
+		void loadCatalog(const CSCollectionCatalog *c);
 
 		bool stopGracefully();
 
+		void setDeviceQueueDepth(int d);
+
 	public Q_SLOTS:
-		void loadSerializedList(const QList<QVariant> &c);
 		void newCollection(const QString &n, const QString &p, bool s);
+		void attachCollection(CSAbstractCollection *c);
 		void reloadCollection(CSAbstractCollection *c);
 		void refreshCollection(CSAbstractCollection *c);
 		void syncCollections(CSAbstractCollection *s,
 			CSAbstractCollection *d);
-		// copy() delete()
+		void copyTracks(CSAbstractCollection *s,
+			CSAbstractCollection *d, const QStringList &k);
+		void deleteTracks(CSAbstractCollection *c,
+			const QStringList &k);
 
 	private:
 		CSCollectionThreadPool *threadPool;
+		CSProgressAggregator *progressAggregator;
 		QList<CSCollectionListItem *> itemList;
 
 		CSCollectionListItem *itemForCollection(
 			const CSAbstractCollection *c);
 
 		bool alreadyContainsName(const QString &n) const;
+		QString getSummary(const CSAbstractCollection *c) const;
 
 	private Q_SLOTS:
 		void doCollectionEnabledChanged();
+		void doCollectionValidatingChanged();
 
 		void doCollectionCreated(CSAbstractCollection *);
 
@@ -93,13 +106,21 @@ class CSCollectionModel : public QAbstractListModel
 
 		void startUnserialize(const QString &, const QString &,
 			const QByteArray &);
+		void startRestore(const QString &);
+		void startAttach(CSAbstractCollection *);
 		void startNew(const QString &, const QString &, bool);
+		void startReload(CSAbstractCollection *);
+		void startRefresh(CSAbstractCollection *);
 		void startSync(CSAbstractCollection *, CSAbstractCollection *);
+		void startCopy(CSAbstractCollection *, CSAbstractCollection *,
+			const QStringList &);
+		void startDelete(CSAbstractCollection *, const QStringList &);
 
 		void jobStarted(const QString &, bool);
 		void progressLimitsUpdated(int, int);
 		void progressUpdated(int);
 		void jobFinished(const QString &);
+		void statisticsUpdated(const CSJobStatistics &);
 };
 
 #endif
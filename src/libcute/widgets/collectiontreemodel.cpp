@@ -0,0 +1,735 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "collectiontreemodel.h"
+
+#include <algorithm>
+
+#include <QHash>
+#include <QTimer>
+
+#include "libcute/defines.h"
+#include "libcute/collections/track.h"
+#include "libcute/util/systemutils.h"
+
+/*!
+ * \brief This functor orders an album's tracks for CSCollectionTreeModel.
+ *
+ * Tracks are ordered by disc number, then track number, and then title.
+ */
+class CSCollectionTreeModelTrackCompare
+{
+	public:
+		/*!
+		 * This constructor creates a new comparison functor, which
+		 * compares rows of the given snapshot.
+		 *
+		 * \param s The snapshot whose rows we are comparing.
+		 */
+		CSCollectionTreeModelTrackCompare(
+			const CSAbstractCollection::TrackSnapshot *s)
+			: snapshot(s)
+		{
+		}
+
+		/*!
+		 * This function tests if the first given snapshot row should
+		 * be listed before the second one.
+		 *
+		 * \param a The first row to compare.
+		 * \param b The second row to compare.
+		 * \return True if a belongs before b, or false otherwise.
+		 */
+		bool operator()(int a, int b) const
+		{
+			const CSTrack *ta = snapshot->rows.at(a).get();
+			const CSTrack *tb = snapshot->rows.at(b).get();
+
+			if(ta->getCDNumber() != tb->getCDNumber())
+				return ta->getCDNumber() < tb->getCDNumber();
+
+			int na = ta->getTrackNumber();
+			int nb = tb->getTrackNumber();
+
+			if(na != nb)
+				return na < nb;
+
+			return QString::localeAwareCompare(ta->getTitle(),
+				tb->getTitle()) < 0;
+		}
+
+	private:
+		const CSAbstractCollection::TrackSnapshot *snapshot;
+};
+
+/*!
+ * This is our default constructor, which creates a new, empty tree model.
+ *
+ * \param p Our parent object.
+ */
+CSCollectionTreeModel::CSCollectionTreeModel(QObject *p)
+	: QAbstractItemModel(p), collection(NULL), active(true), stale(false)
+{
+	rebuildTimer = new QTimer(this);
+	rebuildTimer->setSingleShot(true);
+	rebuildTimer->setInterval(CSCollectionTreeModel::RebuildDelay);
+
+	QObject::connect(rebuildTimer, SIGNAL(timeout()),
+		this, SLOT(rebuild()));
+}
+
+/*!
+ * This is our default destructor, which cleans up & destroys our object.
+ */
+CSCollectionTreeModel::~CSCollectionTreeModel()
+{
+	clearNodes();
+}
+
+/*!
+ * This function returns the collection we are currently displaying, if any.
+ *
+ * \return Our current collection.
+ */
+CSAbstractCollection *CSCollectionTreeModel::getCollection() const
+{
+	return collection;
+}
+
+/*!
+ * This function sets the collection we should display. If we are active, our
+ * tree is built from its current snapshot immediately; otherwise, it is built
+ * once we are activated. Our tree is rebuilt (see scheduleRebuild()) whenever
+ * the collection publishes a new snapshot.
+ *
+ * \param c The collection to display.
+ */
+void CSCollectionTreeModel::setCollection(CSAbstractCollection *c)
+{
+	if(collection != NULL)
+		collection->disconnect(this);
+
+	collection = c;
+
+	if(collection != NULL)
+	{
+		QObject::connect(collection, SIGNAL(snapshotPublished()),
+			this, SLOT(scheduleRebuild()));
+	}
+
+	if(active)
+	{
+		rebuild();
+	}
+	else
+	{
+		// Don't keep showing our old collection until we're activated.
+
+		beginResetModel();
+		clearNodes();
+		snapshot.reset();
+		endResetModel();
+
+		rebuildTimer->stop();
+		stale = true;
+	}
+}
+
+/*!
+ * This function returns whether or not we are active; i.e., whether or not we
+ * rebuild our tree when our collection publishes a new snapshot.
+ *
+ * \return True if we are active, or false otherwise.
+ */
+bool CSCollectionTreeModel::isActive() const
+{
+	return active;
+}
+
+/*!
+ * This function sets whether or not we are active. While we are inactive
+ * (e.g., because our view is hidden), new snapshots only mark our tree as
+ * stale; it is rebuilt as soon as we are activated again.
+ *
+ * \param a Whether or not we should be active.
+ */
+void CSCollectionTreeModel::setActive(bool a)
+{
+	active = a;
+
+	if(!active)
+		rebuildTimer->stop();
+	else if(stale)
+		rebuild();
+}
+
+/*!
+ * This function returns the key of the track at the given index. If the index
+ * isn't a track (i.e., it is an artist or an album), then an empty string is
+ * returned instead.
+ *
+ * \param i The index of the desired track.
+ * \return The track's key.
+ */
+QString CSCollectionTreeModel::getKey(const QModelIndex &i) const
+{
+	Node *n = nodeFromIndex(i);
+
+	if( (n == NULL) || (n->level != TrackLevel) )
+		return QString();
+
+	return snapshot->rows.at(n->tracks.first())->getHash();
+}
+
+/*!
+ * This function returns the keys of every track at or beneath the given index;
+ * e.g., every track by an artist. This doesn't require the node to have been
+ * expanded.
+ *
+ * \param i The index whose tracks are desired.
+ * \return The keys of the tracks beneath the given index.
+ */
+QStringList CSCollectionTreeModel::getKeys(const QModelIndex &i) const
+{
+	QStringList keys;
+	Node *n = nodeFromIndex(i);
+
+	if(n == NULL)
+		return keys;
+
+	QList<Node *> albums;
+
+	if(n->level == ArtistLevel)
+		albums = n->children;
+	else
+		albums.append(n);
+
+	for(int a = 0; a < albums.count(); ++a)
+	{
+		const QVector<int> &tracks = albums.at(a)->tracks;
+
+		for(int t = 0; t < tracks.count(); ++t)
+			keys.append(snapshot->rows.at(tracks.at(t))->getHash());
+	}
+
+	return keys;
+}
+
+/*!
+ * This function returns the path to the given index; i.e., the names of the
+ * nodes from its artist down to the index itself. Paths identify nodes across
+ * rebuilds (see findIndex()), so views can use them to restore, e.g., which
+ * nodes were expanded or selected.
+ *
+ * \param i The index whose path is desired.
+ * \return The path to the given index.
+ */
+QStringList CSCollectionTreeModel::getPath(const QModelIndex &i) const
+{
+	QStringList path;
+
+	for(Node *n = nodeFromIndex(i); n != NULL; n = n->parent)
+		path.prepend(n->name);
+
+	return path;
+}
+
+/*!
+ * This function returns the index of the node with the given path (see
+ * getPath()), or an invalid index if there is no such node. Any nodes along
+ * the path whose children haven't been fetched yet are fetched.
+ *
+ * \param p The path of the desired node.
+ * \return The index of the node with the given path.
+ */
+QModelIndex CSCollectionTreeModel::findIndex(const QStringList &p)
+{
+	QModelIndex i;
+
+	for(int d = 0; d < p.count(); ++d)
+	{
+		Node *n = nodeFromIndex(i);
+
+		if( (n != NULL) && canFetchMore(i) )
+			fetchMore(i);
+
+		const QList<Node *> &children =
+			(n == NULL) ? artists : n->children;
+
+		Node *c = NULL;
+		for(int r = 0; (c == NULL) && (r < children.count()); ++r)
+		{
+			if(children.at(r)->name == p.at(d))
+				c = children.at(r);
+		}
+
+		if(c == NULL)
+			return QModelIndex();
+
+		i = createIndex(c->row, 0, c);
+	}
+
+	return i;
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the index of the
+ * item at the given position beneath the given parent.
+ *
+ * \param r The row of the desired item.
+ * \param c The column of the desired item.
+ * \param p The parent of the desired item.
+ * \return The index of the desired item.
+ */
+QModelIndex CSCollectionTreeModel::index(int r, int c,
+	const QModelIndex &p) const
+{
+	if(!hasIndex(r, c, p))
+		return QModelIndex();
+
+	Node *n = nodeFromIndex(p);
+	const QList<Node *> &children = (n == NULL) ? artists : n->children;
+
+	return createIndex(r, c, children.at(r));
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the index of the
+ * given item's parent.
+ *
+ * \param i The index whose parent is desired.
+ * \return The index of the given item's parent.
+ */
+QModelIndex CSCollectionTreeModel::parent(const QModelIndex &i) const
+{
+	Node *n = nodeFromIndex(i);
+
+	if( (n == NULL) || (n->parent == NULL) )
+		return QModelIndex();
+
+	return createIndex(n->parent->row, 0, n->parent);
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the number of
+ * children the given item has. Items whose children haven't been fetched yet
+ * report zero children.
+ *
+ * \param p The item whose children should be counted.
+ * \return The number of children the given item has.
+ */
+int CSCollectionTreeModel::rowCount(const QModelIndex &p) const
+{
+	if(p.column() > 0)
+		return 0;
+
+	Node *n = nodeFromIndex(p);
+
+	if(n == NULL)
+		return artists.count();
+
+	return n->fetched ? n->children.count() : 0;
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the number of
+ * columns we display.
+ *
+ * \param p The parent item. This is ignored.
+ * \return The number of columns we display.
+ */
+int CSCollectionTreeModel::columnCount(const QModelIndex &UNUSED(p)) const
+{
+	return 4;
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns whether or not
+ * the given item has children, even if they haven't been fetched yet; this is
+ * what lets views show an expansion indicator for unfetched nodes.
+ *
+ * \param p The item to examine.
+ * \return True if the item has children, or false otherwise.
+ */
+bool CSCollectionTreeModel::hasChildren(const QModelIndex &p) const
+{
+	Node *n = nodeFromIndex(p);
+
+	if(n == NULL)
+		return !artists.isEmpty();
+
+	return (n->level != TrackLevel) && (p.column() == 0);
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns whether or not
+ * the given item has children which haven't been fetched yet.
+ *
+ * \param p The item to examine.
+ * \return True if the item's children still need to be fetched.
+ */
+bool CSCollectionTreeModel::canFetchMore(const QModelIndex &p) const
+{
+	Node *n = nodeFromIndex(p);
+
+	if(n == NULL)
+		return false;
+
+	return (n->level != TrackLevel) && !n->fetched;
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It makes the given item's
+ * children available, creating them first if need be. Views call this when
+ * the item is expanded.
+ *
+ * \param p The item whose children should be fetched.
+ */
+void CSCollectionTreeModel::fetchMore(const QModelIndex &p)
+{
+	Node *n = nodeFromIndex(p);
+
+	if( (n == NULL) || (n->level == TrackLevel) || n->fetched )
+		return;
+
+	if(n->level == AlbumLevel)
+		fetchTracks(n);
+
+	if(n->children.isEmpty())
+	{
+		n->fetched = true;
+		return;
+	}
+
+	beginInsertRows(p, 0, n->children.count() - 1);
+	n->fetched = true;
+	endInsertRows();
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the data that
+ * should be displayed for the given item.
+ *
+ * \param i The index of the item whose data we are retrieving.
+ * \param r The display role.
+ * \return The data to be displayed.
+ */
+QVariant CSCollectionTreeModel::data(const QModelIndex &i, int r) const
+{
+	Node *n = nodeFromIndex(i);
+
+	if(n == NULL)
+		return QVariant(QVariant::Invalid);
+
+	if(r == Qt::TextAlignmentRole)
+	{
+		if(i.column() == Name)
+			return QVariant(QVariant::Invalid);
+
+		return QVariant(static_cast<int>(
+			Qt::AlignRight | Qt::AlignVCenter));
+	}
+
+	if(r != Qt::DisplayRole)
+		return QVariant(QVariant::Invalid);
+
+	switch(i.column())
+	{
+		case Name:
+			return QVariant(n->name);
+
+		case Tracks:
+			if(n->level == TrackLevel)
+				return QVariant(QVariant::Invalid);
+
+			return QVariant(n->count);
+
+		case Length:
+			return QVariant(CSTrack::getLengthDisplay(
+				static_cast<int>(n->length)));
+
+		case Size:
+			return QVariant(QString::fromStdString(
+				CSSystemUtils::getHumanReadableSize(
+				static_cast<uint64_t>(n->size))));
+
+		default:
+			return QVariant(QVariant::Invalid);
+	};
+}
+
+/*!
+ * This is one of our QAbstractItemModel functions. It returns the data that
+ * should be displayed in our header.
+ *
+ * \param s The section (i.e., column) desired.
+ * \param o The orientation of the header.
+ * \param r The display role.
+ * \return The data to be displayed.
+ */
+QVariant CSCollectionTreeModel::headerData(int s, Qt::Orientation o,
+	int r) const
+{
+	if( (o != Qt::Horizontal) || (r != Qt::DisplayRole) )
+		return QVariant(QVariant::Invalid);
+
+	switch(s)
+	{
+		case Name:
+			return QVariant(tr("Name"));
+
+		case Tracks:
+			return QVariant(tr("Tracks"));
+
+		case Length:
+			return QVariant(tr("Length"));
+
+		case Size:
+			return QVariant(tr("Size"));
+
+		default:
+			return QVariant(QVariant::Invalid);
+	};
+}
+
+/*!
+ * This slot rebuilds our tree from our collection's current snapshot. Every
+ * row of the snapshot is grouped by artist and album, and each group's totals
+ * are accumulated, in a single pass; no track nodes are created until their
+ * album is expanded.
+ */
+void CSCollectionTreeModel::rebuild()
+{ /* SLOT */
+
+	rebuildTimer->stop();
+	stale = false;
+
+	std::shared_ptr<const CSAbstractCollection::TrackSnapshot> next;
+
+	if(collection != NULL)
+		next = collection->getSnapshot();
+
+	if( (next == snapshot) && next )
+		return;
+
+	beginResetModel();
+
+	clearNodes();
+	snapshot = next;
+
+	if(snapshot)
+	{
+		QHash<QString, Node *> artistNodes;
+		QHash<QString, Node *> albumNodes;
+
+		for(int i = 0; i < snapshot->rows.count(); ++i)
+		{
+			const CSTrack *track = snapshot->rows.at(i).get();
+
+			QString artist = track->getArtist();
+			QString album = track->getAlbum();
+
+			Node *a = artistNodes.value(artist, NULL);
+			if(a == NULL)
+			{
+				a = createNode(ArtistLevel, NULL,
+					artist.isEmpty() ?
+					tr("Unknown Artist") : artist);
+
+				artistNodes.insert(artist, a);
+				artists.append(a);
+			}
+
+			// Album names are only unique per-artist.
+			QString albumKey = artist + QChar(0) + album;
+
+			Node *b = albumNodes.value(albumKey, NULL);
+			if(b == NULL)
+			{
+				b = createNode(AlbumLevel, a,
+					album.isEmpty() ?
+					tr("Unknown Album") : album);
+
+				albumNodes.insert(albumKey, b);
+				a->children.append(b);
+			}
+
+			b->tracks.append(i);
+
+			a->count += 1;
+			b->count += 1;
+			a->length += track->getLength();
+			b->length += track->getLength();
+			a->size += track->getSize();
+			b->size += track->getSize();
+		}
+
+		sortNodes(&artists);
+
+		for(int i = 0; i < artists.count(); ++i)
+			sortNodes(&(artists[i]->children));
+	}
+
+	endResetModel();
+
+}
+
+/*!
+ * This slot notes that our collection has published a new snapshot. If we are
+ * active, our tree is rebuilt once RebuildDelay milliseconds have passed, so
+ * any further snapshots published in the meantime are handled by the same
+ * rebuild; otherwise, we wait until we are activated (see setActive()).
+ */
+void CSCollectionTreeModel::scheduleRebuild()
+{ /* SLOT */
+
+	stale = true;
+
+	if(active && !rebuildTimer->isActive())
+		rebuildTimer->start();
+
+}
+
+/*!
+ * This function returns the node the given index refers to, or NULL if the
+ * index is invalid (i.e., it refers to our invisible root).
+ *
+ * \param i The index to examine.
+ * \return The node the index refers to.
+ */
+CSCollectionTreeModel::Node *CSCollectionTreeModel::nodeFromIndex(
+	const QModelIndex &i) const
+{
+	if(!i.isValid())
+		return NULL;
+
+	return static_cast<Node *>(i.internalPointer());
+}
+
+/*!
+ * This function creates the track nodes beneath the given album node, ordered
+ * by disc and track number.
+ *
+ * \param n The album node to populate.
+ */
+void CSCollectionTreeModel::fetchTracks(Node *n)
+{
+	QVector<int> rows = n->tracks;
+	std::sort(rows.begin(), rows.end(),
+		CSCollectionTreeModelTrackCompare(snapshot.get()));
+
+	for(int i = 0; i < rows.count(); ++i)
+	{
+		const CSTrack *track = snapshot->rows.at(rows.at(i)).get();
+
+		QString name = track->getTitle();
+		if(track->getTrackNumber() > 0)
+		{
+			name = QString("%1. %2").arg(track->getTrackNumber())
+				.arg(name);
+		}
+
+		Node *t = createNode(TrackLevel, n, name);
+		t->row = i;
+		t->count = 1;
+		t->length = track->getLength();
+		t->size = track->getSize();
+		t->tracks.append(rows.at(i));
+		t->fetched = true;
+
+		n->children.append(t);
+	}
+}
+
+/*!
+ * This function deletes all of the nodes in our tree. Note that this doesn't
+ * alert any views; our caller should take care of that.
+ */
+void CSCollectionTreeModel::clearNodes()
+{
+	for(int i = 0; i < artists.count(); ++i)
+		deleteNode(artists.at(i));
+
+	artists.clear();
+}
+
+/*!
+ * This is a utility function which creates a new, empty node.
+ *
+ * \param l The level of the new node.
+ * \param p The new node's parent, or NULL for artists.
+ * \param n The new node's display name.
+ * \return The new node.
+ */
+CSCollectionTreeModel::Node *CSCollectionTreeModel::createNode(Level l,
+	Node *p, const QString &n)
+{
+	Node *node = new Node();
+
+	node->level = l;
+	node->parent = p;
+	node->row = 0;
+	node->name = n;
+	node->count = 0;
+	node->length = 0;
+	node->size = 0;
+	node->fetched = false;
+
+	return node;
+}
+
+/*!
+ * This is a utility function which deletes the given node and all of its
+ * children.
+ *
+ * \param n The node to delete.
+ */
+void CSCollectionTreeModel::deleteNode(Node *n)
+{
+	for(int i = 0; i < n->children.count(); ++i)
+		deleteNode(n->children.at(i));
+
+	delete n;
+}
+
+/*!
+ * This is a utility function which sorts the given list of nodes by name, and
+ * then updates each node's row to match its new position.
+ *
+ * \param l The list of nodes to sort.
+ */
+void CSCollectionTreeModel::sortNodes(QList<Node *> *l)
+{
+	std::sort(l->begin(), l->end(), nodeLessThan);
+
+	for(int i = 0; i < l->count(); ++i)
+		(*l)[i]->row = i;
+}
+
+/*!
+ * This is a utility function which compares two nodes by name, for
+ * sortNodes().
+ *
+ * \param a The first node to compare.
+ * \param b The second node to compare.
+ * \return True if a belongs before b, or false otherwise.
+ */
+bool CSCollectionTreeModel::nodeLessThan(const Node *a, const Node *b)
+{
+	return QString::localeAwareCompare(a->name, b->name) < 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * CuteSync - A media library management and synchronization application.
+ * Copyright (C) 2011 Axel Rasmussen
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDE_LIBCUTE_WIDGETS_COLLECTION_TREE_MODEL_H
+#define INCLUDE_LIBCUTE_WIDGETS_COLLECTION_TREE_MODEL_H
+
+#include <cstdint>
+#include <memory>
+
+#include <QAbstractItemModel>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "libcute/collections/abstractcollection.h"
+
+class QTimer;
+
+/*!
+ * \brief This class presents a collection as an Artist / Album / Track tree.
+ *
+ * The tree is built from the collection's published track snapshot (see
+ * CSAbstractCollection::getSnapshot()), which we share rather than copy. A
+ * single pass over the snapshot groups its rows by artist and album, and
+ * totals each group's track count, length and size as it goes; albums only
+ * store the snapshot row indices of their tracks.
+ *
+ * Nodes are only materialized when they are expanded (via canFetchMore() and
+ * fetchMore()), so a view of a huge library costs one node per artist and
+ * album, plus one per track in the albums the user has actually opened.
+ *
+ * Collections publish snapshots frequently while a job is running, so we don't
+ * rebuild our tree for every one: rebuilds are batched (at most one every
+ * RebuildDelay milliseconds), and are deferred entirely while we are inactive
+ * (e.g., while our view is hidden; see setActive()). Since rebuilding resets
+ * the model, views can use getPath() and findIndex() to restore their state.
+ */
+class CSCollectionTreeModel : public QAbstractItemModel
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		 * This enumeration identifies the columns we display.
+		 */
+		enum Column
+		{
+			Name   = 0,
+			Tracks = 1,
+			Length = 2,
+			Size   = 3
+		};
+
+		/*!
+		 * This enumeration identifies the level of the tree a node
+		 * lives on.
+		 */
+		enum Level
+		{
+			ArtistLevel = 0,
+			AlbumLevel  = 1,
+			TrackLevel  = 2
+		};
+
+		/*!
+		 * This structure stores a single node in our tree. Artist and
+		 * album nodes store their precomputed totals; album nodes
+		 * also store the snapshot rows of their tracks, and track
+		 * nodes store their own snapshot row.
+		 */
+		typedef struct Node
+		{
+			Level level;
+			struct Node *parent;
+			int row;
+			QString name;
+			int count;
+			int64_t length;
+			int64_t size;
+			QVector<int> tracks;
+			QList<struct Node *> children;
+			bool fetched;
+		} Node;
+
+		static const int RebuildDelay = 1000;
+
+		CSCollectionTreeModel(QObject *p = 0);
+		virtual ~CSCollectionTreeModel();
+
+		CSAbstractCollection *getCollection() const;
+		void setCollection(CSAbstractCollection *c);
+
+		bool isActive() const;
+		void setActive(bool a);
+
+		QString getKey(const QModelIndex &i) const;
+		QStringList getKeys(const QModelIndex &i) const;
+
+		QStringList getPath(const QModelIndex &i) const;
+		QModelIndex findIndex(const QStringList &p);
+
+		virtual QModelIndex index(int r, int c,
+			const QModelIndex &p = QModelIndex()) const;
+		virtual QModelIndex parent(const QModelIndex &i) const;
+		virtual int rowCount(
+			const QModelIndex &p = QModelIndex()) const;
+		virtual int columnCount(
+			const QModelIndex &p = QModelIndex()) const;
+		virtual bool hasChildren(
+			const QModelIndex &p = QModelIndex()) const;
+		virtual bool canFetchMore(const QModelIndex &p) const;
+		virtual void fetchMore(const QModelIndex &p);
+		virtual QVariant data(const QModelIndex &i,
+			int r = Qt::DisplayRole) const;
+		virtual QVariant headerData(int s, Qt::Orientation o,
+			int r = Qt::DisplayRole) const;
+
+	public Q_SLOTS:
+		void rebuild();
+		void scheduleRebuild();
+
+	private:
+		CSAbstractCollection *collection;
+		std::shared_ptr<const CSAbstractCollection::TrackSnapshot>
+			snapshot;
+		QList<Node *> artists;
+		QTimer *rebuildTimer;
+		bool active;
+		bool stale;
+
+		Node *nodeFromIndex(const QModelIndex &i) const;
+		void fetchTracks(Node *n);
+		void clearNodes();
+
+		static Node *createNode(Level l, Node *p,
+			const QString &n);
+		static void deleteNode(Node *n);
+		static void sortNodes(QList<Node *> *l);
+		static bool nodeLessThan(const Node *a, const Node *b);
+};
+
+#endif